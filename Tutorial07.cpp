@@ -41,14 +41,49 @@
 //--------------------------------------------------------------------------------------
 
 #include <windows.h>
-#include <d3d11.h>
+#include <d3d11_1.h>
+#include <dxgi1_3.h>
 #include <d3dcompiler.h>
 #include <directxmath.h>
 #include <directxcolors.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "resource.h"
+#include "rhi.h"
+#include "rhi_capture.h"
+#include "shader_cache.h"
+#include "shader_watch.h"
+#include "chrome_trace.h"
+#include "frame_timing.h"
+#include "task_graph.h"
+#include "benchmark.h"
+#include "frame_graph.h"
+#include "dynamic_resolution.h"
+#include "frame_pacer.h"
+#include "latency_scheduler.h"
+#include "dependency_tracker.h"
+#include "far_field.h"
+#include "depth_histogram.h"
+#include "stereo_comfort.h"
+#include "stereo_compose.h"
+#include "stereo_capture.h"
+#include "reprojection.h"
+#include "multiview.h"
+#include "Tutorial07_cb.h"
 
 #include "nvapi.h"
 #include "nvapi_lite_stereo.h"
+#ifdef NVAPI_STANDIN
+#include "nvapi_standin.h"
+#endif
 
 
 using namespace DirectX;
@@ -62,14 +97,9 @@ struct SimpleVertex
 	XMFLOAT2 Tex;
 };
 
-struct SharedCB
-{
-	XMMATRIX mWorld;
-	XMMATRIX mView;
-	XMMATRIX mProjection;
 
-	XMVECTOR mStereoParamsArray[3];
-};
+// SharedCB, ResolveCB and ReprojectCB are generated from the cbuffers in Tutorial07.fx, see
+// Tutorial07_cb.h and cbuffer_gen.cpp.
 
 
 //--------------------------------------------------------------------------------------
@@ -90,6 +120,7 @@ ID3D11RenderTargetView*             g_pOffscreenTextureView = nullptr;
 ID3D11Texture2D*                    g_pDepthStencil = nullptr;
 ID3D11DepthStencilView*             g_pDepthStencilView = nullptr;
 ID3D11ShaderResourceView*           g_pPackedDepthTextureSRV = nullptr;
+ID3D11ShaderResourceView*           g_pOffscreenColorSRV = nullptr;
 
 ID3D11RenderTargetView*             g_pOffscreenRTV_Color = nullptr;
 ID3D11RenderTargetView*             g_pOffscreenRTV_Depth = nullptr;
@@ -103,9 +134,43 @@ ID3D11Buffer*                       g_pIndexBuffer = nullptr;
 
 ID3D11VertexShader*                 g_pQuadVertexShader = nullptr;
 ID3D11PixelShader*                  g_pQuadPixelShader = nullptr;
-ID3D11PixelShader*                  g_pMSQuadPixelShader = nullptr;
+ID3D11PixelShader*                  g_pUpscalePixelShader = nullptr;
+
+ID3D11Texture2D*                    g_pFarLayerTexture = nullptr;
+ID3D11RenderTargetView*             g_pFarLayerRTV_Color = nullptr;
+ID3D11RenderTargetView*             g_pFarLayerRTV_Depth = nullptr;
+ID3D11ShaderResourceView*           g_pFarLayerSRV = nullptr;
+ID3D11Texture2D*                    g_pFarDepthStencil = nullptr;
+ID3D11DepthStencilView*             g_pFarDepthStencilView = nullptr;
+ID3D11PixelShader*                  g_pFarPixelShader = nullptr;
+ID3D11GeometryShader*               g_pFarCompositeGeometryShader = nullptr;
+ID3D11PixelShader*                  g_pFarCompositePixelShader = nullptr;
+
+ID3D11Texture2D*                    g_pDepthReadbackTexture = nullptr;
+ID3D11RenderTargetView*             g_pDepthReadbackRTV = nullptr;
+ID3D11PixelShader*                  g_pDepthCopyPixelShader = nullptr;
+
+ID3D11Texture2D*                    g_pEyePairTexture = nullptr;
+ID3D11ShaderResourceView*           g_pEyePairSRV = nullptr;
+ID3D11Texture2D*                    g_pComposeTexture = nullptr;
+ID3D11RenderTargetView*             g_pComposeRTV = nullptr;
+ID3D11PixelShader*                  g_pComposePixelShader = nullptr;
+ID3D11PixelShader*                  g_pInterleavePixelShader = nullptr;
+
+ID3D11PixelShader*                  g_pReprojectPixelShader = nullptr;
+ID3D11Texture2D*                    g_pReprojectCheckTexture = nullptr;
+ID3D11RenderTargetView*             g_pReprojectCheckRTV[3] = {};
 
 ID3D11Buffer*                       g_pSharedCB = nullptr;
+ID3D11Buffer*                       g_pResolveCB = nullptr;
+ID3D11Buffer*                       g_pReprojectCB = nullptr;
+
+// What the GPU copy of cbShared holds, so a frame only uploads the fields that
+// changed.  Partial updates need D3D 11.1 and driver support, otherwise any change
+// uploads the whole buffer.
+SharedCB							g_SharedCBUploaded;
+bool								g_SharedCBValid = false;
+bool								g_CbPartialUpdates = false;
 
 XMMATRIX                            g_World;
 XMMATRIX                            g_View;
@@ -115,794 +180,5243 @@ StereoHandle						g_StereoHandle;
 UINT								g_ScreenWidth = 1920;
 UINT								g_ScreenHeight = 1080;
 
-D3D11_VIEWPORT						g_Viewport;
+D3D11_VIEWPORT						g_Viewport;				// scene, inside each offscreen slice
+D3D11_VIEWPORT						g_BackBufferViewport;	// full size, for passes into the back buffer
 
-bool								g_isMSAA = false;
+UINT								g_SampleCount = 1;
+DXGI_SAMPLE_DESC					g_SampleDesc = { 1, 0 };
 
 //--------------------------------------------------------------------------------------
-// Forward declarations
+// How each eye slice gets from the offscreen array into the back buffer, see
+// frame_graph.h.
 //--------------------------------------------------------------------------------------
-HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
-HRESULT InitStereo();
-HRESULT InitDevice();
-HRESULT ActivateStereo();
-void CleanupDevice();
-LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
-void RenderFrame();
+EyeCopyPath							g_EyeCopyPath = EyeCopy_Resolve;
+UINT64								g_EyeCopyBytes = 0;		// bytes moved this frame
 
 
 //--------------------------------------------------------------------------------------
-// Entry point to the program. Initializes everything and goes into a message processing 
-// loop. Idle time is used to render the scene.
+// Dynamic resolution, see dynamic_resolution.h.
 //--------------------------------------------------------------------------------------
-int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
+DynamicResolution					g_DynamicResolution;
+bool								g_DynamicResolutionEnabled = true;
+double								g_LastFrameMs = 0.0;
+float								g_LastFrameWorkMs = 0.0f;	// the last frame's time, less waiting
+
+
+//--------------------------------------------------------------------------------------
+// Frame graph, see frame_graph.h.
+//--------------------------------------------------------------------------------------
+FrameGraph							g_FrameGraph;
+int									g_FgOffscreen = -1;
+int									g_FgDepthStencil = -1;
+int									g_FgBackBuffer = -1;
+int									g_FgDepthView = -1;
+int									g_FgScene = -1;
+int									g_FgFarField = -1;
+int									g_FgFarComposite = -1;
+int									g_FgDepthReadback = -1;
+int									g_FgCompose = -1;
+int									g_FgInterleave = -1;
+int									g_FgEyeCapture = -1;
+int									g_FgClear = -1;
+int									g_FgLeftEye = -1;
+int									g_FgRightEye = -1;
+int									g_FgReprojectLeft = -1;
+int									g_FgReprojectRight = -1;
+
+
+//--------------------------------------------------------------------------------------
+// Presentation
+//
+// A flip model swap chain is used when DXGI 1.3 is around, so that the frame latency
+// can be capped and waited on.  Otherwise it falls back to the old blt model.  The
+// pacer counts the refreshes missed, see frame_pacer.h.
+//--------------------------------------------------------------------------------------
+bool								g_UseFlipModel = true;
+UINT								g_SwapChainBufferCount = 2;
+UINT								g_MaxFrameLatency = 1;
+UINT								g_PresentSyncInterval = 1;
+bool								g_IsFlipModel = false;
+HANDLE								g_FrameLatencyWaitableObject = nullptr;
+FramePacer							g_FramePacer;
+UINT64								g_PresentCount = 0;
+double								g_FrameWaitMs = 0.0;	// time spent waiting on the latency object
+
+
+//--------------------------------------------------------------------------------------
+// Low latency frame start, see latency_scheduler.h.  L turns it on and off.
+//--------------------------------------------------------------------------------------
+bool								g_LowLatencyMode = false;
+LatencyScheduler					g_LatencyScheduler;
+LatencyMarkers						g_LatencyMarkers = {};
+FILE*								g_LatencyLog = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// Dependency tracking for device resources, see dependency_tracker.h.
+//--------------------------------------------------------------------------------------
+enum DeviceParam
 {
-	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
+	Param_Size		= 1 << 0,	// g_ScreenWidth, g_ScreenHeight
+	Param_Samples	= 1 << 1,	// MSAA sample description
+	Param_Slices	= 1 << 2,	// g_Permutation.SliceCount()
+	Param_Output	= 1 << 3,	// g_OutputFormat, Direct Mode, composed or interleaved, and eye recording
+};
 
-	if (FAILED(InitWindow(hInstance, nCmdShow)))
-		return 0;
+DependencyTracker					g_DeviceResources;
+bool								g_TearingDown = false;	// no more rebuilds, the device is going
 
-	if (FAILED(InitStereo()))
-		return 0;
 
-	if (FAILED(InitDevice()))
-	{
-		CleanupDevice();
-		return 0;
-	}
+//--------------------------------------------------------------------------------------
+// Render hardware interface, the backend side.  The command lists, and the null
+// backend, are in rhi.h.
+//
+// A table of backend objects, indexed by handle.  Freed slots are reused.
+//--------------------------------------------------------------------------------------
+template <class Tag, class T>
+struct RhiTable
+{
+	std::vector<T> items;
+	std::vector<uint32_t> freeSlots;
 
-	if (FAILED(ActivateStereo()))
-	{
-		CleanupDevice();
-		return 0;
-	}
+	RhiTable() : items(1, T()) {}
 
-	// Main message loop
-	MSG msg = { 0 };
-	while (WM_QUIT != msg.message)
+	RhiHandle<Tag> Add(T item)
 	{
-		if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		RhiHandle<Tag> handle;
+		if (!freeSlots.empty())
 		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
+			handle.index = freeSlots.back();
+			freeSlots.pop_back();
+			items[handle.index] = item;
 		}
 		else
 		{
-			RenderFrame();
+			handle.index = (uint32_t)items.size();
+			items.push_back(item);
 		}
+		return handle;
 	}
 
-	CleanupDevice();
+	// Point a handle at a new object, or make the handle if it is still null.
+	void Bind(RhiHandle<Tag>& handle, T item)
+	{
+		if (handle.index == 0)
+			handle = Add(item);
+		else
+			items[handle.index] = item;
+	}
 
-	return (int)msg.wParam;
-}
+	void Remove(RhiHandle<Tag>& handle)
+	{
+		if (handle.index == 0)
+			return;
+		items[handle.index] = T();
+		freeSlots.push_back(handle.index);
+		handle.index = 0;
+	}
+
+	T operator[](uint32_t index) const { return items[index]; }
+};
 
 
 //--------------------------------------------------------------------------------------
-// Register class and create window
+// GPU timers
+//
+// A timestamp query pair around each timed scope, inside a disjoint query per frame
+// for the tick rate, and a pipeline statistics query around the scene.  The results
+// are read back g_GpuTimerFrames frames later without flushing, so the CPU never
+// waits on them.  A frame whose queries are still in flight goes untimed instead.
 //--------------------------------------------------------------------------------------
-HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
+const UINT							g_GpuTimerFrames = 4;
+const UINT							g_GpuTimerScopes = 16;
+
+struct GpuTimerFrame
 {
-	// Register class
-	WNDCLASSEX wcex;
-	wcex.cbSize = sizeof(WNDCLASSEX);
-	wcex.style = CS_HREDRAW | CS_VREDRAW;
-	wcex.lpfnWndProc = WndProc;
-	wcex.cbClsExtra = 0;
-	wcex.cbWndExtra = 0;
-	wcex.hInstance = hInstance;
-	wcex.hIcon = LoadIcon(hInstance, (LPCTSTR)IDI_TUTORIAL1);
-	wcex.hCursor = LoadCursor(nullptr, IDC_ARROW);
-	wcex.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-	wcex.lpszMenuName = nullptr;
-	wcex.lpszClassName = L"TutorialWindowClass";
-	wcex.hIconSm = LoadIcon(wcex.hInstance, (LPCTSTR)IDI_TUTORIAL1);
-	if (!RegisterClassEx(&wcex))
-		return E_FAIL;
+	ID3D11Query* disjoint;
+	ID3D11Query* start;			// the frame's first timestamp
+	ID3D11Query* begin[g_GpuTimerScopes];
+	ID3D11Query* end[g_GpuTimerScopes];
+	ID3D11Query* statistics;
+	uint32_t usedScopes;		// bit per scope
+	bool usedStatistics;
+	bool pending;
+	uint64_t frame;
+	double cpuMs;				// when the frame was begun, to put it on the CPU clock
+};
 
-	// Create window
-	g_hInst = hInstance;
-	RECT rc = { 0, 0, g_ScreenWidth, g_ScreenHeight };
-	AdjustWindowRect(&rc, WS_OVERLAPPEDWINDOW, FALSE);
-	g_hWnd = CreateWindow(L"TutorialWindowClass", L"Direct3D 11 Tutorial 7",
-		WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX,
-		CW_USEDEFAULT, CW_USEDEFAULT, rc.right - rc.left, rc.bottom - rc.top, nullptr, nullptr, hInstance,
-		nullptr);
-	if (!g_hWnd)
-		return E_FAIL;
+struct GpuTimers
+{
+	GpuTimerFrame frames[g_GpuTimerFrames] = {};
+	GpuTimerFrame* current = nullptr;
+	FrameTiming* timing = nullptr;
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics = {};	// of the last frame read back
+	uint64_t untimedFrames = 0;
 
-	ShowWindow(g_hWnd, nCmdShow);
+	HRESULT Create(ID3D11Device* device, FrameTiming* frameTiming)
+	{
+		D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+		D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+		D3D11_QUERY_DESC statisticsDesc = { D3D11_QUERY_PIPELINE_STATISTICS, 0 };
 
-	return S_OK;
-}
+		timing = frameTiming;
+		for (GpuTimerFrame& f : frames)
+		{
+			HRESULT hr = device->CreateQuery(&disjointDesc, &f.disjoint);
+			if (SUCCEEDED(hr))
+				hr = device->CreateQuery(&timestampDesc, &f.start);
+			if (SUCCEEDED(hr))
+				hr = device->CreateQuery(&statisticsDesc, &f.statistics);
+			for (UINT i = 0; i < g_GpuTimerScopes && SUCCEEDED(hr); i++)
+			{
+				hr = device->CreateQuery(&timestampDesc, &f.begin[i]);
+				if (SUCCEEDED(hr))
+					hr = device->CreateQuery(&timestampDesc, &f.end[i]);
+			}
+			if (FAILED(hr))
+				return hr;
+		}
+		return S_OK;
+	}
 
+	void Release()
+	{
+		for (GpuTimerFrame& f : frames)
+		{
+			if (f.disjoint) f.disjoint->Release();
+			if (f.start) f.start->Release();
+			if (f.statistics) f.statistics->Release();
+			for (UINT i = 0; i < g_GpuTimerScopes; i++)
+			{
+				if (f.begin[i]) f.begin[i]->Release();
+				if (f.end[i]) f.end[i]->Release();
+			}
+			f = GpuTimerFrame();
+		}
+		current = nullptr;
+		timing = nullptr;
+	}
 
-//--------------------------------------------------------------------------------------
-// Setup nvapi, and enable stereo by direct mode for the app.
-// This must be called before the Device is created for Direct Mode to work.
-//--------------------------------------------------------------------------------------
-HRESULT InitStereo()
-{
-	NvAPI_Status status;
+	void BeginFrame(ID3D11DeviceContext* context, uint64_t frame, double cpuMs)
+	{
+		if (!timing)
+			return;
+		Resolve(context);
 
-	status = NvAPI_Initialize();
-	if (FAILED(status))
-		return status;
+		GpuTimerFrame& f = frames[frame % g_GpuTimerFrames];
+		if (f.pending)
+		{
+			untimedFrames++;
+			return;
+		}
+		f.usedScopes = 0;
+		f.usedStatistics = false;
+		f.frame = frame;
+		f.cpuMs = cpuMs;
+		context->Begin(f.disjoint);
+		context->End(f.start);
+		current = &f;
+	}
 
-	// The entire point is to show stereo.  
-	// If it's not enabled in the control panel, let the user know.
-	NvU8 stereoEnabled;
-	status = NvAPI_Stereo_IsEnabled(&stereoEnabled);
-	if (FAILED(status) || !stereoEnabled)
+	void EndFrame(ID3D11DeviceContext* context)
 	{
-		MessageBox(g_hWnd, L"3D Vision is not enabled. Enable it in the NVidia Control Panel.", L"Error", MB_OK);
-		return status;
+		if (!current)
+			return;
+		context->End(current->disjoint);
+		current->pending = true;
+		current = nullptr;
 	}
 
-	status = NvAPI_Stereo_SetDriverMode(NVAPI_STEREO_DRIVER_MODE_DIRECT);
-	if (FAILED(status))
-		return status;
-
-	return status;
-}
+	void Begin(ID3D11DeviceContext* context, uint32_t scope)
+	{
+		if (!current || scope >= g_GpuTimerScopes)
+			return;
+		context->End(current->begin[scope]);
+		current->usedScopes |= 1u << scope;
+	}
 
+	void End(ID3D11DeviceContext* context, uint32_t scope)
+	{
+		if (current && (current->usedScopes & (1u << scope)))
+			context->End(current->end[scope]);
+	}
 
-//--------------------------------------------------------------------------------------
-// Activate stereo for the given device.
-// This must be called after the device is created.
-//--------------------------------------------------------------------------------------
-HRESULT ActivateStereo()
-{
-	NvAPI_Status status;
+	void BeginStatistics(ID3D11DeviceContext* context)
+	{
+		if (!current)
+			return;
+		context->Begin(current->statistics);
+		current->usedStatistics = true;
+	}
 
-	status = NvAPI_Stereo_CreateHandleFromIUnknown(g_pd3dDevice, &g_StereoHandle);
-	if (FAILED(status))
-		return status;
+	void EndStatistics(ID3D11DeviceContext* context)
+	{
+		if (current && current->usedStatistics)
+			context->End(current->statistics);
+	}
 
-	return status;
-}
+	// Hand every frame the GPU has finished to the frame timing.
+	void Resolve(ID3D11DeviceContext* context)
+	{
+		const UINT flags = D3D11_ASYNC_GETDATA_DONOTFLUSH;
+		for (GpuTimerFrame& f : frames)
+		{
+			if (!f.pending)
+				continue;
+
+			D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+			if (context->GetData(f.disjoint, &disjoint, sizeof(disjoint), flags) != S_OK)
+				continue;
+			f.pending = false;
+
+			UINT64 start;
+			if (disjoint.Disjoint || context->GetData(f.start, &start, sizeof(start), flags) != S_OK)
+				continue;
+
+			double msPerTick = 1000.0 / disjoint.Frequency;
+			for (UINT scope = 0; scope < g_GpuTimerScopes; scope++)
+			{
+				UINT64 begin, end;
+				if (!(f.usedScopes & (1u << scope)) ||
+					context->GetData(f.begin[scope], &begin, sizeof(begin), flags) != S_OK ||
+					context->GetData(f.end[scope], &end, sizeof(end), flags) != S_OK)
+					continue;
+				timing->Record(scope, Timing_Gpu, f.frame, f.cpuMs + (begin - start) * msPerTick, f.cpuMs + (end - start) * msPerTick);
+			}
+
+			if (f.usedStatistics)
+				context->GetData(f.statistics, &statistics, sizeof(statistics), flags);
+		}
+	}
+};
 
 
 //--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DCompile
-//
-// With VS 11, we could load up prebuilt .cso files instead...
+// D3D11 backend
 //--------------------------------------------------------------------------------------
-HRESULT CompileShaderFromFile(WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
+struct RhiD3D11
 {
-	HRESULT hr = S_OK;
-
-	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-	// Setting this flag improves the shader debugging experience, but still allows 
-	// the shaders to be optimized and to run exactly the way they will run in 
-	// the release configuration of this program.
-	dwShaderFlags |= D3DCOMPILE_DEBUG;
+	ID3D11DeviceContext* context = nullptr;
+	ID3D11DeviceContext1* context1 = nullptr;	// for partial constant buffer updates
+	bool partialUpdates = false;				// context1 is there and the driver takes them
+	std::vector<std::vector<uint8_t>> shadows;	// buffer contents, to apply ranges to without them
+	StereoHandle stereo = nullptr;
+	GpuTimers timers;
+
+	RhiTable<RhiTextureTag, ID3D11Resource*>					textures;
+	RhiTable<RhiRenderTargetTag, ID3D11RenderTargetView*>		renderTargets;
+	RhiTable<RhiDepthTargetTag, ID3D11DepthStencilView*>		depthTargets;
+	RhiTable<RhiShaderViewTag, ID3D11ShaderResourceView*>		shaderViews;
+	RhiTable<RhiBufferTag, ID3D11Buffer*>						buffers;
+	RhiTable<RhiInputLayoutTag, ID3D11InputLayout*>				inputLayouts;
+	RhiTable<RhiVertexShaderTag, ID3D11VertexShader*>			vertexShaders;
+	RhiTable<RhiGeometryShaderTag, ID3D11GeometryShader*>		geometryShaders;
+	RhiTable<RhiPixelShaderTag, ID3D11PixelShader*>				pixelShaders;
+
+	static DXGI_FORMAT Format(uint32_t format)
+	{
+		switch (format)
+		{
+		case RhiFormat_R8G8B8A8_UNORM:	return DXGI_FORMAT_R8G8B8A8_UNORM;
+		case RhiFormat_R16_UINT:		return DXGI_FORMAT_R16_UINT;
+		default:						return DXGI_FORMAT_UNKNOWN;
+		}
+	}
 
-	// Disable optimizations to further improve shader debugging
-	dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
+	// Writes data at offset into the copy of the buffer's contents, which is the size
+	// of the buffer.  Null if there is no buffer or the data does not fit.
+	const uint8_t* Shadow(uint32_t buffer, uint32_t offset, const void* data, uint32_t size)
+	{
+		ID3D11Buffer* pBuffer = buffers[buffer];
+		if (!pBuffer)
+			return nullptr;
+		D3D11_BUFFER_DESC desc;
+		pBuffer->GetDesc(&desc);
+		if (offset > desc.ByteWidth || size > desc.ByteWidth - offset)
+			return nullptr;
+
+		if (shadows.size() <= buffer)
+			shadows.resize(buffer + 1);
+		std::vector<uint8_t>& shadow = shadows[buffer];
+		shadow.resize(desc.ByteWidth);
+		memcpy(shadow.data() + offset, data, size);
+		return shadow.data();
+	}
 
-	ID3DBlob* pErrorBlob = nullptr;
-	hr = D3DCompileFromFile(szFileName, nullptr, nullptr, szEntryPoint, szShaderModel,
-		dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
-	if (FAILED(hr))
+	void Execute(const RhiCommandList& list)
 	{
-		if (pErrorBlob)
+		for (const RhiCommand& cmd : list.commands)
 		{
-			OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
-			pErrorBlob->Release();
+			switch (cmd.op)
+			{
+			case RhiOp_SetRenderTargets:
+			{
+				ID3D11RenderTargetView* rtvs[2] = { renderTargets[cmd.a], renderTargets[cmd.c] };
+				context->OMSetRenderTargets(rtvs[1] ? 2 : (rtvs[0] ? 1 : 0), rtvs[0] ? rtvs : nullptr, depthTargets[cmd.b]);
+				break;
+			}
+			case RhiOp_ClearRenderTarget:
+				context->ClearRenderTargetView(renderTargets[cmd.a], (const FLOAT*)list.Data(cmd));
+				break;
+			case RhiOp_ClearDepth:
+				context->ClearDepthStencilView(depthTargets[cmd.a], D3D11_CLEAR_DEPTH, *(const float*)list.Data(cmd), 0);
+				break;
+			case RhiOp_SetViewport:
+			{
+				const RhiViewport* vps = (const RhiViewport*)list.Data(cmd);
+				D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+				UINT count = min(cmd.dataSize / (UINT)sizeof(RhiViewport), (UINT)ARRAYSIZE(viewports));
+				for (UINT i = 0; i < count; i++)
+				{
+					const RhiViewport& vp = vps[i];
+					D3D11_VIEWPORT viewport = { vp.x, vp.y, vp.width, vp.height, vp.minDepth, vp.maxDepth };
+					viewports[i] = viewport;
+				}
+				context->RSSetViewports(count, viewports);
+				break;
+			}
+			case RhiOp_SetInputLayout:
+				context->IASetInputLayout(inputLayouts[cmd.a]);
+				break;
+			case RhiOp_SetVertexBuffer:
+			{
+				ID3D11Buffer* buffer = buffers[cmd.a];
+				UINT stride = cmd.b;
+				UINT offset = 0;
+				context->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+				break;
+			}
+			case RhiOp_SetIndexBuffer:
+				context->IASetIndexBuffer(buffers[cmd.a], Format(cmd.b), 0);
+				break;
+			case RhiOp_SetTopology:
+				context->IASetPrimitiveTopology((cmd.a == RhiTopology_TriangleStrip) ?
+					D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP : D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+				break;
+			case RhiOp_UpdateBuffer:
+				context->UpdateSubresource(buffers[cmd.a], 0, nullptr, list.Data(cmd), 0, 0);
+				if (!partialUpdates)
+					Shadow(cmd.a, 0, list.Data(cmd), cmd.dataSize);
+				break;
+			case RhiOp_UpdateBufferRange:
+			{
+				if (partialUpdates)
+				{
+					D3D11_BOX box = { cmd.b, 0, 0, cmd.b + cmd.dataSize, 1, 1 };
+					context1->UpdateSubresource1(buffers[cmd.a], 0, &box, list.Data(cmd), 0, 0, 0);
+				}
+				else if (const uint8_t* contents = Shadow(cmd.a, cmd.b, list.Data(cmd), cmd.dataSize))
+				{
+					// A capture made where partial updates work, replayed where they
+					// do not: the whole buffer, with the range applied.
+					context->UpdateSubresource(buffers[cmd.a], 0, nullptr, contents, 0, 0);
+				}
+				break;
+			}
+			case RhiOp_SetVertexShader:
+				context->VSSetShader(vertexShaders[cmd.a], nullptr, 0);
+				break;
+			case RhiOp_SetGeometryShader:
+				context->GSSetShader(geometryShaders[cmd.a], nullptr, 0);
+				break;
+			case RhiOp_SetPixelShader:
+				context->PSSetShader(pixelShaders[cmd.a], nullptr, 0);
+				break;
+			case RhiOp_SetConstantBuffer:
+			{
+				ID3D11Buffer* buffer = buffers[cmd.c];
+				if (cmd.a & RhiStage_Vertex) context->VSSetConstantBuffers(cmd.b, 1, &buffer);
+				if (cmd.a & RhiStage_Geometry) context->GSSetConstantBuffers(cmd.b, 1, &buffer);
+				if (cmd.a & RhiStage_Pixel) context->PSSetConstantBuffers(cmd.b, 1, &buffer);
+				break;
+			}
+			case RhiOp_SetShaderView:
+			{
+				ID3D11ShaderResourceView* view = shaderViews[cmd.b];
+				context->PSSetShaderResources(cmd.a, 1, &view);
+				break;
+			}
+			case RhiOp_Draw:
+				context->Draw(cmd.a, cmd.b);
+				break;
+			case RhiOp_DrawIndexed:
+				context->DrawIndexed(cmd.a, cmd.b, (INT)cmd.c);
+				break;
+			case RhiOp_CopySubresource:
+				context->CopySubresourceRegion(textures[cmd.a], cmd.b, 0, 0, 0, textures[cmd.c], cmd.d, nullptr);
+				break;
+			case RhiOp_Resolve:
+				context->ResolveSubresource(textures[cmd.a], cmd.b, textures[cmd.c], cmd.d, Format(cmd.e));
+				break;
+			case RhiOp_SetActiveEye:
+				if (stereo)
+					NvAPI_Stereo_SetActiveEye(stereo, (NV_STEREO_ACTIVE_EYE)cmd.a);
+				break;
+			case RhiOp_BeginTimer:
+				timers.Begin(context, cmd.a);
+				break;
+			case RhiOp_EndTimer:
+				timers.End(context, cmd.a);
+				break;
+			case RhiOp_BeginStatistics:
+				timers.BeginStatistics(context);
+				break;
+			case RhiOp_EndStatistics:
+				timers.EndStatistics(context);
+				break;
+			default:
+				break;
+			}
 		}
-		return hr;
 	}
-	if (pErrorBlob) pErrorBlob->Release();
+};
 
-	return S_OK;
-}
+RhiD3D11							g_Rhi;
+RhiCommandList						g_CommandList;
+
+// Handles for everything a frame uses
+RhiTexture							g_hBackBuffer = {};
+RhiTexture							g_hOffscreenTexture = {};
+RhiRenderTarget						g_hRenderTargetView = {};
+RhiRenderTarget						g_hOffscreenTextureView = {};
+RhiRenderTarget						g_hOffscreenRTV_Color = {};
+RhiRenderTarget						g_hOffscreenRTV_Depth = {};
+RhiDepthTarget						g_hDepthStencilView = {};
+RhiShaderView						g_hPackedDepthTextureSRV = {};
+RhiShaderView						g_hOffscreenColorSRV = {};
+RhiBuffer							g_hVertexBuffer = {};
+RhiBuffer							g_hIndexBuffer = {};
+RhiBuffer							g_hSharedCB = {};
+RhiBuffer							g_hResolveCB = {};
+RhiInputLayout						g_hVertexLayout = {};
+RhiVertexShader						g_hVertexShader = {};
+RhiVertexShader						g_hQuadVertexShader = {};
+RhiGeometryShader					g_hGeometryShader = {};
+RhiPixelShader						g_hPixelShader = {};
+RhiPixelShader						g_hQuadPixelShader = {};
+RhiPixelShader						g_hUpscalePixelShader = {};
+RhiRenderTarget						g_hFarLayerRTV_Color = {};
+RhiRenderTarget						g_hFarLayerRTV_Depth = {};
+RhiShaderView						g_hFarLayerSRV = {};
+RhiDepthTarget						g_hFarDepthStencilView = {};
+RhiPixelShader						g_hFarPixelShader = {};
+RhiGeometryShader					g_hFarCompositeGeometryShader = {};
+RhiPixelShader						g_hFarCompositePixelShader = {};
+RhiTexture							g_hDepthReadbackTexture = {};
+RhiRenderTarget						g_hDepthReadbackRTV = {};
+RhiPixelShader						g_hDepthCopyPixelShader = {};
+RhiTexture							g_hEyePairTexture = {};
+RhiShaderView						g_hEyePairSRV = {};
+RhiRenderTarget						g_hComposeRTV = {};
+RhiPixelShader						g_hComposePixelShader = {};
+RhiPixelShader						g_hInterleavePixelShader = {};
+RhiBuffer							g_hReprojectCB = {};
+RhiPixelShader						g_hReprojectPixelShader = {};
+RhiRenderTarget						g_hReprojectCheckRTV[3] = {};
 
 
 //--------------------------------------------------------------------------------------
-// Create Direct3D device and swap chain
+// Shader permutations
+//
+// The shaders are specialized on the options below, passed in as macros, so neither
+// the shaders nor the frame branch on them.  The C++ side is picked once at setup,
+// from templates on the same options.  Each shader job lists the options its
+// source reads, and only those go into its macros and its cache key, so VS is the
+// same bytecode at every MSAA level, for one.
 //--------------------------------------------------------------------------------------
-HRESULT InitDevice()
+enum DepthPacking
 {
-	HRESULT hr = S_OK;
-
-	UINT createDeviceFlags = 0;
-#ifdef _DEBUG
-	createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
-#endif
+	DepthPack_Float,	// the bits of the float, one byte per channel
+	DepthPack_Unorm24,	// depth / far plane in 24 bits
+};
 
-	DXGI_SWAP_CHAIN_DESC sd;
-	ZeroMemory(&sd, sizeof(sd));
-	sd.BufferCount = 1;
-	sd.BufferDesc.Width = g_ScreenWidth;
-	sd.BufferDesc.Height = g_ScreenHeight;
-	sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	sd.BufferDesc.RefreshRate.Numerator = 120;	// Needs to be 120Hz for 3D Vision 
-	sd.BufferDesc.RefreshRate.Denominator = 1;
-	sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	sd.OutputWindow = g_hWnd;
-	sd.SampleDesc.Count = 1;
-	sd.SampleDesc.Quality = 0;
-	sd.Windowed = TRUE;
+enum PermutationOption
+{
+	Perm_MSAA = 1 << 0,		// MSAA_SAMPLES
+	Perm_Views = 1 << 1,	// VIEW_COUNT
+	Perm_Mono = 1 << 2,		// MONO_SLICE
+	Perm_Depth = 1 << 3,	// DEPTH_PACKING
+	Perm_OptionCount = 4
+};
 
-	// Create the simple DX11, Device, SwapChain, and Context.
-	hr = D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, createDeviceFlags, nullptr, 0,
-		D3D11_SDK_VERSION, &sd, &g_pSwapChain, &g_pd3dDevice, nullptr, &g_pImmediateContext);
-	if (FAILED(hr))
-		return hr;
+struct ShaderPermutation
+{
+	UINT msaaSamples;
+	UINT viewCount;			// view slices, 2 for the eyes, more for a lenticular panel
+	bool monoSlice;			// the packed depth slice after the eyes
+	DepthPacking depthPacking;
 
-	// For DX11 3D, it's required that we run in exclusive full-screen mode, otherwise 3D
-	// Vision will not activate.
-	hr = g_pSwapChain->SetFullscreenState(TRUE, nullptr);
-	if (FAILED(hr))
-		return hr;
+	UINT SliceCount() const { return viewCount + (monoSlice ? 1 : 0); }
+};
 
-	// Create a render target view from the backbuffer
-	//
-	// Since this is derived from the backbuffer, it will also be 2x in width.
-	hr = g_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&g_pBackBuffer));
-	if (FAILED(hr))
-		return hr;
+ShaderPermutation					g_Permutation = { 1, 2, true, DepthPack_Float };
+FLOAT								g_DepthFar = 100.0f;		// DEPTH_FAR in the shaders
+FLOAT								g_PackedDepthClear[4];		// far, packed for the mono slice
 
-	hr = g_pd3dDevice->CreateRenderTargetView(g_pBackBuffer, nullptr, &g_pRenderTargetView);
+// How many values of each option the app can ask for, in PermutationOption order.
+// MSAA is 1, 2, 4 or 8, and the view count one of g_ViewCounts.
+constexpr UINT						g_PermutationValues[Perm_OptionCount] = { 4, 3, 2, 2 };
+const UINT							g_ViewCounts[3] = { 2, 8, 9 };
 
-	DXGI_SAMPLE_DESC sampleDesc = { 1, 0 };
-	UINT numQualityLevels;
-	//*
-	if (SUCCEEDED(g_pd3dDevice->CheckMultisampleQualityLevels(DXGI_FORMAT_B8G8R8A8_UNORM, 4, &numQualityLevels)))
-	{
-		sampleDesc.Count = 4;
-		sampleDesc.Quality = numQualityLevels - 1;
-		g_isMSAA = true;
-	}//*/
+constexpr UINT PermutationVariants(UINT options, UINT option = 0)
+{
+	return option == Perm_OptionCount ? 1 :
+		((options & (1 << option)) ? g_PermutationValues[option] : 1) * PermutationVariants(options, option + 1);
+}
 
-	// Create Offscreen texture
-	D3D11_TEXTURE2D_DESC descOffscreen;
-	ZeroMemory(&descOffscreen, sizeof(descOffscreen));
-	descOffscreen.Width = g_ScreenWidth;
-	descOffscreen.Height = g_ScreenHeight;
-	descOffscreen.MipLevels = 1;
-	descOffscreen.ArraySize = 3; // 2 slices for stereo + 1 for mono
-	descOffscreen.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
-	descOffscreen.SampleDesc = sampleDesc;
-	descOffscreen.Usage = D3D11_USAGE_DEFAULT;
-	descOffscreen.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	descOffscreen.CPUAccessFlags = 0;
-	descOffscreen.MiscFlags = 0;
-	hr = g_pd3dDevice->CreateTexture2D(&descOffscreen, nullptr, &g_pOffscreenTexture);
-	if (FAILED(hr))
-		return hr;
+// Every variant of every shader is a compile on a cold cache, keep the count down.
+constexpr UINT						g_ShaderVariantBudget = 64;
+const double						g_ShaderCompileBudgetMs = 5000.0;	// all variants, one thread
 
-	D3D11_RENDER_TARGET_VIEW_DESC descOffscreenRTV;
-	ZeroMemory(&descOffscreenRTV, sizeof(descOffscreenRTV));
-	descOffscreenRTV.Format = DXGI_FORMAT_R8G8B8A8_UINT;
-	if (sampleDesc.Count > 1)
-	{
-		descOffscreenRTV.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY;
-		descOffscreenRTV.Texture2DMSArray.FirstArraySlice = 0;
-		descOffscreenRTV.Texture2DMSArray.ArraySize = descOffscreen.ArraySize;
-	}
-	else
-	{
-		descOffscreenRTV.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-		descOffscreenRTV.Texture2DArray.MipSlice = 0;
-		descOffscreenRTV.Texture2DArray.FirstArraySlice = 0;
-		descOffscreenRTV.Texture2DArray.ArraySize = descOffscreen.ArraySize;
-	}
+// Room for a job's macros, and the D3D form of them with its null terminator.
+struct PermutationDefines
+{
+	char values[Perm_OptionCount][8];
+	ShaderDefine defines[Perm_OptionCount];
+	D3D_SHADER_MACRO macros[Perm_OptionCount + 1];
+	UINT count;
+};
 
-	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descOffscreenRTV, &g_pOffscreenTextureView);
-	if (FAILED(hr))
-		return hr;
+void BuildPermutationDefines(const ShaderPermutation& permutation, UINT options, PermutationDefines& out)
+{
+	static const char* names[Perm_OptionCount] = { "MSAA_SAMPLES", "VIEW_COUNT", "MONO_SLICE", "DEPTH_PACKING" };
+	UINT values[Perm_OptionCount] = { permutation.msaaSamples, permutation.viewCount,
+		permutation.monoSlice ? 1u : 0u, (UINT)permutation.depthPacking };
 
-	D3D11_RENDER_TARGET_VIEW_DESC descOffscreenRTV_Color;
-	ZeroMemory(&descOffscreenRTV_Color, sizeof(descOffscreenRTV_Color));
-	descOffscreenRTV_Color.Format = DXGI_FORMAT_R8G8B8A8_UINT;
-	if (sampleDesc.Count > 1)
-	{
-		descOffscreenRTV_Color.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY;
-		descOffscreenRTV_Color.Texture2DMSArray.FirstArraySlice = 0;
-		descOffscreenRTV_Color.Texture2DMSArray.ArraySize = 2;
-	}
-	else
+	out.count = 0;
+	for (UINT option = 0; option < Perm_OptionCount; option++)
 	{
-		descOffscreenRTV_Color.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-		descOffscreenRTV_Color.Texture2DArray.FirstArraySlice = 0;
-		descOffscreenRTV_Color.Texture2DArray.ArraySize = 2;
+		if (!(options & (1 << option)))
+			continue;
+		sprintf_s(out.values[out.count], "%u", values[option]);
+		out.defines[out.count].name = names[option];
+		out.defines[out.count].value = out.values[out.count];
+		out.macros[out.count].Name = names[option];
+		out.macros[out.count].Definition = out.values[out.count];
+		out.count++;
 	}
+	out.macros[out.count].Name = nullptr;
+	out.macros[out.count].Definition = nullptr;
+}
 
-	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descOffscreenRTV_Color, &g_pOffscreenRTV_Color);
-	if (FAILED(hr))
-		return hr;
 
-	D3D11_RENDER_TARGET_VIEW_DESC descOffscreenRTV_Depth;
-	ZeroMemory(&descOffscreenRTV_Depth, sizeof(descOffscreenRTV_Depth));
-	descOffscreenRTV_Depth.Format = DXGI_FORMAT_R8G8B8A8_UINT;
-	if (sampleDesc.Count > 1)
-	{
-		descOffscreenRTV_Depth.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY;
-		descOffscreenRTV_Depth.Texture2DMSArray.FirstArraySlice = 2;
-		descOffscreenRTV_Depth.Texture2DMSArray.ArraySize = 1;
-	}
-	else
-	{
-		descOffscreenRTV_Depth.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-		descOffscreenRTV_Depth.Texture2DArray.FirstArraySlice = 2;
-		descOffscreenRTV_Depth.Texture2DArray.ArraySize = 1;
-	}
+//--------------------------------------------------------------------------------------
+// Shaders
+//
+// Every shader in Tutorial07.fx is a job.  CompileShaders fills in the bytecode,
+// from the cache when the key matches, and the D3D11 objects are made from that.
+//--------------------------------------------------------------------------------------
+struct ShaderJob
+{
+	const char* entry;
+	const char* profile;
+	UINT options;				// the PermutationOptions the source reads
 
-	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descOffscreenRTV_Depth, &g_pOffscreenRTV_Depth);
-	if (FAILED(hr))
-		return hr;
+	std::vector<uint8_t> bytecode;
+	HRESULT hr;
+	double ms;					// cache lookup plus compile, if it missed
+	bool cached;
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC descOffscreenSRV;
-	descOffscreenSRV.Format = DXGI_FORMAT_R8G8B8A8_UINT;
-	if (sampleDesc.Count > 1)
+	uint64_t sourceHash;		// of the source this entry point depends on, for hot reload
+	uint64_t bytecodeHash;
+};
+
+enum ShaderId
+{
+	Shader_VS,
+	Shader_GS,
+	Shader_PS,
+	Shader_QuadVS,
+	Shader_QuadPS,
+	Shader_UpscalePS,
+	Shader_FarPS,
+	Shader_FarCompositeGS,
+	Shader_FarCompositePS,
+	Shader_DepthCopyPS,
+	Shader_ComposePS,
+	Shader_ReprojectPS,
+	Shader_InterleavePS,
+	Shader_Count
+};
+
+// What each shader reads, checked against the budget when the app is built.
+constexpr UINT						g_ShaderOptions[Shader_Count] =
+{
+	0,										// VS
+	Perm_Views | Perm_Mono,					// GS
+	Perm_Views | Perm_Mono | Perm_Depth,	// PS
+	0,										// QuadVS
+	Perm_MSAA | Perm_Depth,					// QuadPS
+	Perm_MSAA,								// UpscalePS
+	Perm_Mono | Perm_Depth,					// FarPS
+	Perm_Views | Perm_Mono,					// FarCompositeGS
+	Perm_Views | Perm_Mono,					// FarCompositePS
+	Perm_MSAA,								// DepthCopyPS
+	0,										// ComposePS
+	Perm_MSAA | Perm_Depth,					// ReprojectPS
+	Perm_Views,								// InterleavePS
+};
+
+constexpr UINT ShaderVariants(UINT id = 0)
+{
+	return id == Shader_Count ? 0 : PermutationVariants(g_ShaderOptions[id]) + ShaderVariants(id + 1);
+}
+
+static_assert(ShaderVariants() <= g_ShaderVariantBudget, "Too many shader variants, see g_ShaderVariantBudget");
+
+ShaderJob							g_ShaderJobs[Shader_Count] =
+{
+	{ "VS", "vs_5_0", g_ShaderOptions[Shader_VS] },
+	{ "GS", "gs_5_0", g_ShaderOptions[Shader_GS] },
+	{ "PS", "ps_5_0", g_ShaderOptions[Shader_PS] },
+	{ "QuadVS", "vs_5_0", g_ShaderOptions[Shader_QuadVS] },
+	{ "QuadPS", "ps_5_0", g_ShaderOptions[Shader_QuadPS] },
+	{ "UpscalePS", "ps_5_0", g_ShaderOptions[Shader_UpscalePS] },
+	{ "FarPS", "ps_5_0", g_ShaderOptions[Shader_FarPS] },
+	{ "FarCompositeGS", "gs_5_0", g_ShaderOptions[Shader_FarCompositeGS] },
+	{ "FarCompositePS", "ps_5_0", g_ShaderOptions[Shader_FarCompositePS] },
+	{ "DepthCopyPS", "ps_5_0", g_ShaderOptions[Shader_DepthCopyPS] },
+	{ "ComposePS", "ps_5_0", g_ShaderOptions[Shader_ComposePS] },
+	{ "ReprojectPS", "ps_5_0", g_ShaderOptions[Shader_ReprojectPS] },
+	{ "InterleavePS", "ps_5_0", g_ShaderOptions[Shader_InterleavePS] },
+};
+
+const char*							g_ShaderCacheDir = "ShaderCache";
+const WCHAR*						g_ShaderFile = L"Tutorial07.fx";
+const char*							g_ShaderSourceName = "Tutorial07.fx";
+
+
+//--------------------------------------------------------------------------------------
+// Shader hot reload
+//
+// The watcher thread notices Tutorial07.fx being saved, works out which entry points
+// the edit reaches, and compiles and creates only those, all off the render thread.
+// The new objects wait in g_ShaderSwap until RenderFrame takes them, between frames,
+// so every shader from one save goes live in the same frame, and all the render
+// thread does is swap pointers.
+//--------------------------------------------------------------------------------------
+struct ShaderSwap
+{
+	ID3D11DeviceChild* shaders[Shader_Count];	// null where nothing changed
+	ID3D11InputLayout* inputLayout;				// made again when VS changes
+	double changeMs;			// when the save was seen, on WatchClockMs
+	double compileMs;
+	UINT count;
+	bool deferred;				// from startup rather than a save
+};
+
+#ifdef PROFILE
+bool								g_ShaderHotReload = true;
+#else
+bool								g_ShaderHotReload = false;
+#endif
+FileWatcher							g_ShaderWatcher;
+std::mutex							g_ShaderSwapLock;
+ShaderSwap							g_ShaderSwap = {};
+std::atomic<bool>					g_ShaderSwapReady(false);
+
+
+//--------------------------------------------------------------------------------------
+// Startup
+//
+// Startup runs as a TaskGraph, so shader compiles and NvAPI overlap device creation,
+// and the quad shaders, which the first frame does not need, come later on
+// g_DeferredThread.  Every task goes in g_StartupTrace.
+//--------------------------------------------------------------------------------------
+ChromeTrace							g_StartupTrace;
+std::thread							g_DeferredThread;
+const char*							g_StartupTraceFile = "startup_trace.json";
+const UINT							g_StartupWorkers = 3;		// the graph is no wider
+
+
+//--------------------------------------------------------------------------------------
+// Frame timing
+//
+// CPU timers around the parts of RenderFrame, and CPU and GPU timers around every
+// pass of the frame graph.  The CPU time of a pass is encoding it, the GPU time is
+// running it.  Submit is the CPU side of running the whole command list.  The
+// percentiles are printed with the other Profile stats, and the first
+// g_FrameTraceFrames frames go to frame_trace.json.
+//--------------------------------------------------------------------------------------
+#ifdef PROFILE
+bool								g_FrameTimingEnabled = true;
+#else
+bool								g_FrameTimingEnabled = false;
+#endif
+FrameTiming							g_FrameTiming;
+ChromeTrace							g_FrameTrace;
+const char*							g_FrameTraceFile = "frame_trace.json";
+const UINT							g_FrameTraceFrames = 600;
+int									g_TimerFrame = -1;
+int									g_TimerWait = -1;
+int									g_TimerCompile = -1;
+int									g_TimerSubmit = -1;
+int									g_TimerPresent = -1;
+std::vector<int>					g_PassTimers;		// by pass index
+double								g_PassStartMs = 0.0;
+
+
+//--------------------------------------------------------------------------------------
+// Capture and replay
+//
+// C records the command lists of the next g_CaptureFrames frames to g_CaptureFile.
+// R loads the capture, reports its size and how fast it replays on RhiNull, and
+// then runs it on the device in place of the frame graph, over and over, until R
+// again.  The lists carry the constant buffers, stereo parameters and eyes as they
+// were, so a slow stretch of frames runs again exactly as captured.  rhi_replay.cpp
+// reads the same files offline.
+//--------------------------------------------------------------------------------------
+RhiCaptureWriter					g_Capture;
+RhiCaptureReader					g_Replay;
+const char*							g_CaptureFile = "frame_capture.rhic";
+const UINT							g_CaptureFrames = 300;
+UINT								g_CaptureFramesLeft = 0;
+bool								g_Replaying = false;
+UINT								g_ReplayFrames = 0;
+double								g_ReplayStartMs = 0.0;
+
+#ifdef PROFILE
+// B keeps the lists of the next g_RhiBenchmarkFrames frames in memory, and runs them
+// on RhiNull, see RecordRhiBenchmarkFrame.
+std::vector<RhiCommandList>			g_RhiBenchmarkLists;
+const UINT							g_RhiBenchmarkFrames = 120;
+const UINT							g_RhiBenchmarkRepeat = 100;
+bool								g_RhiBenchmarking = false;
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark mode
+//
+// -benchmark on the command line runs each of g_BenchmarkScenes for its warmup and
+// measured frames, then writes the report and quits, see benchmark.h.  The cube
+// turns on g_AnimationClock, which steps a fixed amount per frame in this mode, so
+// every run draws the same frames.  Hot reload and dynamic resolution are off, and
+// Present does not wait for the vertical blank, so the frames measure the work.
+//--------------------------------------------------------------------------------------
+struct BenchmarkRun
+{
+	UINT scene;				// index into g_BenchmarkScenes
+	UINT frame;				// of the scene, warmup included
+	UINT64 firstFrame;		// the first measured, by g_PresentCount
+	BenchmarkScene current;	// as it runs, the MSAA the device has
+	std::vector<BenchmarkResult> results;
+};
+
+BenchmarkOptions					g_Benchmark;
+BenchmarkRun						g_BenchmarkRun = {};
+AnimationClock						g_AnimationClock;
+UINT								g_ObjectCount = 1;			// cubes in the scene
+UINT								g_MaxSampleCount = 1;		// the MSAA the device has
+UINT								g_MaxSampleQuality = 0;
+
+// Resolution is a fixed render scale of the full-screen mode, through the upscale.
+const BenchmarkScene				g_BenchmarkScenes[] =
+{
+	{ "baseline",		1,	1.0f,	4,	true },
+	{ "objects",		64,	1.0f,	4,	true },
+	{ "no_msaa",		64,	1.0f,	1,	true },
+	{ "no_mono_slice",	64,	1.0f,	4,	false },
+	{ "half_scale",		64,	0.5f,	4,	true },
+};
+
+
+//--------------------------------------------------------------------------------------
+// Mono far layer
+//
+// Cubes far enough away that the eyes see them alike, but for a shift, are drawn once
+// into the far layer, which is copied into every slice before the near cubes are
+// drawn, see far_field.h.  The split follows the live convergence and separation,
+// so it is worked out every frame, before the frame graph is compiled, and the far
+// passes drop out when nothing is far.  F turns the layer off and on.
+//--------------------------------------------------------------------------------------
+bool								g_FarFieldEnabled = true;
+const float							g_FarFieldThresholdPx = 0.5f;	// and up to half a pixel rounding the shift
+const float							g_ObjectRadius = 1.7320508f;	// of the cube's bounds, turning
+XMFLOAT4							g_StereoParams[MultiviewMaxViews + 1];	// the views, then mono, as in cbShared
+FarFieldSplit						g_FarField = {};
+std::vector<FarFieldObject>			g_FarFieldObjects;
+std::vector<uint8_t>				g_FarObjects;					// by object, 1 when in the far layer
+std::vector<uint32_t>				g_FarFieldOrder;
+UINT64								g_FarFieldSavedTriangles = 0;	// since the last Profile report
+UINT64								g_FarFieldTriangles = 0;
+
+
+//--------------------------------------------------------------------------------------
+// Depth readback
+//
+// Every g_DepthReadbackInterval frames the DepthReadback pass copies the packed depth
+// of the mono slice, the first sample of each texel, into a single sample target,
+// and from there into the next free staging texture, along with the stereo
+// parameters it was drawn with.  A later frame maps it without waiting, and hands
+// it to auto-convergence and the comfort analysis, whichever are on, which work
+// through it on their own threads while the frames go on.  It is unmapped once both
+// are done.  There is only depth to read with the mono slice.
+//--------------------------------------------------------------------------------------
+const UINT							g_DepthReadbackInterval = 4;
+const UINT							g_DepthStagingCount = 3;		// copies in flight, and one being read
+ID3D11Texture2D*					g_pDepthStaging[g_DepthStagingCount] = {};
+RhiTexture							g_hDepthStaging[g_DepthStagingCount] = {};
+UINT64								g_DepthStagingFrame[g_DepthStagingCount] = {};	// copied in, by g_PresentCount
+D3D11_VIEWPORT						g_DepthStagingViewport[g_DepthStagingCount];	// the part of it rendered
+XMFLOAT4							g_DepthStagingStereo[g_DepthStagingCount][2];	// left and right, as drawn
+bool								g_DepthStagingPending[g_DepthStagingCount] = {};
+int									g_DepthStagingMapped = -1;		// being read
+int									g_DepthStagingNext = -1;		// for this frame's copy, if any
+bool								g_DepthHistogramRunning = false;	// on the mapped one
+bool								g_ComfortRunning = false;
+UINT64								g_DepthReadbackLatency = 0;		// frames from copy to map, summed
+UINT								g_DepthReadbacks = 0;			// mapped, since the last Profile report
+
+//--------------------------------------------------------------------------------------
+// Auto-convergence
+//
+// The read back depth is binned into a histogram, the controller picks a target from
+// it, and every frame eases the convergence towards it through NvAPI, see
+// depth_histogram.h.  A turns it on, and off again back to the convergence the
+// user had.
+//--------------------------------------------------------------------------------------
+bool								g_AutoConvergenceEnabled = false;
+const UINT							g_DepthHistogramBins = 256;
+const UINT							g_DepthHistogramThreads = 2;
+std::unique_ptr<DepthHistogram>		g_DepthHistogram;
+ConvergenceController				g_ConvergenceController;
+float								g_UserConvergence = 0.0f;		// to go back to
+double								g_ConvergenceEaseMs = 0.0;
+UINT								g_DepthHistograms = 0;			// since the last Profile report
+
+//--------------------------------------------------------------------------------------
+// Comfort analysis
+//
+// The read back depth goes through the stereo parameters it was drawn with into a
+// screen disparity for every texel, and the tiles that break the viewing limits are
+// flagged, see stereo_comfort.h.  The limit past which the eyes diverge is the
+// driver's eye separation, the interocular as a share of the screen width.  Every
+// analysis whose flags differ from the last one's goes to the debug output, and the
+// Profile build sums them up.  V turns it off and on.
+//--------------------------------------------------------------------------------------
+#ifdef PROFILE
+bool								g_ComfortEnabled = true;
+#else
+bool								g_ComfortEnabled = false;
+#endif
+const UINT							g_ComfortThreads = 2;
+std::unique_ptr<ComfortAnalyzer>	g_ComfortAnalyzer;
+ComfortLimits						g_ComfortLimits;
+float								g_EyeSeparation = 0.0f;			// from the driver, UpdateFarField reads it
+UINT								g_ComfortFlags = 0;				// of the last analysis
+UINT								g_ComfortAnalyses = 0;			// since the last Profile report
+UINT								g_ComfortFlagged[4] = {};		// analyses with each ComfortFlag
+float								g_ComfortMinPx = 0.0f;
+float								g_ComfortMaxPx = 0.0f;
+double								g_ComfortMs = 0.0;
+
+//--------------------------------------------------------------------------------------
+// Stereo output formats
+//
+// With g_OutputFormat at -1 the eyes go out through Direct Mode, each to its own
+// back buffer.  Otherwise the eye passes copy or resolve both eyes into a single
+// sample pair, and the Compose pass packs them into one frame in that format, the
+// same for both eyes, see stereo_compose.h.  The back buffer is one eye wide, so
+// full side by side goes to g_pComposeTexture, twice as wide, and the screen shows
+// half side by side.  O steps through the formats.  K composes the eyes of the next
+// frame on the CPU as well, and compares the two byte for byte.  Dynamic resolution
+// stays at full scale while composing.
+//--------------------------------------------------------------------------------------
+int									g_OutputFormat = -1;			// StereoFormat, -1 for Direct Mode
+bool								g_ComposeCheckRequested = false;
+bool								g_ComposeCheckPending = false;	// this frame composed into g_pComposeTexture for it
+
+static_assert(sizeof(g_StereoParams) == sizeof(SharedCB::mStereoParamsArray), "StereoParamsArray holds MAX_VIEWS + 1");
+
+//--------------------------------------------------------------------------------------
+// Lenticular output
+//
+// N steps the view count through g_ViewCounts.  With more than two, the GS draws
+// every view, spaced as the eyes are, see multiview.h.  The eye passes copy or
+// resolve the views into the eye pair, which then has a slice for each, and the
+// Interleave pass spreads them over the subpixels of a slanted lenticular panel.
+// Direct Mode, the output formats, reprojection and eye recording are for two views
+// and wait until N comes round to 2 again.  K interleaves the next frame's views on
+// the CPU as well, and compares the two byte for byte.  Full scale, as composing.
+//--------------------------------------------------------------------------------------
+const float							g_LenticularViewsPerSubpixel = 2.0f;	// the lens pitch is the view count over this
+const float							g_LenticularSlant = 0.5f;		// subpixels a row, 1/6 on square texels
+
+bool LenticularOutput()
+{
+	return g_Permutation.viewCount > 2;
+}
+
+LenticularLayout CurrentLenticularLayout()
+{
+	LenticularLayout layout = { g_Permutation.viewCount, g_Permutation.viewCount / g_LenticularViewsPerSubpixel,
+		g_LenticularSlant, 0.0f };
+	return layout;
+}
+
+//--------------------------------------------------------------------------------------
+// Eye recording
+//
+// E starts writing both eyes to g_EyeRecordingFile, and stops again, see
+// stereo_capture.h.  The eyes go into the eye pair as for the output formats, and
+// the EyeCapture pass copies the pair, and the packed depth of the mono slice the
+// right eye is predicted through, into the next free staging textures along with
+// the stereo parameters they were drawn with.  A later frame maps the oldest
+// without waiting and hands it to the writer, which codes it on its own threads.
+// A frame is skipped when every staging texture is still in flight, and dropped
+// by the writer when it is too far behind, and both are counted.  Dynamic
+// resolution stays at full scale while recording, and a new window size stops it.
+// The coding is not real time, at 1920x1080 the writer keeps a few frames a second
+// and drops the rest.
+//--------------------------------------------------------------------------------------
+const char*							g_EyeRecordingFile = "eye_capture.scap";
+const UINT							g_EyeRecordingThreads = 3;
+const UINT							g_EyeRecordingQueue = 4;		// frames the writer holds before it drops one
+const UINT							g_EyeRecordingSampling = 16;	// frames kept apart the right eye is counted on its own
+const UINT							g_EyeStagingCount = 3;
+ID3D11Texture2D*					g_pEyeStaging[g_EyeStagingCount] = {};			// both eyes, a slice each
+ID3D11Texture2D*					g_pEyeDepthStaging[g_EyeStagingCount] = {};	// with the mono slice
+RhiTexture							g_hEyeStaging[g_EyeStagingCount] = {};
+RhiTexture							g_hEyeDepthStaging[g_EyeStagingCount] = {};
+UINT64								g_EyeStagingFrame[g_EyeStagingCount] = {};	// copied in, by g_PresentCount
+StereoCaptureView					g_EyeStagingView[g_EyeStagingCount];
+bool								g_EyeStagingPending[g_EyeStagingCount] = {};
+int									g_EyeStagingNext = -1;			// for this frame's copy, if any
+std::unique_ptr<StereoCaptureWriter>	g_EyeRecorder;				// while recording
+UINT								g_EyeRecordingWidth = 0;		// the size it was started at
+UINT								g_EyeRecordingHeight = 0;
+UINT64								g_EyeRecordingSkipped = 0;
+
+//--------------------------------------------------------------------------------------
+// Reprojection fallback
+//
+// A frame that misses its refresh swaps the eyes on the glasses, see FramePacer.
+// With W on, a frame that would start too late to be drawn in time is not drawn:
+// the offscreen array still holds the last frame drawn, and the Reproject passes
+// warp its eyes, through the mono slice's depth, to the cube's turn and the stereo
+// parameters of now, into the back buffers, see reprojection.h.  That is a pass
+// over each eye, which makes the refresh, and the frame after a warp is always
+// drawn.  Only in Direct Mode with the mono slice, and not while recording.  X
+// warps the next frame whatever the time, and warps its left eye on the CPU as well
+// to compare the two.
+//
+// With one immediate context a warp cannot be presented while a frame is still
+// being drawn, so the choice is made when the frame starts, from what drawn frames
+// have recently cost.  Like the pacer, this is only arithmetic on ms values.
+//--------------------------------------------------------------------------------------
+struct ReprojectionFallback
+{
+	double costMs = 4.0;		// recent cost of a drawn frame, start to present
+	double marginMs = 0.5;
+	double decay = 0.1;			// how fast the cost estimate comes down
+	uint32_t maxInRow = 1;		// warps before a frame is drawn whatever the time
+
+	uint32_t inRow = 0;
+	uint64_t frames = 0;
+	uint64_t lateFrames = 0;	// that would have missed their refresh drawn
+	uint64_t warpedFrames = 0;
+	uint64_t missedWarps = 0;	// warped, and missed all the same
+
+	void Reset()
+	{
+		inRow = 0;
+		frames = lateFrames = warpedFrames = missedWarps = 0;
+	}
+
+	// Whether a frame drawn from nowMs misses the first refresh after nowMs.
+	bool IsLate(double nowMs, double lastRefreshMs, double periodMs) const
+	{
+		double deadlineMs = lastRefreshMs + periodMs;
+		if (deadlineMs < nowMs)
+			deadlineMs += ceil((nowMs - deadlineMs) / periodMs) * periodMs;
+		return nowMs + costMs + marginMs > deadlineMs;
+	}
+
+	// Warp a late frame, but the scene has to move on now and then.
+	bool Decide(bool late)
+	{
+		bool warp = late && inRow < maxInRow;
+		frames++;
+		lateFrames += late ? 1 : 0;
+		warpedFrames += warp ? 1 : 0;
+		return warp;
+	}
+
+	// After the present.  Only drawn frames say what drawing costs, and the cost goes
+	// up at once and comes down slowly.
+	void OnPresent(bool warped, bool missed, double frameCostMs)
+	{
+		inRow = warped ? inRow + 1 : 0;
+		if (warped)
+			missedWarps += missed ? 1 : 0;
+		else if (frameCostMs > costMs)
+			costMs = frameCostMs;
+		else
+			costMs += decay * (frameCostMs - costMs);
+	}
+};
+
+bool								g_ReprojectionEnabled = false;
+ReprojectionFallback				g_Reprojection;
+const UINT							g_ReprojectionIterations = 2;	// REPROJECT_ITERATIONS in Tutorial07.fx
+bool								g_ReprojectionWarp = false;		// this frame, or the last one before the next decides
+XMMATRIX							g_ReprojectionWorld;			// what the offscreen array was drawn with
+XMMATRIX							g_ReprojectionView;
+XMFLOAT4							g_ReprojectionStereo[2];
+D3D11_VIEWPORT						g_ReprojectionViewport;
+bool								g_ReprojectionSourceValid = false;
+bool								g_ReprojectionCheckRequested = false;
+bool								g_ReprojectionCheckPending = false;	// this frame warped into g_pReprojectCheckTexture
+ReprojectCB							g_ReprojectionCheckCB;			// the left eye's, for the CPU
+
+//--------------------------------------------------------------------------------------
+// Binocular suppression
+//
+// The eyes fuse into one image, and the sharper one carries the detail, so the other
+// eye can be drawn smaller with little to see for it, see eye_upscale.h.  D steps
+// from both eyes at full size to the left eye small, the right eye small, then the
+// small eye swapping every g_SuppressionPeriod frames, so neither stays soft for
+// long, and back.  The GS sends each slice through its own viewport, and the small
+// eye's is g_SuppressedEyeScale of the others, on top of dynamic resolution.  Its
+// eye pass filters it up into the back buffer as dynamic resolution does.  The mono
+// slice stays full size, for the depth.  Direct Mode with two views only, as the
+// eye pair and the recording read whole eyes, and a frame with a small eye is not
+// warped later.  Profile reports the slice texels drawn, and frame timing the PS
+// invocations of the scene against the last report without a small eye.
+//--------------------------------------------------------------------------------------
+enum Suppression
+{
+	Suppression_Off,
+	Suppression_Left,		// the left eye small, the right one dominant
+	Suppression_Right,
+	Suppression_Alternate,
+	Suppression_Count
+};
+
+const char*							g_SuppressionNames[Suppression_Count] = { "off", "the left eye small", "the right eye small", "alternating" };
+Suppression							g_Suppression = Suppression_Off;
+float								g_SuppressedEyeScale = 0.5f;	// of the other eye's viewport
+const UINT							g_SuppressionPeriod = 60;		// frames between swaps, alternating
+int									g_SuppressedSlice = -1;			// this frame, -1 for none
+D3D11_VIEWPORT						g_SliceViewports[MultiviewMaxViews + 1];	// the views, then mono
+UINT64								g_SuppressionTexels = 0;		// drawn since the last Profile report
+UINT64								g_SuppressionFullTexels = 0;	// the same at full size
+UINT64								g_UnsuppressedPSInvocations = 0;	// of the scene, both eyes full size
+
+//--------------------------------------------------------------------------------------
+// Forward declarations
+//--------------------------------------------------------------------------------------
+HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
+HRESULT InitStereo();
+HRESULT Startup(HINSTANCE hInstance, int nCmdShow);
+HRESULT CreateSwapChain();
+HRESULT ResizeDevice(UINT width, UINT height);
+void ReleaseDirtyDeviceResources();
+HRESULT ActivateStereo();
+void CleanupDevice();
+LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
+void RenderFrame();
+#ifdef PROFILE
+void StartRhiBenchmark();
+void RecordRhiBenchmarkFrame();
+#endif
+void BuildFrameGraph();
+void SelectPermutation(UINT sampleCount);
+void StartCapture();
+void ToggleReplay();
+void ToggleAutoConvergence();
+void ToggleComfortAnalysis();
+void CycleOutputFormat();
+void CycleViewCount();
+void CheckComposer();
+void ToggleEyeRecording();
+void StopEyeRecording();
+void ToggleReprojection();
+void RequestReprojectionCheck();
+void CheckReprojection();
+
+
+//--------------------------------------------------------------------------------------
+// Entry point to the program. Initializes everything and goes into a message processing 
+// loop. Idle time is used to render the scene.
+//--------------------------------------------------------------------------------------
+int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
+{
+	UNREFERENCED_PARAMETER(hPrevInstance);
+
+	std::string error;
+	if (!ParseBenchmarkOptions(lpCmdLine, g_Benchmark, error) ||
+		(g_Benchmark.scene >= (int)ARRAYSIZE(g_BenchmarkScenes)))
+	{
+		if (error.empty())
+			error = "-scene is past the last scene";
+		MessageBoxA(nullptr, error.c_str(), "Command line", MB_OK);
+		return 0;
+	}
+	if (g_Benchmark.enabled)
+	{
+		g_FrameTimingEnabled = true;
+		g_ShaderHotReload = false;
+		g_DynamicResolutionEnabled = false;
+		g_PresentSyncInterval = 0;
+		g_AnimationClock.stepMs = g_Benchmark.stepMs;
+		g_BenchmarkRun.scene = max(g_Benchmark.scene, 0);
+	}
+
+	if (FAILED(Startup(hInstance, nCmdShow)))
+	{
+		CleanupDevice();
+		return 0;
+	}
+
+	// Main message loop
+	MSG msg = { 0 };
+	while (WM_QUIT != msg.message)
+	{
+		if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+		else
+		{
+			RenderFrame();
+		}
+	}
+
+	CleanupDevice();
+
+	return (int)msg.wParam;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Register class and create window
+//--------------------------------------------------------------------------------------
+HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
+{
+	// Register class
+	WNDCLASSEX wcex;
+	wcex.cbSize = sizeof(WNDCLASSEX);
+	wcex.style = CS_HREDRAW | CS_VREDRAW;
+	wcex.lpfnWndProc = WndProc;
+	wcex.cbClsExtra = 0;
+	wcex.cbWndExtra = 0;
+	wcex.hInstance = hInstance;
+	wcex.hIcon = LoadIcon(hInstance, (LPCTSTR)IDI_TUTORIAL1);
+	wcex.hCursor = LoadCursor(nullptr, IDC_ARROW);
+	wcex.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+	wcex.lpszMenuName = nullptr;
+	wcex.lpszClassName = L"TutorialWindowClass";
+	wcex.hIconSm = LoadIcon(wcex.hInstance, (LPCTSTR)IDI_TUTORIAL1);
+	if (!RegisterClassEx(&wcex))
+		return E_FAIL;
+
+	// Create window
+	g_hInst = hInstance;
+	RECT rc = { 0, 0, g_ScreenWidth, g_ScreenHeight };
+	AdjustWindowRect(&rc, WS_OVERLAPPEDWINDOW, FALSE);
+	g_hWnd = CreateWindow(L"TutorialWindowClass", L"Direct3D 11 Tutorial 7",
+		WS_OVERLAPPEDWINDOW,
+		CW_USEDEFAULT, CW_USEDEFAULT, rc.right - rc.left, rc.bottom - rc.top, nullptr, nullptr, hInstance,
+		nullptr);
+	if (!g_hWnd)
+		return E_FAIL;
+
+	ShowWindow(g_hWnd, nCmdShow);
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Setup nvapi, and enable stereo by direct mode for the app.
+// This must be called before the Device is created for Direct Mode to work.
+//--------------------------------------------------------------------------------------
+HRESULT InitStereo()
+{
+	NvAPI_Status status;
+
+	status = NvAPI_Initialize();
+	if (FAILED(status))
+		return status;
+
+	// The entire point is to show stereo.  
+	// If it's not enabled in the control panel, let the user know.
+	NvU8 stereoEnabled;
+	status = NvAPI_Stereo_IsEnabled(&stereoEnabled);
+	if (FAILED(status) || !stereoEnabled)
+	{
+		// No owner, this runs on a startup worker, maybe before the window exists.
+		MessageBox(nullptr, L"3D Vision is not enabled. Enable it in the NVidia Control Panel.", L"Error", MB_OK);
+		return status;
+	}
+
+	status = NvAPI_Stereo_SetDriverMode(NVAPI_STEREO_DRIVER_MODE_DIRECT);
+	if (FAILED(status))
+		return status;
+
+	return status;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Activate stereo for the given device.
+// This must be called after the device is created.
+//--------------------------------------------------------------------------------------
+HRESULT ActivateStereo()
+{
+	NvAPI_Status status;
+
+	status = NvAPI_Stereo_CreateHandleFromIUnknown(g_pd3dDevice, &g_StereoHandle);
+	if (FAILED(status))
+		return status;
+
+	return status;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Flags for every shader compile.  They are part of the cache key.
+//--------------------------------------------------------------------------------------
+DWORD ShaderCompileFlags()
+{
+	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#ifdef _DEBUG
+	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
+	// Setting this flag improves the shader debugging experience, but still allows 
+	// the shaders to be optimized and to run exactly the way they will run in 
+	// the release configuration of this program.
+	dwShaderFlags |= D3DCOMPILE_DEBUG;
+
+	// Disable optimizations to further improve shader debugging
+	dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+	return dwShaderFlags;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Read a whole shader source file.
+//--------------------------------------------------------------------------------------
+HRESULT LoadShaderSource(const WCHAR* szFileName, std::vector<char>& source)
+{
+	HANDLE file = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	LARGE_INTEGER size;
+	DWORD read = 0;
+	BOOL ok = GetFileSizeEx(file, &size) && size.HighPart == 0;
+	if (ok)
+	{
+		source.resize(size.LowPart);
+		ok = ReadFile(file, source.data(), size.LowPart, &read, nullptr) && read == size.LowPart;
+	}
+	CloseHandle(file);
+
+	return ok ? S_OK : E_FAIL;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Helper for compiling shaders with D3DCompile, from source already in memory.
+//--------------------------------------------------------------------------------------
+HRESULT CompileShaderFromSource(const std::vector<char>& source, LPCSTR szSourceName, const D3D_SHADER_MACRO* pDefines,
+	LPCSTR szEntryPoint, LPCSTR szShaderModel, DWORD dwShaderFlags, std::vector<uint8_t>& bytecode)
+{
+	ID3DBlob* pBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3DCompile(source.data(), source.size(), szSourceName, pDefines, nullptr, szEntryPoint, szShaderModel,
+		dwShaderFlags, 0, &pBlob, &pErrorBlob);
+	if (FAILED(hr))
+	{
+		if (pErrorBlob)
+		{
+			OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
+			pErrorBlob->Release();
+		}
+		return hr;
+	}
+	if (pErrorBlob) pErrorBlob->Release();
+
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(pBlob->GetBufferPointer());
+	bytecode.assign(data, data + pBlob->GetBufferSize());
+	pBlob->Release();
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Hash the part of the source each job's entry point depends on.
+//--------------------------------------------------------------------------------------
+void HashShaderSources(const std::vector<char>& source, ShaderJob* jobs, UINT count)
+{
+	std::vector<const char*> entries(count);
+	std::vector<uint64_t> hashes(count);
+	for (UINT i = 0; i < count; i++)
+		entries[i] = jobs[i].entry;
+
+	ShaderEntryHashes(source.data(), source.size(), entries.data(), count, hashes.data());
+	for (UINT i = 0; i < count; i++)
+		jobs[i].sourceHash = hashes[i];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Fill in the bytecode of all the jobs, specialized for one permutation.
+//
+// The source is read once.  Each job looks in the cache first, and the misses are
+// compiled in parallel, one thread per core at most, and stored back.  D3DCompile
+// is safe to call from several threads.  Tutorial07.fx has no #includes, so the
+// source text is all of the source in the key.
+//--------------------------------------------------------------------------------------
+HRESULT CompileShaders(const std::vector<char>& source, LPCSTR szSourceName, const ShaderPermutation& permutation,
+	ShaderJob* jobs, UINT count)
+{
+	LARGE_INTEGER start, frequency;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	HRESULT hr = S_OK;
+	HashShaderSources(source, jobs, count);
+
+	ShaderCache cache(g_ShaderCacheDir);
+	DWORD flags = ShaderCompileFlags();
+
+	std::vector<uint64_t> keys(count);
+	std::vector<PermutationDefines> defines(count);
+	std::vector<UINT> misses;
+	for (UINT i = 0; i < count; i++)
+	{
+		LARGE_INTEGER jobStart, jobEnd;
+		QueryPerformanceCounter(&jobStart);
+
+		BuildPermutationDefines(permutation, jobs[i].options, defines[i]);
+		ShaderCacheKey key = { source.data(), source.size(), defines[i].defines, defines[i].count,
+			jobs[i].entry, jobs[i].profile, flags, D3D_COMPILER_VERSION };
+		keys[i] = ShaderCacheHash(key);
+		jobs[i].cached = cache.Load(keys[i], jobs[i].bytecode);
+		jobs[i].hr = jobs[i].cached ? S_OK : E_PENDING;
+
+		QueryPerformanceCounter(&jobEnd);
+		jobs[i].ms = (jobEnd.QuadPart - jobStart.QuadPart) * 1000.0 / frequency.QuadPart;
+
+		if (!jobs[i].cached)
+			misses.push_back(i);
+	}
+
+	//
+	// Compile the misses.  Threads take the next job off a shared counter until
+	// there are none left.
+	//
+	std::atomic<UINT> next(0);
+	auto worker = [&]()
+	{
+		for (UINT m = next++; m < misses.size(); m = next++)
+		{
+			ShaderJob& job = jobs[misses[m]];
+
+			LARGE_INTEGER jobStart, jobEnd;
+			QueryPerformanceCounter(&jobStart);
+
+			job.hr = CompileShaderFromSource(source, szSourceName, defines[misses[m]].macros, job.entry, job.profile,
+				flags, job.bytecode);
+			if (SUCCEEDED(job.hr))
+				cache.Store(keys[misses[m]], job.bytecode.data(), job.bytecode.size());
+
+			QueryPerformanceCounter(&jobEnd);
+			job.ms += (jobEnd.QuadPart - jobStart.QuadPart) * 1000.0 / frequency.QuadPart;
+		}
+	};
+
+	UINT threadCount = min((UINT)misses.size(), max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	for (UINT t = 1; t < threadCount; t++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+
+	char msg[256];
+	for (UINT i = 0; i < count; i++)
+	{
+		sprintf_s(msg, "Shader %s (%s): %s in %.2fms, %u bytes\n", jobs[i].entry, jobs[i].profile,
+			jobs[i].cached ? "cache hit" : "compiled", jobs[i].ms, (UINT)jobs[i].bytecode.size());
+		OutputDebugStringA(msg);
+
+		if (FAILED(jobs[i].hr))
+			hr = jobs[i].hr;
+		else
+			jobs[i].bytecodeHash = Fnv1a64(jobs[i].bytecode.data(), jobs[i].bytecode.size());
+	}
+	sprintf_s(msg, "Shaders: %u of %u from cache, %u compiled on %u threads, %.2fms total\n",
+		count - (UINT)misses.size(), count, (UINT)misses.size(), threadCount,
+		(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart);
+	OutputDebugStringA(msg);
+
+	return hr;
+}
+
+HRESULT CompileShaders(const WCHAR* szFileName, LPCSTR szSourceName, const ShaderPermutation& permutation,
+	ShaderJob* jobs, UINT count)
+{
+	std::vector<char> source;
+	HRESULT hr = LoadShaderSource(szFileName, source);
+	if (FAILED(hr))
+		return hr;
+
+	return CompileShaders(source, szSourceName, permutation, jobs, count);
+}
+
+
+//--------------------------------------------------------------------------------------
+// How big the permutation space is, and what building all of it would cost.
+//
+// The compile times of the jobs that missed the cache stand in for every variant
+// of that shader.  Jobs that hit the cache were not timed, so a warm cache gives
+// no estimate for them.
+//--------------------------------------------------------------------------------------
+void ReportShaderPermutations(const ShaderJob* jobs, UINT count)
+{
+	UINT space = 1;
+	for (UINT option = 0; option < Perm_OptionCount; option++)
+		space *= g_PermutationValues[option];
+
+	UINT variants = 0;
+	UINT untimed = 0;
+	double estimateMs = 0.0;
+	char msg[256];
+	for (UINT i = 0; i < count; i++)
+	{
+		UINT jobVariants = PermutationVariants(jobs[i].options);
+		variants += jobVariants;
+		if (jobs[i].cached)
+			untimed++;
+		else
+			estimateMs += jobVariants * jobs[i].ms;
+
+		sprintf_s(msg, "Permutations %s: %u variants\n", jobs[i].entry, jobVariants);
+		OutputDebugStringA(msg);
+	}
+
+	sprintf_s(msg, "Permutations: %u option combinations, %u shader variants (budget %u), "
+		"about %.0fms to build them all on one thread (budget %.0fms)%s\n",
+		space, variants, g_ShaderVariantBudget, estimateMs, g_ShaderCompileBudgetMs,
+		untimed ? ", cached shaders not counted" : "");
+	OutputDebugStringA(msg);
+
+	if (variants > g_ShaderVariantBudget || estimateMs > g_ShaderCompileBudgetMs)
+		OutputDebugStringA("Permutations: over budget\n");
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bytes read plus bytes written to move one eye slice into the back buffer.
+// The upscale pass only reads the part of the slice that was rendered.
+//--------------------------------------------------------------------------------------
+UINT64 EyeCopyBytes(EyeCopyPath path, UINT width, UINT height, UINT sampleCount, float renderScale = 1.0f)
+{
+	UINT64 texels = (UINT64)width * height;
+	UINT64 bytesRead = texels * 4;
+	if (path == EyeCopy_Resolve)
+		bytesRead *= sampleCount;
+	else if (path == EyeCopy_Upscale)
+		bytesRead = (UINT64)(bytesRead * renderScale * renderScale) * sampleCount;
+	UINT64 bytesWritten = texels * 4;
+	return bytesRead + bytesWritten;
+}
+
+
+//--------------------------------------------------------------------------------------
+// D3D11 viewports are plain floats, the RHI one is the same thing.
+//--------------------------------------------------------------------------------------
+RhiViewport ToRhiViewport(const D3D11_VIEWPORT& vp)
+{
+	RhiViewport viewport = { vp.TopLeftX, vp.TopLeftY, vp.Width, vp.Height, vp.MinDepth, vp.MaxDepth };
+	return viewport;
+}
+
+// For the passes that draw every slice through the GS, SV_ViewportArrayIndex picks
+// the slice's own.
+void SetSliceViewports(RhiCommandList& cl)
+{
+	UINT slices = g_Permutation.SliceCount();
+	RhiViewport viewports[MultiviewMaxViews + 1];
+	for (UINT s = 0; s < slices; s++)
+		viewports[s] = ToRhiViewport(g_SliceViewports[s]);
+	cl.SetViewports(viewports, slices);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Filter the rendered part of an eye slice up to the full size back buffer.  The
+// slice's own viewport, which is smaller for a suppressed eye.
+//--------------------------------------------------------------------------------------
+void UpscaleEyeToBackBuffer(UINT slice)
+{
+	const D3D11_VIEWPORT& vp = g_SliceViewports[slice];
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(vp.Width / g_BackBufferViewport.Width, vp.Height / g_BackBufferViewport.Height, (float)slice, 0.0f);
+	cb.mResolveClamp = XMFLOAT4(vp.Width - 1.0f, vp.Height - 1.0f, 0.0f, 0.0f);
+	RhiCommandList& cl = g_CommandList;
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
+
+	cl.SetRenderTargets(g_hRenderTargetView, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(g_BackBufferViewport));
+
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hUpscalePixelShader);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetShaderView(1, g_hOffscreenColorSRV);
+
+	cl.SetTopology(RhiTopology_TriangleStrip);
+	cl.Draw(4, 0);
+
+	cl.SetShaderView(1, RhiShaderView());
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copy a single eye slice of the offscreen array to the currently active eye.
+//--------------------------------------------------------------------------------------
+void CopyEyeToBackBuffer(UINT slice)
+{
+	UINT subresource = D3D11CalcSubresource(0, slice, 1);
+
+	if (g_EyeCopyPath == EyeCopy_Upscale)
+		UpscaleEyeToBackBuffer(slice);
+	else if (g_EyeCopyPath == EyeCopy_Copy)
+		g_CommandList.CopySubresource(g_hBackBuffer, 0, g_hOffscreenTexture, subresource);
+	else
+		g_CommandList.Resolve(g_hBackBuffer, 0, g_hOffscreenTexture, subresource, RhiFormat_R8G8B8A8_UNORM);
+
+	float scale = g_DynamicResolution.scale * g_StereoParams[slice].w;
+	g_EyeCopyBytes += EyeCopyBytes(g_EyeCopyPath, g_ScreenWidth, g_ScreenHeight, g_SampleCount, scale);
+}
+
+
+//--------------------------------------------------------------------------------------
+// High resolution time in ms.
+//--------------------------------------------------------------------------------------
+double NowMs()
+{
+	static LARGE_INTEGER s_frequency = {};
+	if (s_frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&s_frequency);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart * 1000.0 / s_frequency.QuadPart;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the swap chain, from the factory that made our device.
+//--------------------------------------------------------------------------------------
+HRESULT CreateSwapChain()
+{
+	HRESULT hr;
+
+	IDXGIDevice* pDXGIDevice = nullptr;
+	IDXGIAdapter* pAdapter = nullptr;
+	IDXGIFactory1* pFactory = nullptr;
+	IDXGIFactory2* pFactory2 = nullptr;
+
+	hr = g_pd3dDevice->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&pDXGIDevice));
+	if (SUCCEEDED(hr))
+		hr = pDXGIDevice->GetAdapter(&pAdapter);
+	if (SUCCEEDED(hr))
+		hr = pAdapter->GetParent(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&pFactory));
+	if (pAdapter) pAdapter->Release();
+	if (pDXGIDevice) pDXGIDevice->Release();
+	if (FAILED(hr))
+		return hr;
+
+	g_IsFlipModel = false;
+	if (g_UseFlipModel)
+		pFactory->QueryInterface(__uuidof(IDXGIFactory2), reinterpret_cast<void**>(&pFactory2));
+
+	if (pFactory2)
+	{
+		DXGI_SWAP_CHAIN_DESC1 sd;
+		ZeroMemory(&sd, sizeof(sd));
+		sd.Width = g_ScreenWidth;
+		sd.Height = g_ScreenHeight;
+		sd.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		sd.SampleDesc.Count = 1;
+		sd.SampleDesc.Quality = 0;
+		sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		sd.BufferCount = max(g_SwapChainBufferCount, 2u);	// flip model needs at least 2
+		sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+		sd.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
+		DXGI_SWAP_CHAIN_FULLSCREEN_DESC fsd;
+		ZeroMemory(&fsd, sizeof(fsd));
+		fsd.RefreshRate.Numerator = 120;	// Needs to be 120Hz for 3D Vision 
+		fsd.RefreshRate.Denominator = 1;
+		fsd.Windowed = TRUE;
+
+		IDXGISwapChain1* pSwapChain1 = nullptr;
+		hr = pFactory2->CreateSwapChainForHwnd(g_pd3dDevice, g_hWnd, &sd, &fsd, nullptr, &pSwapChain1);
+		pFactory2->Release();
+
+		// The waitable object needs DXGI 1.3, Windows 8.1.  Without it, use the old model.
+		IDXGISwapChain2* pSwapChain2 = nullptr;
+		if (SUCCEEDED(hr))
+		{
+			pSwapChain1->QueryInterface(__uuidof(IDXGISwapChain2), reinterpret_cast<void**>(&pSwapChain2));
+			g_pSwapChain = pSwapChain1;
+		}
+		if (pSwapChain2)
+		{
+			pSwapChain2->SetMaximumFrameLatency(g_MaxFrameLatency);
+			g_FrameLatencyWaitableObject = pSwapChain2->GetFrameLatencyWaitableObject();
+			pSwapChain2->Release();
+			g_IsFlipModel = true;
+		}
+		else if (g_pSwapChain)
+		{
+			g_pSwapChain->Release();
+			g_pSwapChain = nullptr;
+		}
+	}
+
+	if (!g_IsFlipModel)
+	{
+		DXGI_SWAP_CHAIN_DESC sd;
+		ZeroMemory(&sd, sizeof(sd));
+		sd.BufferCount = g_SwapChainBufferCount;
+		sd.BufferDesc.Width = g_ScreenWidth;
+		sd.BufferDesc.Height = g_ScreenHeight;
+		sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		sd.BufferDesc.RefreshRate.Numerator = 120;	// Needs to be 120Hz for 3D Vision 
+		sd.BufferDesc.RefreshRate.Denominator = 1;
+		sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		sd.OutputWindow = g_hWnd;
+		sd.SampleDesc.Count = 1;
+		sd.SampleDesc.Quality = 0;
+		sd.Windowed = TRUE;
+
+		hr = pFactory->CreateSwapChain(g_pd3dDevice, &sd, &g_pSwapChain);
+	}
+	pFactory->Release();
+	if (FAILED(hr))
+		return hr;
+
+	g_FramePacer.Reset();
+	g_FramePacer.refreshMs = 1000.0 / 120.0;
+	g_FramePacer.refreshesPerFrame = max(g_PresentSyncInterval, 1u);
+	g_PresentCount = 0;
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Block until the swap chain can take another frame, so the frame starts as late
+// as it can and still make the refresh.
+//--------------------------------------------------------------------------------------
+void WaitForNextFrame()
+{
+	double startMs = NowMs();
+
+	if (g_FrameLatencyWaitableObject)
+		WaitForSingleObjectEx(g_FrameLatencyWaitableObject, 1000, TRUE);
+
+	// Then hold off until the frame only just makes the refresh.  Sleep is only good
+	// to about a ms, so spin for the last bit.
+	if (g_LowLatencyMode)
+	{
+		double frameStartMs = g_LatencyScheduler.FrameStartMs(NowMs(), g_FramePacer.lastRefreshMs,
+			g_FramePacer.refreshMs * g_FramePacer.refreshesPerFrame);
+
+		for (double leftMs = frameStartMs - NowMs(); leftMs > 0.0; leftMs = frameStartMs - NowMs())
+		{
+			if (leftMs > 2.0)
+				Sleep((DWORD)(leftMs - 1.0));
+			else
+				YieldProcessor();
+		}
+	}
+
+	g_LatencyMarkers.frameStartMs = NowMs();
+	g_FrameWaitMs = g_LatencyMarkers.frameStartMs - startMs;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Present, and tell the pacer which refresh it landed on.
+//
+// Frame statistics are only there in full-screen or flip model, otherwise the time
+// Present returns is the best guess we have.
+//--------------------------------------------------------------------------------------
+void PresentFrame()
+{
+	g_LatencyMarkers.submitMs = NowMs();
+	g_pSwapChain->Present(g_PresentSyncInterval, 0);
+	g_LatencyMarkers.presentMs = NowMs();
+	g_PresentCount++;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	DXGI_FRAME_STATISTICS stats;
+	HRESULT hr = g_pSwapChain->GetFrameStatistics(&stats);
+	if (SUCCEEDED(hr))
+	{
+		double syncMs = stats.SyncQPCTime.QuadPart * 1000.0 / frequency.QuadPart;
+		g_FramePacer.OnPresent(stats.PresentCount, stats.PresentRefreshCount, syncMs);
+	}
+	else if (hr == DXGI_ERROR_FRAME_STATISTICS_DISJOINT)
+	{
+		g_FramePacer.OnDisjoint();
+	}
+	else
+	{
+		g_FramePacer.OnPresentTime(g_PresentCount, g_LatencyMarkers.presentMs);
+	}
+
+	g_LatencyScheduler.OnFrameCost(g_LatencyMarkers.presentMs - g_LatencyMarkers.frameStartMs);
+
+#ifdef PROFILE
+	if (!g_LatencyLog && fopen_s(&g_LatencyLog, "latency.csv", "w") == 0)
+		fprintf(g_LatencyLog, "frame,lowLatency,inputMs,latchMs,submitMs,presentMs,inputToPresentMs,workMs,renderScale\n");
+	if (g_LatencyLog)
+	{
+		// workMs is of the frame before, as dynamic resolution sees it, for
+		// dynamic_resolution_bench.cpp to replay.
+		const LatencyMarkers& m = g_LatencyMarkers;
+		fprintf(g_LatencyLog, "%llu,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", g_PresentCount, g_LowLatencyMode ? 1 : 0,
+			m.inputSampleMs, m.latchMs, m.submitMs, m.presentMs, m.presentMs - m.inputSampleMs, g_LastFrameWorkMs,
+			g_DynamicResolution.scale);
+	}
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Size dependent resources
+//
+// Everything sized from g_ScreenWidth/g_ScreenHeight, or made with the MSAA sample
+// description, is created in the groups below.  Each group is tracked by what it
+// depends on, so a resize only rebuilds what the new size touches, and the shaders,
+// buffers and input layout are kept.
+//--------------------------------------------------------------------------------------
+template <class T> void SafeRelease(T*& p)
+{
+	if (p) p->Release();
+	p = nullptr;
+}
+
+HRESULT CreateBackBufferView()
+{
+	HRESULT hr;
+
+	// Create a render target view from the backbuffer
+	//
+	// Since this is derived from the backbuffer, it will also be 2x in width.
+	hr = g_pSwapChain->ResizeBuffers(0, g_ScreenWidth, g_ScreenHeight, DXGI_FORMAT_UNKNOWN,
+		g_IsFlipModel ? DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT : 0);
+	if (FAILED(hr))
+		return hr;
+
+	hr = g_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&g_pBackBuffer));
+	if (FAILED(hr))
+		return hr;
+
+	return g_pd3dDevice->CreateRenderTargetView(g_pBackBuffer, nullptr, &g_pRenderTargetView);
+}
+
+void ReleaseBackBufferView()
+{
+	SafeRelease(g_pRenderTargetView);
+	SafeRelease(g_pBackBuffer);
+}
+
+HRESULT CreateOffscreenTexture()
+{
+	HRESULT hr;
+
+	// Create Offscreen texture
+	D3D11_TEXTURE2D_DESC descOffscreen;
+	ZeroMemory(&descOffscreen, sizeof(descOffscreen));
+	descOffscreen.Width = g_ScreenWidth;
+	descOffscreen.Height = g_ScreenHeight;
+	descOffscreen.MipLevels = 1;
+	descOffscreen.ArraySize = g_Permutation.SliceCount(); // the eyes, then the mono slice if there is one
+	descOffscreen.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	descOffscreen.SampleDesc = g_SampleDesc;
+	descOffscreen.Usage = D3D11_USAGE_DEFAULT;
+	descOffscreen.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	descOffscreen.CPUAccessFlags = 0;
+	descOffscreen.MiscFlags = 0;
+	hr = g_pd3dDevice->CreateTexture2D(&descOffscreen, nullptr, &g_pOffscreenTexture);
+	if (FAILED(hr))
+		return hr;
+
+	return S_OK;
+}
+
+void ReleaseOffscreenTexture()
+{
+	SafeRelease(g_pOffscreenTexture);
+}
+
+//--------------------------------------------------------------------------------------
+// Views of a range of slices of the offscreen and depth arrays.  The MSAA and single
+// sample forms differ only in the view dimension and which union member is used.
+//--------------------------------------------------------------------------------------
+template <bool MSAA> struct ArrayViewDesc;
+
+template <> struct ArrayViewDesc<true>
+{
+	static void RTV(D3D11_RENDER_TARGET_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DMSARRAY;
+		desc.Texture2DMSArray.FirstArraySlice = firstSlice;
+		desc.Texture2DMSArray.ArraySize = sliceCount;
+	}
+
+	static void SRV(D3D11_SHADER_RESOURCE_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY;
+		desc.Texture2DMSArray.FirstArraySlice = firstSlice;
+		desc.Texture2DMSArray.ArraySize = sliceCount;
+	}
+
+	static void DSV(D3D11_DEPTH_STENCIL_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMSARRAY;
+		desc.Texture2DMSArray.FirstArraySlice = firstSlice;
+		desc.Texture2DMSArray.ArraySize = sliceCount;
+	}
+};
+
+template <> struct ArrayViewDesc<false>
+{
+	static void RTV(D3D11_RENDER_TARGET_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+		desc.Texture2DArray.MipSlice = 0;
+		desc.Texture2DArray.FirstArraySlice = firstSlice;
+		desc.Texture2DArray.ArraySize = sliceCount;
+	}
+
+	static void SRV(D3D11_SHADER_RESOURCE_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		desc.Texture2DArray.MostDetailedMip = 0;
+		desc.Texture2DArray.MipLevels = 1;
+		desc.Texture2DArray.FirstArraySlice = firstSlice;
+		desc.Texture2DArray.ArraySize = sliceCount;
+	}
+
+	static void DSV(D3D11_DEPTH_STENCIL_VIEW_DESC& desc, UINT firstSlice, UINT sliceCount)
+	{
+		desc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		desc.Texture2DArray.MipSlice = 0;
+		desc.Texture2DArray.FirstArraySlice = firstSlice;
+		desc.Texture2DArray.ArraySize = sliceCount;
+	}
+};
+
+template <bool MSAA>
+HRESULT CreateOffscreenViewsT()
+{
+	typedef ArrayViewDesc<MSAA> View;
+	HRESULT hr;
+	UINT views = g_Permutation.viewCount;
+
+	D3D11_RENDER_TARGET_VIEW_DESC descRTV;
+	ZeroMemory(&descRTV, sizeof(descRTV));
+	descRTV.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+
+	// All the slices, for the scene
+	View::RTV(descRTV, 0, g_Permutation.SliceCount());
+	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descRTV, &g_pOffscreenTextureView);
+	if (FAILED(hr))
+		return hr;
+
+	// The eyes, for the clear
+	View::RTV(descRTV, 0, views);
+	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descRTV, &g_pOffscreenRTV_Color);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC descSRV;
+	ZeroMemory(&descSRV, sizeof(descSRV));
+	descSRV.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+
+	// Both eye slices, read by the upscale pass when rendering below full size.
+	View::SRV(descSRV, 0, views);
+	hr = g_pd3dDevice->CreateShaderResourceView(g_pOffscreenTexture, &descSRV, &g_pOffscreenColorSRV);
+	if (FAILED(hr))
+		return hr;
+
+	if (!g_Permutation.monoSlice)
+		return S_OK;
+
+	// The mono slice, written with packed depth and read by the depth view.
+	View::RTV(descRTV, views, 1);
+	hr = g_pd3dDevice->CreateRenderTargetView(g_pOffscreenTexture, &descRTV, &g_pOffscreenRTV_Depth);
+	if (FAILED(hr))
+		return hr;
+
+	View::SRV(descSRV, views, 1);
+	hr = g_pd3dDevice->CreateShaderResourceView(g_pOffscreenTexture, &descSRV, &g_pPackedDepthTextureSRV);
+	if (FAILED(hr))
+		return hr;
+
+	return S_OK;
+}
+
+HRESULT CreateOffscreenViews()
+{
+	return (g_Permutation.msaaSamples > 1) ? CreateOffscreenViewsT<true>() : CreateOffscreenViewsT<false>();
+}
+
+void ReleaseOffscreenViews()
+{
+	SafeRelease(g_pOffscreenTextureView);
+	SafeRelease(g_pOffscreenRTV_Color);
+	SafeRelease(g_pOffscreenRTV_Depth);
+	SafeRelease(g_pPackedDepthTextureSRV);
+	SafeRelease(g_pOffscreenColorSRV);
+}
+
+HRESULT CreateDepthStencil()
+{
+	HRESULT hr;
+
+	// Create depth stencil texture
+	D3D11_TEXTURE2D_DESC descDepth;
+	ZeroMemory(&descDepth, sizeof(descDepth));
+	descDepth.Width = g_ScreenWidth;
+	descDepth.Height = g_ScreenHeight;
+	descDepth.MipLevels = 1;
+	descDepth.ArraySize = g_Permutation.SliceCount(); // the eyes, then the mono slice if there is one
+	descDepth.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	descDepth.SampleDesc = g_SampleDesc;
+	descDepth.Usage = D3D11_USAGE_DEFAULT;
+	descDepth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	descDepth.CPUAccessFlags = 0;
+	descDepth.MiscFlags = 0;
+	hr = g_pd3dDevice->CreateTexture2D(&descDepth, nullptr, &g_pDepthStencil);
+	if (FAILED(hr))
+		return hr;
+
+	// Create the depth stencil view
+	//
+	// This is not strictly necessary for our 3D, but is almost always used.
+	D3D11_DEPTH_STENCIL_VIEW_DESC descDSV;
+	ZeroMemory(&descDSV, sizeof(descDSV));
+	descDSV.Format = descDepth.Format;
+	if (g_Permutation.msaaSamples > 1)
+		ArrayViewDesc<true>::DSV(descDSV, 0, descDepth.ArraySize);
+	else
+		ArrayViewDesc<false>::DSV(descDSV, 0, descDepth.ArraySize);
+	hr = g_pd3dDevice->CreateDepthStencilView(g_pDepthStencil, &descDSV, &g_pDepthStencilView);
+	if (FAILED(hr))
+		return hr;
+
+	return S_OK;
+}
+
+void ReleaseDepthStencil()
+{
+	SafeRelease(g_pDepthStencilView);
+	SafeRelease(g_pDepthStencil);
+}
+
+//--------------------------------------------------------------------------------------
+// The mono far layer, color and then packed depth if there is a mono slice, with
+// its own depth buffer.  It is single sample, whatever the offscreen array is, as
+// the composite copies it texel for texel.
+//--------------------------------------------------------------------------------------
+HRESULT CreateFarLayer()
+{
+	HRESULT hr;
+	UINT slices = g_Permutation.monoSlice ? 2 : 1;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_ScreenWidth;
+	desc.Height = g_ScreenHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = slices;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pFarLayerTexture);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_RENDER_TARGET_VIEW_DESC descRTV;
+	ZeroMemory(&descRTV, sizeof(descRTV));
+	descRTV.Format = desc.Format;
+	ArrayViewDesc<false>::RTV(descRTV, 0, 1);
+	hr = g_pd3dDevice->CreateRenderTargetView(g_pFarLayerTexture, &descRTV, &g_pFarLayerRTV_Color);
+	if (FAILED(hr))
+		return hr;
+
+	if (g_Permutation.monoSlice)
+	{
+		ArrayViewDesc<false>::RTV(descRTV, 1, 1);
+		hr = g_pd3dDevice->CreateRenderTargetView(g_pFarLayerTexture, &descRTV, &g_pFarLayerRTV_Depth);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC descSRV;
+	ZeroMemory(&descSRV, sizeof(descSRV));
+	descSRV.Format = desc.Format;
+	ArrayViewDesc<false>::SRV(descSRV, 0, slices);
+	hr = g_pd3dDevice->CreateShaderResourceView(g_pFarLayerTexture, &descSRV, &g_pFarLayerSRV);
+	if (FAILED(hr))
+		return hr;
+
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pFarDepthStencil);
+	if (FAILED(hr))
+		return hr;
+
+	return g_pd3dDevice->CreateDepthStencilView(g_pFarDepthStencil, nullptr, &g_pFarDepthStencilView);
+}
+
+void ReleaseFarLayer()
+{
+	SafeRelease(g_pFarDepthStencilView);
+	SafeRelease(g_pFarDepthStencil);
+	SafeRelease(g_pFarLayerSRV);
+	SafeRelease(g_pFarLayerRTV_Depth);
+	SafeRelease(g_pFarLayerRTV_Color);
+	SafeRelease(g_pFarLayerTexture);
+}
+
+//--------------------------------------------------------------------------------------
+// The depth readback, the copy target and the staging textures it is read through.  Only with a mono slice, there is no depth to read otherwise.
+//--------------------------------------------------------------------------------------
+HRESULT CreateDepthReadback()
+{
+	HRESULT hr;
+	if (!g_Permutation.monoSlice)
+		return S_OK;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_ScreenWidth;
+	desc.Height = g_ScreenHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pDepthReadbackTexture);
+	if (FAILED(hr))
+		return hr;
+	hr = g_pd3dDevice->CreateRenderTargetView(g_pDepthReadbackTexture, nullptr, &g_pDepthReadbackRTV);
+	if (FAILED(hr))
+		return hr;
+
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (UINT i = 0; i < g_DepthStagingCount; i++)
+	{
+		hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pDepthStaging[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+// Forget the copies in flight.  The workers may still be reading the mapped one.
+void DropDepthReadbacks()
+{
+	if (g_DepthStagingMapped >= 0)
+	{
+		if (g_DepthHistogramRunning)
+			g_DepthHistogram->Wait();
+		if (g_ComfortRunning)
+			g_ComfortAnalyzer->Wait();
+		g_pImmediateContext->Unmap(g_pDepthStaging[g_DepthStagingMapped], 0);
+		g_DepthStagingMapped = -1;
+		g_DepthHistogramRunning = g_ComfortRunning = false;
+	}
+	for (UINT i = 0; i < g_DepthStagingCount; i++)
+		g_DepthStagingPending[i] = false;
+}
+
+void ReleaseDepthReadback()
+{
+	DropDepthReadbacks();
+	for (UINT i = 0; i < g_DepthStagingCount; i++)
+		SafeRelease(g_pDepthStaging[i]);
+	SafeRelease(g_pDepthReadbackRTV);
+	SafeRelease(g_pDepthReadbackTexture);
+}
+
+//--------------------------------------------------------------------------------------
+// The stereo output formats, the single sample eye pair the Compose pass reads, and
+// the double width target for side by side and the K check.  Only when composing,
+// and the eye pair alone when recording the eyes.  With a lenticular panel the pair
+// holds every view, and the K check target is one wide.
+//--------------------------------------------------------------------------------------
+HRESULT CreateStereoOutput()
+{
+	HRESULT hr;
+	bool lenticular = LenticularOutput();
+	if (g_OutputFormat < 0 && !g_EyeRecorder && !lenticular)
+		return S_OK;
+
+	// Typeless, so the eyes can be resolved into it as UNORM and read as UINT.
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_ScreenWidth;
+	desc.Height = g_ScreenHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = g_Permutation.viewCount;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pEyePairTexture);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC descSRV;
+	ZeroMemory(&descSRV, sizeof(descSRV));
+	descSRV.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	ArrayViewDesc<false>::SRV(descSRV, 0, desc.ArraySize);
+	hr = g_pd3dDevice->CreateShaderResourceView(g_pEyePairTexture, &descSRV, &g_pEyePairSRV);
+	if (FAILED(hr) || (g_OutputFormat < 0 && !lenticular))
+		return hr;
+
+	desc.Width = lenticular ? g_ScreenWidth : g_ScreenWidth * 2;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pComposeTexture);
+	if (FAILED(hr))
+		return hr;
+
+	return g_pd3dDevice->CreateRenderTargetView(g_pComposeTexture, nullptr, &g_pComposeRTV);
+}
+
+void ReleaseStereoOutput()
+{
+	SafeRelease(g_pComposeRTV);
+	SafeRelease(g_pComposeTexture);
+	SafeRelease(g_pEyePairSRV);
+	SafeRelease(g_pEyePairTexture);
+}
+
+//--------------------------------------------------------------------------------------
+// The staging textures the eyes are recorded through, only while recording.
+//--------------------------------------------------------------------------------------
+HRESULT CreateEyeRecording()
+{
+	HRESULT hr;
+	if (!g_EyeRecorder)
+		return S_OK;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_ScreenWidth;
+	desc.Height = g_ScreenHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 2;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (UINT i = 0; i < g_EyeStagingCount; i++)
+	{
+		hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pEyeStaging[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	if (!g_Permutation.monoSlice)
+		return S_OK;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	for (UINT i = 0; i < g_EyeStagingCount; i++)
+	{
+		hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pEyeDepthStaging[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+void ReleaseEyeRecording()
+{
+	for (UINT i = 0; i < g_EyeStagingCount; i++)
+	{
+		SafeRelease(g_pEyeDepthStaging[i]);
+		SafeRelease(g_pEyeStaging[i]);
+		g_EyeStagingPending[i] = false;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// What the X check draws into, the left eye warped and as it was drawn, both single
+// sample, and the packed depth, a slice each.  Only with the mono slice.
+//--------------------------------------------------------------------------------------
+HRESULT CreateReprojection()
+{
+	HRESULT hr;
+	if (!g_Permutation.monoSlice)
+		return S_OK;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Width = g_ScreenWidth;
+	desc.Height = g_ScreenHeight;
+	desc.MipLevels = 1;
+	desc.ArraySize = 3;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &g_pReprojectCheckTexture);
+	if (FAILED(hr))
+		return hr;
+
+	for (UINT i = 0; i < 3; i++)
+	{
+		D3D11_RENDER_TARGET_VIEW_DESC descRTV;
+		ZeroMemory(&descRTV, sizeof(descRTV));
+		descRTV.Format = (i == 2) ? DXGI_FORMAT_R8G8B8A8_UINT : DXGI_FORMAT_R8G8B8A8_UNORM;
+		ArrayViewDesc<false>::RTV(descRTV, i, 1);
+		hr = g_pd3dDevice->CreateRenderTargetView(g_pReprojectCheckTexture, &descRTV, &g_pReprojectCheckRTV[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+void ReleaseReprojection()
+{
+	for (UINT i = 0; i < 3; i++)
+		SafeRelease(g_pReprojectCheckRTV[i]);
+	SafeRelease(g_pReprojectCheckTexture);
+	g_ReprojectionCheckPending = false;
+}
+
+HRESULT CreateViewport()
+{
+	g_Viewport.Width = (FLOAT)g_ScreenWidth;
+	g_Viewport.Height = (FLOAT)g_ScreenHeight;
+	g_Viewport.MinDepth = 0.0f;
+	g_Viewport.MaxDepth = 1.0f;
+	g_Viewport.TopLeftX = 0;
+	g_Viewport.TopLeftY = 0;
+	g_BackBufferViewport = g_Viewport;
+	g_DynamicResolution.Reset();
+
+	// Initialize the projection matrix
+	//
+	// For the projection matrix, the shaders know nothing about being in stereo, 
+	// so this needs to be only ScreenWidth, one per eye.
+	g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, (float)g_ScreenWidth / (float)g_ScreenHeight, 0.01f, g_DepthFar);
+
+	return S_OK;
+}
+
+HRESULT CreateFrameGraph()
+{
+	BuildFrameGraph();
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Register the size dependent groups, in creation order.
+//--------------------------------------------------------------------------------------
+struct DeviceResourceGroup
+{
+	HRESULT (*create)();
+	void (*release)();
+};
+
+std::vector<DeviceResourceGroup>	g_DeviceResourceGroups;
+
+int AddDeviceResourceGroup(const char* name, uint32_t params, uint64_t inputs, HRESULT (*create)(), void (*release)())
+{
+	DeviceResourceGroup group = { create, release };
+	g_DeviceResourceGroups.push_back(group);
+	return g_DeviceResources.Add(name, params, inputs);
+}
+
+void RegisterDeviceResources()
+{
+	g_DeviceResources = DependencyTracker();
+	g_DeviceResourceGroups.clear();
+
+	AddDeviceResourceGroup("BackBufferView", Param_Size, 0, CreateBackBufferView, ReleaseBackBufferView);
+	int offscreen = AddDeviceResourceGroup("OffscreenTexture", Param_Size | Param_Samples | Param_Slices, 0, CreateOffscreenTexture, ReleaseOffscreenTexture);
+	AddDeviceResourceGroup("OffscreenViews", 0, 1ull << offscreen, CreateOffscreenViews, ReleaseOffscreenViews);
+	AddDeviceResourceGroup("DepthStencil", Param_Size | Param_Samples | Param_Slices, 0, CreateDepthStencil, ReleaseDepthStencil);
+	AddDeviceResourceGroup("Viewport", Param_Size, 0, CreateViewport, nullptr);
+	AddDeviceResourceGroup("FarLayer", Param_Size | Param_Slices, 0, CreateFarLayer, ReleaseFarLayer);
+	AddDeviceResourceGroup("DepthReadback", Param_Size | Param_Slices, 0, CreateDepthReadback, ReleaseDepthReadback);
+	AddDeviceResourceGroup("StereoOutput", Param_Size | Param_Output, 0, CreateStereoOutput, ReleaseStereoOutput);
+	AddDeviceResourceGroup("EyeRecording", Param_Size | Param_Slices | Param_Output, 0, CreateEyeRecording, ReleaseEyeRecording);
+	AddDeviceResourceGroup("Reprojection", Param_Size | Param_Slices, 0, CreateReprojection, ReleaseReprojection);
+	AddDeviceResourceGroup("FrameGraph", Param_Size | Param_Samples | Param_Slices | Param_Output, 0, CreateFrameGraph, nullptr);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Release every dirty group, last first, then create them again in order.
+//--------------------------------------------------------------------------------------
+void ReleaseDirtyDeviceResources()
+{
+	for (int i = (int)g_DeviceResourceGroups.size() - 1; i >= 0; i--)
+		if (g_DeviceResources.nodes[i].dirty && g_DeviceResourceGroups[i].release)
+			g_DeviceResourceGroups[i].release();
+}
+
+HRESULT RebuildDeviceResources()
+{
+	// Nothing may still be bound when the back buffer is resized.
+	g_pImmediateContext->OMSetRenderTargets(0, nullptr, nullptr);
+	ReleaseDirtyDeviceResources();
+
+	for (size_t i = 0; i < g_DeviceResourceGroups.size(); i++)
+	{
+		if (!g_DeviceResources.nodes[i].dirty)
+			continue;
+
+		HRESULT hr = g_DeviceResourceGroups[i].create();
+		if (FAILED(hr))
+			return hr;
+	}
+
+	g_DeviceResources.Clean();
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The window, or the full-screen mode, changed size.
+//--------------------------------------------------------------------------------------
+HRESULT ResizeDevice(UINT width, UINT height)
+{
+	if (width == 0 || height == 0 || (width == g_ScreenWidth && height == g_ScreenHeight))
+		return S_OK;
+
+	g_ScreenWidth = width;
+	g_ScreenHeight = height;
+
+	// Still starting up, the first build will use the new size.  Leaving full screen in
+	// CleanupDevice sends WM_SIZE too, with the groups about to be released.
+	if (g_DeviceResourceGroups.empty() || g_TearingDown)
+		return S_OK;
+
+	double startMs = NowMs();
+	g_DeviceResources.Invalidate(Param_Size);
+	size_t rebuilt = g_DeviceResources.DirtyCount();
+
+	HRESULT hr = RebuildDeviceResources();
+	BindRhiObjects();
+
+	char msg[128];
+	sprintf_s(msg, "Resize: %ux%u, rebuilt %u of %u groups in %.2fms\n", width, height,
+		(UINT)rebuilt, (UINT)g_DeviceResourceGroups.size(), NowMs() - startMs);
+	OutputDebugStringA(msg);
+
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Make the D3D11 object for a compiled shader job.
+//--------------------------------------------------------------------------------------
+HRESULT CreateShader(ShaderId id, const ShaderJob& job, ID3D11DeviceChild** ppShader)
+{
+	const void* bytecode = job.bytecode.data();
+	SIZE_T size = job.bytecode.size();
+
+	switch (id)
+	{
+	case Shader_VS:
+	case Shader_QuadVS:
+		return g_pd3dDevice->CreateVertexShader(bytecode, size, nullptr, reinterpret_cast<ID3D11VertexShader**>(ppShader));
+	case Shader_GS:
+	case Shader_FarCompositeGS:
+		return g_pd3dDevice->CreateGeometryShader(bytecode, size, nullptr, reinterpret_cast<ID3D11GeometryShader**>(ppShader));
+	default:
+		return g_pd3dDevice->CreatePixelShader(bytecode, size, nullptr, reinterpret_cast<ID3D11PixelShader**>(ppShader));
+	}
+}
+
+HRESULT CreateInputLayout(const ShaderJob& vs, ID3D11InputLayout** ppLayout)
+{
+	// Define the input layout
+	D3D11_INPUT_ELEMENT_DESC layout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	UINT numElements = ARRAYSIZE(layout);
+
+	return g_pd3dDevice->CreateInputLayout(layout, numElements, vs.bytecode.data(), vs.bytecode.size(), ppLayout);
+}
+
+//--------------------------------------------------------------------------------------
+// Put a shader in its global, releasing the one it replaces.  Takes over the
+// reference.  The RHI handles follow on the next BindRhiObjects, which startup
+// tasks leave to the main thread, as they may run beside a rebuild.
+//--------------------------------------------------------------------------------------
+template <class T>
+void InstallShader(T*& pGlobal, ID3D11DeviceChild* pShader)
+{
+	SafeRelease(pGlobal);
+	pGlobal = static_cast<T*>(pShader);
+}
+
+void InstallShader(ShaderId id, ID3D11DeviceChild* pShader)
+{
+	switch (id)
+	{
+	case Shader_VS:			InstallShader(g_pVertexShader, pShader); break;
+	case Shader_GS:			InstallShader(g_pGeometryShader, pShader); break;
+	case Shader_PS:			InstallShader(g_pPixelShader, pShader); break;
+	case Shader_QuadVS:		InstallShader(g_pQuadVertexShader, pShader); break;
+	case Shader_QuadPS:		InstallShader(g_pQuadPixelShader, pShader); break;
+	case Shader_UpscalePS:	InstallShader(g_pUpscalePixelShader, pShader); break;
+	case Shader_FarPS:		InstallShader(g_pFarPixelShader, pShader); break;
+	case Shader_FarCompositeGS:	InstallShader(g_pFarCompositeGeometryShader, pShader); break;
+	case Shader_FarCompositePS:	InstallShader(g_pFarCompositePixelShader, pShader); break;
+	case Shader_DepthCopyPS:	InstallShader(g_pDepthCopyPixelShader, pShader); break;
+	case Shader_ComposePS:	InstallShader(g_pComposePixelShader, pShader); break;
+	case Shader_ReprojectPS:	InstallShader(g_pReprojectPixelShader, pShader); break;
+	case Shader_InterleavePS:	InstallShader(g_pInterleavePixelShader, pShader); break;
+	default:				break;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Hand new shader objects to the render thread.  A swap not taken yet is merged
+// into, newer shaders win.
+//--------------------------------------------------------------------------------------
+void PublishShaderSwap(const ShaderSwap& swap)
+{
+	std::lock_guard<std::mutex> lock(g_ShaderSwapLock);
+	ShaderSwap& pending = g_ShaderSwap;
+	for (UINT id = 0; id < Shader_Count; id++)
+	{
+		if (!swap.shaders[id])
+			continue;
+		if (!pending.shaders[id])
+			pending.count++;
+		SafeRelease(pending.shaders[id]);
+		pending.shaders[id] = swap.shaders[id];
+	}
+	if (swap.inputLayout)
+	{
+		SafeRelease(pending.inputLayout);
+		pending.inputLayout = swap.inputLayout;
+	}
+	if (!g_ShaderSwapReady)
+	{
+		pending.changeMs = swap.changeMs;
+		pending.deferred = swap.deferred;
+	}
+	pending.compileMs += swap.compileMs;
+	g_ShaderSwapReady.store(true, std::memory_order_release);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Runs on the watcher thread after a save.  Only the entry points whose source
+// changed are compiled, and only those whose bytecode then changed are swapped, so
+// editing a comment or QuadPS leaves the scene shaders alone.
+//--------------------------------------------------------------------------------------
+void ReloadShaders(double changeMs)
+{
+	std::vector<char> source;
+	if (FAILED(LoadShaderSource(g_ShaderFile, source)))
+		return;
+
+	// The watcher thread is the only one that looks at the hashes once it has started.
+	ShaderJob hashes[Shader_Count];
+	for (UINT id = 0; id < Shader_Count; id++)
+		hashes[id].entry = g_ShaderJobs[id].entry;
+	HashShaderSources(source, hashes, Shader_Count);
+
+	std::vector<ShaderJob> jobs;
+	std::vector<ShaderId> ids;
+	for (UINT id = 0; id < Shader_Count; id++)
+	{
+		if (hashes[id].sourceHash == g_ShaderJobs[id].sourceHash)
+			continue;
+		jobs.push_back(g_ShaderJobs[id]);
+		ids.push_back((ShaderId)id);
+	}
+	if (jobs.empty())
+	{
+		OutputDebugStringA("Hot reload: no entry points affected\n");
+		return;
+	}
+
+	double compileStartMs = WatchClockMs();
+	CompileShaders(source, g_ShaderSourceName, g_Permutation, jobs.data(), (UINT)jobs.size());
+
+	ShaderSwap swap = {};
+	swap.changeMs = changeMs;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		ShaderJob& job = jobs[j];
+		ShaderJob& current = g_ShaderJobs[ids[j]];
+		if (FAILED(job.hr))
+			continue;	// the compiler said why, the old shader stays
+
+		current.sourceHash = job.sourceHash;
+		if (job.bytecodeHash == current.bytecodeHash)
+			continue;
+
+		ID3D11DeviceChild* pShader = nullptr;
+		ID3D11InputLayout* pLayout = nullptr;
+		if (FAILED(CreateShader(ids[j], job, &pShader)) ||
+			(ids[j] == Shader_VS && FAILED(CreateInputLayout(job, &pLayout))))
+		{
+			SafeRelease(pShader);
+			continue;
+		}
+		current.bytecodeHash = job.bytecodeHash;
+		swap.shaders[ids[j]] = pShader;
+		if (pLayout)
+			swap.inputLayout = pLayout;
+		swap.count++;
+	}
+	swap.compileMs = WatchClockMs() - compileStartMs;
+
+	if (swap.count == 0)
+	{
+		OutputDebugStringA("Hot reload: no bytecode changed\n");
+		return;
+	}
+
+	PublishShaderSwap(swap);
+}
+
+//--------------------------------------------------------------------------------------
+// On the render thread, between frames.
+//--------------------------------------------------------------------------------------
+void ApplyShaderSwap()
+{
+	ShaderSwap swap;
+	{
+		std::lock_guard<std::mutex> lock(g_ShaderSwapLock);
+		swap = g_ShaderSwap;
+		g_ShaderSwap = ShaderSwap();
+		g_ShaderSwapReady.store(false, std::memory_order_relaxed);
+	}
+
+	char names[128] = "";
+	for (UINT id = 0; id < Shader_Count; id++)
+	{
+		if (!swap.shaders[id])
+			continue;
+		InstallShader((ShaderId)id, swap.shaders[id]);
+		strcat_s(names, " ");
+		strcat_s(names, g_ShaderJobs[id].entry);
+	}
+	if (swap.inputLayout)
+	{
+		SafeRelease(g_pVertexLayout);
+		g_pVertexLayout = swap.inputLayout;
+	}
+	BindRhiObjects();
+
+	char msg[256];
+	sprintf_s(msg, "%s:%s live %.1fms after %s, %.1fms compiling\n", swap.deferred ? "Deferred shaders" : "Hot reload",
+		names, WatchClockMs() - swap.changeMs, swap.deferred ? "startup" : "the save", swap.compileMs);
+	OutputDebugStringA(msg);
+}
+
+//--------------------------------------------------------------------------------------
+// Compile every shader that reads any of the PermutationOptions again, for a new
+// g_Permutation, on this thread, and install them.  Take the deferred shaders
+// before changing the permutation, they are compiled for the old one.
+//--------------------------------------------------------------------------------------
+HRESULT RecompileShaders(UINT options)
+{
+	std::vector<ShaderJob> jobs;
+	std::vector<ShaderId> ids;
+	for (UINT id = 0; id < Shader_Count; id++)
+	{
+		if (!(g_ShaderJobs[id].options & options))
+			continue;
+		jobs.push_back(g_ShaderJobs[id]);
+		ids.push_back((ShaderId)id);
+	}
+
+	HRESULT hr = CompileShaders(g_ShaderFile, g_ShaderSourceName, g_Permutation, jobs.data(), (UINT)jobs.size());
+	for (size_t j = 0; j < jobs.size() && SUCCEEDED(hr); j++)
+	{
+		ID3D11DeviceChild* pShader = nullptr;
+		hr = CreateShader(ids[j], jobs[j], &pShader);
+		if (SUCCEEDED(hr))
+			InstallShader(ids[j], pShader);
+	}
+	return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Point the RHI handles at the current D3D11 objects.  Handles stay the same when
+// objects are made again, so this is run after every rebuild.
+//--------------------------------------------------------------------------------------
+void BindRhiObjects()
+{
+	g_Rhi.context = g_pImmediateContext;
+	g_Rhi.stereo = g_StereoHandle;
+
+	g_Rhi.textures.Bind(g_hBackBuffer, g_pBackBuffer);
+	g_Rhi.textures.Bind(g_hOffscreenTexture, g_pOffscreenTexture);
+	g_Rhi.renderTargets.Bind(g_hRenderTargetView, g_pRenderTargetView);
+	g_Rhi.renderTargets.Bind(g_hOffscreenTextureView, g_pOffscreenTextureView);
+	g_Rhi.renderTargets.Bind(g_hOffscreenRTV_Color, g_pOffscreenRTV_Color);
+	g_Rhi.renderTargets.Bind(g_hOffscreenRTV_Depth, g_pOffscreenRTV_Depth);
+	g_Rhi.depthTargets.Bind(g_hDepthStencilView, g_pDepthStencilView);
+	g_Rhi.shaderViews.Bind(g_hPackedDepthTextureSRV, g_pPackedDepthTextureSRV);
+	g_Rhi.shaderViews.Bind(g_hOffscreenColorSRV, g_pOffscreenColorSRV);
+	g_Rhi.buffers.Bind(g_hVertexBuffer, g_pVertexBuffer);
+	g_Rhi.buffers.Bind(g_hIndexBuffer, g_pIndexBuffer);
+	g_Rhi.buffers.Bind(g_hSharedCB, g_pSharedCB);
+	g_Rhi.buffers.Bind(g_hResolveCB, g_pResolveCB);
+	g_Rhi.inputLayouts.Bind(g_hVertexLayout, g_pVertexLayout);
+	g_Rhi.vertexShaders.Bind(g_hVertexShader, g_pVertexShader);
+	g_Rhi.vertexShaders.Bind(g_hQuadVertexShader, g_pQuadVertexShader);
+	g_Rhi.geometryShaders.Bind(g_hGeometryShader, g_pGeometryShader);
+	g_Rhi.pixelShaders.Bind(g_hPixelShader, g_pPixelShader);
+	g_Rhi.pixelShaders.Bind(g_hQuadPixelShader, g_pQuadPixelShader);
+	g_Rhi.pixelShaders.Bind(g_hUpscalePixelShader, g_pUpscalePixelShader);
+	g_Rhi.renderTargets.Bind(g_hFarLayerRTV_Color, g_pFarLayerRTV_Color);
+	g_Rhi.renderTargets.Bind(g_hFarLayerRTV_Depth, g_pFarLayerRTV_Depth);
+	g_Rhi.shaderViews.Bind(g_hFarLayerSRV, g_pFarLayerSRV);
+	g_Rhi.depthTargets.Bind(g_hFarDepthStencilView, g_pFarDepthStencilView);
+	g_Rhi.pixelShaders.Bind(g_hFarPixelShader, g_pFarPixelShader);
+	g_Rhi.geometryShaders.Bind(g_hFarCompositeGeometryShader, g_pFarCompositeGeometryShader);
+	g_Rhi.pixelShaders.Bind(g_hFarCompositePixelShader, g_pFarCompositePixelShader);
+	g_Rhi.textures.Bind(g_hDepthReadbackTexture, g_pDepthReadbackTexture);
+	g_Rhi.renderTargets.Bind(g_hDepthReadbackRTV, g_pDepthReadbackRTV);
+	g_Rhi.pixelShaders.Bind(g_hDepthCopyPixelShader, g_pDepthCopyPixelShader);
+	g_Rhi.textures.Bind(g_hEyePairTexture, g_pEyePairTexture);
+	g_Rhi.shaderViews.Bind(g_hEyePairSRV, g_pEyePairSRV);
+	g_Rhi.renderTargets.Bind(g_hComposeRTV, g_pComposeRTV);
+	g_Rhi.pixelShaders.Bind(g_hComposePixelShader, g_pComposePixelShader);
+	g_Rhi.pixelShaders.Bind(g_hInterleavePixelShader, g_pInterleavePixelShader);
+	g_Rhi.buffers.Bind(g_hReprojectCB, g_pReprojectCB);
+	g_Rhi.pixelShaders.Bind(g_hReprojectPixelShader, g_pReprojectPixelShader);
+	for (UINT i = 0; i < 3; i++)
+		g_Rhi.renderTargets.Bind(g_hReprojectCheckRTV[i], g_pReprojectCheckRTV[i]);
+	for (UINT i = 0; i < g_DepthStagingCount; i++)
+		g_Rhi.textures.Bind(g_hDepthStaging[i], g_pDepthStaging[i]);
+	for (UINT i = 0; i < g_EyeStagingCount; i++)
+	{
+		g_Rhi.textures.Bind(g_hEyeStaging[i], g_pEyeStaging[i]);
+		g_Rhi.textures.Bind(g_hEyeDepthStaging[i], g_pEyeDepthStaging[i]);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the Direct3D device, and settle the permutation for it.
+//--------------------------------------------------------------------------------------
+HRESULT CreateDevice()
+{
+	HRESULT hr = S_OK;
+
+	UINT createDeviceFlags = 0;
+#ifdef _DEBUG
+	createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
+#endif
+
+	// Create the simple DX11, Device, and Context.
+	hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, createDeviceFlags, nullptr, 0,
+		D3D11_SDK_VERSION, &g_pd3dDevice, nullptr, &g_pImmediateContext);
+	if (FAILED(hr))
+		return hr;
+
+	// Partial constant buffer updates need the 11.1 context and the driver to say so.
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(g_pImmediateContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&g_Rhi.context1))) &&
+		SUCCEEDED(g_pd3dDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+	{
+		g_CbPartialUpdates = (options.ConstantBufferPartialUpdate != FALSE);
+	}
+	g_Rhi.partialUpdates = g_CbPartialUpdates;
+	g_SharedCBValid = false;
+
+	g_SampleDesc.Count = 1;
+	g_SampleDesc.Quality = 0;
+	UINT numQualityLevels;
+	//*
+	if (SUCCEEDED(g_pd3dDevice->CheckMultisampleQualityLevels(DXGI_FORMAT_B8G8R8A8_UNORM, 4, &numQualityLevels)))
+	{
+		g_SampleDesc.Count = 4;
+		g_SampleDesc.Quality = numQualityLevels - 1;
+	}//*/
+	g_MaxSampleCount = g_SampleDesc.Count;
+	g_MaxSampleQuality = g_SampleDesc.Quality;
+	g_SampleCount = g_SampleDesc.Count;
+	SelectPermutation(g_SampleCount);
+	g_EyeCopyPath = SelectEyeCopyPath(g_SampleCount);
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// For DX11 3D, it's required that we run in exclusive full-screen mode, otherwise 3D
+// Vision will not activate.  DXGI sends the window messages here, so this stays on
+// the thread that owns the window.
+//--------------------------------------------------------------------------------------
+HRESULT EnterFullScreen()
+{
+	HRESULT hr = CreateSwapChain();
+	if (FAILED(hr))
+		return hr;
+
+	return g_pSwapChain->SetFullscreenState(TRUE, nullptr);
+}
+
+
+//--------------------------------------------------------------------------------------
+// The first build of the size dependent groups, once the full-screen size is known.
+//--------------------------------------------------------------------------------------
+HRESULT CreateSizeDependentResources()
+{
+	RegisterDeviceResources();
+	g_DeviceResources.InvalidateAll();
+	return RebuildDeviceResources();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Compile the shaders the first frame draws with.  The quad shaders are left to
+// CreateDeferredShaders.  The device is not needed to compile, and none of these read
+// the options it decides, so this starts at once.
+//--------------------------------------------------------------------------------------
+HRESULT CompileSceneShaders(const ShaderPermutation& permutation)
+{
+	HRESULT hr = CompileShaders(g_ShaderFile, g_ShaderSourceName, permutation, g_ShaderJobs, Shader_QuadPS);
+	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+		return hr;
+	}
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the scene shaders, and the input layout that goes with the vertex shader.
+//--------------------------------------------------------------------------------------
+HRESULT CreateSceneShaders()
+{
+	HRESULT hr = S_OK;
+
+	for (UINT id = 0; id < Shader_QuadPS; id++)
+	{
+		ID3D11DeviceChild* pShader = nullptr;
+		hr = CreateShader((ShaderId)id, g_ShaderJobs[id], &pShader);
+		if (FAILED(hr))
+			return hr;
+		InstallShader((ShaderId)id, pShader);
+	}
+
+	hr = CreateInputLayout(g_ShaderJobs[Shader_VS], &g_pVertexLayout);
+	if (FAILED(hr))
+		return hr;
+
+	// The bytecode is not needed once the shaders are made.
+	for (UINT id = 0; id < Shader_QuadPS; id++)
+		std::vector<uint8_t>().swap(g_ShaderJobs[id].bytecode);
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the cube's vertex and index buffers, and the constant buffers.
+//--------------------------------------------------------------------------------------
+HRESULT CreateSceneBuffers()
+{
+	HRESULT hr = S_OK;
+
+	// Create vertex buffer for the cube
+	SimpleVertex vertices[] =
+	{
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 0.0f) },
+
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+
+		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
+		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 0.0f) },
+		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) },
+	};
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(SimpleVertex) * 24;
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = 0;
+	D3D11_SUBRESOURCE_DATA InitData;
+	ZeroMemory(&InitData, sizeof(InitData));
+	InitData.pSysMem = vertices;
+	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// Create index buffer
+	// Create vertex buffer
+	WORD indices[] =
+	{
+		3, 1, 0,
+		2, 1, 3,
+
+		6, 4, 5,
+		7, 4, 6,
+
+		11, 9, 8,
+		10, 9, 11,
+
+		14, 12, 13,
+		15, 12, 14,
+
+		19, 17, 16,
+		18, 17, 19,
+
+		22, 20, 21,
+		23, 20, 22
+	};
+
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(WORD) * 36;
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bd.CPUAccessFlags = 0;
+	InitData.pSysMem = indices;
+	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pIndexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+
+	// Create the constant buffer
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(SharedCB);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pSharedCB);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = sizeof(ResolveCB);
+	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pResolveCB);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = sizeof(ReprojectCB);
+	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pReprojectCB);
+	if (FAILED(hr))
+		return hr;
+
+	// Initialize the world matrix
+	g_World = XMMatrixIdentity();
+
+	// Initialize the view matrix
+	XMVECTOR Eye = XMVectorSet(0.0f, 3.0f, -6.0f, 0.0f);
+	XMVECTOR At = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMVECTOR Up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	g_View = XMMatrixLookAtLH(Eye, At, Up);
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The scopes outside the frame graph, and the GPU queries.  The passes add theirs in
+// BuildFrameGraph.  Scopes are added on the main thread only.
+//--------------------------------------------------------------------------------------
+void RegisterFrameTimers()
+{
+	if (!g_FrameTimingEnabled)
+		return;
+
+	g_TimerFrame = g_FrameTiming.AddScope("Frame");
+	g_TimerWait = g_FrameTiming.AddScope("Wait");
+	g_TimerCompile = g_FrameTiming.AddScope("Compile");
+	g_TimerSubmit = g_FrameTiming.AddScope("Submit");
+	g_TimerPresent = g_FrameTiming.AddScope("Present");
+}
+
+HRESULT CreateGpuTimers()
+{
+	if (!g_FrameTimingEnabled)
+		return S_OK;
+
+	return g_Rhi.timers.Create(g_pd3dDevice, &g_FrameTiming);
+}
+
+
+//--------------------------------------------------------------------------------------
+// The quad shaders only draw the depth view and the upscaled eyes, and the first
+// frame needs neither, so they are compiled after startup on g_DeferredThread, and go
+// live through the same swap as a hot reload.  Until then the depth view stays off
+// and dynamic resolution holds full scale.  The shader watcher starts after, as it
+// shares the job hashes with this.
+//--------------------------------------------------------------------------------------
+void CreateDeferredShaders()
+{
+	double startMs = g_StartupTrace.NowMs();
+
+	ShaderSwap swap = {};
+	swap.changeMs = WatchClockMs();
+	swap.deferred = true;
+
+	CompileShaders(g_ShaderFile, g_ShaderSourceName, g_Permutation, &g_ShaderJobs[Shader_QuadPS], Shader_Count - Shader_QuadPS);
+	for (UINT id = Shader_QuadPS; id < Shader_Count; id++)
+	{
+		ShaderJob& job = g_ShaderJobs[id];
+		if (SUCCEEDED(job.hr) && SUCCEEDED(CreateShader((ShaderId)id, job, &swap.shaders[id])))
+			swap.count++;
+		std::vector<uint8_t>().swap(job.bytecode);
+	}
+	swap.compileMs = WatchClockMs() - swap.changeMs;
+	ReportShaderPermutations(g_ShaderJobs, Shader_Count);
+
+	if (swap.count)
+		PublishShaderSwap(swap);
+
+	g_StartupTrace.Add("CreateDeferredShaders", "deferred", g_StartupWorkers + 1, startMs, g_StartupTrace.NowMs());
+#ifdef PROFILE
+	g_StartupTrace.Write(g_StartupTraceFile);
+#endif
+
+	if (g_ShaderHotReload)
+		g_ShaderWatcher.Start(g_ShaderSourceName, ReloadShaders);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bring up the window, stereo and the device as a graph of tasks, rather than one
+// after the other.
+//
+// The scene shaders compile while NvAPI loads and the device and swap chain are
+// made.  The buffers and shader objects are made on workers beside the size
+// dependent resources.  The window, the full-screen switch and the first rebuild,
+// which uses the immediate context, are held to the main thread, and only the main
+// thread binds the RHI handles, at the end.  ActivateStereo waits for full screen, as
+// it always followed it.
+//--------------------------------------------------------------------------------------
+HRESULT Startup(HINSTANCE hInstance, int nCmdShow)
+{
+	ChromeTrace& trace = g_StartupTrace;
+	double startMs = trace.NowMs();
+
+	HRESULT hr = S_OK;
+	std::mutex hrLock;
+	auto step = [&](HRESULT result)
+	{
+		if (FAILED(result))
+		{
+			std::lock_guard<std::mutex> lock(hrLock);
+			if (SUCCEEDED(hr))
+				hr = result;
+		}
+		return SUCCEEDED(result);
+	};
+
+	RegisterFrameTimers();
+
+	// Copied, as CreateDevice settles the MSAA option while the compile runs.
+	ShaderPermutation scenePermutation = g_Permutation;
+
+	TaskGraph graph;
+	int window = graph.Add("InitWindow", [&] { return step(InitWindow(hInstance, nCmdShow)); }, {}, true);
+	int stereo = graph.Add("InitStereo", [&] { return step(InitStereo()); });
+	int compile = graph.Add("CompileSceneShaders", [&] { return step(CompileSceneShaders(scenePermutation)); });
+	int device = graph.Add("CreateDevice", [&] { return step(CreateDevice()); }, { stereo });
+	int fullScreen = graph.Add("EnterFullScreen", [&] { return step(EnterFullScreen()); }, { window, device }, true);
+	int activate = graph.Add("ActivateStereo", [&] { return step(ActivateStereo()); }, { fullScreen });
+	int sized = graph.Add("CreateSizeDependentResources", [&] { return step(CreateSizeDependentResources()); }, { fullScreen }, true);
+	int buffers = graph.Add("CreateSceneBuffers", [&] { return step(CreateSceneBuffers()); }, { device });
+	int shaders = graph.Add("CreateSceneShaders", [&] { return step(CreateSceneShaders()); }, { device, compile });
+	int timers = graph.Add("CreateGpuTimers", [&] { return step(CreateGpuTimers()); }, { device });
+	graph.Add("BindRhiObjects", [] { BindRhiObjects(); return true; }, { activate, sized, buffers, shaders, timers }, true);
+
+	UINT workers = min(g_StartupWorkers, max(2u, std::thread::hardware_concurrency()) - 1);
+	graph.Run(workers, &trace, "startup");
+	trace.NameThread(g_StartupWorkers + 1, "Deferred");
+
+	char msg[256];
+	int failed = graph.Failed();
+	if (failed >= 0)
+	{
+		sprintf_s(msg, "Startup: %s failed, 0x%08x\n", graph[failed].name, (UINT)hr);
+		OutputDebugStringA(msg);
+#ifdef PROFILE
+		trace.Write(g_StartupTraceFile);
+#endif
+		return FAILED(hr) ? hr : E_FAIL;
+	}
+
+	double taskMs = 0.0;
+	for (size_t i = 0; i < graph.Size(); i++)
+		taskMs += graph[i].endMs - graph[i].startMs;
+
+	std::vector<int> path;
+	double pathMs = graph.CriticalPath(&path);
+	sprintf_s(msg, "Startup: %.1fms on %u threads, %.1fms of tasks, critical path %.1fms:",
+		trace.NowMs() - startMs, workers + 1, taskMs, pathMs);
+	OutputDebugStringA(msg);
+	for (int task : path)
+	{
+		sprintf_s(msg, " %s %.1fms", graph[task].name, graph[task].endMs - graph[task].startMs);
+		OutputDebugStringA(msg);
+	}
+	OutputDebugStringA("\n");
+
+	g_DeferredThread = std::thread(CreateDeferredShaders);
+
+	return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Clean up the objects we've created
+//--------------------------------------------------------------------------------------
+void CleanupDevice()
+{
+	g_TearingDown = true;
+	if (g_pSwapChain) g_pSwapChain->SetFullscreenState(FALSE, nullptr);
+
+	// The deferred shaders and the watcher make shaders on the device, so they stop
+	// first, in that order, as the deferred thread starts the watcher.
+	if (g_DeferredThread.joinable())
+		g_DeferredThread.join();
+	g_ShaderWatcher.Stop();
+	for (ID3D11DeviceChild*& pShader : g_ShaderSwap.shaders)
+		SafeRelease(pShader);
+	SafeRelease(g_ShaderSwap.inputLayout);
+
+	// The copies in flight go to the writer, which finishes the file.
+	StopEyeRecording();
+
+	if (g_pImmediateContext) g_pImmediateContext->ClearState();
+	SafeRelease(g_Rhi.context1);
+	g_Rhi.partialUpdates = false;
+	g_Rhi.shadows.clear();
+	g_Rhi.timers.Release();
+
+	if (g_pSharedCB) g_pSharedCB->Release();
+	if (g_pResolveCB) g_pResolveCB->Release();
+	if (g_pReprojectCB) g_pReprojectCB->Release();
+	if (g_pVertexBuffer) g_pVertexBuffer->Release();
+	if (g_pIndexBuffer) g_pIndexBuffer->Release();
+	if (g_pVertexLayout) g_pVertexLayout->Release();
+
+	if (g_pVertexShader) g_pVertexShader->Release();
+	if (g_pPixelShader) g_pPixelShader->Release();
+	if (g_pUpscalePixelShader) g_pUpscalePixelShader->Release();
+	if (g_pFarPixelShader) g_pFarPixelShader->Release();
+	if (g_pFarCompositeGeometryShader) g_pFarCompositeGeometryShader->Release();
+	if (g_pFarCompositePixelShader) g_pFarCompositePixelShader->Release();
+	if (g_pDepthCopyPixelShader) g_pDepthCopyPixelShader->Release();
+	if (g_pComposePixelShader) g_pComposePixelShader->Release();
+	if (g_pInterleavePixelShader) g_pInterleavePixelShader->Release();
+	if (g_pReprojectPixelShader) g_pReprojectPixelShader->Release();
+
+	// All of the size dependent groups
+	g_DeviceResources.InvalidateAll();
+	ReleaseDirtyDeviceResources();
+
+	if (g_pSwapChain) g_pSwapChain->Release();
+	if (g_pImmediateContext) g_pImmediateContext->Release();
+	if (g_pd3dDevice) g_pd3dDevice->Release();
+
+	if (g_StereoHandle) NvAPI_Stereo_DestroyHandle(g_StereoHandle);
+
+	if (g_FrameLatencyWaitableObject) CloseHandle(g_FrameLatencyWaitableObject);
+
+	if (g_LatencyLog) fclose(g_LatencyLog);
+	if (g_LowLatencyMode) timeEndPeriod(1);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Called every time the application receives a message
+//--------------------------------------------------------------------------------------
+LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	PAINTSTRUCT ps;
+	HDC hdc;
+
+	switch (message)
+	{
+	case WM_PAINT:
+		hdc = BeginPaint(hWnd, &ps);
+		EndPaint(hWnd, &ps);
+		break;
+
+	case WM_DESTROY:
+		PostQuitMessage(0);
+		break;
+
+	case WM_SIZE:
+		// Only what depends on the size is rebuilt.
+		if (wParam != SIZE_MINIMIZED && FAILED(ResizeDevice(LOWORD(lParam), HIWORD(lParam))))
+			PostQuitMessage(0);
+		break;
+
+	case WM_KEYDOWN:
+		// A held key repeats, and every key here toggles or starts something, so
+		// only the first press counts.
+		if (lParam & (1 << 30))
+			break;
+
+		// L toggles the low latency frame start.  It sleeps to within a ms of the
+		// frame start, so it needs the 1ms timer period while it is on.
+		if (wParam == 'L')
+		{
+			g_LowLatencyMode = !g_LowLatencyMode;
+			if (g_LowLatencyMode)
+				timeBeginPeriod(1);
+			else
+				timeEndPeriod(1);
+		}
+#ifdef PROFILE
+		// B measures the lists of the next frames against the null backend.
+		if (wParam == 'B')
+			StartRhiBenchmark();
+#endif
+		if (wParam == 'C')
+			StartCapture();
+		if (wParam == 'R')
+			ToggleReplay();
+		if (wParam == 'F')
+			g_FarFieldEnabled = !g_FarFieldEnabled;
+		if (wParam == 'A')
+			ToggleAutoConvergence();
+		if (wParam == 'V')
+			ToggleComfortAnalysis();
+		if (wParam == 'O')
+			CycleOutputFormat();
+		if (wParam == 'N')
+			CycleViewCount();
+		if (wParam == 'K' && (g_OutputFormat >= 0 || LenticularOutput()))
+			g_ComposeCheckRequested = true;
+		if (wParam == 'E')
+			ToggleEyeRecording();
+		if (wParam == 'W')
+			ToggleReprojection();
+		if (wParam == 'X')
+			RequestReprojectionCheck();
+		if (wParam == 'D')
+			CycleSuppression();
+		break;
+
+	default:
+		return DefWindowProc(hWnd, message, wParam, lParam);
+	}
+
+	return 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Pack a depth into the 4 channels of a UINT target, the same as packDepth does
+// for each DEPTH_PACKING.
+//--------------------------------------------------------------------------------------
+template <DepthPacking Packing> void PackDepth(FLOAT depth, FLOAT* out);
+
+template <> void PackDepth<DepthPack_Float>(FLOAT depth, FLOAT* out)
+{
+	DWORD dw = *(DWORD*)&depth;
+	out[0] = (FLOAT)(dw & 255); out[1] = (FLOAT)((dw >> 8) & 255); out[2] = (FLOAT)((dw >> 16) & 255); out[3] = (FLOAT)(dw >> 24);
+}
+
+template <> void PackDepth<DepthPack_Unorm24>(FLOAT depth, FLOAT* out)
+{
+	FLOAT unorm = min(max(depth / g_DepthFar, 0.0f), 1.0f);
+	DWORD dw = (DWORD)(unorm * 16777215.0f + 0.5f);
+	out[0] = (FLOAT)(dw & 255); out[1] = (FLOAT)((dw >> 8) & 255); out[2] = (FLOAT)((dw >> 16) & 255); out[3] = 255.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// Settle the permutation for this device.  Everything the options decide that does
+// not change per frame is worked out here, so the passes do not look at them.
+//--------------------------------------------------------------------------------------
+void SelectPermutation(UINT sampleCount)
+{
+	g_Permutation.msaaSamples = sampleCount;
+
+	if (g_Permutation.depthPacking == DepthPack_Unorm24)
+		PackDepth<DepthPack_Unorm24>(g_DepthFar, g_PackedDepthClear);
+	else
+		PackDepth<DepthPack_Float>(FLT_MAX, g_PackedDepthClear);
+}
+
+//--------------------------------------------------------------------------------------
+// Feed the last frame time to the dynamic resolution controller, and size the scene
+// viewport inside the offscreen slices to match.
+//--------------------------------------------------------------------------------------
+void UpdateDynamicResolution()
+{
+	double nowMs = NowMs();
+
+	// Time spent blocked on the swap chain, or held back for latency, is not work.
+	g_LastFrameWorkMs = (g_LastFrameMs != 0.0) ? (float)(nowMs - g_LastFrameMs - g_FrameWaitMs) : 0.0f;
+
+	// Below full scale needs UpscalePS, which comes after startup.  The composer,
+	// the interleaver and the eye recording read whole eyes.  A warped frame says
+	// nothing of what drawing costs.
+	if (g_DynamicResolutionEnabled && g_LastFrameMs != 0.0 && g_pUpscalePixelShader && g_OutputFormat < 0 && !g_EyeRecorder &&
+		!LenticularOutput() && !g_ReprojectionWarp)
+	{
+		float scale = g_DynamicResolution.Update(g_LastFrameWorkMs);
+
+		g_Viewport.Width = floorf(g_BackBufferViewport.Width * scale);
+		g_Viewport.Height = floorf(g_BackBufferViewport.Height * scale);
+	}
+	g_LastFrameMs = nowMs;
+}
+
+//--------------------------------------------------------------------------------------
+// Upload only the registers of cbShared that changed since the last upload.  The
+// cube turns every frame, but the view, the projection and the stereo parameters
+// mostly stand still.
+//--------------------------------------------------------------------------------------
+void UploadSharedCB(const SharedCB& cb)
+{
+	uint32_t begin = 0;
+	uint32_t end = sizeof(cb);
+	if (g_SharedCBValid && !CbDirtyRange(&g_SharedCBUploaded, &cb, SharedCB_Fields, SharedCB_FieldCount, &begin, &end))
+		return;
+
+	if (g_SharedCBValid && g_CbPartialUpdates)
+		g_CommandList.UpdateBufferRange(g_hSharedCB, begin, (const uint8_t*)&cb + begin, end - begin);
+	else
+		g_CommandList.UpdateBuffer(g_hSharedCB, &cb, sizeof(cb));
+
+	g_SharedCBUploaded = cb;
+	g_SharedCBValid = true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Where each cube is, in rows going away from the camera.  A single one is at the
+// origin, as ever.  Each turns about its own center.
+//--------------------------------------------------------------------------------------
+XMVECTOR ObjectPosition(UINT i)
+{
+	UINT columns = (UINT)ceilf(sqrtf((float)g_ObjectCount));
+	float x = ((float)(i % columns) - (columns - 1) * 0.5f) * 3.0f;
+	float z = (float)(i / columns) * 3.0f;
+	return XMVectorSet(x, 0.0f, z, 1.0f);
+}
+
+//--------------------------------------------------------------------------------------
+// Read the stereo parameters for the frame, and split the cubes into the near ones
+// and those for the far layer.  Their bounds do not depend on the turn, so this runs
+// before the frame graph is compiled.  The turn is latched later, by the first pass
+// that draws cubes.
+//--------------------------------------------------------------------------------------
+void UpdateFarField()
+{
+	float pConvergence = 0;
+	float pSeparationPercentage = 0;
+	float pEyeSeparation = 0;
+
+	if (g_StereoHandle)
+	{
+		NvAPI_Stereo_GetConvergence(g_StereoHandle, &pConvergence);
+		NvAPI_Stereo_GetSeparation(g_StereoHandle, &pSeparationPercentage);
+		NvAPI_Stereo_GetEyeSeparation(g_StereoHandle, &pEyeSeparation);
+	}
+	float separation = pEyeSeparation * pSeparationPercentage / 100;
+	g_EyeSeparation = pEyeSeparation;
+
+	g_FarFieldObjects.resize(g_ObjectCount);
+	g_FarObjects.resize(g_ObjectCount);
+	for (UINT i = 0; i < g_ObjectCount; i++)
+	{
+		// w is view space z with this projection.
+		float w = XMVectorGetZ(XMVector3TransformCoord(ObjectPosition(i), g_View));
+		g_FarFieldObjects[i].nearW = w - g_ObjectRadius;
+		g_FarFieldObjects[i].farW = w + g_ObjectRadius;
+		g_FarFieldObjects[i].triangles = 12;
+	}
+
+	// The outer views are the furthest apart, and the split has to hold for them.
+	UINT views = g_Permutation.viewCount;
+	FarFieldView view = { separation * (views - 1), pConvergence, g_Viewport.Width, g_FarFieldThresholdPx };
+	g_FarField = ClassifyFarField(view, g_FarFieldObjects.data(), g_ObjectCount, g_FarObjects.data(), g_FarFieldOrder);
+
+	// The far passes need the deferred shaders, until then every cube is near.
+	bool farLayer = g_FarFieldEnabled && g_FarField.farObjects && g_pFarPixelShader && g_pFarCompositeGeometryShader &&
+		g_pFarCompositePixelShader;
+	if (!farLayer)
+	{
+		std::fill(g_FarObjects.begin(), g_FarObjects.end(), (uint8_t)0);
+		g_FarField.nearObjects += g_FarField.farObjects;
+		g_FarField.nearTriangles += g_FarField.farTriangles;
+		g_FarField.farObjects = 0;
+		g_FarField.farTriangles = 0;
+	}
+
+	FrameGraph& g = g_FrameGraph;
+	g.passes[g_FgFarField].enabled = farLayer;
+	g.passes[g_FgFarComposite].enabled = farLayer;
+
+	// Left eye, right eye and mono with two views.
+	float shift = FarFieldShiftPx(g_FarField, separation, pConvergence, g_Viewport.Width);
+	MultiviewStereoParams(separation, pConvergence, shift, views, reinterpret_cast<float (*)[4]>(g_StereoParams));
+
+	UINT slices = g_Permutation.SliceCount();
+	g_FarFieldTriangles += (g_FarField.nearTriangles + g_FarField.farTriangles) * slices;
+	g_FarFieldSavedTriangles += g_FarField.farTriangles * (slices - 1);
+}
+
+//--------------------------------------------------------------------------------------
+// Sum up a comfort analysis, and say when its flags change.
+//--------------------------------------------------------------------------------------
+void RecordComfortReport(UINT64 frame)
+{
+	const ComfortReport& report = g_ComfortAnalyzer->Report();
+	if (g_ComfortAnalyses == 0 || report.minDisparityPx < g_ComfortMinPx)
+		g_ComfortMinPx = report.minDisparityPx;
+	if (g_ComfortAnalyses == 0 || report.maxDisparityPx > g_ComfortMaxPx)
+		g_ComfortMaxPx = report.maxDisparityPx;
+	for (UINT flag = 0; flag < 4; flag++)
+		g_ComfortFlagged[flag] += (report.flags & (1 << flag)) ? 1 : 0;
+	g_ComfortMs += report.ms;
+	g_ComfortAnalyses++;
+
+	if (report.flags != g_ComfortFlags)
+	{
+		char msg[256];
+		sprintf_s(msg, "Comfort: frame %llu,%s%s%s%s%s in %u of %u tiles, disparity %.1f to %.1fpx\n", frame,
+			report.flags ? "" : " within the limits",
+			(report.flags & Comfort_Divergence) ? " divergence" : "", (report.flags & Comfort_Crossed) ? " crossed" : "",
+			(report.flags & Comfort_Window) ? " window" : "", (report.flags & Comfort_Jump) ? " jump" : "",
+			report.flaggedTiles, report.tiles, report.minDisparityPx, report.maxDisparityPx);
+		OutputDebugStringA(msg);
+		g_ComfortFlags = report.flags;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Finish with the mapped copy once its readers are done, map the oldest copy the
+// GPU has finished and start them on it, and decide whether this frame copies the
+// depth out again.
+//--------------------------------------------------------------------------------------
+void UpdateDepthReadback()
+{
+	g_DepthStagingNext = -1;
+	if (g_FgDepthReadback < 0)
+		return;
+	FrameGraph& g = g_FrameGraph;
+	g.passes[g_FgDepthReadback].enabled = false;
+
+	bool histogram = g_AutoConvergenceEnabled && g_StereoHandle;
+	if (!histogram && !g_ComfortEnabled)
+		return;
+	if (g_ComfortEnabled && !g_ComfortAnalyzer)
+		g_ComfortAnalyzer.reset(new ComfortAnalyzer(g_ComfortThreads, false));
+
+	if (g_DepthStagingMapped >= 0 && !(g_DepthHistogramRunning && g_DepthHistogram->Busy()) &&
+		!(g_ComfortRunning && g_ComfortAnalyzer->Busy()))
+	{
+		if (g_DepthHistogramRunning)
+		{
+			g_DepthHistogram->Wait();
+			g_ConvergenceController.Update(*g_DepthHistogram);
+			g_DepthHistograms++;
+		}
+		if (g_ComfortRunning)
+		{
+			g_ComfortAnalyzer->Wait();
+			RecordComfortReport(g_DepthStagingFrame[g_DepthStagingMapped]);
+		}
+		g_pImmediateContext->Unmap(g_pDepthStaging[g_DepthStagingMapped], 0);
+		g_DepthStagingPending[g_DepthStagingMapped] = false;
+		g_DepthStagingMapped = -1;
+		g_DepthHistogramRunning = g_ComfortRunning = false;
+	}
+
+	// The oldest copy first.  Still being drawn and it waits for a later frame.
+	if (g_DepthStagingMapped < 0)
+	{
+		int oldest = -1;
+		for (UINT i = 0; i < g_DepthStagingCount; i++)
+		{
+			if (g_DepthStagingPending[i] && (oldest < 0 || g_DepthStagingFrame[i] < g_DepthStagingFrame[oldest]))
+				oldest = (int)i;
+		}
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (oldest >= 0 &&
+			g_pImmediateContext->Map(g_pDepthStaging[oldest], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) == S_OK)
+		{
+			const D3D11_VIEWPORT& vp = g_DepthStagingViewport[oldest];
+			uint32_t width = (uint32_t)vp.Width;
+			uint32_t height = (uint32_t)vp.Height;
+			DepthEncoding encoding = (g_Permutation.depthPacking == DepthPack_Unorm24) ? DepthEncoding_Unorm24 : DepthEncoding_Float;
+			if (histogram)
+			{
+				g_DepthHistogram->Start(mapped.pData, mapped.RowPitch, width, height, encoding);
+				g_DepthHistogramRunning = true;
+			}
+			if (g_ComfortEnabled)
+			{
+				const XMFLOAT4* stereo = g_DepthStagingStereo[oldest];
+				ComfortView view = { stereo[0].x, stereo[0].y, stereo[1].x, stereo[1].y, (float)g_ScreenWidth };
+				if (g_EyeSeparation > 0.0f)
+					g_ComfortLimits.maxUncrossed = g_EyeSeparation;
+				g_ComfortAnalyzer->Start(mapped.pData, mapped.RowPitch, width, height, encoding, g_DepthFar, view, g_ComfortLimits);
+				g_ComfortRunning = true;
+			}
+			g_DepthStagingMapped = oldest;
+			g_DepthReadbackLatency += g_PresentCount - g_DepthStagingFrame[oldest];
+			g_DepthReadbacks++;
+		}
+	}
+
+	// Copy again every few frames, when a staging texture is free.
+	if (g_PresentCount % g_DepthReadbackInterval == 0 && g_pDepthCopyPixelShader)
+	{
+		for (UINT i = 0; i < g_DepthStagingCount && g_DepthStagingNext < 0; i++)
+		{
+			if (!g_DepthStagingPending[i] && (int)i != g_DepthStagingMapped)
+				g_DepthStagingNext = (int)i;
+		}
+		g.passes[g_FgDepthReadback].enabled = (g_DepthStagingNext >= 0);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Ease the convergence towards the target of the last histogram.  Runs before
+// UpdateFarField, which reads the convergence back.
+//--------------------------------------------------------------------------------------
+void UpdateAutoConvergence()
+{
+	if (!g_AutoConvergenceEnabled || !g_StereoHandle)
+		return;
+
+	float current = 0;
+	NvAPI_Stereo_GetConvergence(g_StereoHandle, &current);
+	double nowMs = NowMs();
+	float convergence = g_ConvergenceController.Ease(current, g_ConvergenceEaseMs != 0.0 ? nowMs - g_ConvergenceEaseMs : 0.0);
+	g_ConvergenceEaseMs = nowMs;
+	if (fabsf(convergence - current) > 1e-4f * current)
+		NvAPI_Stereo_SetConvergence(g_StereoHandle, convergence);
+}
+
+//--------------------------------------------------------------------------------------
+// A turns auto-convergence on, from the convergence the user has, and off again back
+// to it.
+//--------------------------------------------------------------------------------------
+void ToggleAutoConvergence()
+{
+	if (!g_StereoHandle || !g_Permutation.monoSlice)
+	{
+		OutputDebugStringA("Auto-convergence: needs stereo and the mono slice\n");
+		return;
+	}
+
+	g_AutoConvergenceEnabled = !g_AutoConvergenceEnabled;
+	if (g_AutoConvergenceEnabled)
+	{
+		if (!g_DepthHistogram)
+			g_DepthHistogram.reset(new DepthHistogram(g_DepthHistogramBins, g_DepthFar, g_DepthHistogramThreads));
+		NvAPI_Stereo_GetConvergence(g_StereoHandle, &g_UserConvergence);
+		g_ConvergenceController.convergence = 0.0f;
+		g_ConvergenceController.target = 0.0f;
+		g_ConvergenceEaseMs = 0.0;
+	}
+	else
+	{
+		DropDepthReadbacks();
+		NvAPI_Stereo_SetConvergence(g_StereoHandle, g_UserConvergence);
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// V turns the comfort analysis off and on.
+//--------------------------------------------------------------------------------------
+void ToggleComfortAnalysis()
+{
+	if (g_ComfortEnabled)
+		DropDepthReadbacks();
+	g_ComfortEnabled = !g_ComfortEnabled;
+	g_ComfortFlags = 0;
+}
+
+//--------------------------------------------------------------------------------------
+// O steps from Direct Mode through the stereo output formats and back.
+//--------------------------------------------------------------------------------------
+void CycleOutputFormat()
+{
+	if (LenticularOutput())
+	{
+		OutputDebugStringA("Output: the formats are for two views, N steps back to them\n");
+		return;
+	}
+
+	g_OutputFormat = (g_OutputFormat + 2) % (StereoFormat_Count + 1) - 1;
+	g_ComposeCheckRequested = g_ComposeCheckPending = false;
+
+	// Back to full scale, the composer reads whole eyes.
+	if (g_OutputFormat >= 0)
+	{
+		g_Viewport = g_BackBufferViewport;
+		g_DynamicResolution.Reset();
+	}
+
+	g_DeviceResources.Invalidate(Param_Output);
+	if (FAILED(RebuildDeviceResources()))
+		PostQuitMessage(0);
+	BindRhiObjects();
+
+	char msg[128];
+	sprintf_s(msg, "Output: %s\n", g_OutputFormat < 0 ? "Direct Mode" : StereoFormatName((StereoFormat)g_OutputFormat));
+	OutputDebugStringA(msg);
+}
+
+//--------------------------------------------------------------------------------------
+// N steps the view count through g_ViewCounts, and back to the eyes.  The shaders
+// that read VIEW_COUNT are compiled again, and the slices and outputs rebuilt.
+//--------------------------------------------------------------------------------------
+void CycleViewCount()
+{
+	if (g_EyeRecorder)
+	{
+		OutputDebugStringA("Views: not while recording the eyes\n");
+		return;
+	}
+
+	UINT next = 0;
+	while (next < ARRAYSIZE(g_ViewCounts) && g_ViewCounts[next] != g_Permutation.viewCount)
+		next++;
+	next = (next + 1) % ARRAYSIZE(g_ViewCounts);
+
+	// The deferred shaders are compiled for the old permutation, take them first.
+	if (g_DeferredThread.joinable())
+		g_DeferredThread.join();
+	if (g_ShaderSwapReady.load(std::memory_order_acquire))
+		ApplyShaderSwap();
+
+	double startMs = NowMs();
+	g_Permutation.viewCount = g_ViewCounts[next];
+	g_ComposeCheckRequested = g_ComposeCheckPending = false;
+	g_Viewport = g_BackBufferViewport;
+	g_DynamicResolution.Reset();
+
+	HRESULT hr = RecompileShaders(Perm_Views);
+	if (SUCCEEDED(hr))
+	{
+		g_DeviceResources.Invalidate(Param_Slices | Param_Output);
+		hr = RebuildDeviceResources();
+		BindRhiObjects();
+	}
+	if (FAILED(hr))
+		PostQuitMessage(0);
+
+	char msg[128];
+	sprintf_s(msg, "Views: %u, %s, %.1fms to switch\n", g_Permutation.viewCount,
+		LenticularOutput() ? "interleaved for a lenticular panel" : "the eyes", NowMs() - startMs);
+	OutputDebugStringA(msg);
+}
+
+//--------------------------------------------------------------------------------------
+// K: read back the eye pair and the frame the GPU composed or interleaved from it,
+// do the same on the CPU, and compare the two.  It waits for the GPU, once.
+//--------------------------------------------------------------------------------------
+void CheckComposer()
+{
+	g_ComposeCheckPending = false;
+	bool lenticular = LenticularOutput();
+	StereoFormat format = (StereoFormat)g_OutputFormat;
+	UINT views = g_Permutation.viewCount;
+	UINT width = g_ScreenWidth, height = g_ScreenHeight;
+	if (!lenticular)
+		StereoOutputSize(format, g_ScreenWidth, g_ScreenHeight, &width, &height);
+
+	ID3D11Texture2D* pEyes = nullptr;
+	ID3D11Texture2D* pFrame = nullptr;
+	D3D11_TEXTURE2D_DESC desc;
+	g_pEyePairTexture->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	HRESULT hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &pEyes);
+	if (SUCCEEDED(hr))
+	{
+		g_pComposeTexture->GetDesc(&desc);
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &pFrame);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE eyes[MultiviewMaxViews] = {}, gpu = {};
+	if (SUCCEEDED(hr))
+	{
+		g_pImmediateContext->CopyResource(pEyes, g_pEyePairTexture);
+		g_pImmediateContext->CopyResource(pFrame, g_pComposeTexture);
+	}
+	for (UINT v = 0; v < views && SUCCEEDED(hr); v++)
+		hr = g_pImmediateContext->Map(pEyes, v, D3D11_MAP_READ, 0, &eyes[v]);
+	if (SUCCEEDED(hr))
+		hr = g_pImmediateContext->Map(pFrame, 0, D3D11_MAP_READ, 0, &gpu);
+
+	char name[64];
+	if (lenticular)
+		sprintf_s(name, "lenticular, %u views", views);
+	else
+		sprintf_s(name, "%s", StereoFormatName(format));
+
+	char msg[256];
+	if (SUCCEEDED(hr))
+	{
+		const uint8_t* slices[MultiviewMaxViews];
+		for (UINT v = 0; v < views; v++)
+			slices[v] = (const uint8_t*)eyes[v].pData;
+
+		std::vector<uint32_t> cpu(width * height);
+		double startMs = NowMs();
+		if (lenticular)
+			InterleaveViews(CurrentLenticularLayout(), slices, eyes[0].RowPitch, width, height, (uint8_t*)cpu.data(),
+				width * sizeof(uint32_t));
+		else
+			ComposeStereo(format, slices[0], slices[1], eyes[0].RowPitch, g_ScreenWidth, g_ScreenHeight,
+				(uint8_t*)cpu.data(), width * sizeof(uint32_t));
+		double ms = NowMs() - startMs;
+
+		UINT64 different = 0;
+		for (UINT y = 0; y < height; y++)
+		{
+			const uint32_t* row = (const uint32_t*)((const uint8_t*)gpu.pData + y * gpu.RowPitch);
+			for (UINT x = 0; x < width; x++)
+				different += cpu[y * width + x] != row[x];
+		}
+
+		// Every view in and the frame out.
+		double bytes = ((double)views * g_ScreenWidth * g_ScreenHeight + (double)width * height) * sizeof(uint32_t);
+		sprintf_s(msg, "Compose: %s %ux%u, %llu texels differ from the GPU, CPU %.2fms, %.2f GB/s\n",
+			name, width, height, different, ms, bytes / ms / 1e6);
+	}
+	else
+	{
+		sprintf_s(msg, "Compose: cannot read back the frame, 0x%08x\n", (UINT)hr);
+	}
+	OutputDebugStringA(msg);
+
+	if (gpu.pData)
+		g_pImmediateContext->Unmap(pFrame, 0);
+	for (UINT v = 0; v < views; v++)
+	{
+		if (eyes[v].pData)
+			g_pImmediateContext->Unmap(pEyes, v);
+	}
+	SafeRelease(pFrame);
+	SafeRelease(pEyes);
+}
+
+//--------------------------------------------------------------------------------------
+// Hand the eyes and depth in a staging slot to the writer, which copies them, once
+// the GPU is done with them, or waiting for it.  The depth was copied last.
+//--------------------------------------------------------------------------------------
+bool SubmitEyeStaging(int slot, bool wait)
+{
+	ID3D11DeviceContext* context = g_pImmediateContext;
+	UINT flags = wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT;
+	D3D11_MAPPED_SUBRESOURCE left = {}, right = {}, depth = {};
+	HRESULT hr = S_OK;
+	if (g_pEyeDepthStaging[slot])
+		hr = context->Map(g_pEyeDepthStaging[slot], 0, D3D11_MAP_READ, flags, &depth);
+	if (hr == S_OK)
+		hr = context->Map(g_pEyeStaging[slot], 1, D3D11_MAP_READ, flags, &right);
+	if (hr == S_OK)
+		hr = context->Map(g_pEyeStaging[slot], 0, D3D11_MAP_READ, flags, &left);
+
+	if (hr == S_OK)
+	{
+		DepthEncoding encoding = (g_Permutation.depthPacking == DepthPack_Unorm24) ? DepthEncoding_Unorm24 : DepthEncoding_Float;
+		StereoCaptureFrame frame = { (const uint8_t*)left.pData, (const uint8_t*)right.pData, left.RowPitch,
+			(const uint8_t*)depth.pData, depth.RowPitch, encoding, g_DepthFar, g_EyeStagingView[slot] };
+		g_EyeRecorder->Submit(frame);
+		g_EyeStagingPending[slot] = false;
+	}
+
+	if (left.pData)
+		context->Unmap(g_pEyeStaging[slot], 0);
+	if (right.pData)
+		context->Unmap(g_pEyeStaging[slot], 1);
+	if (depth.pData)
+		context->Unmap(g_pEyeDepthStaging[slot], 0);
+	return hr == S_OK;
+}
+
+// The pending slot copied in first, or -1.
+int OldestEyeStaging()
+{
+	int oldest = -1;
+	for (UINT i = 0; i < g_EyeStagingCount; i++)
+	{
+		if (g_EyeStagingPending[i] && (oldest < 0 || g_EyeStagingFrame[i] < g_EyeStagingFrame[oldest]))
+			oldest = (int)i;
+	}
+	return oldest;
+}
+
+//--------------------------------------------------------------------------------------
+// Hand the oldest copy the GPU has finished to the writer, and decide whether this
+// frame copies the eyes out again.
+//--------------------------------------------------------------------------------------
+void UpdateEyeRecording()
+{
+	g_EyeStagingNext = -1;
+	if (!g_EyeRecorder)
+		return;
+	if (g_ScreenWidth != g_EyeRecordingWidth || g_ScreenHeight != g_EyeRecordingHeight)
+	{
+		OutputDebugStringA("Eye recording: the window changed size\n");
+		ToggleEyeRecording();
+		return;
+	}
+
+	int oldest = OldestEyeStaging();
+	if (oldest >= 0)
+		SubmitEyeStaging(oldest, false);
+
+	for (UINT i = 0; i < g_EyeStagingCount && g_EyeStagingNext < 0; i++)
+	{
+		if (!g_EyeStagingPending[i])
+			g_EyeStagingNext = (int)i;
+	}
+	if (g_EyeStagingNext < 0)
+		g_EyeRecordingSkipped++;
+	g_FrameGraph.passes[g_FgEyeCapture].enabled = (g_EyeStagingNext >= 0);
+}
+
+//--------------------------------------------------------------------------------------
+// Finish the file with the copies still in flight, and report what the recording
+// cost and what the left eye saved on the right one.
+//--------------------------------------------------------------------------------------
+void StopEyeRecording()
+{
+	if (!g_EyeRecorder)
+		return;
+
+	for (int slot = OldestEyeStaging(); slot >= 0; slot = OldestEyeStaging())
+	{
+		if (!SubmitEyeStaging(slot, true))
+			g_EyeStagingPending[slot] = false;
+	}
+	g_EyeRecorder->Close();
+
+	StereoCaptureStats stats = g_EyeRecorder->Stats();
+	double texels = (double)g_EyeRecordingWidth * g_EyeRecordingHeight * max(stats.frames, 1ull);
+	char msg[512];
+	sprintf_s(msg, "Eye recording: %llu frames to %s, %.1f MB, bits/texel left %.2f right %.2f disparity %.3f, "
+		"%.1f%% smaller than each eye on its own over %llu frames, %.1f%% of right eye blocks predicted, "
+		"%.1fms of coding per frame, %llu dropped by the writer, %llu skipped with the staging full\n",
+		stats.frames, g_EyeRecordingFile, stats.bytes / 1e6, stats.leftBits / texels, stats.rightBits / texels,
+		stats.disparityBits / texels, 100.0 * stats.Savings(), stats.sampledFrames,
+		100.0 * stats.predictedBlocks / max(stats.blocks, 1ull),
+		stats.encodeMs / max(stats.frames, 1ull), stats.dropped, g_EyeRecordingSkipped);
+	OutputDebugStringA(msg);
+	g_EyeRecorder.reset();
+}
+
+//--------------------------------------------------------------------------------------
+// E starts recording the eyes, at full scale, and stops again.
+//--------------------------------------------------------------------------------------
+void ToggleEyeRecording()
+{
+	if (g_EyeRecorder)
+	{
+		StopEyeRecording();
+	}
+	else if (LenticularOutput())
 	{
-		descOffscreenSRV.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMSARRAY;
-		descOffscreenSRV.Texture2DMSArray.FirstArraySlice = 2;
-		descOffscreenSRV.Texture2DMSArray.ArraySize = 1;
+		OutputDebugStringA("Eye recording: only with two views\n");
+		return;
 	}
 	else
 	{
-		descOffscreenSRV.Texture2DArray.MostDetailedMip = 0;
-		descOffscreenSRV.Texture2DArray.MipLevels = 1;
-		descOffscreenSRV.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-		descOffscreenSRV.Texture2DArray.FirstArraySlice = 2;
-		descOffscreenSRV.Texture2DArray.ArraySize = 1;
+		g_EyeRecorder.reset(new StereoCaptureWriter(g_EyeRecordingThreads, g_EyeRecordingQueue, g_EyeRecordingSampling));
+		if (!g_EyeRecorder->Open(g_EyeRecordingFile, g_ScreenWidth, g_ScreenHeight))
+		{
+			OutputDebugStringA("Eye recording: cannot open the file\n");
+			g_EyeRecorder.reset();
+			return;
+		}
+		g_EyeRecordingWidth = g_ScreenWidth;
+		g_EyeRecordingHeight = g_ScreenHeight;
+		g_EyeRecordingSkipped = 0;
+		g_Viewport = g_BackBufferViewport;
+		g_DynamicResolution.Reset();
 	}
 
-	hr = g_pd3dDevice->CreateShaderResourceView(g_pOffscreenTexture, &descOffscreenSRV, &g_pPackedDepthTextureSRV);
-	if (FAILED(hr))
-		return hr;
+	g_DeviceResources.Invalidate(Param_Output);
+	if (FAILED(RebuildDeviceResources()))
+		PostQuitMessage(0);
+	BindRhiObjects();
+}
 
-	
+//--------------------------------------------------------------------------------------
+// Decide whether this frame is drawn or warped, and turn the passes to match.  After
+// UpdateFarField, which reads the stereo parameters the warp goes to.
+//--------------------------------------------------------------------------------------
+void UpdateReprojection()
+{
+	g_ReprojectionWarp = false;
+	if (g_FgReprojectLeft < 0)
+		return;
 
-	// Create depth stencil texture
-	D3D11_TEXTURE2D_DESC descDepth;
-	ZeroMemory(&descDepth, sizeof(descDepth));
-	descDepth.Width = g_ScreenWidth;
-	descDepth.Height = g_ScreenHeight;
-	descDepth.MipLevels = 1;
-	descDepth.ArraySize = 3; // 2 slices for stereo + 1 for mono
-	descDepth.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-	descDepth.SampleDesc = sampleDesc;
-	descDepth.Usage = D3D11_USAGE_DEFAULT;
-	descDepth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	descDepth.CPUAccessFlags = 0;
-	descDepth.MiscFlags = 0;
-	hr = g_pd3dDevice->CreateTexture2D(&descDepth, nullptr, &g_pDepthStencil);
-	if (FAILED(hr))
-		return hr;
+	// A replayed or benchmark frame is not what ScenePass last drew.
+	if (g_Replaying || g_Benchmark.enabled)
+		g_ReprojectionSourceValid = false;
+	bool possible = g_ReprojectionSourceValid && g_pReprojectPixelShader;
 
-	// Create the depth stencil view
-	//
-	// This is not strictly necessary for our 3D, but is almost always used.
-	D3D11_DEPTH_STENCIL_VIEW_DESC descDSV;
-	ZeroMemory(&descDSV, sizeof(descDSV));
-	descDSV.Format = descDepth.Format;
-	if (sampleDesc.Count > 1)
+	if (g_ReprojectionEnabled)
 	{
-		descDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMSARRAY;
-		descDSV.Texture2DMSArray.ArraySize = 2;
-		descDSV.Texture2DMSArray.FirstArraySlice = 0;
+		bool late = possible && g_FramePacer.started && g_Reprojection.IsLate(NowMs(), g_FramePacer.lastRefreshMs,
+			g_FramePacer.refreshMs * g_FramePacer.refreshesPerFrame);
+		g_ReprojectionWarp = g_Reprojection.Decide(late);
 	}
-	else
+	if (possible && g_ReprojectionCheckRequested)
+		g_ReprojectionWarp = true;
+
+	FrameGraph& g = g_FrameGraph;
+	bool warp = g_ReprojectionWarp;
+	g.passes[g_FgClear].enabled = !warp;
+	g.passes[g_FgScene].enabled = !warp;
+	g.passes[g_FgLeftEye].enabled = !warp;
+	g.passes[g_FgRightEye].enabled = !warp;
+	g.passes[g_FgReprojectLeft].enabled = warp;
+	g.passes[g_FgReprojectRight].enabled = warp;
+	if (warp)
 	{
-		descDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
-		descDSV.Texture2DArray.ArraySize = 2;
-		descDSV.Texture2DArray.FirstArraySlice = 0;
-		descDSV.Texture2DArray.MipSlice = 0;
+		g.passes[g_FgFarField].enabled = false;
+		g.passes[g_FgFarComposite].enabled = false;
 	}
-	hr = g_pd3dDevice->CreateDepthStencilView(g_pDepthStencil, nullptr/*&descDSV*/, &g_pDepthStencilView);
-	if (FAILED(hr))
-		return hr;
+}
 
-	g_Viewport.Width = (FLOAT)g_ScreenWidth;
-	g_Viewport.Height = (FLOAT)g_ScreenHeight;
-	g_Viewport.MinDepth = 0.0f;
-	g_Viewport.MaxDepth = 1.0f;
-	g_Viewport.TopLeftX = 0;
-	g_Viewport.TopLeftY = 0;
+void ReportReprojection()
+{
+	const ReprojectionFallback& r = g_Reprojection;
+	char msg[256];
+	sprintf_s(msg, "Reprojection: %llu of %llu frames warped (%.1f%%), %llu of them missed all the same, %llu more late but drawn, "
+		"drawing costs %.2fms\n", r.warpedFrames, r.frames, r.frames ? 100.0 * r.warpedFrames / r.frames : 0.0,
+		r.missedWarps, r.lateFrames - r.warpedFrames, r.costMs);
+	OutputDebugStringA(msg);
+}
 
-	// Compile the vertex shader
-	ID3DBlob* pVSBlob = nullptr;
-	hr = CompileShaderFromFile(L"Tutorial07.fx", "VS", "vs_5_0", &pVSBlob);
-	if (FAILED(hr))
+//--------------------------------------------------------------------------------------
+// W turns the fallback on, and off again with what it did.
+//--------------------------------------------------------------------------------------
+void ToggleReprojection()
+{
+	g_ReprojectionEnabled = !g_ReprojectionEnabled;
+	if (g_ReprojectionEnabled)
 	{
-		MessageBox(nullptr,
-			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-		return hr;
+		g_Reprojection.Reset();
+		if (g_FgReprojectLeft < 0)
+			OutputDebugStringA("Reprojection: only in Direct Mode with the mono slice, and not while recording\n");
+	}
+	else
+	{
+		ReportReprojection();
 	}
+}
 
-	// Create the vertex shader
-	hr = g_pd3dDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), nullptr, &g_pVertexShader);
-	if (FAILED(hr))
+void RequestReprojectionCheck()
+{
+	if (g_FgReprojectLeft < 0 || !g_pUpscalePixelShader || !g_pDepthCopyPixelShader)
+		OutputDebugStringA("Reprojection: nothing to check, it needs Direct Mode with the mono slice\n");
+	else
+		g_ReprojectionCheckRequested = true;
+}
+
+//--------------------------------------------------------------------------------------
+// Warp the left eye of the X check on the CPU, from the same eye and depth the GPU
+// warped, and compare the two texel for texel.  A few can differ, where a float
+// rounds the other way.
+//--------------------------------------------------------------------------------------
+void CheckReprojection()
+{
+	g_ReprojectionCheckPending = false;
+	UINT width = (UINT)g_ReprojectionViewport.Width;
+	UINT height = (UINT)g_ReprojectionViewport.Height;
+
+	ID3D11Texture2D* pCheck = nullptr;
+	D3D11_TEXTURE2D_DESC desc;
+	g_pReprojectCheckTexture->GetDesc(&desc);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	HRESULT hr = g_pd3dDevice->CreateTexture2D(&desc, nullptr, &pCheck);
+
+	D3D11_MAPPED_SUBRESOURCE gpu = {}, eye = {}, depth = {};
+	if (SUCCEEDED(hr))
 	{
-		pVSBlob->Release();
-		return hr;
+		g_pImmediateContext->CopyResource(pCheck, g_pReprojectCheckTexture);
+		hr = g_pImmediateContext->Map(pCheck, 0, D3D11_MAP_READ, 0, &gpu);
 	}
+	if (SUCCEEDED(hr))
+		hr = g_pImmediateContext->Map(pCheck, 1, D3D11_MAP_READ, 0, &eye);
+	if (SUCCEEDED(hr))
+		hr = g_pImmediateContext->Map(pCheck, 2, D3D11_MAP_READ, 0, &depth);
 
-	// Define the input layout
-	D3D11_INPUT_ELEMENT_DESC layout[] =
+	char msg[256];
+	if (SUCCEEDED(hr))
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
-	UINT numElements = ARRAYSIZE(layout);
+		const ReprojectCB& cb = g_ReprojectionCheckCB;
+		ReprojectionParams params;
+		memcpy(params.object, cb.mReprojectObject.m, sizeof(params.object));
+		memcpy(params.background, cb.mReprojectBackground.m, sizeof(params.background));
+		params.projectionX = cb.mReprojectProjection.x;
+		params.projectionY = cb.mReprojectProjection.y;
+		params.width = width;
+		params.height = height;
+		params.oldSeparation = cb.mReprojectStereo.x;
+		params.oldConvergence = cb.mReprojectStereo.y;
+		params.newSeparation = cb.mReprojectStereo.z;
+		params.newConvergence = cb.mReprojectStereo.w;
+		params.maxDepth = g_DepthFar;
+		params.iterations = g_ReprojectionIterations;
+
+		DepthEncoding encoding = (g_Permutation.depthPacking == DepthPack_Unorm24) ? DepthEncoding_Unorm24 : DepthEncoding_Float;
+		std::vector<float> w((size_t)width * height);
+		UnpackMonoDepth((const uint8_t*)depth.pData, depth.RowPitch, width, height, encoding, g_DepthFar, w.data());
+
+		std::vector<uint32_t> cpu((size_t)width * height);
+		double startMs = NowMs();
+		ReprojectEye(params, w.data(), (const uint8_t*)eye.pData, eye.RowPitch, (uint8_t*)cpu.data(), width * sizeof(uint32_t), false);
+		double plainMs = NowMs() - startMs;
+		startMs = NowMs();
+		ReprojectEye(params, w.data(), (const uint8_t*)eye.pData, eye.RowPitch, (uint8_t*)cpu.data(), width * sizeof(uint32_t), true);
+		double simdMs = NowMs() - startMs;
+
+		UINT64 different = 0;
+		for (UINT y = 0; y < height; y++)
+		{
+			const uint32_t* row = (const uint32_t*)((const uint8_t*)gpu.pData + y * gpu.RowPitch);
+			for (UINT x = 0; x < width; x++)
+				different += cpu[y * width + x] != row[x];
+		}
+		sprintf_s(msg, "Reprojection: left eye %ux%u, %llu texels differ from the GPU (%.3f%%), CPU %.2fms, SSE2 %.2fms\n",
+			width, height, different, 100.0 * different / max((double)width * height, 1.0), plainMs, simdMs);
+	}
+	else
+	{
+		sprintf_s(msg, "Reprojection: cannot read back the check, 0x%08x\n", (UINT)hr);
+	}
+	OutputDebugStringA(msg);
+
+	if (depth.pData)
+		g_pImmediateContext->Unmap(pCheck, 2);
+	if (eye.pData)
+		g_pImmediateContext->Unmap(pCheck, 1);
+	if (gpu.pData)
+		g_pImmediateContext->Unmap(pCheck, 0);
+	SafeRelease(pCheck);
+}
 
-	// Create the input layout
-	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, pVSBlob->GetBufferPointer(),
-		pVSBlob->GetBufferSize(), &g_pVertexLayout);
-	pVSBlob->Release();
-	if (FAILED(hr))
-		return hr;
+//--------------------------------------------------------------------------------------
+// Pick the eye drawn small this frame, if any, and size the viewport of every slice
+// to match.  After UpdateDynamicResolution, which sizes the full one, and after
+// UpdateFarField, which writes the rest of the stereo parameters.
+//--------------------------------------------------------------------------------------
+void UpdateSuppression()
+{
+	UINT slices = g_Permutation.SliceCount();
+	for (UINT s = 0; s < slices; s++)
+		g_SliceViewports[s] = g_Viewport;
+
+	// The small eye needs UpscalePS, which comes after startup.
+	g_SuppressedSlice = -1;
+	bool possible = g_FgLeftEye >= 0 && g_OutputFormat < 0 && !g_EyeRecorder && g_pUpscalePixelShader;
+	if (g_Suppression == Suppression_Alternate && possible)
+		g_SuppressedSlice = (int)(g_PresentCount / g_SuppressionPeriod % 2);
+	else if (g_Suppression != Suppression_Off && possible)
+		g_SuppressedSlice = (g_Suppression == Suppression_Left) ? 0 : 1;
+
+	FrameGraph& g = g_FrameGraph;
+	if (g_FgLeftEye >= 0)
+		g.passes[g_FgLeftEye].sliceScale = g.passes[g_FgRightEye].sliceScale = 1.0f;
+	if (g_SuppressedSlice < 0)
+		return;
+
+	D3D11_VIEWPORT& vp = g_SliceViewports[g_SuppressedSlice];
+	vp.Width = max(floorf(g_Viewport.Width * g_SuppressedEyeScale), 1.0f);
+	vp.Height = max(floorf(g_Viewport.Height * g_SuppressedEyeScale), 1.0f);
+
+	// FarCompositePS reads the layer by it, and the eye pass upscales by it.
+	float scale = vp.Width / g_Viewport.Width;
+	g_StereoParams[g_SuppressedSlice].w = scale;
+	g.passes[g_SuppressedSlice == 0 ? g_FgLeftEye : g_FgRightEye].sliceScale = scale;
+}
+
+void ReportSuppression()
+{
+	char msg[256];
+	sprintf_s(msg, "Suppression: %s at %.2f, %.1f%% of slice texels saved over 120 frames\n", g_SuppressionNames[g_Suppression],
+		g_SuppressedEyeScale, g_SuppressionFullTexels ? 100.0 - 100.0 * g_SuppressionTexels / g_SuppressionFullTexels : 0.0);
+	OutputDebugStringA(msg);
+	g_SuppressionTexels = g_SuppressionFullTexels = 0;
+}
 
-	// Set the input layout
-	g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
+//--------------------------------------------------------------------------------------
+// D steps binocular suppression through the eyes, alternating, and off again.
+//--------------------------------------------------------------------------------------
+void CycleSuppression()
+{
+	g_Suppression = (Suppression)((g_Suppression + 1) % Suppression_Count);
+	g_SuppressionTexels = g_SuppressionFullTexels = 0;
 
+	const char* name = g_SuppressionNames[g_Suppression];
+	char msg[128];
+	if (g_Suppression != Suppression_Off && (g_FgLeftEye < 0 || g_OutputFormat >= 0 || g_EyeRecorder))
+		sprintf_s(msg, "Suppression: %s, only in Direct Mode with two views, and not while recording\n", name);
+	else
+		sprintf_s(msg, "Suppression: %s, at %.2f of full size\n", name, g_SuppressedEyeScale);
+	OutputDebugStringA(msg);
+}
 
-	// Compile the geometry shader
-	ID3DBlob* pGSBlob = nullptr;
-	hr = CompileShaderFromFile(L"Tutorial07.fx", "GS", "gs_5_0", &pGSBlob);
-	if (FAILED(hr))
-	{
-		MessageBox(nullptr,
-			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-		return hr;
-	}
 
-	// Create the geometry shader
-	hr = g_pd3dDevice->CreateGeometryShader(pGSBlob->GetBufferPointer(), pGSBlob->GetBufferSize(), nullptr, &g_pGeometryShader);
-	pGSBlob->Release();
-	if (FAILED(hr))
+//--------------------------------------------------------------------------------------
+// The passes of a frame, run by the frame graph.
+//--------------------------------------------------------------------------------------
+template <bool MonoSlice>
+void ClearPass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+
+	cl.SetRenderTargets(g_hOffscreenTextureView, g_hDepthStencilView);
+	//
+	// Clear color in left & right eyes
+	FLOAT clearColor[4] = { 0, 0, 128, 255 };
+	cl.ClearRenderTarget(g_hOffscreenRTV_Color, clearColor);
+
+	// Clear packed depth
+	if (MonoSlice)
+		cl.ClearRenderTarget(g_hOffscreenRTV_Depth, g_PackedDepthClear);
+
+	//
+	// Clear the depth buffer to 1.0 (max depth)
+	cl.ClearDepth(g_hDepthStencilView, 1.0f);
+}
+
+void ScenePass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+
+	//
+	// Everything below is latched as late as it can be, right before the draw.  When
+	// the far layer is drawn, it latched just before this, for both.
+	//
+	if (!g_FrameGraph.passes[g_FgFarField].enabled)
+		g_LatencyMarkers.latchMs = NowMs();
+
+	//
+	// Rotate cube around the origin
+	//
+	float angle = (float)(g_AnimationClock.NowMs(g_LatencyMarkers.latchMs) / 1000.0);
+	g_World = XMMatrixRotationY(angle);
+
+	//
+	// This now includes changing CBChangeOnResize each frame as well, because
+	// we need to update the Projection matrix each frame, in case the user changes
+	// the 3D settings.  UpdateFarField read them for this frame.
+	// The variable names are a bit misleading at present.
+	//
+	SharedCB cb;
+	memcpy(cb.mStereoParamsArray, g_StereoParams, sizeof(g_StereoParams));
+
+	SetSliceViewports(cl);
+
+	// Set vertex and index buffer
+	cl.SetInputLayout(g_hVertexLayout);
+	cl.SetVertexBuffer(g_hVertexBuffer, sizeof(SimpleVertex));
+	cl.SetIndexBuffer(g_hIndexBuffer, RhiFormat_R16_UINT);
+
+	// Set primitive topology
+	cl.SetTopology(RhiTopology_TriangleList);
+
+	// The matrices are row_major in the shader, no transpose.
+	XMStoreFloat4x4(&cb.mView, g_View);
+	XMStoreFloat4x4(&cb.mProjection, g_Projection);
+
+	//
+	// Render the cube
+	//
+	cl.SetVertexShader(g_hVertexShader);
+	cl.SetGeometryShader(g_hGeometryShader);
+	cl.SetConstantBuffer(RhiStage_Vertex | RhiStage_Geometry, SharedCB_Slot, g_hSharedCB);
+	cl.SetPixelShader(g_hPixelShader);
+
+	// The benchmark scenes have more cubes.  Only the world matrix changes between
+	// them, so only its registers are uploaded.  The far ones are in the far layer.
+	for (UINT i = 0; i < g_ObjectCount; i++)
 	{
-		return hr;
+		if (g_FarObjects[i])
+			continue;
+		XMStoreFloat4x4(&cb.mWorld, g_World * XMMatrixTranslationFromVector(ObjectPosition(i)));
+		UploadSharedCB(cb);
+		cl.DrawIndexed(36, 0, 0);
 	}
 
-	// Compile the pixel shader
-	ID3DBlob* pPSBlob = nullptr;
-	hr = CompileShaderFromFile(L"Tutorial07.fx", "PS", "ps_5_0", &pPSBlob);
-	if (FAILED(hr))
+	// What a warp of these eyes starts from.
+	g_ReprojectionWorld = g_World;
+	g_ReprojectionView = g_View;
+	g_ReprojectionStereo[0] = g_StereoParams[0];
+	g_ReprojectionStereo[1] = g_StereoParams[1];
+	g_ReprojectionViewport = g_Viewport;
+	g_ReprojectionSourceValid = g_Permutation.monoSlice && g_SuppressedSlice < 0;
+
+	// What binocular suppression saves, a full size slice each otherwise.
+	UINT slices = g_Permutation.SliceCount();
+	for (UINT s = 0; s < slices; s++)
+		g_SuppressionTexels += (UINT64)g_SliceViewports[s].Width * (UINT64)g_SliceViewports[s].Height;
+	g_SuppressionFullTexels += (UINT64)g_Viewport.Width * (UINT64)g_Viewport.Height * slices;
+}
+
+//--------------------------------------------------------------------------------------
+// Draw the far cubes once, from the center, with no GS, into the far layer.
+//--------------------------------------------------------------------------------------
+void FarFieldPass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+
+	cl.SetRenderTargets(g_hFarLayerRTV_Color, g_hFarDepthStencilView, g_hFarLayerRTV_Depth);
+	FLOAT clearColor[4] = { 0, 0, 128, 255 };
+	cl.ClearRenderTarget(g_hFarLayerRTV_Color, clearColor);
+	if (g_Permutation.monoSlice)
+		cl.ClearRenderTarget(g_hFarLayerRTV_Depth, g_PackedDepthClear);
+	cl.ClearDepth(g_hFarDepthStencilView, 1.0f);
+
+	cl.SetViewport(ToRhiViewport(g_Viewport));
+	cl.SetInputLayout(g_hVertexLayout);
+	cl.SetVertexBuffer(g_hVertexBuffer, sizeof(SimpleVertex));
+	cl.SetIndexBuffer(g_hIndexBuffer, RhiFormat_R16_UINT);
+	cl.SetTopology(RhiTopology_TriangleList);
+
+	cl.SetVertexShader(g_hVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetConstantBuffer(RhiStage_Vertex | RhiStage_Geometry, SharedCB_Slot, g_hSharedCB);
+	cl.SetPixelShader(g_hFarPixelShader);
+
+	// The near cubes turn by the same latch.
+	g_LatencyMarkers.latchMs = NowMs();
+	float angle = (float)(g_AnimationClock.NowMs(g_LatencyMarkers.latchMs) / 1000.0);
+	SharedCB cb;
+	memcpy(cb.mStereoParamsArray, g_StereoParams, sizeof(g_StereoParams));
+	XMStoreFloat4x4(&cb.mView, g_View);
+	XMStoreFloat4x4(&cb.mProjection, g_Projection);
+	for (UINT i = 0; i < g_ObjectCount; i++)
 	{
-		MessageBox(nullptr,
-			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-		return hr;
+		if (!g_FarObjects[i])
+			continue;
+		XMStoreFloat4x4(&cb.mWorld, XMMatrixRotationY(angle) * XMMatrixTranslationFromVector(ObjectPosition(i)));
+		UploadSharedCB(cb);
+		cl.DrawIndexed(36, 0, 0);
 	}
+}
 
-	// Create the pixel shader
-	hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &g_pPixelShader);
-	pPSBlob->Release();
-	if (FAILED(hr))
-		return hr;
+//--------------------------------------------------------------------------------------
+// Copy the far layer into every slice, shifted for each eye.  It covers the whole
+// viewport, so the clear color comes through it.
+//--------------------------------------------------------------------------------------
+void FarCompositePass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
 
-	{
-		// Compile the vertex shader
-		ID3DBlob* pVSBlob = nullptr;
-		hr = CompileShaderFromFile(L"Tutorial07.fx", "QuadVS", "vs_5_0", &pVSBlob);
-		if (FAILED(hr))
-		{
-			MessageBox(nullptr,
-				L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-			return hr;
-		}
-		hr = g_pd3dDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), nullptr, &g_pQuadVertexShader);
-		pVSBlob->Release();
-		if (FAILED(hr))
-			return hr;
+	cl.SetRenderTargets(g_hOffscreenTextureView, RhiDepthTarget());
+	SetSliceViewports(cl);
 
-		// Compile the pixel shader
-		ID3DBlob* pPSBlob = nullptr;
-		hr = CompileShaderFromFile(L"Tutorial07.fx", "QuadPS", "ps_5_0", &pPSBlob);
-		if (FAILED(hr))
-		{
-			MessageBox(nullptr,
-				L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-			return hr;
-		}
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+	cb.mResolveClamp = XMFLOAT4(g_Viewport.Width - 1.0f, g_Viewport.Height - 1.0f, 0.0f, 0.0f);
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
 
-		// Create the pixel shader
-		hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &g_pQuadPixelShader);
-		pPSBlob->Release();
-		if (FAILED(hr))
-			return hr;
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(g_hFarCompositeGeometryShader);
+	cl.SetPixelShader(g_hFarCompositePixelShader);
+	cl.SetConstantBuffer(RhiStage_Geometry, SharedCB_Slot, g_hSharedCB);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetShaderView(2, g_hFarLayerSRV);
 
-		// Compile the pixel shader
-		ID3DBlob* pPSBlob1 = nullptr;
-		hr = CompileShaderFromFile(L"Tutorial07.fx", "MSQuadPS", "ps_5_0", &pPSBlob1);
-		if (FAILED(hr))
-		{
-			MessageBox(nullptr,
-				L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-			return hr;
-		}
+	cl.SetTopology(RhiTopology_TriangleStrip);
+	cl.Draw(4, 0);
 
-		// Create the pixel shader
-		hr = g_pd3dDevice->CreatePixelShader(pPSBlob1->GetBufferPointer(), pPSBlob1->GetBufferSize(), nullptr, &g_pMSQuadPixelShader);
-		pPSBlob1->Release();
-		if (FAILED(hr))
-			return hr;
-	}
+	cl.SetShaderView(2, RhiShaderView());
+}
 
-	// Create vertex buffer for the cube
-	SimpleVertex vertices[] =
+void EyeOutputPass(const FgPass& pass)
+{
+	g_EyeCopyPath = pass.copyPath;
+
+	g_CommandList.SetActiveEye(pass.eye);
+	CopyEyeToBackBuffer(pass.slice);
+}
+
+//--------------------------------------------------------------------------------------
+// With a stereo output format, each eye goes into its slice of the eye pair, by the
+// copy path Compile picked, and the Compose pass packs the pair into one frame.
+//--------------------------------------------------------------------------------------
+void EyePairPass(const FgPass& pass)
+{
+	UINT subresource = D3D11CalcSubresource(0, pass.slice, 1);
+	g_EyeCopyPath = pass.copyPath;
+
+	if (g_EyeCopyPath == EyeCopy_Copy)
+		g_CommandList.CopySubresource(g_hEyePairTexture, subresource, g_hOffscreenTexture, subresource);
+	else
+		g_CommandList.Resolve(g_hEyePairTexture, subresource, g_hOffscreenTexture, subresource, RhiFormat_R8G8B8A8_UNORM);
+
+	g_EyeCopyBytes += EyeCopyBytes(g_EyeCopyPath, g_ScreenWidth, g_ScreenHeight, g_SampleCount);
+}
+
+void DrawComposed(RhiRenderTarget target, StereoFormat format)
+{
+	RhiCommandList& cl = g_CommandList;
+
+	UINT width, height;
+	StereoOutputSize(format, g_ScreenWidth, g_ScreenHeight, &width, &height);
+	D3D11_VIEWPORT viewport = g_BackBufferViewport;
+	viewport.Width = (FLOAT)width;
+	viewport.Height = (FLOAT)height;
+
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(1.0f, 1.0f, 0.0f, (float)format);
+	cb.mResolveClamp = XMFLOAT4(g_ScreenWidth - 1.0f, g_ScreenHeight - 1.0f, 0.0f, 0.0f);
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
+
+	cl.SetRenderTargets(target, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(viewport));
+	cl.Draw(4, 0);
+}
+
+void ComposePass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+	StereoFormat format = (StereoFormat)g_OutputFormat;
+
+	cl.SetActiveEye(NVAPI_STEREO_EYE_MONO);
+
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hComposePixelShader);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetShaderView(3, g_hEyePairSRV);
+	cl.SetTopology(RhiTopology_TriangleStrip);
+
+	// Full side by side does not fit the back buffer.
+	if (format == StereoFormat_SideBySide || g_ComposeCheckRequested)
 	{
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
+		DrawComposed(g_hComposeRTV, format);
+		g_ComposeCheckPending = g_ComposeCheckRequested;
+		g_ComposeCheckRequested = false;
+	}
+	DrawComposed(g_hRenderTargetView, format == StereoFormat_SideBySide ? StereoFormat_HalfSideBySide : format);
 
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
+	cl.SetShaderView(3, RhiShaderView());
+}
 
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 0.0f) },
+//--------------------------------------------------------------------------------------
+// With a lenticular panel every view goes into its slice of the eye pair, as the
+// eyes do for the formats, and the Interleave pass spreads them over the subpixels.
+//--------------------------------------------------------------------------------------
+void DrawInterleaved(RhiRenderTarget target)
+{
+	RhiCommandList& cl = g_CommandList;
 
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) },
+	InterleaveSteps steps;
+	LenticularSteps(CurrentLenticularLayout(), &steps);
 
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, -1.0f), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, -1.0f), XMFLOAT2(1.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, -1.0f), XMFLOAT2(0.0f, 0.0f) },
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+	cb.mResolveClamp = XMFLOAT4(g_ScreenWidth - 1.0f, g_ScreenHeight - 1.0f, 0.0f, 0.0f);
+	cb.mInterleaveSteps = XMUINT4(steps.subpixel, steps.pixel, steps.row, steps.origin);
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
 
-		{ XMFLOAT3(-1.0f, -1.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, -1.0f, 1.0f), XMFLOAT2(0.0f, 1.0f) },
-		{ XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT2(0.0f, 0.0f) },
-		{ XMFLOAT3(-1.0f, 1.0f, 1.0f), XMFLOAT2(1.0f, 0.0f) },
-	};
+	cl.SetRenderTargets(target, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(g_BackBufferViewport));
+	cl.Draw(4, 0);
+}
 
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SimpleVertex) * 24;
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	D3D11_SUBRESOURCE_DATA InitData;
-	ZeroMemory(&InitData, sizeof(InitData));
-	InitData.pSysMem = vertices;
-	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pVertexBuffer);
-	if (FAILED(hr))
-		return hr;
+void InterleavePass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+
+	cl.SetActiveEye(NVAPI_STEREO_EYE_MONO);
+
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hInterleavePixelShader);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetShaderView(3, g_hEyePairSRV);
+	cl.SetTopology(RhiTopology_TriangleStrip);
+
+	if (g_ComposeCheckRequested)
+	{
+		DrawInterleaved(g_hComposeRTV);
+		g_ComposeCheckPending = true;
+		g_ComposeCheckRequested = false;
+	}
+	DrawInterleaved(g_hRenderTargetView);
 
-	// Set vertex buffer
-	UINT stride = sizeof(SimpleVertex);
-	UINT offset = 0;
-	g_pImmediateContext->IASetVertexBuffers(0, 1, &g_pVertexBuffer, &stride, &offset);
+	cl.SetShaderView(3, RhiShaderView());
+}
 
-	// Create index buffer
-	// Create vertex buffer
-	WORD indices[] =
-	{
-		3, 1, 0,
-		2, 1, 3,
+void DepthViewPass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
 
-		6, 4, 5,
-		7, 4, 6,
+	cl.SetActiveEye(NVAPI_STEREO_EYE_MONO);
 
-		11, 9, 8,
-		10, 9, 11,
+	cl.SetRenderTargets(g_hRenderTargetView, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(g_BackBufferViewport));
 
-		14, 12, 13,
-		15, 12, 14,
+	// The mono slice was rendered at the same scale as the eyes.
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(g_Viewport.Width / g_BackBufferViewport.Width, g_Viewport.Height / g_BackBufferViewport.Height, (float)g_Permutation.viewCount, 0.0f);
+	cb.mResolveClamp = XMFLOAT4(g_Viewport.Width - 1.0f, g_Viewport.Height - 1.0f, 0.0f, 0.0f);
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
 
-		19, 17, 16,
-		18, 17, 19,
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hQuadPixelShader);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetShaderView(0, g_hPackedDepthTextureSRV);
 
-		22, 20, 21,
-		23, 20, 22
-	};
+	cl.SetTopology(RhiTopology_TriangleStrip);
+	cl.Draw(4, 0);
 
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(WORD) * 36;
-	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	InitData.pSysMem = indices;
-	hr = g_pd3dDevice->CreateBuffer(&bd, &InitData, &g_pIndexBuffer);
-	if (FAILED(hr))
-		return hr;
+	cl.SetShaderView(0, RhiShaderView());
+}
 
+//--------------------------------------------------------------------------------------
+// Copy the packed depth of the part of the mono slice that was rendered into the
+// next staging texture, for auto-convergence.  UINT cannot be resolved, so it goes
+// through a single sample target, the first sample of each texel.
+//--------------------------------------------------------------------------------------
+void CopyPackedDepth(RhiRenderTarget target, const D3D11_VIEWPORT& viewport)
+{
+	RhiCommandList& cl = g_CommandList;
 
-	// Create the constant buffer
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(SharedCB);
-	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	bd.CPUAccessFlags = 0;
-	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pSharedCB);
-	if (FAILED(hr))
-		return hr;
+	cl.SetRenderTargets(target, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(viewport));
 
-	// Initialize the world matrix
-	g_World = XMMatrixIdentity();
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hDepthCopyPixelShader);
+	cl.SetShaderView(0, g_hPackedDepthTextureSRV);
 
-	// Initialize the view matrix
-	XMVECTOR Eye = XMVectorSet(0.0f, 3.0f, -6.0f, 0.0f);
-	XMVECTOR At = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	XMVECTOR Up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	g_View = XMMatrixLookAtLH(Eye, At, Up);
+	cl.SetTopology(RhiTopology_TriangleStrip);
+	cl.Draw(4, 0);
 
-	// Initialize the projection matrix
-	//
-	// For the projection matrix, the shaders know nothing about being in stereo, 
-	// so this needs to be only ScreenWidth, one per eye.
-	g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, (float)g_ScreenWidth / (float)g_ScreenHeight, 0.01f, 100.0f);
+	cl.SetShaderView(0, RhiShaderView());
+}
 
-	return S_OK;
+void DepthReadbackPass(const FgPass&)
+{
+	int slot = g_DepthStagingNext;
+
+	CopyPackedDepth(g_hDepthReadbackRTV, g_Viewport);
+	g_CommandList.CopySubresource(g_hDepthStaging[slot], 0, g_hDepthReadbackTexture, 0);
+	g_DepthStagingFrame[slot] = g_PresentCount;
+	g_DepthStagingViewport[slot] = g_Viewport;
+	g_DepthStagingStereo[slot][0] = g_StereoParams[0];
+	g_DepthStagingStereo[slot][1] = g_StereoParams[1];
+	g_DepthStagingPending[slot] = true;
 }
 
+//--------------------------------------------------------------------------------------
+// Copy both eyes, and the packed depth after them, into the next staging textures
+// for the eye recording.
+//--------------------------------------------------------------------------------------
+void EyeCapturePass(const FgPass&)
+{
+	RhiCommandList& cl = g_CommandList;
+	int slot = g_EyeStagingNext;
+
+	cl.CopySubresource(g_hEyeStaging[slot], 0, g_hEyePairTexture, 0);
+	cl.CopySubresource(g_hEyeStaging[slot], 1, g_hEyePairTexture, 1);
+	if (g_pEyeDepthStaging[slot])
+	{
+		CopyPackedDepth(g_hDepthReadbackRTV, g_Viewport);
+		cl.CopySubresource(g_hEyeDepthStaging[slot], 0, g_hDepthReadbackTexture, 0);
+	}
+
+	StereoCaptureView view = { g_StereoParams[0].x, g_StereoParams[0].y, g_StereoParams[1].x, g_StereoParams[1].y };
+	g_EyeStagingView[slot] = view;
+	g_EyeStagingFrame[slot] = g_PresentCount;
+	g_EyeStagingPending[slot] = true;
+}
 
 //--------------------------------------------------------------------------------------
-// Clean up the objects we've created
+// In place of an eye output, when the frame is warped rather than drawn.  The cubes
+// move from how they were drawn to how they turn now.  Each spins about its own
+// middle, so one delta is only right for one cube, and with more of them they are
+// left where they were drawn and only the view and the stereo parameters move.
 //--------------------------------------------------------------------------------------
-void CleanupDevice()
+void SetReprojectConstants(UINT slice, ReprojectCB& cb)
 {
-	if (g_pSwapChain) g_pSwapChain->SetFullscreenState(FALSE, nullptr);
+	XMMATRIX view = XMMatrixInverse(nullptr, g_ReprojectionView) * g_View;
+	XMMATRIX object = view;
+	if (g_ObjectCount == 1)
+	{
+		XMMATRIX place = XMMatrixTranslationFromVector(ObjectPosition(0));
+		object = XMMatrixInverse(nullptr, g_ReprojectionWorld * place * g_ReprojectionView) * (g_World * place * g_View);
+	}
+	XMStoreFloat4x4(&cb.mReprojectObject, object);
+	XMStoreFloat4x4(&cb.mReprojectBackground, view);
+
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, g_Projection);
+	cb.mReprojectProjection = XMFLOAT4(projection._11, projection._22, g_ReprojectionViewport.Width, g_ReprojectionViewport.Height);
+	cb.mReprojectStereo = XMFLOAT4(g_ReprojectionStereo[slice].x, g_ReprojectionStereo[slice].y, g_StereoParams[slice].x,
+		g_StereoParams[slice].y);
+}
 
-	if (g_pImmediateContext) g_pImmediateContext->ClearState();
+// Warp into target, scale from its texels to the slice's.
+void DrawReprojected(RhiRenderTarget target, const D3D11_VIEWPORT& viewport, float scaleX, float scaleY, UINT slice)
+{
+	RhiCommandList& cl = g_CommandList;
 
-	if (g_pSharedCB) g_pSharedCB->Release();
-	if (g_pVertexBuffer) g_pVertexBuffer->Release();
-	if (g_pIndexBuffer) g_pIndexBuffer->Release();
-	if (g_pVertexLayout) g_pVertexLayout->Release();
+	ResolveCB cb;
+	cb.mResolveParams = XMFLOAT4(scaleX, scaleY, (float)slice, 0.0f);
+	cb.mResolveClamp = XMFLOAT4(g_ReprojectionViewport.Width - 1.0f, g_ReprojectionViewport.Height - 1.0f, 0.0f, 0.0f);
+	cl.UpdateBuffer(g_hResolveCB, &cb, sizeof(cb));
 
-	if (g_pVertexShader) g_pVertexShader->Release();
-	if (g_pPixelShader) g_pPixelShader->Release();
-	if (g_pDepthStencil) g_pDepthStencil->Release();
-	if (g_pDepthStencilView) g_pDepthStencilView->Release();
-	if (g_pRenderTargetView) g_pRenderTargetView->Release();
+	cl.SetRenderTargets(target, RhiDepthTarget());
+	cl.SetViewport(ToRhiViewport(viewport));
+	cl.Draw(4, 0);
+}
 
-	if (g_pSwapChain) g_pSwapChain->Release();
-	if (g_pImmediateContext) g_pImmediateContext->Release();
-	if (g_pd3dDevice) g_pd3dDevice->Release();
+void ReprojectPass(const FgPass& pass)
+{
+	RhiCommandList& cl = g_CommandList;
 
-	if (g_StereoHandle) NvAPI_Stereo_DestroyHandle(g_StereoHandle);
+	// Both eyes go to the turn latched for the left one.
+	if (pass.slice == 0)
+	{
+		g_LatencyMarkers.latchMs = NowMs();
+		g_World = XMMatrixRotationY((float)(g_AnimationClock.NowMs(g_LatencyMarkers.latchMs) / 1000.0));
+	}
+
+	ReprojectCB cb;
+	SetReprojectConstants(pass.slice, cb);
+	cl.UpdateBuffer(g_hReprojectCB, &cb, sizeof(cb));
+
+	cl.SetActiveEye(pass.eye);
+	cl.SetVertexShader(g_hQuadVertexShader);
+	cl.SetGeometryShader(RhiGeometryShader());
+	cl.SetPixelShader(g_hReprojectPixelShader);
+	cl.SetConstantBuffer(RhiStage_Pixel, ResolveCB_Slot, g_hResolveCB);
+	cl.SetConstantBuffer(RhiStage_Pixel, ReprojectCB_Slot, g_hReprojectCB);
+	cl.SetShaderView(0, g_hPackedDepthTextureSRV);
+	cl.SetShaderView(1, g_hOffscreenColorSRV);
+	cl.SetTopology(RhiTopology_TriangleStrip);
+
+	const D3D11_VIEWPORT& source = g_ReprojectionViewport;
+	DrawReprojected(g_hRenderTargetView, g_BackBufferViewport, source.Width / g_BackBufferViewport.Width,
+		source.Height / g_BackBufferViewport.Height, pass.slice);
+
+	// The X check, the left eye at the slice's own size, with what the CPU warps it
+	// from: the eye through UpscalePS at a scale of one, which averages the samples
+	// as ReprojectPS does, and the packed depth.
+	if (pass.slice == 0 && g_ReprojectionCheckRequested && g_pReprojectCheckTexture)
+	{
+		DrawReprojected(g_hReprojectCheckRTV[0], source, 1.0f, 1.0f, pass.slice);
+		cl.SetPixelShader(g_hUpscalePixelShader);
+		DrawReprojected(g_hReprojectCheckRTV[1], source, 1.0f, 1.0f, pass.slice);
+		CopyPackedDepth(g_hReprojectCheckRTV[2], source);
+		g_ReprojectionCheckCB = cb;
+		g_ReprojectionCheckRequested = false;
+		g_ReprojectionCheckPending = true;
+	}
+
+	cl.SetShaderView(0, RhiShaderView());
+	cl.SetShaderView(1, RhiShaderView());
 }
 
 
 //--------------------------------------------------------------------------------------
-// Called every time the application receives a message
+// Declare the passes of a frame, and what each one reads and writes.
 //--------------------------------------------------------------------------------------
-LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+void BuildFrameGraph()
 {
-	PAINTSTRUCT ps;
-	HDC hdc;
+	FrameGraph& g = g_FrameGraph;
+	g = FrameGraph();
+
+	// The offscreen array is R8G8B8A8, and the depth array is D24S8, 4 bytes each.
+	UINT slices = g_Permutation.SliceCount();
+	g_FgOffscreen = g.AddResource("Offscreen", g_ScreenWidth, g_ScreenHeight, slices, g_SampleCount, 4);
+	g_FgDepthStencil = g.AddResource("DepthStencil", g_ScreenWidth, g_ScreenHeight, slices, g_SampleCount, 4);
+	g_FgBackBuffer = g.AddResource("BackBuffer", g_ScreenWidth, g_ScreenHeight, 1, 1, 4, true);
+
+	int clear = g.AddPass("Clear", g_Permutation.monoSlice ? ClearPass<true> : ClearPass<false>);
+	g.Write(clear, g_FgOffscreen);
+	g.Write(clear, g_FgDepthStencil);
+	g_FgClear = clear;
+
+	// The far layer goes in under the scene.  UpdateFarField turns both passes off
+	// when nothing is far.
+	int farLayer = g.AddResource("FarLayer", g_ScreenWidth, g_ScreenHeight, g_Permutation.monoSlice ? 2 : 1, 1, 4);
+	int farDepth = g.AddResource("FarDepth", g_ScreenWidth, g_ScreenHeight, 1, 1, 4);
+	g_FgFarField = g.AddPass("FarField", FarFieldPass);
+	g.Write(g_FgFarField, farLayer);
+	g.Write(g_FgFarField, farDepth);
+	g_FgFarComposite = g.AddPass("FarComposite", FarCompositePass);
+	g.Read(g_FgFarComposite, farLayer);
+	g.Read(g_FgFarComposite, g_FgOffscreen);
+	g.Write(g_FgFarComposite, g_FgOffscreen);
+
+	int scene = g.AddPass("Scene", ScenePass);
+	g.Read(scene, g_FgOffscreen);
+	g.Read(scene, g_FgDepthStencil);
+	g.Write(scene, g_FgOffscreen);
+	g.Write(scene, g_FgDepthStencil);
+	g_FgScene = scene;
+
+	// Composed, the eyes meet in the pair first.  RenderFrame holds Compose back
+	// until ComposePS is ready.  Recorded, they go into the pair as well.  For a
+	// lenticular panel every view does, and Interleave waits for InterleavePS.
+	bool lenticular = LenticularOutput();
+	g_FgCompose = g_FgInterleave = -1;
+	int eyePair = -1;
+	if (g_OutputFormat >= 0 || g_EyeRecorder || lenticular)
+		eyePair = g.AddResource("EyePair", g_ScreenWidth, g_ScreenHeight, g_Permutation.viewCount, 1, 4);
+	if (lenticular)
+	{
+		static const char* names[MultiviewMaxViews] =
+		{
+			"View0", "View1", "View2", "View3", "View4", "View5", "View6", "View7", "View8"
+		};
+		for (UINT v = 0; v < g_Permutation.viewCount; v++)
+			g.AddEyeOutput(names[v], EyePairPass, g_FgOffscreen, v, NVAPI_STEREO_EYE_MONO, eyePair);
+		g_FgLeftEye = g_FgRightEye = -1;
+
+		int interleaved = g.AddResource("StereoOutput", g_ScreenWidth, g_ScreenHeight, 1, 1, 4, true);
+		g_FgInterleave = g.AddPass("Interleave", InterleavePass);
+		g.Read(g_FgInterleave, eyePair);
+		g.Write(g_FgInterleave, g_FgBackBuffer);
+		g.Write(g_FgInterleave, interleaved);
+	}
+	else if (g_OutputFormat < 0)
+	{
+		g_FgLeftEye = g.AddEyeOutput("LeftEye", EyeOutputPass, g_FgOffscreen, 0, NVAPI_STEREO_EYE_LEFT, g_FgBackBuffer);
+		g_FgRightEye = g.AddEyeOutput("RightEye", EyeOutputPass, g_FgOffscreen, 1, NVAPI_STEREO_EYE_RIGHT, g_FgBackBuffer);
+		if (eyePair >= 0)
+		{
+			g.AddEyeOutput("LeftEyeRecord", EyePairPass, g_FgOffscreen, 0, NVAPI_STEREO_EYE_LEFT, eyePair);
+			g.AddEyeOutput("RightEyeRecord", EyePairPass, g_FgOffscreen, 1, NVAPI_STEREO_EYE_RIGHT, eyePair);
+		}
+	}
+	else
+	{
+		int composed = g.AddResource("StereoOutput", g_ScreenWidth * 2, g_ScreenHeight, 1, 1, 4, true);
+		g_FgLeftEye = g.AddEyeOutput("LeftEye", EyePairPass, g_FgOffscreen, 0, NVAPI_STEREO_EYE_LEFT, eyePair);
+		g_FgRightEye = g.AddEyeOutput("RightEye", EyePairPass, g_FgOffscreen, 1, NVAPI_STEREO_EYE_RIGHT, eyePair);
+		g_FgCompose = g.AddPass("Compose", ComposePass);
+		g.Read(g_FgCompose, eyePair);
+		g.Write(g_FgCompose, g_FgBackBuffer);
+		g.Write(g_FgCompose, composed);
+	}
 
-	switch (message)
+	// UpdateReprojection turns these on, and the passes that draw off, to warp the
+	// last frame drawn instead.  There is nothing to warp from until one is drawn.
+	g_FgReprojectLeft = g_FgReprojectRight = -1;
+	g_ReprojectionSourceValid = false;
+	if (g_OutputFormat < 0 && !lenticular && g_Permutation.monoSlice && !g_EyeRecorder)
 	{
-	case WM_PAINT:
-		hdc = BeginPaint(hWnd, &ps);
-		EndPaint(hWnd, &ps);
-		break;
+		g_FgReprojectLeft = g.AddEyeOutput("LeftReproject", ReprojectPass, g_FgOffscreen, 0, NVAPI_STEREO_EYE_LEFT, g_FgBackBuffer);
+		g_FgReprojectRight = g.AddEyeOutput("RightReproject", ReprojectPass, g_FgOffscreen, 1, NVAPI_STEREO_EYE_RIGHT, g_FgBackBuffer);
+		g.passes[g_FgReprojectLeft].enabled = false;
+		g.passes[g_FgReprojectRight].enabled = false;
+	}
 
-	case WM_DESTROY:
-		PostQuitMessage(0);
-		break;
+	// UpdateEyeRecording turns it on when a staging texture is free.  Off, the eye
+	// pair in Direct Mode is culled along with it.
+	g_FgEyeCapture = -1;
+	if (g_EyeRecorder)
+	{
+		int staging = g.AddResource("EyeStaging", g_ScreenWidth, g_ScreenHeight, 2, 1, 4, true);
+		g_FgEyeCapture = g.AddPass("EyeCapture", EyeCapturePass);
+		g.Read(g_FgEyeCapture, eyePair);
+		if (g_Permutation.monoSlice)
+			g.Read(g_FgEyeCapture, g_FgOffscreen);
+		g.Write(g_FgEyeCapture, staging);
+		g.passes[g_FgEyeCapture].enabled = false;
+	}
 
-		// Note that this tutorial does not handle resizing (WM_SIZE) requests,
-		// so we created the window without the resize border.
+	// Without a mono slice there is no depth to show.
+	g_FgDepthView = -1;
+	if (g_Permutation.monoSlice)
+	{
+		g_FgDepthView = g.AddPass("DepthView", DepthViewPass);
+		g.Read(g_FgDepthView, g_FgOffscreen);
+		g.Write(g_FgDepthView, g_FgBackBuffer);
+	}
 
-	default:
-		return DefWindowProc(hWnd, message, wParam, lParam);
+	// UpdateDepthReadback turns it on every few frames.  The staging textures are
+	// outside the graph, and read by the CPU.
+	g_FgDepthReadback = -1;
+	if (g_Permutation.monoSlice)
+	{
+		int readback = g.AddResource("DepthReadback", g_ScreenWidth, g_ScreenHeight, 1, 1, 4, true);
+		g_FgDepthReadback = g.AddPass("DepthReadback", DepthReadbackPass);
+		g.Read(g_FgDepthReadback, g_FgOffscreen);
+		g.Write(g_FgDepthReadback, readback);
+		g.passes[g_FgDepthReadback].enabled = false;
 	}
 
-	return 0;
+	// Passes keep their scope across rebuilds, as scopes are found by name.
+	g_PassTimers.clear();
+	for (const FgPass& pass : g.passes)
+		g_PassTimers.push_back(g_FrameTimingEnabled ? g_FrameTiming.AddScope(pass.name) : -1);
 }
 
+
 //--------------------------------------------------------------------------------------
-// Render a frame, both eyes.
+// Around every pass, when frame timing is on.
 //--------------------------------------------------------------------------------------
+void BeginPassTiming(const FgPass& pass)
+{
+	int index = (int)(&pass - g_FrameGraph.passes.data());
+	g_CommandList.BeginTimer(g_PassTimers[index]);
+	if (index == g_FgScene)
+		g_CommandList.BeginStatistics();
+	g_PassStartMs = FrameTiming::NowMs();
+}
 
-void PackFloat(FLOAT in, FLOAT* out)
+void EndPassTiming(const FgPass& pass)
 {
-	DWORD dw = *(DWORD*)&in;
-	out[0] = dw & 255; out[1] = (dw >> 8) & 255; out[2] = (dw >> 16) & 255; out[3] = (dw >> 24);
+	int index = (int)(&pass - g_FrameGraph.passes.data());
+	g_FrameTiming.Record(g_PassTimers[index], Timing_Cpu, g_PresentCount, g_PassStartMs, FrameTiming::NowMs());
+	if (index == g_FgScene)
+		g_CommandList.EndStatistics();
+	g_CommandList.EndTimer(g_PassTimers[index]);
 }
 
-void RenderFrame()
+
+#ifdef PROFILE
+//--------------------------------------------------------------------------------------
+// Keep the lists the next frames submit, then run them many times on the null
+// backend, so the cost is the CPU work of walking a frame's commands, with no driver
+// or GPU.  Nothing is encoded again, so no pass runs twice or talks to NvAPI.  What
+// encoding costs is in the CPU times of the passes.
+//--------------------------------------------------------------------------------------
+void StartRhiBenchmark()
 {
-	g_pImmediateContext->OMSetRenderTargets(1, &g_pOffscreenTextureView, g_pDepthStencilView);
-	//
-	// Clear color in left & right eyes
-	FLOAT clearColor[4] = { 0, 0, 128, 255 };
-	g_pImmediateContext->ClearRenderTargetView(g_pOffscreenRTV_Color, clearColor);
+	g_RhiBenchmarkLists.clear();
+	g_RhiBenchmarking = true;
+}
 
-	// Clear packed depth
-	FLOAT clearDepth[4];
-	PackFloat(FLT_MAX, clearDepth);
-	g_pImmediateContext->ClearRenderTargetView(g_pOffscreenRTV_Depth, clearDepth);
+void RecordRhiBenchmarkFrame()
+{
+	g_RhiBenchmarkLists.push_back(g_CommandList);
+	if (g_RhiBenchmarkLists.size() < g_RhiBenchmarkFrames)
+		return;
+	g_RhiBenchmarking = false;
+
+	RhiNull rhi;
+	LARGE_INTEGER start, end, frequency;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	for (UINT r = 0; r < g_RhiBenchmarkRepeat; r++)
+		for (const RhiCommandList& list : g_RhiBenchmarkLists)
+			rhi.Execute(list);
+
+	QueryPerformanceCounter(&end);
+	UINT frames = (UINT)g_RhiBenchmarkLists.size() * g_RhiBenchmarkRepeat;
+	double us = (end.QuadPart - start.QuadPart) * 1000000.0 / frequency.QuadPart;
+	std::vector<RhiCommandList>().swap(g_RhiBenchmarkLists);
+
+	char msg[256];
+	sprintf_s(msg, "RHI null backend: %u frames recorded, %u runs, %.2fus/frame, %llu commands/frame, %llu draws/frame, %llu payload bytes/frame\n",
+		g_RhiBenchmarkFrames, g_RhiBenchmarkRepeat, us / frames, rhi.commands / frames, rhi.draws / frames, rhi.payloadBytes / frames);
+	OutputDebugStringA(msg);
+}
+#endif
 
-	//
-	// Clear the depth buffer to 1.0 (max depth)
-	g_pImmediateContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	//
-	// Rotate cube around the origin
-	//
-	g_World = XMMatrixRotationY(GetTickCount64() / 1000.0f);
+//--------------------------------------------------------------------------------------
+// Capture and replay, see g_Capture.
+//--------------------------------------------------------------------------------------
+void StartCapture()
+{
+	if (g_Capture.IsOpen() || g_Replaying)
+		return;
+	if (!g_Capture.Open(g_CaptureFile))
+	{
+		OutputDebugStringA("Capture: cannot open the capture file\n");
+		return;
+	}
+	g_CaptureFramesLeft = g_CaptureFrames;
 
-	//
-	// This now includes changing CBChangeOnResize each frame as well, because
-	// we need to update the Projection matrix each frame, in case the user changes
-	// the 3D settings.
-	// The variable names are a bit misleading at present.
-	//
-	NvAPI_Status status;
-	SharedCB cb;
-	float pConvergence = 0;
-	float pSeparationPercentage = 0;
-	float pEyeSeparation = 0;
+	// The first frame captured has the whole constant buffer, so a replay does not
+	// start from ranges of whatever was there.
+	g_SharedCBValid = false;
+}
 
-	if (g_StereoHandle)
+void CaptureFrame()
+{
+	bool written = g_Capture.WriteFrame(g_CommandList);
+	if (written && --g_CaptureFramesLeft != 0)
+		return;
+
+	char msg[256];
+	sprintf_s(msg, "Capture: %u frames to %s, %llu bytes, %.0f bytes/frame, %.1f commands/frame%s\n",
+		g_Capture.Frames(), g_CaptureFile, g_Capture.Bytes(), (double)g_Capture.Bytes() / max(1u, g_Capture.Frames()),
+		(double)g_Capture.Commands() / max(1u, g_Capture.Frames()), written ? "" : ", stopped on a write error");
+	OutputDebugStringA(msg);
+
+	g_CaptureFramesLeft = 0;
+	g_Capture.Close();
+}
+
+void ToggleReplay()
+{
+	char msg[256];
+	if (g_Replaying)
 	{
-		NvAPI_Stereo_GetConvergence(g_StereoHandle, &pConvergence);
-		NvAPI_Stereo_GetSeparation(g_StereoHandle, &pSeparationPercentage);
-		NvAPI_Stereo_GetEyeSeparation(g_StereoHandle, &pEyeSeparation);
+		double ms = NowMs() - g_ReplayStartMs;
+		sprintf_s(msg, "Replay on the device: %u frames, %.2fms/frame with Present\n", g_ReplayFrames, ms / max(1u, g_ReplayFrames));
+		OutputDebugStringA(msg);
+		g_Replaying = false;
+		// The replay left its own contents in the constant buffer.
+		g_SharedCBValid = false;
+		return;
+	}
+
+	if (g_Capture.IsOpen())
+		return;
+	if (!g_Replay.Load(g_CaptureFile) || g_Replay.Frames() == 0)
+	{
+		sprintf_s(msg, "Replay: %s: %s\n", g_CaptureFile, g_Replay.Frames() ? g_Replay.Error() : "no frames");
+		OutputDebugStringA(msg);
+		return;
 	}
 
-	cb.mStereoParamsArray[0] = { -pEyeSeparation * pSeparationPercentage / 100, pConvergence, 0.0f, 0.0f }; //left eye
-	cb.mStereoParamsArray[1] = { +pEyeSeparation * pSeparationPercentage / 100, pConvergence, 0.0f, 0.0f }; //right eye
-	cb.mStereoParamsArray[2] = { 0.0f, 0.0f, 0.0f, 0.0f }; //mono
+	RhiReplayStats stats = ReplayNull(g_Replay, 10);
+	sprintf_s(msg, "Replay: %u frames, %.0f bytes/frame, on null %.2fus/frame, %.1fM commands/s\n",
+		g_Replay.Frames(), (double)g_Replay.Bytes() / g_Replay.Frames(), stats.ms * 1000.0 / stats.frames,
+		stats.commands / (stats.ms * 1000.0));
+	OutputDebugStringA(msg);
 
+	g_Replaying = true;
+	g_ReplayFrames = 0;
+	g_ReplayStartMs = NowMs();
+	g_SharedCBValid = false;
+}
 
+// The next captured frame, from the start again after the last.
+void ReplayFrame()
+{
+	if (!g_Replay.ReadFrame(g_CommandList))
 	{
-		g_pImmediateContext->RSSetViewports(1, &g_Viewport);
-		// Set index buffer
-		g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		g_Replay.Rewind();
+		g_Replay.ReadFrame(g_CommandList);
+	}
+	g_ReplayFrames++;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Set up a benchmark scene, between frames.  A change of MSAA or of the mono slice is
+// a new permutation, so the shaders that read those are compiled and made again on
+// this thread, and the groups that depend on them rebuilt.
+//--------------------------------------------------------------------------------------
+HRESULT ApplyBenchmarkScene(BenchmarkScene& scene)
+{
+	// The deferred shaders are compiled for the old permutation, take them first.
+	if (g_DeferredThread.joinable())
+		g_DeferredThread.join();
+	if (g_ShaderSwapReady.load(std::memory_order_acquire))
+		ApplyShaderSwap();
 
-		// Set primitive topology
-		g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	scene.msaaSamples = min(scene.msaaSamples, g_MaxSampleCount);
+	g_ObjectCount = scene.objects;
 
-		cb.mWorld = XMMatrixTranspose(g_World);
-		cb.mView = XMMatrixTranspose(g_View);
-		cb.mProjection = XMMatrixTranspose(g_Projection);
-		g_pImmediateContext->UpdateSubresource(g_pSharedCB, 0, nullptr, &cb, 0, 0);
+	HRESULT hr = S_OK;
+	UINT params = (scene.msaaSamples != g_SampleCount ? Param_Samples : 0) |
+		(scene.monoSlice != g_Permutation.monoSlice ? Param_Slices : 0);
+	if (params)
+	{
+		g_SampleDesc.Count = scene.msaaSamples;
+		g_SampleDesc.Quality = scene.msaaSamples == g_MaxSampleCount ? g_MaxSampleQuality : 0;
+		g_SampleCount = scene.msaaSamples;
+		g_Permutation.monoSlice = scene.monoSlice;
+		SelectPermutation(g_SampleCount);
+		g_EyeCopyPath = SelectEyeCopyPath(g_SampleCount);
+
+		hr = RecompileShaders((params & Param_Samples ? Perm_MSAA : 0) | (params & Param_Slices ? Perm_Mono : 0));
+		if (FAILED(hr))
+			return hr;
 
-		//
-		// Render the cube
-		//
-		g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
-		g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pSharedCB);
-		g_pImmediateContext->GSSetShader(g_pGeometryShader, nullptr, 0);
-		g_pImmediateContext->GSSetConstantBuffers(0, 1, &g_pSharedCB);
-		g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
-		g_pImmediateContext->DrawIndexed(36, 0, 0);
+		g_DeviceResources.Invalidate(params);
+		hr = RebuildDeviceResources();
+		BindRhiObjects();
 	}
 
-	//
-	// Copy left/right eye to back buffer
-	//
-	NvAPI_Stereo_SetActiveEye(g_StereoHandle, NVAPI_STEREO_EYE_LEFT);
-	g_pImmediateContext->ResolveSubresource(g_pBackBuffer, 0, g_pOffscreenTexture, 0, DXGI_FORMAT_R8G8B8A8_UNORM);
+	g_DynamicResolution.scale = scene.renderScale;
+	g_Viewport.Width = floorf(g_BackBufferViewport.Width * scene.renderScale);
+	g_Viewport.Height = floorf(g_BackBufferViewport.Height * scene.renderScale);
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+// The timings in the report, the same for every scene.
+//--------------------------------------------------------------------------------------
+void CollectBenchmarkResult(const BenchmarkScene& scene)
+{
+	struct Timing
+	{
+		const char* name;
+		const char* scope;
+		TimingClock clock;
+	};
+	static const Timing timings[] =
+	{
+		{ "frame_cpu", "Frame", Timing_Cpu },
+		{ "frame_gpu", "Frame", Timing_Gpu },
+		{ "scene_gpu", "Scene", Timing_Gpu },
+		{ "left_eye_cpu", "LeftEye", Timing_Cpu },
+		{ "left_eye_gpu", "LeftEye", Timing_Gpu },
+		{ "right_eye_cpu", "RightEye", Timing_Cpu },
+		{ "right_eye_gpu", "RightEye", Timing_Gpu },
+		{ "present_cpu", "Present", Timing_Cpu },
+	};
+
+	g_FrameTiming.Collect();
 
-	NvAPI_Stereo_SetActiveEye(g_StereoHandle, NVAPI_STEREO_EYE_RIGHT);
-	g_pImmediateContext->ResolveSubresource(g_pBackBuffer, 0, g_pOffscreenTexture, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+	BenchmarkResult result;
+	result.scene = scene;
+	result.frames = g_Benchmark.measuredFrames;
+	for (const Timing& timing : timings)
+	{
+		result.names.push_back(timing.name);
+		result.timings.push_back(g_FrameTiming.Stats(g_FrameTiming.AddScope(timing.scope), timing.clock));
+	}
+	g_BenchmarkRun.results.push_back(result);
+
+	char msg[256];
+	sprintf_s(msg, "Benchmark: %s, %u objects, scale %.2f, %ux MSAA, %s mono slice: frame %.2fms mean %.2fms p99, GPU %.2fms mean %.2fms p99\n",
+		scene.name, scene.objects, scene.renderScale, scene.msaaSamples, scene.monoSlice ? "with" : "no",
+		result.timings[0].meanMs, result.timings[0].p99Ms, result.timings[1].meanMs, result.timings[1].p99Ms);
+	OutputDebugStringA(msg);
+}
+
+//--------------------------------------------------------------------------------------
+// Moves the benchmark along, before each frame.  Returns false once it is done, and
+// the report is written.
+//
+// GPU samples resolve up to g_GpuTimerFrames frames late, so each scene runs that
+// many frames more before it is collected, and FrameTiming keeps only the samples of
+// the measured frames.
+//--------------------------------------------------------------------------------------
+bool BenchmarkStep()
+{
+	BenchmarkRun& run = g_BenchmarkRun;
+	const BenchmarkOptions& options = g_Benchmark;
+	UINT lastScene = options.scene >= 0 ? (UINT)options.scene : ARRAYSIZE(g_BenchmarkScenes) - 1;
+
+	if (run.scene > lastScene)
+		return false;
+
+	if (run.frame == options.warmupFrames + options.measuredFrames + g_GpuTimerFrames)
+	{
+		CollectBenchmarkResult(run.current);
+		run.scene++;
+		run.frame = 0;
+
+		if (run.scene > lastScene)
+		{
+			std::string csv = options.output + ".csv";
+			std::string json = options.output + ".json";
+#if defined(_DEBUG)
+			const char* build = "Debug";
+#elif defined(PROFILE)
+			const char* build = "Profile";
+#else
+			const char* build = "Release";
+#endif
+			if (!WriteBenchmarkCsv(csv.c_str(), run.results) || !WriteBenchmarkJson(json.c_str(), run.results, options, build))
+				OutputDebugStringA("Benchmark: cannot write the report\n");
+			PostQuitMessage(0);
+			return false;
+		}
+	}
 
-	if (::GetAsyncKeyState(VK_SPACE))
+	if (run.frame == 0)
+	{
+		run.current = g_BenchmarkScenes[run.scene];
+		if (FAILED(ApplyBenchmarkScene(run.current)))
+		{
+			OutputDebugStringA("Benchmark: cannot set up the scene\n");
+			run.scene = lastScene + 1;
+			PostQuitMessage(1);
+			return false;
+		}
+		g_AnimationClock.ticks = 0;
+	}
+	if (run.frame == options.warmupFrames)
 	{
-		NvAPI_Stereo_SetActiveEye(g_StereoHandle, NVAPI_STEREO_EYE_MONO);
+		run.firstFrame = g_PresentCount;
+		g_FrameTiming.Reset(options.measuredFrames, run.firstFrame, run.firstFrame + options.measuredFrames - 1);
+	}
+
+	run.frame++;
+	return true;
+}
 
-		g_pImmediateContext->OMSetRenderTargets(1, &g_pRenderTargetView, nullptr);
 
-		g_pImmediateContext->VSSetShader(g_pQuadVertexShader, nullptr, 0);
-		g_pImmediateContext->GSSetShader(nullptr, nullptr, 0);
-		g_pImmediateContext->PSSetShader(g_isMSAA ? g_pMSQuadPixelShader : g_pQuadPixelShader, nullptr, 0);
-		g_pImmediateContext->PSSetShaderResources(0, 1, &g_pPackedDepthTextureSRV);
+//--------------------------------------------------------------------------------------
+// Render a frame, both eyes.
+//--------------------------------------------------------------------------------------
+void RenderFrame()
+{
+	if (g_Benchmark.enabled && !BenchmarkStep())
+		return;
+
+	FrameTiming* timing = g_FrameTimingEnabled ? &g_FrameTiming : nullptr;
+	uint64_t frame = g_PresentCount;
+	ScopedCpuTimer frameTimer(timing, g_TimerFrame, frame);
+
+	{
+		ScopedCpuTimer timer(timing, g_TimerWait, frame);
+		WaitForNextFrame();
+	}
+	UpdateDynamicResolution();
+
+	FrameGraph& g = g_FrameGraph;
+	g.resources[g_FgOffscreen].renderScale = g_DynamicResolution.scale;
+
+	g_LatencyMarkers.inputSampleMs = NowMs();
+
+	// A hot reload, or the deferred shaders, finished since the last frame.
+	if (g_ShaderSwapReady.load(std::memory_order_acquire))
+		ApplyShaderSwap();
+	if (g_FgDepthView >= 0)
+		g.passes[g_FgDepthView].enabled = (::GetAsyncKeyState(VK_SPACE) != 0) && g_pQuadPixelShader;
+	if (g_FgCompose >= 0)
+		g.passes[g_FgCompose].enabled = g_pComposePixelShader != nullptr;
+	if (g_FgInterleave >= 0)
+		g.passes[g_FgInterleave].enabled = g_pInterleavePixelShader != nullptr;
+	UpdateDepthReadback();
+	UpdateEyeRecording();
+	UpdateAutoConvergence();
+	UpdateFarField();
+	UpdateSuppression();
+	UpdateReprojection();
+
+#ifdef PROFILE
+	LARGE_INTEGER compileStart, compileEnd, frequency;
+	QueryPerformanceCounter(&compileStart);
+#endif
+	{
+		ScopedCpuTimer timer(timing, g_TimerCompile, frame);
+		g.Compile();
+	}
+#ifdef PROFILE
+	QueryPerformanceCounter(&compileEnd);
+	QueryPerformanceFrequency(&frequency);
+#endif
 
-		g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-		g_pImmediateContext->Draw(4, 0);
+	g_EyeCopyBytes = 0;
+	g_CommandList.Reset();
+	if (timing)
+		g_Rhi.timers.BeginFrame(g_pImmediateContext, frame, FrameTiming::NowMs());
+	if (g_Replaying)
+	{
+		ReplayFrame();
+	}
+	else if (timing)
+	{
+		g_CommandList.BeginTimer(g_TimerFrame);
+		g.Execute(BeginPassTiming, EndPassTiming);
+		g_CommandList.EndTimer(g_TimerFrame);
+	}
+	else
+	{
+		g.Execute();
+	}
+	if (g_CaptureFramesLeft)
+		CaptureFrame();
+#ifdef PROFILE
+	if (g_RhiBenchmarking)
+		RecordRhiBenchmarkFrame();
+#endif
+	{
+		ScopedCpuTimer timer(timing, g_TimerSubmit, frame);
+		g_Rhi.Execute(g_CommandList);
+	}
+	if (timing)
+		g_Rhi.timers.EndFrame(g_pImmediateContext);
+	if (g_ComposeCheckPending)
+		CheckComposer();
+	if (g_ReprojectionCheckPending)
+		CheckReprojection();
+
+	// Percentiles over the last g_FrameTiming window, and the pipeline statistics of
+	// the scene.  The GS is instanced once per slice, so its output is the input
+	// times the slice count.
+	if (timing && frame % 120 == 119)
+	{
+		g_FrameTiming.Collect(frame < g_FrameTraceFrames ? &g_FrameTrace : nullptr);
+		if (frame + 120 >= g_FrameTraceFrames && frame < g_FrameTraceFrames)
+			g_FrameTrace.Write(g_FrameTraceFile);
+		OutputDebugStringA(g_FrameTiming.Report().c_str());
+
+		const D3D11_QUERY_DATA_PIPELINE_STATISTICS& stats = g_Rhi.timers.statistics;
+		char msg[256];
+		sprintf_s(msg, "Pipeline: %llu primitives in, %llu GS invocations, %llu primitives out of GS (%.2fx), %llu PS invocations, %llu frames untimed\n",
+			stats.IAPrimitives, stats.GSInvocations, stats.GSPrimitives,
+			stats.IAPrimitives ? (double)stats.GSPrimitives / stats.IAPrimitives : 0.0, stats.PSInvocations,
+			g_Rhi.timers.untimedFrames);
+		OutputDebugStringA(msg);
+
+		// The statistics are of a frame a few back, near enough for a steady mode.
+		if (g_SuppressedSlice < 0)
+		{
+			g_UnsuppressedPSInvocations = stats.PSInvocations;
+		}
+		else if (g_UnsuppressedPSInvocations)
+		{
+			sprintf_s(msg, "Suppression: %llu scene PS invocations, %.1f%% fewer than both eyes at full size\n",
+				stats.PSInvocations, 100.0 - 100.0 * stats.PSInvocations / g_UnsuppressedPSInvocations);
+			OutputDebugStringA(msg);
+		}
+	}
 
-		ID3D11ShaderResourceView* nullSRV = nullptr;
-		g_pImmediateContext->PSSetShaderResources(0, 1, &nullSRV);
+#ifdef PROFILE
+	static UINT s_frameCount = 0;
+	if (++s_frameCount % 120 == 0)
+	{
+		char msg[256];
+		static const char* pathNames[] = { "ResolveSubresource", "CopySubresourceRegion", "Upscale" };
+		sprintf_s(msg, "EyeCopy: %s, %llu bytes/frame, scale %.2f\n",
+			pathNames[g_EyeCopyPath], g_EyeCopyBytes, g_DynamicResolution.scale);
+		OutputDebugStringA(msg);
+
+		sprintf_s(msg, "FrameGraph: %u of %u passes, compiled in %.1fus, %llu transient bytes in %u pools, %llu saved by aliasing\n",
+			(UINT)g.order.size(), (UINT)g.passes.size(),
+			(compileEnd.QuadPart - compileStart.QuadPart) * 1000000.0 / frequency.QuadPart,
+			g.transientBytes, (UINT)g.pools.size(), g.transientBytes - g.pooledBytes);
+		OutputDebugStringA(msg);
+
+		sprintf_s(msg, "FarField: %u of %u cubes far, beyond w %.1f, outer view shift %.2fpx, %.1f%% of GS triangles saved over 120 frames\n",
+			g_FarField.farObjects, g_FarField.nearObjects + g_FarField.farObjects, g_FarField.splitW, g_FarField.shiftPx,
+			g_FarFieldTriangles ? 100.0 * g_FarFieldSavedTriangles / g_FarFieldTriangles : 0.0);
+		OutputDebugStringA(msg);
+		g_FarFieldTriangles = g_FarFieldSavedTriangles = 0;
+
+		if (g_DepthReadbacks)
+		{
+			sprintf_s(msg, "DepthReadback: %u over 120 frames, %.1f frames from copy to map\n",
+				g_DepthReadbacks, (double)g_DepthReadbackLatency / g_DepthReadbacks);
+			OutputDebugStringA(msg);
+		}
+		if (g_AutoConvergenceEnabled && g_DepthHistograms)
+		{
+			sprintf_s(msg, "AutoConvergence: %.2f, target %.2f, %u histograms, %llu of %llu texels binned\n",
+				g_ConvergenceController.convergence, g_ConvergenceController.target, g_DepthHistograms,
+				g_DepthHistogram->Count(), g_DepthHistogram->Count() + g_DepthHistogram->Background());
+			OutputDebugStringA(msg);
+		}
+		if (g_ComfortEnabled && g_ComfortAnalyses)
+		{
+			sprintf_s(msg, "Comfort: %u analyses, %.2fms each, disparity %.1f to %.1fpx, flagged divergence %u, crossed %u, window %u, jump %u\n",
+				g_ComfortAnalyses, g_ComfortMs / g_ComfortAnalyses, g_ComfortMinPx, g_ComfortMaxPx,
+				g_ComfortFlagged[0], g_ComfortFlagged[1], g_ComfortFlagged[2], g_ComfortFlagged[3]);
+			OutputDebugStringA(msg);
+		}
+		g_DepthReadbacks = 0;
+		g_DepthReadbackLatency = 0;
+		g_DepthHistograms = 0;
+		g_ComfortAnalyses = 0;
+		g_ComfortMs = 0.0;
+		memset(g_ComfortFlagged, 0, sizeof(g_ComfortFlagged));
+
+		sprintf_s(msg, "Present: %s, %llu frames, %llu missed (%llu refreshes), %llu eye swaps%s\n",
+			g_IsFlipModel ? "flip" : "blt", g_FramePacer.frames, g_FramePacer.missedFrames,
+			g_FramePacer.missedRefreshes, g_FramePacer.eyeSwaps, g_FramePacer.eyesSwapped ? ", eyes swapped" : "");
+		OutputDebugStringA(msg);
+		if (g_ReprojectionEnabled)
+			ReportReprojection();
+		if (g_Suppression != Suppression_Off)
+			ReportSuppression();
+
+#ifdef NVAPI_STANDIN
+		// What the NvAPI calls cost per frame, including any latency injected by
+		// the stand-in's script.
+		UINT64 calls = 0;
+		UINT64 totalNs = 0;
+		for (int call = 0; call < NvStandIn_CallCount; call++)
+		{
+			NvStandInCallStats stats;
+			NvStandIn_GetStats((NvStandInCall)call, &stats);
+			calls += stats.calls;
+			totalNs += stats.totalNs;
+		}
+		NvStandIn_ResetStats();
+		sprintf_s(msg, "NvAPI: %.1f calls/frame, %.2fus/frame, script frame %llu\n",
+			calls / 120.0, totalNs / 120000.0, NvStandIn_GetFrame());
+		OutputDebugStringA(msg);
+#endif
 	}
+#endif
 
 	//
 	// Present our back buffer to our front buffer
@@ -910,5 +5424,10 @@ void RenderFrame()
 	// In stereo mode, the driver knows to use the 2x width buffer, and
 	// present each eye in order.
 	//
-	g_pSwapChain->Present(0, 0);
+	ScopedCpuTimer presentTimer(timing, g_TimerPresent, frame);
+	UINT64 missedFrames = g_FramePacer.missedFrames;
+	PresentFrame();
+	g_Reprojection.OnPresent(g_ReprojectionWarp, g_FramePacer.missedFrames != missedFrames,
+		g_LatencyMarkers.presentMs - g_LatencyMarkers.frameStartMs);
+	g_AnimationClock.Tick();
 }
@@ -4,6 +4,38 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------------------------------
+// Permutation options
+//
+// Set by the app when it compiles each shader, see ShaderPermutation in Tutorial07.cpp.
+// Only the options a shader reads are passed to it, the defaults here fill in the rest.
+//--------------------------------------------------------------------------------------
+#ifndef MSAA_SAMPLES
+#define MSAA_SAMPLES 1			// samples per texel of the offscreen array
+#endif
+#ifndef VIEW_COUNT
+#define VIEW_COUNT 2			// view slices, at the front of the array, the two eyes or more
+#endif
+#ifndef MONO_SLICE
+#define MONO_SLICE 1			// a mono slice after the eyes, holding packed depth
+#endif
+
+#define DEPTH_PACK_FLOAT 0		// the bits of the float depth, one byte per channel
+#define DEPTH_PACK_UNORM24 1	// depth / DEPTH_FAR in 24 bits, w is left at 255
+#ifndef DEPTH_PACKING
+#define DEPTH_PACKING DEPTH_PACK_FLOAT
+#endif
+#define DEPTH_FAR 100.0f		// the far plane of the projection
+
+#define MAX_VIEWS 9				// MultiviewMaxViews, see multiview.h
+#define SLICE_COUNT (VIEW_COUNT + MONO_SLICE)
+#define MONO_INDEX VIEW_COUNT
+
+#if VIEW_COUNT < 2 || VIEW_COUNT > MAX_VIEWS
+#error StereoParamsArray holds 2 to MAX_VIEWS views and the mono slice
+#endif
+
+#if DEPTH_PACKING == DEPTH_PACK_FLOAT
 uint4 packDepth(float depth)
 {
 	uint uiDepth = asuint(depth);
@@ -15,18 +47,52 @@ float unpackDepth(uint4 packedDepth)
 	uint uiDepth = packedDepth.x | (packedDepth.y << 8) | (packedDepth.z << 16) | (packedDepth.w << 24);
 	return asfloat(uiDepth);
 }
+#elif DEPTH_PACKING == DEPTH_PACK_UNORM24
+uint4 packDepth(float depth)
+{
+	uint uiDepth = (uint)(saturate(depth / DEPTH_FAR) * 16777215.0f + 0.5f);
+	return uint4(uiDepth & 255, (uiDepth >> 8) & 255, (uiDepth >> 16) & 255, 255);
+}
+
+float unpackDepth(uint4 packedDepth)
+{
+	uint uiDepth = packedDepth.x | (packedDepth.y << 8) | (packedDepth.z << 16);
+	return uiDepth * (DEPTH_FAR / 16777215.0f);
+}
+#else
+#error Unknown DEPTH_PACKING
+#endif
 
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
+//
+// The C++ structs for these are generated, run cbuffer_gen on this file after
+// changing them.  Matrices are row_major, so the app uploads DirectXMath matrices
+// as they are.
 //--------------------------------------------------------------------------------------
 
 cbuffer cbShared : register( b0 )
 {
-	matrix World;
-	matrix View;
-	matrix Projection;
+	row_major matrix World;
+	row_major matrix View;
+	row_major matrix Projection;
 
-	float4 StereoParamsArray[3];
+	float4 StereoParamsArray[10];	// MAX_VIEWS + 1, x = separation, y = convergence, z = far layer shift in pixels, w = viewport scale
+};
+
+cbuffer cbResolve : register( b1 )
+{
+	float4 ResolveParams;	// xy = render scale, z = source slice, w = stereo format for ComposePS
+	float4 ResolveClamp;	// xy = last texel actually rendered in the slice
+	uint4 InterleaveSteps;	// for InterleavePS, x = subpixel, y = pixel, z = row, w = origin
+};
+
+cbuffer cbReproject : register( b2 )
+{
+	row_major matrix ReprojectObject;		// view space drawn in to view space now, for the cubes
+	row_major matrix ReprojectBackground;	// the same for what is at DEPTH_FAR
+	float4 ReprojectProjection;	// xy = Projection._11 and _22, zw = size of the part of the slices drawn
+	float4 ReprojectStereo;		// xy = separation and convergence the eye was drawn with, zw = now
 };
 
 
@@ -48,6 +114,7 @@ struct GS_OUTPUT
 	float4 Pos : SV_POSITION;
 	float2 Tex : TEXCOORD0;
 	uint rtIndex : SV_RenderTargetArrayIndex;
+	uint vpIndex : SV_ViewportArrayIndex;
 };
 
 //--------------------------------------------------------------------------------------
@@ -71,12 +138,15 @@ float4 GetStereoPos(float4 pos, float4 stereoParams)
 	return spos;
 }
 
-[instance(3)]
+// Each slice goes through its own viewport, so the eye binocular suppression draws
+// small fills only the top left of its slice.
+[instance(SLICE_COUNT)]
 [maxvertexcount(3)]
 void GS(triangle PS_INPUT In[3], inout TriangleStream<GS_OUTPUT> TriStream, uint gsInstanceId : SV_GSInstanceID)
 {
 	GS_OUTPUT output;
 	output.rtIndex = gsInstanceId;
+	output.vpIndex = gsInstanceId;
 	[unroll] for (int v = 0; v < 3; v++)
 	{
 		output.Pos = GetStereoPos(In[v].Pos, StereoParamsArray[gsInstanceId]);
@@ -90,14 +160,21 @@ void GS(triangle PS_INPUT In[3], inout TriangleStream<GS_OUTPUT> TriStream, uint
 //--------------------------------------------------------------------------------------
 
 //[earlydepthstencil]
+#if MONO_SLICE
 uint4 PS(PS_INPUT input, uint rtIndex : SV_RenderTargetArrayIndex) : SV_Target
 {
-	if (rtIndex == 2)
+	if (rtIndex == MONO_INDEX)
 	{
 		return packDepth(input.Pos.w);
 	}
 	return uint4(128, 128, 128, 255);
 }
+#else
+uint4 PS(PS_INPUT input) : SV_Target
+{
+	return uint4(128, 128, 128, 255);
+}
+#endif
 
 
 struct QuadVS_Output {
@@ -112,18 +189,329 @@ QuadVS_Output QuadVS(uint vIdx : SV_VertexID)
 	return output;
 }
 
+
+//--------------------------------------------------------------------------------------
+// The offscreen array, read with Load since it is UINT.  With MSAA the samples are
+// averaged, the count is a literal so the loop unrolls.
+//--------------------------------------------------------------------------------------
+#if MSAA_SAMPLES > 1
+Texture2DMS<uint4, MSAA_SAMPLES> PackedDepthSRV : register(t0);
+Texture2DMSArray<uint4, MSAA_SAMPLES> EyeSRV : register(t1);
+
+uint4 LoadPackedDepth(int2 xy)
+{
+	return PackedDepthSRV.Load(xy, 0);
+}
+
+float4 LoadEyeTexel(int2 xy)
+{
+	float4 sum = 0;
+	[unroll] for (uint s = 0; s < MSAA_SAMPLES; s++)
+	{
+		sum += EyeSRV.Load(int3(xy, ResolveParams.z), s);
+	}
+	return sum / MSAA_SAMPLES;
+}
+#else
 Texture2D<uint4> PackedDepthSRV : register(t0);
+Texture2DArray<uint4> EyeSRV : register(t1);
+
+uint4 LoadPackedDepth(int2 xy)
+{
+	return PackedDepthSRV.Load(int3(xy, 0));
+}
+
+float4 LoadEyeTexel(int2 xy)
+{
+	return EyeSRV.Load(int4(xy, ResolveParams.z, 0));
+}
+#endif
 
 float4 QuadPS(QuadVS_Output input) : SV_Target
 {
-	float depth = unpackDepth(PackedDepthSRV.Load(int3(input.pos.xy, 0))) * 0.1f;
+	float depth = unpackDepth(LoadPackedDepth(int2(input.pos.xy * ResolveParams.xy))) * 0.1f;
 	return float4(depth, 0.0f, depth, 1.0f);
 }
 
-Texture2DMS<uint4> PackedDepthSRV_MS : register(t0);
 
-float4 MSQuadPS(QuadVS_Output input) : SV_Target
+//--------------------------------------------------------------------------------------
+// Copy the packed depth, the first sample with MSAA, into a single sample target the
+// CPU reads back for auto-convergence.  A UINT target cannot be resolved.
+//--------------------------------------------------------------------------------------
+uint4 DepthCopyPS(QuadVS_Output input) : SV_Target
 {
-	float depth = unpackDepth(PackedDepthSRV_MS.Load(int3(input.pos.xy, 0), 0)) * 0.1f;
-	return float4(depth, 0.0f, depth, 1.0f);
+	return LoadPackedDepth(int2(input.pos.xy));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pack both eyes into one frame, for displays that take stereo that way rather than
+// through Direct Mode.  The eyes were copied or resolved into a single sample pair,
+// and ResolveClamp.xy is the last texel of an eye.  Integer only, so the CPU
+// composer in stereo_compose.cpp gives the same bytes, see there for the formats.
+//--------------------------------------------------------------------------------------
+#define STEREO_FORMAT_SIDE_BY_SIDE 0
+#define STEREO_FORMAT_HALF_SIDE_BY_SIDE 1
+#define STEREO_FORMAT_TOP_BOTTOM 2
+#define STEREO_FORMAT_ROW_INTERLEAVED 3
+#define STEREO_FORMAT_CHECKERBOARD 4
+#define STEREO_FORMAT_ANAGLYPH 5
+
+Texture2DArray<uint4> EyePairSRV : register(t3);
+
+// Dubois' red-cyan matrices in 1/1024ths, g_DuboisLeft and g_DuboisRight.
+static const int3 DuboisLeft[3] = { int3(467, 512, 180), int3(-41, -39, -16), int3(-15, -22, -5) };
+static const int3 DuboisRight[3] = { int3(-44, -90, -2), int3(387, 752, -18), int3(-74, -116, 1255) };
+
+uint4 LoadEyePair(int2 xy, uint eye)
+{
+	return EyePairSRV.Load(int4(xy, eye, 0));
+}
+
+uint4 AverageEyeTexels(int2 a, int2 b, uint eye)
+{
+	return (LoadEyePair(a, eye) + LoadEyePair(b, eye) + 1) >> 1;
+}
+
+uint4 Anaglyph(int3 l, int3 r)
+{
+	int3 sum;
+	[unroll] for (int c = 0; c < 3; c++)
+	{
+		sum[c] = dot(DuboisLeft[c], l) + dot(DuboisRight[c], r);
+	}
+	return uint4(min(max(sum + 512, 0) >> 10, 255), 255);
+}
+
+float4 ComposePS(QuadVS_Output input) : SV_Target
+{
+	uint format = (uint)ResolveParams.w;
+	int2 last = int2(ResolveClamp.xy);
+	int2 xy = int2(input.pos.xy);
+	uint4 texel;
+
+	if (format == STEREO_FORMAT_SIDE_BY_SIDE)
+	{
+		uint eye = xy.x > last.x ? 1 : 0;
+		texel = LoadEyePair(int2(xy.x - eye * (last.x + 1), xy.y), eye);
+	}
+	else if (format == STEREO_FORMAT_HALF_SIDE_BY_SIDE)
+	{
+		int halfWidth = (last.x + 1) / 2;
+		uint eye = xy.x >= halfWidth ? 1 : 0;
+		int x = 2 * (xy.x - eye * halfWidth);
+		texel = AverageEyeTexels(int2(x, xy.y), int2(min(x + 1, last.x), xy.y), eye);
+	}
+	else if (format == STEREO_FORMAT_TOP_BOTTOM)
+	{
+		int halfHeight = (last.y + 1) / 2;
+		uint eye = xy.y >= halfHeight ? 1 : 0;
+		int y = 2 * (xy.y - eye * halfHeight);
+		texel = AverageEyeTexels(int2(xy.x, y), int2(xy.x, min(y + 1, last.y)), eye);
+	}
+	else if (format == STEREO_FORMAT_ROW_INTERLEAVED)
+	{
+		texel = LoadEyePair(xy, xy.y & 1);
+	}
+	else if (format == STEREO_FORMAT_CHECKERBOARD)
+	{
+		texel = LoadEyePair(xy, (xy.x + xy.y) & 1);
+	}
+	else
+	{
+		texel = Anaglyph(int3(LoadEyePair(xy, 0).rgb), int3(LoadEyePair(xy, 1).rgb));
+	}
+
+	// Exact through the UNORM target.
+	return texel / 255.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Interleave the views into the subpixels of a slanted lenticular panel.  The views
+// were copied or resolved into the eye pair, a slice each, as the eyes are for the
+// formats above.  Each channel takes the view under its part of the lens, by the
+// integer phase in InterleaveSteps, so InterleaveViews in multiview.cpp gives the
+// same bytes, see multiview.h.
+//--------------------------------------------------------------------------------------
+#define INTERLEAVE_PERIOD (VIEW_COUNT << 16)
+
+float4 InterleavePS(QuadVS_Output input) : SV_Target
+{
+	uint2 xy = uint2(input.pos.xy);
+	uint base = ((InterleaveSteps.w + xy.y * InterleaveSteps.z) % INTERLEAVE_PERIOD + (xy.x * InterleaveSteps.y) % INTERLEAVE_PERIOD) %
+		INTERLEAVE_PERIOD;
+
+	uint4 texel = uint4(0, 0, 0, 255);
+	[unroll] for (uint c = 0; c < 3; c++)
+	{
+		uint view = ((base + c * InterleaveSteps.x) % INTERLEAVE_PERIOD) >> 16;
+		texel[c] = LoadEyePair(int2(xy), view)[c];
+	}
+	return texel / 255.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Upscale an eye slice rendered at reduced resolution into the full size back buffer.
+//
+// The offscreen array is written through a UINT view, so there is no filtering
+// available.  The bilinear filter is done by hand on 4 texels.
+//--------------------------------------------------------------------------------------
+float4 LoadEye(int2 xy)
+{
+	xy = clamp(xy, int2(0, 0), int2(ResolveClamp.xy));
+	return LoadEyeTexel(xy) / 255.0f;
+}
+
+float4 UpscalePS(QuadVS_Output input) : SV_Target
+{
+	float2 src = input.pos.xy * ResolveParams.xy - 0.5f;
+	int2 i = (int2)floor(src);
+	float2 f = src - i;
+
+	float4 top = lerp(LoadEye(i), LoadEye(i + int2(1, 0)), f.x);
+	float4 bottom = lerp(LoadEye(i + int2(0, 1)), LoadEye(i + int2(1, 1)), f.x);
+	return lerp(top, bottom, f.y);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Warp an eye of the last frame drawn to now, for a frame that is not drawn, see
+// reprojection.h.  The depth the eye saw, found through the mono slice, puts each
+// eye texel back in view space, the matrices move it, and GetStereoPos's shift puts
+// it back in the eye.  This goes backwards, from the texel written to the eye texel
+// that lands on it, by a few fixed point steps, so every texel is written, and with
+// nothing moved every texel stays where it is.  Everything is read at the nearest texel,
+// in the same order of operations as ReprojectEye, so the CPU gives the same texels.
+// ResolveParams.xy is the scale from the back buffer to the slice, z the eye slice.
+//--------------------------------------------------------------------------------------
+#define REPROJECT_ITERATIONS 2
+
+int2 ReprojectTexel(float2 xy)
+{
+	return (int2)(clamp(xy, float2(0.0f, 0.0f), ResolveClamp.xy) + 0.5f);
+}
+
+float ReprojectDepth(float2 xy)
+{
+	float w = unpackDepth(LoadPackedDepth(ReprojectTexel(xy)));
+	return (w > 0.0f && w < DEPTH_FAR) ? w : DEPTH_FAR;
+}
+
+float ReprojectShift(float w, float2 stereo)
+{
+	return stereo.x * (1.0f - stereo.y / w) * (ReprojectProjection.z * 0.5f);
+}
+
+// The depth the eye saw at eye texel e, as EyeDepth in reprojection.cpp.
+#define REPROJECT_CONSISTENT_PX 1.0f
+
+float ReprojectEyeDepth(float2 e)
+{
+	float w0 = ReprojectDepth(e);
+	float s0 = ReprojectShift(w0, ReprojectStereo.xy);
+	float w1 = ReprojectDepth(e - float2(s0, 0.0f));
+	float s1 = ReprojectShift(w1, ReprojectStereo.xy);
+	float s2 = ReprojectShift(ReprojectDepth(e - float2(s1, 0.0f)), ReprojectStereo.xy);
+	bool right0 = abs(s1 - s0) < REPROJECT_CONSISTENT_PX;
+	bool right1 = abs(s2 - s1) < REPROJECT_CONSISTENT_PX;
+	if (right0 && right1)
+		return min(w0, w1);
+	if (right0 || right1)
+		return right0 ? w0 : w1;
+	return max(w0, w1);
+}
+
+// Where the eye sees mono texel m at depth w now.
+float2 ReprojectForward(float2 m, float w)
+{
+	float2 halfSize = ReprojectProjection.zw * 0.5f;
+	float4 v = float4(((m.x + 0.5f) / halfSize.x - 1.0f) * w / ReprojectProjection.x,
+		(1.0f - (m.y + 0.5f) / halfSize.y) * w / ReprojectProjection.y, w, 1.0f);
+	float4 n = (w < DEPTH_FAR) ? mul(v, ReprojectObject) : mul(v, ReprojectBackground);
+	n.z = max(n.z, 0.001f);
+	return float2((ReprojectProjection.x * n.x / n.z + 1.0f) * halfSize.x - 0.5f + ReprojectShift(n.z, ReprojectStereo.zw),
+		(1.0f - ReprojectProjection.y * n.y / n.z) * halfSize.y - 0.5f);
+}
+
+float4 ReprojectPS(QuadVS_Output input) : SV_Target
+{
+	float2 p = input.pos.xy * ResolveParams.xy - 0.5f;
+	float2 e = p;
+	[unroll] for (int i = 0; i < REPROJECT_ITERATIONS; i++)
+	{
+		float w = ReprojectEyeDepth(e);
+		e = e + (p - ReprojectForward(e - float2(ReprojectShift(w, ReprojectStereo.xy), 0.0f), w));
+	}
+	return LoadEye(ReprojectTexel(e));
+}
+
+
+//--------------------------------------------------------------------------------------
+// The mono far layer.  Objects far enough away that both eyes see them the same,
+// but for a shift, are drawn once, straight from VS without the GS, into the layer,
+// and the layer is copied into every slice, shifted by StereoParamsArray[slice].z
+// pixels, before the near objects are drawn over it.  The mono slice gets the
+// layer's packed depth, unshifted.  A slice drawn through a smaller viewport,
+// StereoParamsArray[slice].w of full size, reads the layer at the nearest full
+// size texel.  See far_field.h.
+//--------------------------------------------------------------------------------------
+struct FAR_OUTPUT
+{
+	uint4 color : SV_Target0;
+#if MONO_SLICE
+	uint4 depth : SV_Target1;
+#endif
+};
+
+FAR_OUTPUT FarPS(PS_INPUT input)
+{
+	FAR_OUTPUT output;
+	output.color = uint4(128, 128, 128, 255);
+#if MONO_SLICE
+	output.depth = packDepth(input.Pos.w);
+#endif
+	return output;
+}
+
+struct FAR_COMPOSITE_INPUT
+{
+	float4 pos : SV_POSITION;
+	nointerpolation float shift : TEXCOORD0;
+	nointerpolation float scale : TEXCOORD1;
+	uint rtIndex : SV_RenderTargetArrayIndex;
+	uint vpIndex : SV_ViewportArrayIndex;
+};
+
+[instance(SLICE_COUNT)]
+[maxvertexcount(3)]
+void FarCompositeGS(triangle QuadVS_Output In[3], inout TriangleStream<FAR_COMPOSITE_INPUT> TriStream, uint gsInstanceId : SV_GSInstanceID)
+{
+	FAR_COMPOSITE_INPUT output;
+	output.rtIndex = gsInstanceId;
+	output.vpIndex = gsInstanceId;
+	output.shift = StereoParamsArray[gsInstanceId].z;
+	output.scale = StereoParamsArray[gsInstanceId].w;
+	[unroll] for (int v = 0; v < 3; v++)
+	{
+		output.pos = In[v].pos;
+		TriStream.Append(output);
+	}
+}
+
+// The layer is single sample, and the same size as the offscreen array.
+Texture2DArray<uint4> FarLayerSRV : register(t2);
+
+uint4 FarCompositePS(FAR_COMPOSITE_INPUT input) : SV_Target
+{
+	int2 xy = int2(input.pos.xy / input.scale) - int2(round(input.shift), 0);
+	xy = clamp(xy, int2(0, 0), int2(ResolveClamp.xy));
+#if MONO_SLICE
+	if (input.rtIndex == MONO_INDEX)
+	{
+		return FarLayerSRV.Load(int4(xy, 1, 0));
+	}
+#endif
+	return FarLayerSRV.Load(int4(xy, 0, 0));
 }
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// Generated by cbuffer_gen from Tutorial07.fx, do not edit.
+//
+// Matrices are XMFLOAT4X4.  A row_major one takes XMStoreFloat4x4 of a DirectXMath
+// matrix as it is, a column_major one needs it transposed first.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <directxmath.h>
+#include "cbuffer_layout.h"
+
+
+// cbuffer cbShared : register(b0), 352 bytes
+struct SharedCB
+{
+	DirectX::XMFLOAT4X4 mWorld;	// row_major
+	DirectX::XMFLOAT4X4 mView;	// row_major
+	DirectX::XMFLOAT4X4 mProjection;	// row_major
+	DirectX::XMFLOAT4 mStereoParamsArray[10];
+};
+
+static_assert(offsetof(SharedCB, mWorld) == 0, "cbShared.World");
+static_assert(offsetof(SharedCB, mView) == 64, "cbShared.View");
+static_assert(offsetof(SharedCB, mProjection) == 128, "cbShared.Projection");
+static_assert(offsetof(SharedCB, mStereoParamsArray) == 192, "cbShared.StereoParamsArray");
+static_assert(sizeof(SharedCB) == 352, "cbShared");
+
+const uint32_t SharedCB_Slot = 0;
+
+enum SharedCB_Field
+{
+	SharedCB_World,
+	SharedCB_View,
+	SharedCB_Projection,
+	SharedCB_StereoParamsArray,
+	SharedCB_FieldCount
+};
+
+const CbField SharedCB_Fields[SharedCB_FieldCount] =
+{
+	{ "World", 0, 64 },
+	{ "View", 64, 64 },
+	{ "Projection", 128, 64 },
+	{ "StereoParamsArray", 192, 160 },
+};
+
+
+// cbuffer cbResolve : register(b1), 48 bytes
+struct ResolveCB
+{
+	DirectX::XMFLOAT4 mResolveParams;
+	DirectX::XMFLOAT4 mResolveClamp;
+	DirectX::XMUINT4 mInterleaveSteps;
+};
+
+static_assert(offsetof(ResolveCB, mResolveParams) == 0, "cbResolve.ResolveParams");
+static_assert(offsetof(ResolveCB, mResolveClamp) == 16, "cbResolve.ResolveClamp");
+static_assert(offsetof(ResolveCB, mInterleaveSteps) == 32, "cbResolve.InterleaveSteps");
+static_assert(sizeof(ResolveCB) == 48, "cbResolve");
+
+const uint32_t ResolveCB_Slot = 1;
+
+enum ResolveCB_Field
+{
+	ResolveCB_ResolveParams,
+	ResolveCB_ResolveClamp,
+	ResolveCB_InterleaveSteps,
+	ResolveCB_FieldCount
+};
+
+const CbField ResolveCB_Fields[ResolveCB_FieldCount] =
+{
+	{ "ResolveParams", 0, 16 },
+	{ "ResolveClamp", 16, 16 },
+	{ "InterleaveSteps", 32, 16 },
+};
+
+
+// cbuffer cbReproject : register(b2), 160 bytes
+struct ReprojectCB
+{
+	DirectX::XMFLOAT4X4 mReprojectObject;	// row_major
+	DirectX::XMFLOAT4X4 mReprojectBackground;	// row_major
+	DirectX::XMFLOAT4 mReprojectProjection;
+	DirectX::XMFLOAT4 mReprojectStereo;
+};
+
+static_assert(offsetof(ReprojectCB, mReprojectObject) == 0, "cbReproject.ReprojectObject");
+static_assert(offsetof(ReprojectCB, mReprojectBackground) == 64, "cbReproject.ReprojectBackground");
+static_assert(offsetof(ReprojectCB, mReprojectProjection) == 128, "cbReproject.ReprojectProjection");
+static_assert(offsetof(ReprojectCB, mReprojectStereo) == 144, "cbReproject.ReprojectStereo");
+static_assert(sizeof(ReprojectCB) == 160, "cbReproject");
+
+const uint32_t ReprojectCB_Slot = 2;
+
+enum ReprojectCB_Field
+{
+	ReprojectCB_ReprojectObject,
+	ReprojectCB_ReprojectBackground,
+	ReprojectCB_ReprojectProjection,
+	ReprojectCB_ReprojectStereo,
+	ReprojectCB_FieldCount
+};
+
+const CbField ReprojectCB_Fields[ReprojectCB_FieldCount] =
+{
+	{ "ReprojectObject", 0, 64 },
+	{ "ReprojectBackground", 64, 64 },
+	{ "ReprojectProjection", 128, 16 },
+	{ "ReprojectStereo", 144, 16 },
+};
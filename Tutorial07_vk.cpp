@@ -0,0 +1,1376 @@
+//--------------------------------------------------------------------------------------
+// File: Tutorial07_vk.cpp
+//
+// Vulkan backend for the stereo renderer in Tutorial07.cpp, so the same pipeline
+// can be run and checked on Linux, including on the Mesa lavapipe CPU driver where
+// there is no GPU at all.
+//
+// It is headless.  There is no 3D Vision on Linux, so instead of presenting, each
+// frame renders into the same 3 layer array as the D3D11 path:
+//	layer 0 = left eye, layer 1 = right eye, layer 2 = mono packed depth
+// and then draws the quad debug view of the packed depth into a separate output
+// image.  After the last frame the layers and the debug view are read back and
+// checked.
+//
+// Differences from the D3D11 path:
+//	- The render pass uses VK_KHR_multiview with a view mask of 0b111 instead of
+//	  the instanced GS.  gl_ViewIndex does the job of SV_GSInstanceID.
+//	- Separation and convergence come from the command line, not NvAPI.
+//	- Single sampled, and no dynamic resolution.
+//	- The viewport has a negative height so clip space and the images come out the
+//	  same way up as D3D11.
+//
+// Build (the shaders are compiled offline to SPIR-V, see the .vert and .frag files):
+//	g++ -O2 -std=c++14 Tutorial07_vk.cpp -lvulkan -o Tutorial07_vk
+//
+// Run on lavapipe:
+//	VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./Tutorial07_vk --frames 300
+//
+// Exit code is 0 when the output checks pass, so it can gate CI.
+//--------------------------------------------------------------------------------------
+
+#include <vulkan/vulkan.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//
+// Matrices are row major with row vectors, the same as DirectXMath, so the shaders
+// multiply in the same order as Tutorial07.fx.
+//--------------------------------------------------------------------------------------
+struct Float4x4
+{
+	float m[4][4];
+};
+
+struct SimpleVertex
+{
+	float Pos[3];
+	float Tex[2];
+};
+
+// Same layout as SharedCB in Tutorial07.cpp, std140 packs it identically.
+struct SharedCB
+{
+	Float4x4 mWorld;
+	Float4x4 mView;
+	Float4x4 mProjection;
+	float mStereoParamsArray[3][4];
+};
+
+struct ImageResource
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+};
+
+struct BufferResource
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	void* mapped = nullptr;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+uint32_t							g_ScreenWidth = 1280;
+uint32_t							g_ScreenHeight = 720;
+uint32_t							g_FrameCount = 120;
+bool								g_PreferCPU = false;
+const char*							g_DumpPrefix = nullptr;
+
+// Stand-ins for what NvAPI would report on Windows.
+float								g_EyeSeparation = 0.065f;
+float								g_SeparationPercentage = 50.0f;
+float								g_Convergence = 4.0f;
+
+VkInstance							g_Instance = VK_NULL_HANDLE;
+VkPhysicalDevice					g_PhysicalDevice = VK_NULL_HANDLE;
+VkPhysicalDeviceMemoryProperties	g_MemoryProperties;
+VkDevice							g_Device = VK_NULL_HANDLE;
+VkQueue								g_Queue = VK_NULL_HANDLE;
+uint32_t							g_QueueFamily = 0;
+VkCommandPool						g_CommandPool = VK_NULL_HANDLE;
+VkCommandBuffer						g_CommandBuffer = VK_NULL_HANDLE;
+VkFence								g_Fence = VK_NULL_HANDLE;
+
+// The 3 layer offscreen target, and its depth
+ImageResource						g_OffscreenTexture;
+ImageResource						g_DepthStencil;
+// Where the debug view goes, stands in for the back buffer
+ImageResource						g_OutputTexture;
+
+VkRenderPass						g_SceneRenderPass = VK_NULL_HANDLE;
+VkRenderPass						g_QuadRenderPass = VK_NULL_HANDLE;
+VkFramebuffer						g_SceneFramebuffer = VK_NULL_HANDLE;
+VkFramebuffer						g_QuadFramebuffer = VK_NULL_HANDLE;
+
+VkSampler							g_PointSampler = VK_NULL_HANDLE;
+VkDescriptorSetLayout				g_DescriptorSetLayout = VK_NULL_HANDLE;
+VkDescriptorPool					g_DescriptorPool = VK_NULL_HANDLE;
+VkDescriptorSet						g_DescriptorSet = VK_NULL_HANDLE;
+VkPipelineLayout					g_PipelineLayout = VK_NULL_HANDLE;
+VkPipeline							g_ScenePipeline = VK_NULL_HANDLE;
+VkPipeline							g_QuadPipeline = VK_NULL_HANDLE;
+
+BufferResource						g_VertexBuffer;
+BufferResource						g_IndexBuffer;
+BufferResource						g_SharedCB;
+BufferResource						g_ReadbackBuffer;
+
+Float4x4							g_World;
+Float4x4							g_View;
+Float4x4							g_Projection;
+
+const VkFormat						g_OffscreenFormat = VK_FORMAT_R8G8B8A8_UINT;
+const VkFormat						g_DepthFormat = VK_FORMAT_D32_SFLOAT;
+const VkFormat						g_OutputFormat = VK_FORMAT_R8G8B8A8_UNORM;
+const uint32_t						g_LayerCount = 3;
+
+
+//--------------------------------------------------------------------------------------
+// Forward declarations
+//--------------------------------------------------------------------------------------
+VkResult InitDevice();
+VkResult InitResources();
+void CleanupDevice();
+void RenderFrame(uint32_t frame);
+VkResult SubmitAndWait();
+bool ValidateOutput();
+
+
+//--------------------------------------------------------------------------------------
+// Matrix helpers, the same results as their DirectXMath namesakes.
+//--------------------------------------------------------------------------------------
+Float4x4 MatrixIdentity()
+{
+	Float4x4 r = {};
+	r.m[0][0] = r.m[1][1] = r.m[2][2] = r.m[3][3] = 1.0f;
+	return r;
+}
+
+Float4x4 MatrixRotationY(float angle)
+{
+	Float4x4 r = MatrixIdentity();
+	float s = sinf(angle);
+	float c = cosf(angle);
+	r.m[0][0] = c;		r.m[0][2] = -s;
+	r.m[2][0] = s;		r.m[2][2] = c;
+	return r;
+}
+
+Float4x4 MatrixPerspectiveFovLH(float fovY, float aspect, float zn, float zf)
+{
+	Float4x4 r = {};
+	float h = 1.0f / tanf(fovY * 0.5f);
+	float range = zf / (zf - zn);
+	r.m[0][0] = h / aspect;
+	r.m[1][1] = h;
+	r.m[2][2] = range;
+	r.m[2][3] = 1.0f;
+	r.m[3][2] = -range * zn;
+	return r;
+}
+
+Float4x4 MatrixLookAtLH(const float eye[3], const float at[3], const float up[3])
+{
+	float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	float zl = sqrtf(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+	z[0] /= zl; z[1] /= zl; z[2] /= zl;
+
+	float x[3] = { up[1] * z[2] - up[2] * z[1], up[2] * z[0] - up[0] * z[2], up[0] * z[1] - up[1] * z[0] };
+	float xl = sqrtf(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+	x[0] /= xl; x[1] /= xl; x[2] /= xl;
+
+	float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	Float4x4 r = {};
+	for (int i = 0; i < 3; i++)
+	{
+		r.m[i][0] = x[i];
+		r.m[i][1] = y[i];
+		r.m[i][2] = z[i];
+	}
+	r.m[3][0] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+	r.m[3][1] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+	r.m[3][2] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+	r.m[3][3] = 1.0f;
+	return r;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Timing, the QueryPerformanceCounter of this side.
+//--------------------------------------------------------------------------------------
+double NowMs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pack a float into the 4 channels of a UINT target, the same as packDepth does.
+//--------------------------------------------------------------------------------------
+VkClearColorValue PackFloat(float in)
+{
+	uint32_t bits;
+	memcpy(&bits, &in, sizeof(bits));
+
+	VkClearColorValue out;
+	out.uint32[0] = bits & 255;
+	out.uint32[1] = (bits >> 8) & 255;
+	out.uint32[2] = (bits >> 16) & 255;
+	out.uint32[3] = bits >> 24;
+	return out;
+}
+
+float UnpackFloat(const uint8_t* in)
+{
+	uint32_t bits = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+	float out;
+	memcpy(&out, &bits, sizeof(out));
+	return out;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Entry point to the program.
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		bool more = (i + 1 < argc);
+		if (!strcmp(argv[i], "--frames") && more)
+			g_FrameCount = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--width") && more)
+			g_ScreenWidth = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && more)
+			g_ScreenHeight = (uint32_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--separation") && more)
+			g_SeparationPercentage = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--convergence") && more)
+			g_Convergence = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--dump") && more)
+			g_DumpPrefix = argv[++i];
+		else if (!strcmp(argv[i], "--cpu"))
+			g_PreferCPU = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [--frames n] [--width w] [--height h] [--separation percent] "
+				"[--convergence c] [--dump prefix] [--cpu]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (g_FrameCount == 0 || g_ScreenWidth == 0 || g_ScreenHeight == 0)
+		return 2;
+
+	if (InitDevice() != VK_SUCCESS || InitResources() != VK_SUCCESS)
+	{
+		fprintf(stderr, "Vulkan initialization failed\n");
+		CleanupDevice();
+		return 1;
+	}
+
+	//
+	// Frames are recorded fresh every time, so the CPU cost includes recording the
+	// command buffer as well as the driver's submit.  On lavapipe the wait is where
+	// the rasterization happens, so it is reported apart.
+	//
+	std::vector<double> cpuMs;
+	std::vector<double> frameMs;
+	cpuMs.reserve(g_FrameCount);
+	frameMs.reserve(g_FrameCount);
+
+	for (uint32_t frame = 0; frame < g_FrameCount; frame++)
+	{
+		double start = NowMs();
+		RenderFrame(frame);
+		double recorded = NowMs();
+
+		if (SubmitAndWait() != VK_SUCCESS)
+		{
+			fprintf(stderr, "Frame %u failed\n", frame);
+			CleanupDevice();
+			return 1;
+		}
+
+		double end = NowMs();
+		cpuMs.push_back(recorded - start);
+		frameMs.push_back(end - start);
+	}
+
+	std::sort(cpuMs.begin(), cpuMs.end());
+	std::sort(frameMs.begin(), frameMs.end());
+	size_t p50 = cpuMs.size() / 2;
+	size_t p95 = (cpuMs.size() * 95) / 100;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(g_PhysicalDevice, &properties);
+	printf("Device: %s\n", properties.deviceName);
+	printf("Frames: %u at %ux%u, 3 views\n", g_FrameCount, g_ScreenWidth, g_ScreenHeight);
+	printf("CPU record: p50 %.3fms, p95 %.3fms\n", cpuMs[p50], cpuMs[p95]);
+	printf("Frame: p50 %.3fms, p95 %.3fms\n", frameMs[p50], frameMs[p95]);
+
+	bool passed = ValidateOutput();
+
+	CleanupDevice();
+
+	return passed ? 0 : 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Find a memory type with the flags, from the types the resource can use.
+//--------------------------------------------------------------------------------------
+uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags)
+{
+	for (uint32_t i = 0; i < g_MemoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeBits & (1u << i)) && (g_MemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create a host visible buffer and leave it mapped.  Everything here is tiny, or
+// read back by the CPU, so there is no staging.
+//--------------------------------------------------------------------------------------
+VkResult CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, BufferResource& out)
+{
+	VkBufferCreateInfo bci = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bci.size = size;
+	bci.usage = usage;
+	bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkResult res = vkCreateBuffer(g_Device, &bci, nullptr, &out.buffer);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(g_Device, out.buffer, &req);
+
+	VkMemoryAllocateInfo mai = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	mai.allocationSize = req.size;
+	mai.memoryTypeIndex = FindMemoryType(req.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (mai.memoryTypeIndex == UINT32_MAX)
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+
+	res = vkAllocateMemory(g_Device, &mai, nullptr, &out.memory);
+	if (res != VK_SUCCESS)
+		return res;
+	res = vkBindBufferMemory(g_Device, out.buffer, out.memory, 0);
+	if (res != VK_SUCCESS)
+		return res;
+
+	return vkMapMemory(g_Device, out.memory, 0, VK_WHOLE_SIZE, 0, &out.mapped);
+}
+
+void ReleaseBuffer(BufferResource& buffer)
+{
+	if (buffer.buffer) vkDestroyBuffer(g_Device, buffer.buffer, nullptr);
+	if (buffer.memory) vkFreeMemory(g_Device, buffer.memory, nullptr);
+	buffer = BufferResource();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create a 2D array image in device memory, with a view of all its layers.
+//--------------------------------------------------------------------------------------
+VkResult CreateImage(VkFormat format, uint32_t layers, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+	ImageResource& out)
+{
+	VkImageCreateInfo ici = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	ici.imageType = VK_IMAGE_TYPE_2D;
+	ici.format = format;
+	ici.extent = { g_ScreenWidth, g_ScreenHeight, 1 };
+	ici.mipLevels = 1;
+	ici.arrayLayers = layers;
+	ici.samples = VK_SAMPLE_COUNT_1_BIT;
+	ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ici.usage = usage;
+	ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkResult res = vkCreateImage(g_Device, &ici, nullptr, &out.image);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkMemoryRequirements req;
+	vkGetImageMemoryRequirements(g_Device, out.image, &req);
+
+	VkMemoryAllocateInfo mai = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	mai.allocationSize = req.size;
+	mai.memoryTypeIndex = FindMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (mai.memoryTypeIndex == UINT32_MAX)
+		mai.memoryTypeIndex = FindMemoryType(req.memoryTypeBits, 0);
+
+	res = vkAllocateMemory(g_Device, &mai, nullptr, &out.memory);
+	if (res != VK_SUCCESS)
+		return res;
+	res = vkBindImageMemory(g_Device, out.image, out.memory, 0);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkImageViewCreateInfo vci = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	vci.image = out.image;
+	vci.viewType = (layers > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+	vci.format = format;
+	vci.subresourceRange = { aspect, 0, 1, 0, layers };
+	return vkCreateImageView(g_Device, &vci, nullptr, &out.view);
+}
+
+void ReleaseImage(ImageResource& image)
+{
+	if (image.view) vkDestroyImageView(g_Device, image.view, nullptr);
+	if (image.image) vkDestroyImage(g_Device, image.image, nullptr);
+	if (image.memory) vkFreeMemory(g_Device, image.memory, nullptr);
+	image = ImageResource();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Load a SPIR-V file built from the GLSL next to this file.
+//--------------------------------------------------------------------------------------
+VkResult CreateShaderModule(const char* fileName, VkShaderModule* module)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s, build the shaders with glslangValidator first.\n", fileName);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	std::vector<uint32_t> code;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size > 0 && (size % 4) == 0)
+	{
+		code.resize(size / 4);
+		if (fread(code.data(), 1, size, file) != (size_t)size)
+			code.clear();
+	}
+	fclose(file);
+
+	if (code.empty())
+	{
+		fprintf(stderr, "%s is not SPIR-V\n", fileName);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	VkShaderModuleCreateInfo smci = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	smci.codeSize = code.size() * 4;
+	smci.pCode = code.data();
+	return vkCreateShaderModule(g_Device, &smci, nullptr, module);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create the instance and device, with multiview enabled.
+//--------------------------------------------------------------------------------------
+VkResult InitDevice()
+{
+	VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	appInfo.pApplicationName = "Tutorial07";
+	appInfo.apiVersion = VK_API_VERSION_1_1;
+
+	VkInstanceCreateInfo ici = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	ici.pApplicationInfo = &appInfo;
+	VkResult res = vkCreateInstance(&ici, nullptr, &g_Instance);
+	if (res != VK_SUCCESS)
+		return res;
+
+	uint32_t deviceCount = 0;
+	vkEnumeratePhysicalDevices(g_Instance, &deviceCount, nullptr);
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(g_Instance, &deviceCount, devices.data());
+
+	//
+	// Take the first 1.1 device with multiview and at least 3 views, or the first
+	// CPU one when asked for, which is how lavapipe shows up.
+	//
+	for (VkPhysicalDevice device : devices)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_1)
+			continue;
+
+		VkPhysicalDeviceMultiviewFeatures multiview = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES };
+		VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features.pNext = &multiview;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		VkPhysicalDeviceMultiviewProperties multiviewProps = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES };
+		VkPhysicalDeviceProperties2 properties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		properties2.pNext = &multiviewProps;
+		vkGetPhysicalDeviceProperties2(device, &properties2);
+
+		if (!multiview.multiview || multiviewProps.maxMultiviewViewCount < g_LayerCount)
+			continue;
+
+		bool isCPU = (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU);
+		if (!g_PhysicalDevice || (g_PreferCPU && isCPU))
+			g_PhysicalDevice = device;
+	}
+	if (!g_PhysicalDevice)
+	{
+		fprintf(stderr, "No Vulkan 1.1 device with multiview\n");
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	vkGetPhysicalDeviceMemoryProperties(g_PhysicalDevice, &g_MemoryProperties);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(g_PhysicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(g_PhysicalDevice, &familyCount, families.data());
+
+	g_QueueFamily = UINT32_MAX;
+	for (uint32_t i = 0; i < familyCount; i++)
+	{
+		if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		{
+			g_QueueFamily = i;
+			break;
+		}
+	}
+	if (g_QueueFamily == UINT32_MAX)
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+
+	float priority = 1.0f;
+	VkDeviceQueueCreateInfo qci = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+	qci.queueFamilyIndex = g_QueueFamily;
+	qci.queueCount = 1;
+	qci.pQueuePriorities = &priority;
+
+	VkPhysicalDeviceMultiviewFeatures multiview = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES };
+	multiview.multiview = VK_TRUE;
+
+	VkDeviceCreateInfo dci = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+	dci.pNext = &multiview;
+	dci.queueCreateInfoCount = 1;
+	dci.pQueueCreateInfos = &qci;
+	res = vkCreateDevice(g_PhysicalDevice, &dci, nullptr, &g_Device);
+	if (res != VK_SUCCESS)
+		return res;
+
+	vkGetDeviceQueue(g_Device, g_QueueFamily, 0, &g_Queue);
+
+	VkCommandPoolCreateInfo cpci = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	cpci.queueFamilyIndex = g_QueueFamily;
+	res = vkCreateCommandPool(g_Device, &cpci, nullptr, &g_CommandPool);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkCommandBufferAllocateInfo cbai = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	cbai.commandPool = g_CommandPool;
+	cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cbai.commandBufferCount = 1;
+	res = vkAllocateCommandBuffers(g_Device, &cbai, &g_CommandBuffer);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkFenceCreateInfo fci = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	return vkCreateFence(g_Device, &fci, nullptr, &g_Fence);
+}
+
+
+//--------------------------------------------------------------------------------------
+// The scene pass.  One subpass, broadcast to the 3 layers by the view mask.  The
+// color array stays in GENERAL, so it can be cleared before the pass, and the quad
+// pass and the readback can use it after, without more transitions.
+//--------------------------------------------------------------------------------------
+VkResult CreateSceneRenderPass()
+{
+	VkAttachmentDescription attachments[2] = {};
+	attachments[0].format = g_OffscreenFormat;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_GENERAL;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	attachments[1].format = g_DepthFormat;
+	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorRef;
+	subpass.pDepthStencilAttachment = &depthRef;
+
+	// All 3 views in the one subpass.  The eyes see nearly the same thing, which
+	// lets the driver share work between them.
+	uint32_t viewMask = (1u << g_LayerCount) - 1;
+	uint32_t correlationMask = 0x3;
+
+	VkRenderPassMultiviewCreateInfo multiview = { VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO };
+	multiview.subpassCount = 1;
+	multiview.pViewMasks = &viewMask;
+	multiview.correlationMaskCount = 1;
+	multiview.pCorrelationMasks = &correlationMask;
+
+	VkRenderPassCreateInfo rpci = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+	rpci.pNext = &multiview;
+	rpci.attachmentCount = 2;
+	rpci.pAttachments = attachments;
+	rpci.subpassCount = 1;
+	rpci.pSubpasses = &subpass;
+	return vkCreateRenderPass(g_Device, &rpci, nullptr, &g_SceneRenderPass);
+}
+
+
+//--------------------------------------------------------------------------------------
+// The quad pass, a plain single view pass into the output image.
+//--------------------------------------------------------------------------------------
+VkResult CreateQuadRenderPass()
+{
+	VkAttachmentDescription attachment = {};
+	attachment.format = g_OutputFormat;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorRef;
+
+	VkRenderPassCreateInfo rpci = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+	rpci.attachmentCount = 1;
+	rpci.pAttachments = &attachment;
+	rpci.subpassCount = 1;
+	rpci.pSubpasses = &subpass;
+	return vkCreateRenderPass(g_Device, &rpci, nullptr, &g_QuadRenderPass);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Build a pipeline.  Both passes share the layout, and use dynamic viewport and
+// scissor so the negative height viewport is set when recording.
+//--------------------------------------------------------------------------------------
+VkResult CreatePipeline(const char* vsFile, const char* psFile, bool scene, VkPipeline* pipeline)
+{
+	VkShaderModule vs = VK_NULL_HANDLE;
+	VkShaderModule ps = VK_NULL_HANDLE;
+	VkResult res = CreateShaderModule(vsFile, &vs);
+	if (res == VK_SUCCESS)
+		res = CreateShaderModule(psFile, &ps);
+	if (res != VK_SUCCESS)
+	{
+		if (vs) vkDestroyShaderModule(g_Device, vs, nullptr);
+		return res;
+	}
+
+	VkPipelineShaderStageCreateInfo stages[2] = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vs;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = ps;
+	stages[1].pName = "main";
+
+	// Define the input layout, the same as the D3D11 one
+	VkVertexInputBindingDescription binding = { 0, sizeof(SimpleVertex), VK_VERTEX_INPUT_RATE_VERTEX };
+	VkVertexInputAttributeDescription attributes[2] =
+	{
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ 1, 0, VK_FORMAT_R32G32_SFLOAT, 12 },
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertexInput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	if (scene)
+	{
+		vertexInput.vertexBindingDescriptionCount = 1;
+		vertexInput.pVertexBindingDescriptions = &binding;
+		vertexInput.vertexAttributeDescriptionCount = 2;
+		vertexInput.pVertexAttributeDescriptions = attributes;
+	}
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = scene ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// No culling.  The cube is closed and depth tested, so the result is the same
+	// as the D3D11 back face cull, without having to match its winding through
+	// the flipped viewport.
+	VkPipelineRasterizationStateCreateInfo raster = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	raster.polygonMode = VK_POLYGON_MODE_FILL;
+	raster.cullMode = VK_CULL_MODE_NONE;
+	raster.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	raster.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+	depthStencil.depthTestEnable = scene ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = scene ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	VkPipelineColorBlendAttachmentState blendAttachment = {};
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo blend = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	blend.attachmentCount = 1;
+	blend.pAttachments = &blendAttachment;
+
+	VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamicStates;
+
+	VkGraphicsPipelineCreateInfo gpci = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	gpci.stageCount = 2;
+	gpci.pStages = stages;
+	gpci.pVertexInputState = &vertexInput;
+	gpci.pInputAssemblyState = &inputAssembly;
+	gpci.pViewportState = &viewportState;
+	gpci.pRasterizationState = &raster;
+	gpci.pMultisampleState = &multisample;
+	gpci.pDepthStencilState = &depthStencil;
+	gpci.pColorBlendState = &blend;
+	gpci.pDynamicState = &dynamic;
+	gpci.layout = g_PipelineLayout;
+	gpci.renderPass = scene ? g_SceneRenderPass : g_QuadRenderPass;
+	gpci.subpass = 0;
+	res = vkCreateGraphicsPipelines(g_Device, VK_NULL_HANDLE, 1, &gpci, nullptr, pipeline);
+
+	vkDestroyShaderModule(g_Device, vs, nullptr);
+	vkDestroyShaderModule(g_Device, ps, nullptr);
+	return res;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Create everything the frames use: targets, passes, pipelines, geometry.
+//--------------------------------------------------------------------------------------
+VkResult InitResources()
+{
+	VkResult res;
+
+	//
+	// Targets.  The offscreen array has all 3 layers in one image, as the D3D11
+	// texture array does.
+	//
+	res = CreateImage(g_OffscreenFormat, g_LayerCount,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT, g_OffscreenTexture);
+	if (res != VK_SUCCESS)
+		return res;
+
+	res = CreateImage(g_DepthFormat, g_LayerCount, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		VK_IMAGE_ASPECT_DEPTH_BIT, g_DepthStencil);
+	if (res != VK_SUCCESS)
+		return res;
+
+	res = CreateImage(g_OutputFormat, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT, g_OutputTexture);
+	if (res != VK_SUCCESS)
+		return res;
+
+	res = CreateSceneRenderPass();
+	if (res != VK_SUCCESS)
+		return res;
+	res = CreateQuadRenderPass();
+	if (res != VK_SUCCESS)
+		return res;
+
+	// With multiview, the framebuffer has 1 layer and the views pick the layers.
+	VkImageView sceneViews[2] = { g_OffscreenTexture.view, g_DepthStencil.view };
+	VkFramebufferCreateInfo fbci = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	fbci.renderPass = g_SceneRenderPass;
+	fbci.attachmentCount = 2;
+	fbci.pAttachments = sceneViews;
+	fbci.width = g_ScreenWidth;
+	fbci.height = g_ScreenHeight;
+	fbci.layers = 1;
+	res = vkCreateFramebuffer(g_Device, &fbci, nullptr, &g_SceneFramebuffer);
+	if (res != VK_SUCCESS)
+		return res;
+
+	fbci.renderPass = g_QuadRenderPass;
+	fbci.attachmentCount = 1;
+	fbci.pAttachments = &g_OutputTexture.view;
+	res = vkCreateFramebuffer(g_Device, &fbci, nullptr, &g_QuadFramebuffer);
+	if (res != VK_SUCCESS)
+		return res;
+
+	//
+	// One set for both pipelines: b0 is cbShared, t0 is the packed depth.  The UINT
+	// format cannot be filtered, and texelFetch ignores the sampler anyway.
+	//
+	VkSamplerCreateInfo sci = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	sci.magFilter = VK_FILTER_NEAREST;
+	sci.minFilter = VK_FILTER_NEAREST;
+	sci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	res = vkCreateSampler(g_Device, &sci, nullptr, &g_PointSampler);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo dslci = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	dslci.bindingCount = 2;
+	dslci.pBindings = bindings;
+	res = vkCreateDescriptorSetLayout(g_Device, &dslci, nullptr, &g_DescriptorSetLayout);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkDescriptorPoolSize poolSizes[2] =
+	{
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+	};
+	VkDescriptorPoolCreateInfo dpci = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	dpci.maxSets = 1;
+	dpci.poolSizeCount = 2;
+	dpci.pPoolSizes = poolSizes;
+	res = vkCreateDescriptorPool(g_Device, &dpci, nullptr, &g_DescriptorPool);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkDescriptorSetAllocateInfo dsai = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	dsai.descriptorPool = g_DescriptorPool;
+	dsai.descriptorSetCount = 1;
+	dsai.pSetLayouts = &g_DescriptorSetLayout;
+	res = vkAllocateDescriptorSets(g_Device, &dsai, &g_DescriptorSet);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkPipelineLayoutCreateInfo plci = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	plci.setLayoutCount = 1;
+	plci.pSetLayouts = &g_DescriptorSetLayout;
+	res = vkCreatePipelineLayout(g_Device, &plci, nullptr, &g_PipelineLayout);
+	if (res != VK_SUCCESS)
+		return res;
+
+	res = CreatePipeline("Tutorial07_vk.vert.spv", "Tutorial07_vk.frag.spv", true, &g_ScenePipeline);
+	if (res != VK_SUCCESS)
+		return res;
+	res = CreatePipeline("Tutorial07_vk_quad.vert.spv", "Tutorial07_vk_quad.frag.spv", false, &g_QuadPipeline);
+	if (res != VK_SUCCESS)
+		return res;
+
+	//
+	// Geometry, the same cube as Tutorial07.cpp
+	//
+	SimpleVertex vertices[] =
+	{
+		{ { -1.0f, 1.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ { 1.0f, 1.0f, -1.0f }, { 0.0f, 0.0f } },
+		{ { 1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f } },
+		{ { -1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f } },
+
+		{ { -1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f } },
+		{ { 1.0f, -1.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ { 1.0f, -1.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ { -1.0f, -1.0f, 1.0f }, { 0.0f, 1.0f } },
+
+		{ { -1.0f, -1.0f, 1.0f }, { 0.0f, 1.0f } },
+		{ { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f } },
+		{ { -1.0f, 1.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ { -1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f } },
+
+		{ { 1.0f, -1.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ { 1.0f, -1.0f, -1.0f }, { 0.0f, 1.0f } },
+		{ { 1.0f, 1.0f, -1.0f }, { 0.0f, 0.0f } },
+		{ { 1.0f, 1.0f, 1.0f }, { 1.0f, 0.0f } },
+
+		{ { -1.0f, -1.0f, -1.0f }, { 0.0f, 1.0f } },
+		{ { 1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f } },
+		{ { 1.0f, 1.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ { -1.0f, 1.0f, -1.0f }, { 0.0f, 0.0f } },
+
+		{ { -1.0f, -1.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ { 1.0f, -1.0f, 1.0f }, { 0.0f, 1.0f } },
+		{ { 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f } },
+		{ { -1.0f, 1.0f, 1.0f }, { 1.0f, 0.0f } },
+	};
+
+	uint16_t indices[] =
+	{
+		3, 1, 0,
+		2, 1, 3,
+
+		6, 4, 5,
+		7, 4, 6,
+
+		11, 9, 8,
+		10, 9, 11,
+
+		14, 12, 13,
+		15, 12, 14,
+
+		19, 17, 16,
+		18, 17, 19,
+
+		22, 20, 21,
+		23, 20, 22
+	};
+
+	res = CreateBuffer(sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, g_VertexBuffer);
+	if (res != VK_SUCCESS)
+		return res;
+	memcpy(g_VertexBuffer.mapped, vertices, sizeof(vertices));
+
+	res = CreateBuffer(sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, g_IndexBuffer);
+	if (res != VK_SUCCESS)
+		return res;
+	memcpy(g_IndexBuffer.mapped, indices, sizeof(indices));
+
+	res = CreateBuffer(sizeof(SharedCB), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, g_SharedCB);
+	if (res != VK_SUCCESS)
+		return res;
+
+	// Room for the 3 layers and the output image
+	VkDeviceSize layerBytes = (VkDeviceSize)g_ScreenWidth * g_ScreenHeight * 4;
+	res = CreateBuffer(layerBytes * (g_LayerCount + 1), VK_BUFFER_USAGE_TRANSFER_DST_BIT, g_ReadbackBuffer);
+	if (res != VK_SUCCESS)
+		return res;
+
+	VkDescriptorBufferInfo bufferInfo = { g_SharedCB.buffer, 0, sizeof(SharedCB) };
+	VkDescriptorImageInfo imageInfo = { g_PointSampler, g_OffscreenTexture.view, VK_IMAGE_LAYOUT_GENERAL };
+
+	VkWriteDescriptorSet writes[2] = {};
+	writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[0].dstSet = g_DescriptorSet;
+	writes[0].dstBinding = 0;
+	writes[0].descriptorCount = 1;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writes[0].pBufferInfo = &bufferInfo;
+	writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[1].dstSet = g_DescriptorSet;
+	writes[1].dstBinding = 1;
+	writes[1].descriptorCount = 1;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[1].pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(g_Device, 2, writes, 0, nullptr);
+
+	//
+	// Initialize the view and projection matrices, as Tutorial07.cpp does.
+	//
+	float eye[3] = { 0.0f, 3.0f, -6.0f };
+	float at[3] = { 0.0f, 1.0f, 0.0f };
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	g_View = MatrixLookAtLH(eye, at, up);
+	g_Projection = MatrixPerspectiveFovLH(3.14159265f / 4, (float)g_ScreenWidth / (float)g_ScreenHeight, 0.01f, 100.0f);
+
+	return VK_SUCCESS;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Release everything, in reverse order of creation.
+//--------------------------------------------------------------------------------------
+void CleanupDevice()
+{
+	if (g_Device)
+	{
+		vkDeviceWaitIdle(g_Device);
+
+		ReleaseBuffer(g_ReadbackBuffer);
+		ReleaseBuffer(g_SharedCB);
+		ReleaseBuffer(g_IndexBuffer);
+		ReleaseBuffer(g_VertexBuffer);
+
+		if (g_QuadPipeline) vkDestroyPipeline(g_Device, g_QuadPipeline, nullptr);
+		if (g_ScenePipeline) vkDestroyPipeline(g_Device, g_ScenePipeline, nullptr);
+		if (g_PipelineLayout) vkDestroyPipelineLayout(g_Device, g_PipelineLayout, nullptr);
+		if (g_DescriptorPool) vkDestroyDescriptorPool(g_Device, g_DescriptorPool, nullptr);
+		if (g_DescriptorSetLayout) vkDestroyDescriptorSetLayout(g_Device, g_DescriptorSetLayout, nullptr);
+		if (g_PointSampler) vkDestroySampler(g_Device, g_PointSampler, nullptr);
+		if (g_QuadFramebuffer) vkDestroyFramebuffer(g_Device, g_QuadFramebuffer, nullptr);
+		if (g_SceneFramebuffer) vkDestroyFramebuffer(g_Device, g_SceneFramebuffer, nullptr);
+		if (g_QuadRenderPass) vkDestroyRenderPass(g_Device, g_QuadRenderPass, nullptr);
+		if (g_SceneRenderPass) vkDestroyRenderPass(g_Device, g_SceneRenderPass, nullptr);
+
+		ReleaseImage(g_OutputTexture);
+		ReleaseImage(g_DepthStencil);
+		ReleaseImage(g_OffscreenTexture);
+
+		if (g_Fence) vkDestroyFence(g_Device, g_Fence, nullptr);
+		if (g_CommandPool) vkDestroyCommandPool(g_Device, g_CommandPool, nullptr);
+		vkDestroyDevice(g_Device, nullptr);
+		g_Device = VK_NULL_HANDLE;
+	}
+	if (g_Instance)
+	{
+		vkDestroyInstance(g_Instance, nullptr);
+		g_Instance = VK_NULL_HANDLE;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Viewport with a negative height, so +y is up in clip space as it is in D3D11.
+//--------------------------------------------------------------------------------------
+void SetViewport(VkCommandBuffer cb)
+{
+	VkViewport viewport;
+	viewport.x = 0.0f;
+	viewport.y = (float)g_ScreenHeight;
+	viewport.width = (float)g_ScreenWidth;
+	viewport.height = -(float)g_ScreenHeight;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cb, 0, 1, &viewport);
+
+	VkRect2D scissor = { { 0, 0 }, { g_ScreenWidth, g_ScreenHeight } };
+	vkCmdSetScissor(cb, 0, 1, &scissor);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Record a frame: scene into the 3 layers, then the depth view of the mono layer.
+// The last frame also copies the results out for ValidateOutput.
+//--------------------------------------------------------------------------------------
+void RenderFrame(uint32_t frame)
+{
+	//
+	// Fixed time step, so every run renders the same frames.
+	//
+	g_World = MatrixRotationY(frame / 60.0f);
+
+	SharedCB cb;
+	cb.mWorld = g_World;
+	cb.mView = g_View;
+	cb.mProjection = g_Projection;
+
+	float separation = g_EyeSeparation * g_SeparationPercentage / 100;
+	float stereoParams[3][4] =
+	{
+		{ -separation, g_Convergence, 0.0f, 0.0f },		// left eye
+		{ +separation, g_Convergence, 0.0f, 0.0f },		// right eye
+		{ 0.0f, 0.0f, 0.0f, 0.0f },						// mono
+	};
+	memcpy(cb.mStereoParamsArray, stereoParams, sizeof(stereoParams));
+
+	// The last frame has been waited for, so the buffer is free to write.
+	memcpy(g_SharedCB.mapped, &cb, sizeof(cb));
+
+	VkCommandBuffer cmd = g_CommandBuffer;
+	vkResetCommandBuffer(cmd, 0);
+
+	VkCommandBufferBeginInfo cbbi = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &cbbi);
+
+	//
+	// Clear color in left & right eyes, and FLT_MAX packed in the mono layer.  A
+	// render pass clear would be one value for all the views, so the layers are
+	// cleared apart before the pass, as the D3D11 path does with its 2 views.
+	//
+	VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = g_OffscreenTexture.image;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, g_LayerCount };
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkClearColorValue clearColor;
+	clearColor.uint32[0] = 0;
+	clearColor.uint32[1] = 0;
+	clearColor.uint32[2] = 128;
+	clearColor.uint32[3] = 255;
+	VkImageSubresourceRange eyeRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 2 };
+	vkCmdClearColorImage(cmd, g_OffscreenTexture.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &eyeRange);
+
+	VkClearColorValue clearDepth = PackFloat(FLT_MAX);
+	VkImageSubresourceRange monoRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 2, 1 };
+	vkCmdClearColorImage(cmd, g_OffscreenTexture.image, VK_IMAGE_LAYOUT_GENERAL, &clearDepth, 1, &monoRange);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &barrier);
+
+	//
+	// Scene pass.  Clear the depth buffer to 1.0 (max depth).
+	//
+	VkClearValue clearValues[2];
+	clearValues[0].color = clearColor;
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo rpbi = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	rpbi.renderPass = g_SceneRenderPass;
+	rpbi.framebuffer = g_SceneFramebuffer;
+	rpbi.renderArea = { { 0, 0 }, { g_ScreenWidth, g_ScreenHeight } };
+	rpbi.clearValueCount = 2;
+	rpbi.pClearValues = clearValues;
+	vkCmdBeginRenderPass(cmd, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+
+	SetViewport(cmd);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_ScenePipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_PipelineLayout, 0, 1, &g_DescriptorSet, 0, nullptr);
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &g_VertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd, g_IndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+	vkCmdDrawIndexed(cmd, 36, 1, 0, 0, 0);
+
+	vkCmdEndRenderPass(cmd);
+
+	//
+	// The quad pass reads the mono layer the scene pass just wrote.
+	//
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	rpbi.renderPass = g_QuadRenderPass;
+	rpbi.framebuffer = g_QuadFramebuffer;
+	rpbi.clearValueCount = 0;
+	rpbi.pClearValues = nullptr;
+	vkCmdBeginRenderPass(cmd, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+
+	SetViewport(cmd);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_QuadPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_PipelineLayout, 0, 1, &g_DescriptorSet, 0, nullptr);
+	vkCmdDraw(cmd, 4, 1, 0, 0);
+
+	vkCmdEndRenderPass(cmd);
+
+	//
+	// Copy out the layers and the output image on the last frame.
+	//
+	if (frame + 1 == g_FrameCount)
+	{
+		VkDeviceSize layerBytes = (VkDeviceSize)g_ScreenWidth * g_ScreenHeight * 4;
+
+		VkBufferImageCopy regions[g_LayerCount];
+		for (uint32_t layer = 0; layer < g_LayerCount; layer++)
+		{
+			regions[layer] = {};
+			regions[layer].bufferOffset = layer * layerBytes;
+			regions[layer].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layer, 1 };
+			regions[layer].imageExtent = { g_ScreenWidth, g_ScreenHeight, 1 };
+		}
+		vkCmdCopyImageToBuffer(cmd, g_OffscreenTexture.image, VK_IMAGE_LAYOUT_GENERAL,
+			g_ReadbackBuffer.buffer, g_LayerCount, regions);
+
+		VkBufferImageCopy outputRegion = {};
+		outputRegion.bufferOffset = g_LayerCount * layerBytes;
+		outputRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		outputRegion.imageExtent = { g_ScreenWidth, g_ScreenHeight, 1 };
+		vkCmdCopyImageToBuffer(cmd, g_OutputTexture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			g_ReadbackBuffer.buffer, 1, &outputRegion);
+
+		VkMemoryBarrier hostBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			1, &hostBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	vkEndCommandBuffer(cmd);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Submit the recorded frame and wait for it.  There is no swap chain to pace
+// against, so one frame in flight keeps the timing simple to read.
+//--------------------------------------------------------------------------------------
+VkResult SubmitAndWait()
+{
+	VkSubmitInfo si = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	si.commandBufferCount = 1;
+	si.pCommandBuffers = &g_CommandBuffer;
+	VkResult res = vkQueueSubmit(g_Queue, 1, &si, g_Fence);
+	if (res != VK_SUCCESS)
+		return res;
+
+	res = vkWaitForFences(g_Device, 1, &g_Fence, VK_TRUE, UINT64_MAX);
+	if (res != VK_SUCCESS)
+		return res;
+	return vkResetFences(g_Device, 1, &g_Fence);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Write a layer out as a binary PPM, for looking at CI failures.
+//--------------------------------------------------------------------------------------
+void WritePPM(const char* suffix, const uint8_t* rgba)
+{
+	char fileName[512];
+	snprintf(fileName, sizeof(fileName), "%s%s.ppm", g_DumpPrefix, suffix);
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+		return;
+
+	fprintf(file, "P6\n%u %u\n255\n", g_ScreenWidth, g_ScreenHeight);
+	for (uint32_t i = 0; i < g_ScreenWidth * g_ScreenHeight; i++)
+		fwrite(rgba + i * 4, 1, 3, file);
+	fclose(file);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Check the read back results of the last frame:
+//	- both eyes have the cube, with the disparity the stereo params should give
+//	- the mono layer has depths inside the near and far planes where the cube
+//	  is, and FLT_MAX everywhere else
+//	- the debug view matches the mono layer
+//--------------------------------------------------------------------------------------
+bool ValidateOutput()
+{
+	const uint8_t* data = (const uint8_t*)g_ReadbackBuffer.mapped;
+	size_t pixels = (size_t)g_ScreenWidth * g_ScreenHeight;
+	const uint8_t* left = data;
+	const uint8_t* right = data + pixels * 4;
+	const uint8_t* mono = data + pixels * 8;
+	const uint8_t* output = data + pixels * 12;
+
+	if (g_DumpPrefix)
+	{
+		WritePPM("_left", left);
+		WritePPM("_right", right);
+		WritePPM("_depthview", output);
+	}
+
+	//
+	// Eyes: count the cube pixels and find their horizontal center.
+	//
+	uint64_t eyeCount[2] = { 0, 0 };
+	double eyeCenter[2] = { 0.0, 0.0 };
+	const uint8_t* eyes[2] = { left, right };
+	for (int e = 0; e < 2; e++)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			if (eyes[e][i * 4] == 128)
+			{
+				eyeCount[e]++;
+				eyeCenter[e] += (double)(i % g_ScreenWidth);
+			}
+		}
+		if (eyeCount[e])
+			eyeCenter[e] /= (double)eyeCount[e];
+	}
+
+	//
+	// Mono: every pixel is either cleared or a depth in range.  The cube center
+	// is about 6.7 units out, its depth sets the expected shift of each eye.
+	//
+	uint64_t monoCount = 0;
+	uint64_t badDepth = 0;
+	uint64_t badView = 0;
+	double depthSum = 0.0;
+	for (size_t i = 0; i < pixels; i++)
+	{
+		float depth = UnpackFloat(mono + i * 4);
+		if (depth == FLT_MAX)
+			continue;
+		if (!(depth > 0.01f && depth < 100.0f))
+		{
+			badDepth++;
+			continue;
+		}
+		monoCount++;
+		depthSum += depth;
+
+		// The debug view is depth * 0.1 in red and blue, off by one for rounding.
+		float expected = depth * 0.1f;
+		int red = (int)(fminf(expected, 1.0f) * 255.0f + 0.5f);
+		if (abs(output[i * 4] - red) > 1 || abs(output[i * 4 + 2] - red) > 1)
+			badView++;
+	}
+
+	double meanDepth = monoCount ? depthSum / monoCount : 0.0;
+
+	// Shift in pixels for each eye at the mean depth: clip x moves by
+	// sep * (w - conv), which is sep * (w - conv) / w in NDC, and half the width
+	// of the image per NDC unit.
+	float separation = g_EyeSeparation * g_SeparationPercentage / 100;
+	double expectedDisparity = meanDepth > 0.0 ?
+		2.0 * separation * (meanDepth - g_Convergence) / meanDepth * 0.5 * g_ScreenWidth : 0.0;
+	double disparity = eyeCenter[1] - eyeCenter[0];
+
+	printf("Left eye: %llu pixels, center x %.1f\n", (unsigned long long)eyeCount[0], eyeCenter[0]);
+	printf("Right eye: %llu pixels, center x %.1f\n", (unsigned long long)eyeCount[1], eyeCenter[1]);
+	printf("Disparity: %.2f pixels, expected about %.2f\n", disparity, expectedDisparity);
+	printf("Mono: %llu pixels, mean depth %.3f, %llu out of range, %llu debug view mismatches\n",
+		(unsigned long long)monoCount, meanDepth, (unsigned long long)badDepth, (unsigned long long)badView);
+
+	bool passed = true;
+	if (eyeCount[0] == 0 || eyeCount[1] == 0 || monoCount == 0)
+	{
+		printf("FAIL: cube missing from a layer\n");
+		passed = false;
+	}
+	if (badDepth || badView)
+	{
+		printf("FAIL: mono layer or debug view is wrong\n");
+		passed = false;
+	}
+	// The centroid moves with the silhouette, so allow a generous tolerance, but
+	// the sign has to be right.
+	if (fabs(disparity - expectedDisparity) > fmax(2.0, fabs(expectedDisparity) * 0.5))
+	{
+		printf("FAIL: eye disparity does not match the stereo params\n");
+		passed = false;
+	}
+
+	printf(passed ? "PASS\n" : "FAIL\n");
+	return passed;
+}
@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// File: Tutorial07_vk.frag
+//
+// Vulkan version of PS from Tutorial07.fx.  View 2 is the mono slice and gets the
+// packed depth, the eyes get flat grey.
+//
+// Build with:
+//	glslangValidator -V --target-env vulkan1.1 Tutorial07_vk.frag -o Tutorial07_vk.frag.spv
+//--------------------------------------------------------------------------------------
+#version 450
+#extension GL_EXT_multiview : require
+
+layout(location = 0) in vec2 inTex;
+
+layout(location = 0) out uvec4 outColor;
+
+uvec4 packDepth(float depth)
+{
+	uint uiDepth = floatBitsToUint(depth);
+	return uvec4(uiDepth & 255u, (uiDepth >> 8) & 255u, (uiDepth >> 16) & 255u, (uiDepth >> 24));
+}
+
+void main()
+{
+	if (gl_ViewIndex == 2)
+	{
+		// SV_Position.w is the clip w, gl_FragCoord.w is its reciprocal.
+		outColor = packDepth(1.0 / gl_FragCoord.w);
+		return;
+	}
+	outColor = uvec4(128, 128, 128, 255);
+}
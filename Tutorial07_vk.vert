@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// File: Tutorial07_vk.vert
+//
+// Vulkan version of VS and GS from Tutorial07.fx.
+//
+// The D3D11 path broadcasts each triangle to the 3 slices with an instanced GS.
+// Here the render pass has a view mask of 0b111, so the driver runs this shader
+// once per view and gl_ViewIndex picks the stereo params, the same as
+// SV_GSInstanceID does in the GS.
+//
+// Build with:
+//	glslangValidator -V --target-env vulkan1.1 Tutorial07_vk.vert -o Tutorial07_vk.vert.spv
+//--------------------------------------------------------------------------------------
+#version 450
+#extension GL_EXT_multiview : require
+
+// Same layout as cbShared, row_major so the matrices go up untransposed and the
+// multiplies read the same as the HLSL.
+layout(set = 0, binding = 0, std140, row_major) uniform SharedCB
+{
+	mat4 World;
+	mat4 View;
+	mat4 Projection;
+
+	vec4 StereoParamsArray[3];
+};
+
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec2 inTex;
+
+layout(location = 0) out vec2 outTex;
+
+vec4 GetStereoPos(vec4 pos, vec4 stereoParams)
+{
+	vec4 spos = pos;
+	spos.x += stereoParams[0] * (spos.w - stereoParams[1]);
+	return spos;
+}
+
+void main()
+{
+	vec4 pos = vec4(inPos, 1.0) * World;
+	pos = pos * View;
+	pos = pos * Projection;
+
+	gl_Position = GetStereoPos(pos, StereoParamsArray[gl_ViewIndex]);
+	outTex = inTex;
+}
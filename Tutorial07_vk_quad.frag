@@ -0,0 +1,26 @@
+//--------------------------------------------------------------------------------------
+// File: Tutorial07_vk_quad.frag
+//
+// Vulkan version of QuadPS from Tutorial07.fx, shows the packed depth of the mono
+// layer.
+//
+// Build with:
+//	glslangValidator -V --target-env vulkan1.1 Tutorial07_vk_quad.frag -o Tutorial07_vk_quad.frag.spv
+//--------------------------------------------------------------------------------------
+#version 450
+
+layout(set = 0, binding = 1) uniform usampler2DArray PackedDepthSRV;
+
+layout(location = 0) out vec4 outColor;
+
+float unpackDepth(uvec4 packedDepth)
+{
+	uint uiDepth = packedDepth.x | (packedDepth.y << 8) | (packedDepth.z << 16) | (packedDepth.w << 24);
+	return uintBitsToFloat(uiDepth);
+}
+
+void main()
+{
+	float depth = unpackDepth(texelFetch(PackedDepthSRV, ivec3(gl_FragCoord.xy, 2), 0)) * 0.1;
+	outColor = vec4(depth, 0.0, depth, 1.0);
+}
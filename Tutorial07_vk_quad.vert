@@ -0,0 +1,15 @@
+//--------------------------------------------------------------------------------------
+// File: Tutorial07_vk_quad.vert
+//
+// Vulkan version of QuadVS from Tutorial07.fx, a 4 vertex strip covering the target.
+//
+// Build with:
+//	glslangValidator -V --target-env vulkan1.1 Tutorial07_vk_quad.vert -o Tutorial07_vk_quad.vert.spv
+//--------------------------------------------------------------------------------------
+#version 450
+
+void main()
+{
+	vec2 tex = vec2(gl_VertexIndex % 2, gl_VertexIndex % 4 / 2);
+	gl_Position = vec4((tex.x - 0.5) * 2.0, -(tex.y - 0.5) * 2.0, 0.0, 1.0);
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: bench_scene.h
+//
+// The scene the offline benches draw in place of the sample's: textured panels in
+// front of a textured wall, with the sample's projection.  Panels face -z, x and y
+// are the lower left corner, all in view space units, and textures are in the same
+// units, 8 blocks to one.
+//
+// Only for the *_bench.cpp programs, so it is all here, and each of them still
+// builds from its own file and the module it checks.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+
+static const float					s_WallDepth = 60.0f;
+static const float					s_ProjectionY = 1.0f / tanf(3.14159265f / 8.0f);	// XM_PIDIV4, as the sample
+
+struct Panel
+{
+	float x, y, width, height, depth;
+	uint32_t seed;
+};
+
+static inline uint32_t Hash(uint32_t x, uint32_t y, uint32_t seed)
+{
+	uint32_t h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return h ^ (h >> 16);
+}
+
+// Smooth bands with blocky detail over them.
+static inline uint32_t Texture(float u, float v, uint32_t seed)
+{
+	uint32_t cell = Hash((uint32_t)(int32_t)floorf(u * 8.0f), (uint32_t)(int32_t)floorf(v * 8.0f), seed);
+	uint32_t rgb = 0xff000000u;
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		float band = 100.0f + 60.0f * sinf(u * (2.0f + 1.0f * c) + v * 1.3f + seed);
+		float value = band + (float)((cell >> (8 * c)) & 31);
+		rgb |= (uint32_t)std::min(std::max(value, 0.0f), 255.0f) << (8 * c);
+	}
+	return rgb;
+}
+
+// The blocks alone, 8 texels to a block, for drawing in screen space fast.
+static inline uint32_t Texel(int32_t u, int32_t v, uint32_t seed)
+{
+	return (Hash((uint32_t)(u >> 3), (uint32_t)(v >> 3), seed) & 0x3f3f3fu) + 0xff606060u;
+}
+
+// Panel i at depth, sized and placed to stay in view, a little left of and below
+// the middle.
+static inline Panel PlacePanel(uint32_t i, float depth)
+{
+	Panel p;
+	p.depth = depth;
+	p.width = 0.25f * depth;
+	p.height = 0.2f * depth;
+	p.x = depth * (0.3f * sinf(1.7f * i) - 0.12f);
+	p.y = depth * (0.25f * cosf(2.3f * i) - 0.1f);
+	p.seed = 17 + i;
+	return p;
+}
+
+// The colour the ray from o along d meets first, and in t the z it meets it at.
+static inline uint32_t CastRay(const Panel* panels, uint32_t panelCount, const float o[3], const float d[3], float& t)
+{
+	t = (s_WallDepth - o[2]) / d[2];
+	uint32_t color = Texture(o[0] + t * d[0], o[1] + t * d[1], 3);
+	for (uint32_t i = 0; i < panelCount; i++)
+	{
+		const Panel& p = panels[i];
+		float pt = (p.depth - o[2]) / d[2];
+		float u = o[0] + pt * d[0] - p.x;
+		float v = o[1] + pt * d[1] - p.y;
+		if (pt > 0.0f && pt < t && u >= 0.0f && u < p.width && v >= 0.0f && v < p.height)
+		{
+			t = pt;
+			color = Texture(u, v, p.seed);
+		}
+	}
+	return color;
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// File: benchmark.cpp
+//
+// Benchmark mode options and report, see benchmark.h.
+//--------------------------------------------------------------------------------------
+
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+
+static std::string Narrow(const std::wstring& s)
+{
+	std::string out;
+	for (wchar_t c : s)
+		out += (c > 0 && c < 0x80) ? (char)c : '?';
+	return out;
+}
+
+bool ParseBenchmarkOptions(const wchar_t* commandLine, BenchmarkOptions& options, std::string& error)
+{
+	// Split on spaces, with double quotes around arguments that have them.
+	std::vector<std::wstring> args;
+	for (const wchar_t* p = commandLine ? commandLine : L""; *p;)
+	{
+		while (*p == L' ' || *p == L'\t')
+			p++;
+		if (!*p)
+			break;
+		std::wstring arg;
+		bool quoted = false;
+		for (; *p && (quoted || (*p != L' ' && *p != L'\t')); p++)
+		{
+			if (*p == L'"')
+				quoted = !quoted;
+			else
+				arg += *p;
+		}
+		args.push_back(arg);
+	}
+
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		const std::wstring& arg = args[i];
+		bool hasValue = (i + 1 < args.size());
+		const wchar_t* value = hasValue ? args[i + 1].c_str() : L"";
+		wchar_t* end = nullptr;
+
+		if (arg == L"-benchmark")
+		{
+			options.enabled = true;
+			continue;
+		}
+		if (arg != L"-warmup" && arg != L"-frames" && arg != L"-scene" && arg != L"-step" && arg != L"-out")
+		{
+			error = "unknown argument " + Narrow(arg);
+			return false;
+		}
+		if (!hasValue)
+		{
+			error = Narrow(arg) + " needs a value";
+			return false;
+		}
+		i++;
+
+		if (arg == L"-out")
+		{
+			options.output = Narrow(value);
+			continue;
+		}
+		if (arg == L"-step")
+		{
+			options.stepMs = wcstod(value, &end);
+			if (*end || !(options.stepMs > 0.0))
+			{
+				error = "-step needs a time in ms above 0";
+				return false;
+			}
+			continue;
+		}
+
+		long number = wcstol(value, &end, 10);
+		if (*end || number < 0 || (arg == L"-frames" && number == 0))
+		{
+			error = Narrow(arg) + " needs a number" + (arg == L"-frames" ? " above 0" : "");
+			return false;
+		}
+		if (arg == L"-warmup")
+			options.warmupFrames = (uint32_t)number;
+		else if (arg == L"-frames")
+			options.measuredFrames = (uint32_t)number;
+		else
+			options.scene = (int)number;
+	}
+	return true;
+}
+
+bool WriteBenchmarkCsv(const char* fileName, const std::vector<BenchmarkResult>& results)
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "scene,objects,render_scale,msaa,mono_slice,frames");
+	if (!results.empty())
+	{
+		for (const std::string& name : results[0].names)
+			fprintf(file, ",%s_mean_ms,%s_p50_ms,%s_p99_ms", name.c_str(), name.c_str(), name.c_str());
+	}
+	fprintf(file, "\n");
+
+	for (const BenchmarkResult& result : results)
+	{
+		const BenchmarkScene& scene = result.scene;
+		fprintf(file, "%s,%u,%.3f,%u,%d,%u", scene.name, scene.objects, scene.renderScale, scene.msaaSamples,
+			scene.monoSlice ? 1 : 0, result.frames);
+		for (const TimingStats& stats : result.timings)
+			fprintf(file, ",%.4f,%.4f,%.4f", stats.meanMs, stats.p50Ms, stats.p99Ms);
+		fprintf(file, "\n");
+	}
+
+	return fclose(file) == 0;
+}
+
+bool WriteBenchmarkJson(const char* fileName, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options,
+	const char* build)
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n  \"build\": \"%s\",\n  \"warmup_frames\": %u,\n  \"measured_frames\": %u,\n  \"step_ms\": %.6f,\n  \"scenes\": [",
+		build, options.warmupFrames, options.measuredFrames, options.stepMs);
+
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const BenchmarkResult& result = results[r];
+		const BenchmarkScene& scene = result.scene;
+		fprintf(file, "%s\n    {\n      \"name\": \"%s\", \"objects\": %u, \"render_scale\": %.3f, \"msaa\": %u, \"mono_slice\": %s, \"frames\": %u,\n      \"timings\": {",
+			r ? "," : "", scene.name, scene.objects, scene.renderScale, scene.msaaSamples, scene.monoSlice ? "true" : "false", result.frames);
+		for (size_t t = 0; t < result.timings.size(); t++)
+		{
+			const TimingStats& stats = result.timings[t];
+			fprintf(file, "%s\n        \"%s\": { \"count\": %u, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }",
+				t ? "," : "", result.names[t].c_str(), stats.count, stats.meanMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs);
+		}
+		fprintf(file, "\n      }\n    }");
+	}
+	fprintf(file, "\n  ]\n}\n");
+
+	return fclose(file) == 0;
+}
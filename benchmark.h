@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// File: benchmark.h
+//
+// Benchmark mode: its command line, the animation clock, and the report.
+//
+// In benchmark mode the animation does not follow the wall clock but steps by a
+// fixed amount every frame, so every run draws the same frames, on any machine and
+// at any frame rate.  Each scene runs its warmup frames, then its measured frames,
+// and the report has the mean and percentiles of each timing over the measured
+// ones, as CSV, a row per scene, and as JSON.
+//
+// Command line, case sensitive:
+//	-benchmark		turn it on
+//	-warmup N		frames before measuring each scene, default 120
+//	-frames N		measured frames of each scene, default 600
+//	-scene N		only the scene at index N
+//	-step MS		animation step per frame, default 1000/60
+//	-out NAME		writes NAME.csv and NAME.json, default "benchmark"
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "frame_timing.h"
+
+struct BenchmarkOptions
+{
+	bool enabled = false;
+	uint32_t warmupFrames = 120;
+	uint32_t measuredFrames = 600;
+	int scene = -1;					// -1 for all of them
+	double stepMs = 1000.0 / 60.0;
+	std::string output = "benchmark";
+};
+
+// Returns false with a message on anything it does not understand.
+bool ParseBenchmarkOptions(const wchar_t* commandLine, BenchmarkOptions& options, std::string& error);
+
+//--------------------------------------------------------------------------------------
+// The time the animation reads.  The app hands in the real time, and gets it back
+// relative to the first call, unless a fixed step is set, when it gets the number
+// of Ticks times the step instead.
+//--------------------------------------------------------------------------------------
+struct AnimationClock
+{
+	double stepMs = 0.0;			// 0 for real time
+	double startMs = -1.0;
+	uint64_t ticks = 0;
+
+	double NowMs(double realMs)
+	{
+		if (stepMs > 0.0)
+			return ticks * stepMs;
+		if (startMs < 0.0)
+			startMs = realMs;
+		return realMs - startMs;
+	}
+
+	void Tick() { ticks++; }
+};
+
+struct BenchmarkScene
+{
+	const char* name;
+	uint32_t objects;
+	float renderScale;
+	uint32_t msaaSamples;
+	bool monoSlice;
+};
+
+struct BenchmarkResult
+{
+	BenchmarkScene scene;			// as run, the MSAA the device allowed
+	uint32_t frames;
+	std::vector<std::string> names;	// of the timings, the same for every scene
+	std::vector<TimingStats> timings;
+};
+
+bool WriteBenchmarkCsv(const char* fileName, const std::vector<BenchmarkResult>& results);
+bool WriteBenchmarkJson(const char* fileName, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options,
+	const char* build);
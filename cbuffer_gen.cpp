@@ -0,0 +1,446 @@
+//--------------------------------------------------------------------------------------
+// File: cbuffer_gen.cpp
+//
+// Offline generator of the C++ side of the constant buffers in an HLSL file.
+//
+// It reads every cbuffer in the source, lays the fields out with the HLSL packing
+// rules, and writes a header with a struct for each, padded to match.  Every field
+// gets a static_assert on its offset, and the struct on its size, so a compiler
+// that lays the struct out differently fails the build instead of the shaders
+// reading garbage.  Each struct also gets a table of its fields, for the partial
+// updates in cbuffer_layout.h, and its register.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 cbuffer_gen.cpp -o cbuffer_gen
+//	./cbuffer_gen Tutorial07.fx Tutorial07_cb.h
+//
+// The HLSL it understands is what the cbuffers in this sample use:
+//	- scalars and vectors of float, int, uint and bool
+//	- float4x4 and matrix, row_major or column_major, and #pragma pack_matrix
+//	- arrays with a literal size, of 16 byte types, since C++ cannot pad between
+//	  the elements of an array of smaller ones
+// Anything else is an error, with the line it was on.
+//
+// Packing, from the HLSL rules: a field does not straddle a 16 byte register, an
+// array element or a matrix starts on a register, and the size of the buffer is a
+// whole number of registers.  The packoffset keyword is not supported.
+//
+// Names: cbFoo becomes struct FooCB, and a field Bar becomes mBar.
+//--------------------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Structures
+//--------------------------------------------------------------------------------------
+struct HlslType
+{
+	const char* hlsl;
+	const char* cpp;		// the C++ type, with the same size and no alignment above 4
+	uint32_t components;	// per row for a matrix
+	uint32_t rows;			// 1 for scalars and vectors
+};
+
+static const HlslType s_Types[] =
+{
+	{ "float", "float", 1, 1 },
+	{ "float2", "DirectX::XMFLOAT2", 2, 1 },
+	{ "float3", "DirectX::XMFLOAT3", 3, 1 },
+	{ "float4", "DirectX::XMFLOAT4", 4, 1 },
+	{ "int", "int32_t", 1, 1 },
+	{ "int2", "DirectX::XMINT2", 2, 1 },
+	{ "int3", "DirectX::XMINT3", 3, 1 },
+	{ "int4", "DirectX::XMINT4", 4, 1 },
+	{ "uint", "uint32_t", 1, 1 },
+	{ "uint2", "DirectX::XMUINT2", 2, 1 },
+	{ "uint3", "DirectX::XMUINT3", 3, 1 },
+	{ "uint4", "DirectX::XMUINT4", 4, 1 },
+	{ "bool", "uint32_t", 1, 1 },
+	{ "float4x4", "DirectX::XMFLOAT4X4", 4, 4 },
+	{ "matrix", "DirectX::XMFLOAT4X4", 4, 4 },
+};
+
+struct Field
+{
+	std::string name;
+	const HlslType* type;
+	uint32_t arraySize;		// 0 when not an array
+	bool rowMajor;
+	uint32_t offset;
+	uint32_t size;
+	int line;
+};
+
+struct CBuffer
+{
+	std::string name;
+	int slot;				// -1 without a register
+	std::vector<Field> fields;
+	uint32_t size;
+};
+
+struct Token
+{
+	std::string text;
+	int line;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Read the whole file.
+//--------------------------------------------------------------------------------------
+static bool ReadFile(const char* fileName, std::string& text)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, read);
+	fclose(file);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Split the source into identifiers, numbers and single character symbols.
+//
+// Comments are dropped.  Preprocessor lines are dropped too, except that
+// #pragma pack_matrix comes through as a token of its own, since it changes the
+// layout of what follows.
+//--------------------------------------------------------------------------------------
+static std::vector<Token> Tokenize(const std::string& text)
+{
+	std::vector<Token> tokens;
+	int line = 1;
+	bool lineStart = true;
+
+	for (size_t i = 0; i < text.size();)
+	{
+		char c = text[i];
+		if (c == '\n')
+		{
+			line++;
+			lineStart = true;
+			i++;
+		}
+		else if (isspace((unsigned char)c))
+		{
+			i++;
+		}
+		else if (c == '/' && i + 1 < text.size() && text[i + 1] == '/')
+		{
+			while (i < text.size() && text[i] != '\n')
+				i++;
+		}
+		else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*')
+		{
+			for (i += 2; i < text.size() && !(text[i] == '*' && i + 1 < text.size() && text[i + 1] == '/'); i++)
+			{
+				if (text[i] == '\n')
+					line++;
+			}
+			i += 2;
+		}
+		else if (c == '#' && lineStart)
+		{
+			size_t end = text.find('\n', i);
+			if (end == std::string::npos)
+				end = text.size();
+			std::string directive = text.substr(i, end - i);
+			if (directive.find("pack_matrix") != std::string::npos)
+			{
+				Token token = { directive.find("row_major") != std::string::npos ? "#row_major" : "#column_major", line };
+				tokens.push_back(token);
+			}
+			i = end;
+		}
+		else if (isalnum((unsigned char)c) || c == '_')
+		{
+			size_t start = i;
+			while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_'))
+				i++;
+			Token token = { text.substr(start, i - start), line };
+			tokens.push_back(token);
+			lineStart = false;
+		}
+		else
+		{
+			Token token = { std::string(1, c), line };
+			tokens.push_back(token);
+			lineStart = false;
+			i++;
+		}
+	}
+	return tokens;
+}
+
+
+//--------------------------------------------------------------------------------------
+// HLSL packing.  Returns false for what cannot be laid out the same in C++.
+//--------------------------------------------------------------------------------------
+static bool PlaceField(Field& field, uint32_t& offset, std::string& error)
+{
+	const HlslType& type = *field.type;
+
+	// A matrix is a register per row when row major, per column otherwise.  Only
+	// 4x4 is supported, which is 4 full registers either way.
+	uint32_t registers = type.rows;
+	uint32_t elementSize = (registers - 1) * 16 + type.components * 4;
+
+	if (field.arraySize > 0 && elementSize % 16 != 0)
+	{
+		error = "array of " + std::string(type.hlsl) + " has padding between elements, use a 16 byte type";
+		return false;
+	}
+
+	bool startsRegister = (field.arraySize > 0) || (type.rows > 1);
+	if (startsRegister || (offset % 16) + elementSize > 16)
+		offset = (offset + 15) & ~15u;
+
+	field.offset = offset;
+	field.size = field.arraySize > 0 ? field.arraySize * elementSize : elementSize;
+	offset += field.size;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Find every cbuffer, and lay it out.
+//--------------------------------------------------------------------------------------
+static bool Parse(const std::vector<Token>& tokens, std::vector<CBuffer>& cbuffers, std::string& error)
+{
+	bool defaultRowMajor = false;
+	char message[256];
+
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		if (tokens[i].text == "#row_major" || tokens[i].text == "#column_major")
+		{
+			defaultRowMajor = (tokens[i].text == "#row_major");
+			continue;
+		}
+		if (tokens[i].text != "cbuffer")
+			continue;
+
+		CBuffer cb;
+		cb.slot = -1;
+		cb.size = 0;
+		if (++i >= tokens.size())
+			break;
+		cb.name = tokens[i].text;
+
+		// : register(bN)
+		for (i++; i < tokens.size() && tokens[i].text != "{"; i++)
+		{
+			const std::string& t = tokens[i].text;
+			if (t.size() > 1 && t[0] == 'b' && isdigit((unsigned char)t[1]))
+				cb.slot = atoi(t.c_str() + 1);
+		}
+
+		uint32_t offset = 0;
+		for (i++; i < tokens.size() && tokens[i].text != "}"; i++)
+		{
+			int line = tokens[i].line;
+			bool rowMajor = defaultRowMajor;
+			while (i < tokens.size() && (tokens[i].text == "row_major" || tokens[i].text == "column_major"))
+			{
+				rowMajor = (tokens[i].text == "row_major");
+				i++;
+			}
+			if (i + 1 >= tokens.size())
+				break;
+
+			const HlslType* type = nullptr;
+			for (const HlslType& t : s_Types)
+			{
+				if (tokens[i].text == t.hlsl)
+					type = &t;
+			}
+			if (!type)
+			{
+				snprintf(message, sizeof(message), "line %d: unsupported type '%s' in %s",
+					line, tokens[i].text.c_str(), cb.name.c_str());
+				error = message;
+				return false;
+			}
+
+			Field field;
+			field.name = tokens[++i].text;
+			field.type = type;
+			field.arraySize = 0;
+			field.rowMajor = rowMajor;
+			field.line = line;
+
+			if (i + 1 < tokens.size() && tokens[i + 1].text == "[")
+			{
+				if (i + 3 >= tokens.size() || !isdigit((unsigned char)tokens[i + 2].text[0]) || tokens[i + 3].text != "]")
+				{
+					snprintf(message, sizeof(message), "line %d: array size of %s must be a literal", line, field.name.c_str());
+					error = message;
+					return false;
+				}
+				field.arraySize = (uint32_t)atoi(tokens[i + 2].text.c_str());
+				i += 3;
+			}
+			if (i + 1 >= tokens.size() || tokens[i + 1].text != ";")
+			{
+				snprintf(message, sizeof(message), "line %d: expected ; after %s", line, field.name.c_str());
+				error = message;
+				return false;
+			}
+			i++;
+
+			std::string placeError;
+			if (!PlaceField(field, offset, placeError))
+			{
+				snprintf(message, sizeof(message), "line %d: %s", line, placeError.c_str());
+				error = message;
+				return false;
+			}
+			cb.fields.push_back(field);
+		}
+
+		cb.size = (offset + 15) & ~15u;
+		cbuffers.push_back(cb);
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// cbShared -> SharedCB
+//--------------------------------------------------------------------------------------
+static std::string StructName(const std::string& cbuffer)
+{
+	std::string name = cbuffer;
+	if (name.size() > 2 && name[0] == 'c' && name[1] == 'b' && isupper((unsigned char)name[2]))
+		name = name.substr(2);
+	return name + "CB";
+}
+
+
+//--------------------------------------------------------------------------------------
+// Write the header.
+//--------------------------------------------------------------------------------------
+static void Emit(FILE* out, const char* sourceName, const std::vector<CBuffer>& cbuffers)
+{
+	fprintf(out,
+		"//--------------------------------------------------------------------------------------\n"
+		"// Generated by cbuffer_gen from %s, do not edit.\n"
+		"//\n"
+		"// Matrices are XMFLOAT4X4.  A row_major one takes XMStoreFloat4x4 of a DirectXMath\n"
+		"// matrix as it is, a column_major one needs it transposed first.\n"
+		"//--------------------------------------------------------------------------------------\n"
+		"#pragma once\n"
+		"\n"
+		"#include <stddef.h>\n"
+		"#include <stdint.h>\n"
+		"#include <directxmath.h>\n"
+		"#include \"cbuffer_layout.h\"\n",
+		sourceName);
+
+	for (const CBuffer& cb : cbuffers)
+	{
+		std::string name = StructName(cb.name);
+
+		fprintf(out, "\n\n// cbuffer %s", cb.name.c_str());
+		if (cb.slot >= 0)
+			fprintf(out, " : register(b%d)", cb.slot);
+		fprintf(out, ", %u bytes\n", cb.size);
+
+		fprintf(out, "struct %s\n{\n", name.c_str());
+		uint32_t offset = 0;
+		int pad = 0;
+		for (const Field& field : cb.fields)
+		{
+			if (field.offset > offset)
+				fprintf(out, "\tuint32_t _pad%d[%u];\n", pad++, (field.offset - offset) / 4);
+
+			fprintf(out, "\t%s m%s", field.type->cpp, field.name.c_str());
+			if (field.arraySize > 0)
+				fprintf(out, "[%u]", field.arraySize);
+			fprintf(out, ";");
+			if (field.type->rows > 1)
+				fprintf(out, "\t// %s", field.rowMajor ? "row_major" : "column_major, store transposed");
+			fprintf(out, "\n");
+			offset = field.offset + field.size;
+		}
+		if (cb.size > offset)
+			fprintf(out, "\tuint32_t _pad%d[%u];\n", pad++, (cb.size - offset) / 4);
+		fprintf(out, "};\n\n");
+
+		for (const Field& field : cb.fields)
+			fprintf(out, "static_assert(offsetof(%s, m%s) == %u, \"%s.%s\");\n",
+				name.c_str(), field.name.c_str(), field.offset, cb.name.c_str(), field.name.c_str());
+		fprintf(out, "static_assert(sizeof(%s) == %u, \"%s\");\n\n", name.c_str(), cb.size, cb.name.c_str());
+
+		if (cb.slot >= 0)
+			fprintf(out, "const uint32_t %s_Slot = %d;\n\n", name.c_str(), cb.slot);
+
+		fprintf(out, "enum %s_Field\n{\n", name.c_str());
+		for (const Field& field : cb.fields)
+			fprintf(out, "\t%s_%s,\n", name.c_str(), field.name.c_str());
+		fprintf(out, "\t%s_FieldCount\n};\n\n", name.c_str());
+
+		fprintf(out, "const CbField %s_Fields[%s_FieldCount] =\n{\n", name.c_str(), name.c_str());
+		for (const Field& field : cb.fields)
+			fprintf(out, "\t{ \"%s\", %u, %u },\n", field.name.c_str(), field.offset, field.size);
+		fprintf(out, "};\n");
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <source.fx> <output.h>\n", argv[0]);
+		return 2;
+	}
+
+	std::string text;
+	if (!ReadFile(argv[1], text))
+	{
+		fprintf(stderr, "%s: cannot read\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<CBuffer> cbuffers;
+	std::string error;
+	if (!Parse(Tokenize(text), cbuffers, error))
+	{
+		fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+		return 1;
+	}
+
+	FILE* out = fopen(argv[2], "w");
+	if (!out)
+	{
+		fprintf(stderr, "%s: cannot write\n", argv[2]);
+		return 1;
+	}
+
+	// The source name without its directory, so the header is the same wherever it
+	// was made.
+	const char* sourceName = argv[1];
+	for (const char* p = argv[1]; *p; p++)
+	{
+		if (*p == '/' || *p == '\\')
+			sourceName = p + 1;
+	}
+	Emit(out, sourceName, cbuffers);
+
+	bool ok = (fclose(out) == 0);
+	printf("%s: %u cbuffers\n", argv[2], (unsigned)cbuffers.size());
+	return ok ? 0 : 1;
+}
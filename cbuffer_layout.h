@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// File: cbuffer_layout.h
+//
+// Field metadata for the constant buffer structs made by cbuffer_gen, see
+// Tutorial07_cb.h.
+//
+// Each generated struct has a table of its fields, with the byte offset and size
+// HLSL gives them.  CbDirtyRange uses it to find the part of a buffer that changed
+// since the last upload, so only that part has to go to the GPU.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+struct CbField
+{
+	const char* name;
+	uint32_t offset;
+	uint32_t size;
+};
+
+//--------------------------------------------------------------------------------------
+// The byte range covering every field that differs between the last upload and the
+// new contents, widened to whole 16 byte registers, which is what a partial constant
+// buffer update works in.  Returns false when nothing changed.
+//--------------------------------------------------------------------------------------
+inline bool CbDirtyRange(const void* uploaded, const void* contents, const CbField* fields, uint32_t fieldCount,
+	uint32_t* begin, uint32_t* end)
+{
+	const uint8_t* a = (const uint8_t*)uploaded;
+	const uint8_t* b = (const uint8_t*)contents;
+
+	uint32_t first = UINT32_MAX;
+	uint32_t last = 0;
+	for (uint32_t i = 0; i < fieldCount; i++)
+	{
+		const CbField& field = fields[i];
+		if (memcmp(a + field.offset, b + field.offset, field.size) == 0)
+			continue;
+		if (field.offset < first)
+			first = field.offset;
+		if (field.offset + field.size > last)
+			last = field.offset + field.size;
+	}
+	if (first == UINT32_MAX)
+		return false;
+
+	*begin = first & ~15u;
+	*end = (last + 15) & ~15u;
+	return true;
+}
@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// File: chrome_trace.cpp
+//
+// Chrome trace event writer, see chrome_trace.h.
+//--------------------------------------------------------------------------------------
+
+#include "chrome_trace.h"
+
+#include <chrono>
+#include <stdio.h>
+
+
+static double SteadyMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ChromeTrace::ChromeTrace() : m_epochMs(SteadyMs())
+{
+}
+
+double ChromeTrace::NowMs() const
+{
+	return SteadyMs();
+}
+
+void ChromeTrace::Add(const char* name, const char* category, uint32_t thread, double startMs, double endMs)
+{
+	Event event = { name, category ? category : "", thread, startMs, endMs };
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_events.push_back(event);
+}
+
+void ChromeTrace::NameThread(uint32_t thread, const char* name)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	for (auto& threadName : m_threadNames)
+	{
+		if (threadName.first == thread)
+		{
+			threadName.second = name;
+			return;
+		}
+	}
+	m_threadNames.push_back(std::make_pair(thread, std::string(name)));
+}
+
+void ChromeTrace::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_events.clear();
+}
+
+size_t ChromeTrace::EventCount() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_events.size();
+}
+
+// Names are ours, but quote what JSON needs quoted anyway.
+static void AppendJsonString(std::string& out, const std::string& s)
+{
+	out += '"';
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)c);
+			out += escape;
+		}
+		else
+		{
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+std::string ChromeTrace::Json() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	char numbers[128];
+
+	for (const auto& threadName : m_threadNames)
+	{
+		out += first ? "" : ",\n";
+		first = false;
+		snprintf(numbers, sizeof(numbers), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+			threadName.first);
+		out += numbers;
+		AppendJsonString(out, threadName.second);
+		out += "}}";
+	}
+
+	for (const Event& event : m_events)
+	{
+		out += first ? "" : ",\n";
+		first = false;
+		out += "{\"ph\":\"X\",\"pid\":1,\"name\":";
+		AppendJsonString(out, event.name);
+		out += ",\"cat\":";
+		AppendJsonString(out, event.category);
+		snprintf(numbers, sizeof(numbers), ",\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", event.thread,
+			(event.startMs - m_epochMs) * 1000.0, (event.endMs - event.startMs) * 1000.0);
+		out += numbers;
+	}
+
+	out += "\n]}\n";
+	return out;
+}
+
+bool ChromeTrace::Write(const char* fileName) const
+{
+	std::string json = Json();
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+		return false;
+	bool ok = (fwrite(json.data(), 1, json.size(), file) == json.size());
+	return (fclose(file) == 0) && ok;
+}
@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// File: chrome_trace.h
+//
+// Collects timed events and writes them in the Chrome trace event format, to load
+// into chrome://tracing or ui.perfetto.dev.
+//
+// Events are complete ("ph":"X") events, a name, a category, a thread lane and a
+// start and end.  Times are ms on the steady clock, the one WatchClockMs reads, and
+// are written relative to the trace's epoch, in the us the format wants.  Adding is
+// thread safe, behind a lock, so this is for phases, not for per draw events.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ChromeTrace
+{
+public:
+	ChromeTrace();
+
+	double NowMs() const;
+	double EpochMs() const { return m_epochMs; }
+
+	void Add(const char* name, const char* category, uint32_t thread, double startMs, double endMs);
+	void NameThread(uint32_t thread, const char* name);
+	void Clear();
+
+	size_t EventCount() const;
+	bool Write(const char* fileName) const;
+	std::string Json() const;
+
+private:
+	struct Event
+	{
+		std::string name;
+		std::string category;
+		uint32_t thread;
+		double startMs;
+		double endMs;
+	};
+
+	double m_epochMs;
+	mutable std::mutex m_lock;
+	std::vector<Event> m_events;
+	std::vector<std::pair<uint32_t, std::string>> m_threadNames;
+};
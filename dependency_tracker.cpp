@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// File: dependency_tracker.cpp
+//
+// Dependency tracking for device resources, see dependency_tracker.h.
+//--------------------------------------------------------------------------------------
+
+#include "dependency_tracker.h"
+
+
+int DependencyTracker::Add(const char* name, uint32_t params, uint64_t inputs)
+{
+	if (nodes.size() >= MaxNodes || (inputs >> nodes.size()) != 0)
+		return -1;
+
+	Node node = { name, params, inputs, true };
+	nodes.push_back(node);
+	return (int)nodes.size() - 1;
+}
+
+void DependencyTracker::Invalidate(uint32_t changedParams)
+{
+	uint64_t dirtyNodes = 0;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		Node& node = nodes[i];
+		if ((node.params & changedParams) || (node.inputs & dirtyNodes))
+			node.dirty = true;
+		if (node.dirty)
+			dirtyNodes |= 1ull << i;
+	}
+}
+
+void DependencyTracker::InvalidateAll()
+{
+	for (Node& node : nodes)
+		node.dirty = true;
+}
+
+void DependencyTracker::Clean()
+{
+	for (Node& node : nodes)
+		node.dirty = false;
+}
+
+size_t DependencyTracker::DirtyCount() const
+{
+	size_t count = 0;
+	for (const Node& node : nodes)
+		count += node.dirty ? 1 : 0;
+	return count;
+}
@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// File: dependency_tracker.h
+//
+// Dependency tracking for device resources.
+//
+// Each node is a group of objects that are created together.  A node depends on
+// some of the parameters the device is set up with, and on earlier nodes.  When
+// parameters change, Invalidate marks every node that has to be made again, and
+// everything downstream of those.
+//
+// The parameters are bits the caller gives meaning to, Tutorial07.cpp has them in
+// DeviceParam.  Nodes must be added after the nodes they depend on, at most 64 of
+// them, see dependency_tracker_bench.cpp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct DependencyTracker
+{
+	static const size_t MaxNodes = 64;
+
+	struct Node
+	{
+		const char* name;
+		uint32_t params;		// parameter bits
+		uint64_t inputs;		// bit per earlier node
+		bool dirty;
+	};
+
+	std::vector<Node> nodes;
+
+	// Returns the index of the node, dirty, or -1 when there are MaxNodes already or
+	// an input is not an earlier node.
+	int Add(const char* name, uint32_t params, uint64_t inputs = 0);
+
+	void Invalidate(uint32_t changedParams);
+	void InvalidateAll();
+	void Clean();
+	size_t DirtyCount() const;
+};
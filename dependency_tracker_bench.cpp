@@ -0,0 +1,139 @@
+//--------------------------------------------------------------------------------------
+// File: dependency_tracker_bench.cpp
+//
+// Offline check of the device resource dependency tracking, see dependency_tracker.h.
+//
+// The groups are added as RegisterDeviceResources adds them, and for each parameter
+// the sample changes, the groups Invalidate marks are checked against the ones that
+// have to be made again.  Then a chain of 64 nodes, where a change at the start has
+// to reach the end, and the nodes Add has to refuse.  It fails on the first group
+// marked, or left, that should not be.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 dependency_tracker_bench.cpp dependency_tracker.cpp -o dependency_tracker_bench
+//	./dependency_tracker_bench
+//--------------------------------------------------------------------------------------
+
+#include "dependency_tracker.h"
+
+#include <stdio.h>
+#include <string>
+
+
+// As DeviceParam in Tutorial07.cpp.
+enum
+{
+	Param_Size		= 1 << 0,
+	Param_Samples	= 1 << 1,
+	Param_Slices	= 1 << 2,
+	Param_Output	= 1 << 3,
+};
+
+static bool s_Good = true;
+
+static void Check(const char* what, bool passed)
+{
+	printf("  %s%s\n", what, passed ? "" : ", FAILED");
+	s_Good = s_Good && passed;
+}
+
+// The names of the dirty nodes, in order.
+static std::string Dirty(const DependencyTracker& tracker)
+{
+	std::string names;
+	for (const DependencyTracker::Node& node : tracker.nodes)
+	{
+		if (!node.dirty)
+			continue;
+		if (!names.empty())
+			names += " ";
+		names += node.name;
+	}
+	return names;
+}
+
+static void CheckDirty(const char* what, const DependencyTracker& tracker, const char* expected)
+{
+	std::string dirty = Dirty(tracker);
+	Check(what, dirty == expected);
+	if (dirty != expected)
+		printf("    marked %s\n    wanted %s\n", dirty.c_str(), expected);
+}
+
+static DependencyTracker DeviceResources()
+{
+	DependencyTracker tracker;
+	tracker.Add("BackBufferView", Param_Size);
+	int offscreen = tracker.Add("OffscreenTexture", Param_Size | Param_Samples | Param_Slices);
+	tracker.Add("OffscreenViews", 0, 1ull << offscreen);
+	tracker.Add("DepthStencil", Param_Size | Param_Samples | Param_Slices);
+	tracker.Add("Viewport", Param_Size);
+	tracker.Add("FarLayer", Param_Size | Param_Slices);
+	tracker.Add("DepthReadback", Param_Size | Param_Slices);
+	tracker.Add("StereoOutput", Param_Size | Param_Output);
+	tracker.Add("EyeRecording", Param_Size | Param_Slices | Param_Output);
+	tracker.Add("Reprojection", Param_Size | Param_Slices);
+	tracker.Add("FrameGraph", Param_Size | Param_Samples | Param_Slices | Param_Output);
+	return tracker;
+}
+
+int main()
+{
+	printf("Device resources:\n");
+	DependencyTracker tracker = DeviceResources();
+	Check("all new nodes are dirty", tracker.DirtyCount() == tracker.nodes.size());
+	tracker.Clean();
+	Check("clean leaves none dirty", tracker.DirtyCount() == 0);
+
+	tracker.Invalidate(0);
+	Check("no change marks none", tracker.DirtyCount() == 0);
+
+	tracker.Invalidate(Param_Size);
+	Check("size marks every node", tracker.DirtyCount() == tracker.nodes.size());
+	tracker.Clean();
+
+	tracker.Invalidate(Param_Samples);
+	CheckDirty("samples reach the views through the texture", tracker,
+		"OffscreenTexture OffscreenViews DepthStencil FrameGraph");
+	tracker.Clean();
+
+	tracker.Invalidate(Param_Slices);
+	CheckDirty("slices", tracker,
+		"OffscreenTexture OffscreenViews DepthStencil FarLayer DepthReadback EyeRecording Reprojection FrameGraph");
+	tracker.Clean();
+
+	tracker.Invalidate(Param_Output);
+	CheckDirty("output", tracker, "StereoOutput EyeRecording FrameGraph");
+
+	// Not rebuilt yet, so what was dirty stays dirty.
+	tracker.Invalidate(Param_Samples);
+	CheckDirty("output then samples", tracker,
+		"OffscreenTexture OffscreenViews DepthStencil StereoOutput EyeRecording FrameGraph");
+	tracker.Clean();
+
+	tracker.nodes[1].dirty = true;
+	tracker.Invalidate(0);
+	CheckDirty("a dirty node marks what uses it", tracker, "OffscreenTexture OffscreenViews");
+	tracker.InvalidateAll();
+	Check("invalidate all", tracker.DirtyCount() == tracker.nodes.size());
+
+	printf("A chain of %u nodes:\n", (unsigned)DependencyTracker::MaxNodes);
+	DependencyTracker chain;
+	bool added = chain.Add("first", Param_Size) == 0;
+	for (size_t i = 1; i < DependencyTracker::MaxNodes; i++)
+		added = added && chain.Add("next", 0, 1ull << (i - 1)) == (int)i;
+	Check("all added", added);
+	Check("one more is refused", chain.Add("over", Param_Size) == -1 && chain.nodes.size() == DependencyTracker::MaxNodes);
+	chain.Clean();
+	chain.Invalidate(Param_Size);
+	Check("the first reaches the last", chain.DirtyCount() == DependencyTracker::MaxNodes);
+	chain.Clean();
+	chain.Invalidate(Param_Output);
+	Check("another parameter reaches none", chain.DirtyCount() == 0);
+
+	DependencyTracker forward;
+	forward.Add("first", Param_Size);
+	Check("an input that is not an earlier node is refused", forward.Add("second", 0, 1ull << 1) == -1);
+
+	return s_Good ? 0 : 1;
+}
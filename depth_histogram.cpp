@@ -0,0 +1,238 @@
+//--------------------------------------------------------------------------------------
+// File: depth_histogram.cpp
+//
+// Depth histogram and auto-convergence, see depth_histogram.h.
+//--------------------------------------------------------------------------------------
+
+#include "depth_histogram.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEPTH_HISTOGRAM_SSE2 1
+#endif
+
+
+static const float				s_Unorm24Max = 16777215.0f;
+
+// The same steps as the SSE2 kernel, in the same order, so both bin alike.
+static inline uint32_t DepthBin(uint32_t texel, DepthEncoding encoding, float unormScale, float binScale, float maxDepth,
+	uint32_t bins)
+{
+	float w;
+	if (encoding == DepthEncoding_Float)
+		memcpy(&w, &texel, sizeof(w));
+	else
+		w = (float)(int32_t)(texel & 0xffffff) * unormScale;
+
+	if (!(w > 0.0f && w < maxDepth))
+		return bins;
+	uint32_t bin = (uint32_t)(int32_t)(w * binScale);
+	return bin < bins ? bin : bins - 1;
+}
+
+void DepthHistogram::Accumulate(const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t rows, DepthEncoding encoding,
+	uint32_t bins, float maxDepth, uint32_t* lanes, bool simd)
+{
+	float unormScale = maxDepth / s_Unorm24Max;
+	float binScale = bins / maxDepth;
+	uint32_t* lane[Lanes];
+	for (uint32_t l = 0; l < Lanes; l++)
+		lane[l] = lanes + l * (bins + 1);
+
+	for (uint32_t y = 0; y < rows; y++)
+	{
+		const uint32_t* row = reinterpret_cast<const uint32_t*>(texels + y * rowPitch);
+		uint32_t x = 0;
+
+#ifdef DEPTH_HISTOGRAM_SSE2
+		if (simd)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 vMaxDepth = _mm_set1_ps(maxDepth);
+			const __m128 vUnormScale = _mm_set1_ps(unormScale);
+			const __m128 vBinScale = _mm_set1_ps(binScale);
+			const __m128i vUnormMask = _mm_set1_epi32(0xffffff);
+			const __m128i vBackground = _mm_set1_epi32((int)bins);
+			const __m128i vLastBin = _mm_set1_epi32((int)bins - 1);
+			uint32_t index[4];
+
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+				__m128 w = (encoding == DepthEncoding_Float) ? _mm_castsi128_ps(packed) :
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(packed, vUnormMask)), vUnormScale);
+
+				// NaN fails both compares, so it is background too.
+				__m128i inside = _mm_castps_si128(_mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_cmplt_ps(w, vMaxDepth)));
+				__m128i bin = _mm_cvttps_epi32(_mm_mul_ps(_mm_and_ps(w, _mm_castsi128_ps(inside)), vBinScale));
+				__m128i over = _mm_cmpgt_epi32(bin, vLastBin);
+				bin = _mm_or_si128(_mm_andnot_si128(over, bin), _mm_and_si128(over, vLastBin));
+				bin = _mm_or_si128(_mm_and_si128(inside, bin), _mm_andnot_si128(inside, vBackground));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(index), bin);
+				lane[0][index[0]]++;
+				lane[1][index[1]]++;
+				lane[2][index[2]]++;
+				lane[3][index[3]]++;
+			}
+		}
+#endif
+
+		for (; x < width; x++)
+			lane[x & (Lanes - 1)][DepthBin(row[x], encoding, unormScale, binScale, maxDepth, bins)]++;
+	}
+}
+
+
+DepthHistogram::DepthHistogram(uint32_t bins, float maxDepth, uint32_t threads)
+	: m_binCount(bins < 1 ? 1 : bins), m_maxDepth(maxDepth), m_count(0), m_background(0),
+	m_texels(nullptr), m_rowPitch(0), m_width(0), m_height(0), m_encoding(DepthEncoding_Float),
+	m_generation(0), m_running(0), m_quit(false)
+{
+	m_bins.assign(m_binCount, 0);
+
+	threads = threads < 1 ? 1 : threads;
+	m_workerBins.resize(threads);
+	for (uint32_t i = 0; i < threads; i++)
+	{
+		m_workerBins[i].assign(Lanes * (m_binCount + 1), 0);
+		m_threads.push_back(std::thread(&DepthHistogram::Worker, this, i));
+	}
+}
+
+DepthHistogram::~DepthHistogram()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+void DepthHistogram::Start(const void* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding)
+{
+	Wait();
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_texels = static_cast<const uint8_t*>(texels);
+	m_rowPitch = rowPitch;
+	m_width = width;
+	m_height = height;
+	m_encoding = encoding;
+	m_running = (uint32_t)m_threads.size();
+	m_generation++;
+	m_wake.notify_all();
+}
+
+bool DepthHistogram::Busy() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_running != 0;
+}
+
+void DepthHistogram::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_done.wait(lock, [this] { return m_running == 0; });
+	if (!m_texels)
+		return;
+
+	// Add up the workers' lanes, once per Start.
+	m_count = 0;
+	m_background = 0;
+	for (uint32_t bin = 0; bin <= m_binCount; bin++)
+	{
+		uint64_t sum = 0;
+		for (const std::vector<uint32_t>& bins : m_workerBins)
+		{
+			for (uint32_t l = 0; l < Lanes; l++)
+				sum += bins[l * (m_binCount + 1) + bin];
+		}
+		if (bin < m_binCount)
+		{
+			m_bins[bin] = (uint32_t)sum;
+			m_count += sum;
+		}
+		else
+		{
+			m_background = sum;
+		}
+	}
+	m_texels = nullptr;
+}
+
+void DepthHistogram::Worker(uint32_t index)
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+		if (m_quit)
+			return;
+		seen = m_generation;
+
+		uint32_t threads = (uint32_t)m_threads.size();
+		uint32_t first = (uint32_t)((uint64_t)m_height * index / threads);
+		uint32_t last = (uint32_t)((uint64_t)m_height * (index + 1) / threads);
+		const uint8_t* texels = m_texels + first * m_rowPitch;
+		size_t rowPitch = m_rowPitch;
+		uint32_t width = m_width;
+		DepthEncoding encoding = m_encoding;
+		lock.unlock();
+
+		std::vector<uint32_t>& bins = m_workerBins[index];
+		std::fill(bins.begin(), bins.end(), 0u);
+		Accumulate(texels, rowPitch, width, last - first, encoding, m_binCount, m_maxDepth, bins.data(), true);
+
+		lock.lock();
+		if (--m_running == 0)
+			m_done.notify_all();
+	}
+}
+
+float DepthHistogram::Percentile(double p) const
+{
+	if (m_count == 0)
+		return 0.0f;
+
+	uint64_t rank = (uint64_t)(p * (m_count - 1));
+	uint64_t below = 0;
+	for (uint32_t bin = 0; bin < m_binCount; bin++)
+	{
+		below += m_bins[bin];
+		if (below > rank)
+			return BinDepth(bin);
+	}
+	return BinDepth(m_binCount - 1);
+}
+
+
+void ConvergenceController::Update(const DepthHistogram& histogram)
+{
+	if (histogram.Count() < minTexels)
+		return;
+
+	float nearW = histogram.Percentile(nearPercentile);
+	float farW = histogram.Percentile(farPercentile);
+	float wanted = nearW + (farW - nearW) * blend;
+	target = wanted < minConvergence ? minConvergence : (wanted > maxConvergence ? maxConvergence : wanted);
+}
+
+float ConvergenceController::Ease(float current, double elapsedMs)
+{
+	if (target == 0.0f)
+		return current;
+	if (convergence == 0.0f)
+		convergence = current;
+
+	float ease = timeConstantMs > 0.0f ? 1.0f - (float)exp(-elapsedMs / timeConstantMs) : 1.0f;
+	convergence += (target - convergence) * ease;
+	return convergence;
+}
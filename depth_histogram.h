@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// File: depth_histogram.h
+//
+// Histogram of the packed depth in the mono slice, read back from the GPU, and the
+// auto-convergence controller that reads it.
+//
+// The texels are R8G8B8A8_UINT, as packDepth in Tutorial07.fx writes them, so a
+// texel read as a little endian uint32 is either the bits of the float w, or w /
+// DEPTH_FAR in its low 24 bits.  Bins are linear in w from 0 to maxDepth.  Texels
+// at or beyond maxDepth, the clear value among them, are counted as background.
+//
+// The kernel unpacks and bins four texels at a time with SSE2, into four histograms
+// so that neighbouring texels in the same bin do not wait on each other's increment.
+// The rows are split over persistent workers, each with its own histograms, added
+// up in Wait.  Start returns at once, so the caller can go on with the frame while
+// the workers run, as long as the texels stay where they are until Wait.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum DepthEncoding
+{
+	DepthEncoding_Float,		// DEPTH_PACK_FLOAT
+	DepthEncoding_Unorm24,		// DEPTH_PACK_UNORM24
+};
+
+class DepthHistogram
+{
+public:
+	DepthHistogram(uint32_t bins, float maxDepth, uint32_t threads);
+	~DepthHistogram();
+
+	// Histogram width x height texels, rows rowPitch bytes apart.
+	void Start(const void* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding);
+	bool Busy() const;
+	void Wait();
+
+	// After Wait.
+	const std::vector<uint32_t>& Bins() const { return m_bins; }
+	uint64_t Count() const { return m_count; }				// texels in the bins
+	uint64_t Background() const { return m_background; }
+	float BinDepth(uint32_t bin) const { return (bin + 0.5f) * m_maxDepth / m_binCount; }
+
+	// The depth below which a fraction p of the binned texels lie, 0 when there are none.
+	float Percentile(double p) const;
+
+	// The kernel on its own, over some rows, adding into bins + 1 counts per lane, the
+	// last of them background.  simd false is the plain C++ one, for comparison.
+	static void Accumulate(const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t rows, DepthEncoding encoding,
+		uint32_t bins, float maxDepth, uint32_t* lanes, bool simd);
+
+	static const uint32_t Lanes = 4;
+
+private:
+	DepthHistogram(const DepthHistogram&);
+	DepthHistogram& operator=(const DepthHistogram&);
+
+	void Worker(uint32_t index);
+
+	uint32_t m_binCount;
+	float m_maxDepth;
+	std::vector<uint32_t> m_bins;
+	uint64_t m_count;
+	uint64_t m_background;
+
+	// The job, set by Start.
+	const uint8_t* m_texels;
+	size_t m_rowPitch;
+	uint32_t m_width;
+	uint32_t m_height;
+	DepthEncoding m_encoding;
+
+	std::vector<std::thread> m_threads;
+	std::vector<std::vector<uint32_t>> m_workerBins;	// Lanes * (bins + 1) each
+	mutable std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint64_t m_generation;
+	uint32_t m_running;
+	bool m_quit;
+};
+
+//--------------------------------------------------------------------------------------
+// Picks the convergence from two percentiles of the depth histogram, and eases
+// towards it.  At blend 0 the screen plane sits at the near percentile, so almost
+// everything is behind the screen, at 1 at the far one.  A histogram comes every
+// few frames, the easing runs every frame, so the convergence does not step.
+//--------------------------------------------------------------------------------------
+struct ConvergenceController
+{
+	double nearPercentile = 0.05;
+	double farPercentile = 0.50;
+	float blend = 0.25f;
+	float minConvergence = 0.5f;
+	float maxConvergence = 50.0f;
+	float timeConstantMs = 500.0f;	// of the easing, so 63% of the way after this long
+	uint32_t minTexels = 1024;		// fewer and the target stays where it is
+
+	float convergence = 0.0f;		// what to set, 0 until there is a target
+	float target = 0.0f;
+
+	// After a Wait on the histogram.
+	void Update(const DepthHistogram& histogram);
+
+	// elapsedMs is since the last Ease.  current is what is set now, the easing starts
+	// from it the first time.  Returns the convergence to set.
+	float Ease(float current, double elapsedMs);
+};
@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------------------------
+// File: depth_histogram_bench.cpp
+//
+// Offline benchmark of the depth histogram, see depth_histogram.h.
+//
+// It makes a 1920x1080 mono slice of packed depth, a third of it clear and the rest
+// spread over the depth range, in both encodings, and times the plain C++ kernel on
+// one thread, the SSE2 one on one thread, and the SSE2 one on the workers.  All
+// three have to give the same counts.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread depth_histogram_bench.cpp depth_histogram.cpp -o depth_histogram_bench
+//	./depth_histogram_bench [--threads N] [--repeat N] [--bins N]
+//--------------------------------------------------------------------------------------
+
+#include "depth_histogram.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+
+static const uint32_t				s_Width = 1920;
+static const uint32_t				s_Height = 1080;
+static const float					s_DepthFar = 100.0f;		// DEPTH_FAR in Tutorial07.fx
+
+// packDepth, and the clear value, for each encoding.
+static uint32_t PackDepth(float depth, DepthEncoding encoding)
+{
+	uint32_t packed;
+	if (encoding == DepthEncoding_Float)
+	{
+		memcpy(&packed, &depth, sizeof(packed));
+		return packed;
+	}
+	float unorm = depth / s_DepthFar;
+	unorm = unorm < 0.0f ? 0.0f : (unorm > 1.0f ? 1.0f : unorm);
+	return (uint32_t)(unorm * 16777215.0f + 0.5f) | 0xff000000u;
+}
+
+static void MakeFrame(std::vector<uint32_t>& texels, DepthEncoding encoding)
+{
+	uint32_t clear = PackDepth(encoding == DepthEncoding_Float ? FLT_MAX : s_DepthFar, encoding);
+	uint32_t seed = 12345;
+	texels.resize(s_Width * s_Height);
+	for (uint32_t y = 0; y < s_Height; y++)
+	{
+		for (uint32_t x = 0; x < s_Width; x++)
+		{
+			// Blocks of the same depth, as surfaces give, with noise over them.
+			seed = seed * 1664525u + 1013904223u;
+			uint32_t block = ((x / 64) * 7919u + (y / 64) * 104729u) % 97u;
+			float depth = 1.0f + block + (seed >> 8) * (1.0f / 16777216.0f);
+			texels[y * s_Width + x] = (block < 32) ? clear : PackDepth(depth, encoding);
+		}
+	}
+}
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Merges the lanes into bins + 1 counts.
+static std::vector<uint64_t> Merge(const std::vector<uint32_t>& lanes, uint32_t bins)
+{
+	std::vector<uint64_t> counts(bins + 1, 0);
+	for (uint32_t l = 0; l < DepthHistogram::Lanes; l++)
+	{
+		for (uint32_t bin = 0; bin <= bins; bin++)
+			counts[bin] += lanes[l * (bins + 1) + bin];
+	}
+	return counts;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t threads = 4;
+	uint32_t repeat = 100;
+	uint32_t bins = 256;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bins") == 0 && i + 1 < argc)
+			bins = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || threads == 0 || repeat == 0 || bins == 0)
+	{
+		fprintf(stderr, "usage: %s [--threads N] [--repeat N] [--bins N]\n", argv[0]);
+		return 2;
+	}
+
+	const double megaTexels = s_Width * s_Height / 1e6;
+	const size_t rowPitch = s_Width * sizeof(uint32_t);
+	bool ok = true;
+	DepthHistogram histogram(bins, s_DepthFar, threads);
+	std::vector<uint32_t> texels;
+	std::vector<uint32_t> lanes(DepthHistogram::Lanes * (bins + 1));
+
+	for (int e = 0; e < 2; e++)
+	{
+		DepthEncoding encoding = e ? DepthEncoding_Unorm24 : DepthEncoding_Float;
+		MakeFrame(texels, encoding);
+		const uint8_t* frame = reinterpret_cast<const uint8_t*>(texels.data());
+		printf("%s, %ux%u, %u bins:\n", e ? "unorm24" : "float", s_Width, s_Height, bins);
+
+		std::vector<uint64_t> reference;
+		for (int simd = 0; simd < 2; simd++)
+		{
+			double start = NowMs();
+			for (uint32_t r = 0; r < repeat; r++)
+			{
+				std::fill(lanes.begin(), lanes.end(), 0u);
+				DepthHistogram::Accumulate(frame, rowPitch, s_Width, s_Height, encoding, bins, s_DepthFar, lanes.data(), simd != 0);
+			}
+			double ms = (NowMs() - start) / repeat;
+			printf("  %-16s %7.3fms %8.1f Mtexel/s\n", simd ? "sse2, 1 thread" : "scalar, 1 thread", ms, megaTexels / ms * 1000.0);
+
+			std::vector<uint64_t> counts = Merge(lanes, bins);
+			if (!simd)
+				reference = counts;
+			else if (counts != reference)
+				ok = false;
+		}
+
+		double start = NowMs();
+		for (uint32_t r = 0; r < repeat; r++)
+		{
+			histogram.Start(frame, rowPitch, s_Width, s_Height, encoding);
+			histogram.Wait();
+		}
+		double ms = (NowMs() - start) / repeat;
+		char name[32];
+		snprintf(name, sizeof(name), "sse2, %u thread%s", threads, threads == 1 ? "" : "s");
+		printf("  %-16s %7.3fms %8.1f Mtexel/s\n", name, ms, megaTexels / ms * 1000.0);
+
+		for (uint32_t bin = 0; bin < bins; bin++)
+			ok = ok && histogram.Bins()[bin] == reference[bin];
+		ok = ok && histogram.Background() == reference[bins];
+		printf("  %llu texels binned, %llu background, p5 %.2f, p50 %.2f\n", (unsigned long long)histogram.Count(),
+			(unsigned long long)histogram.Background(), histogram.Percentile(0.05), histogram.Percentile(0.5));
+	}
+
+	if (!ok)
+	{
+		fprintf(stderr, "the kernels disagree\n");
+		return 1;
+	}
+	return 0;
+}
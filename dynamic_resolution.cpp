@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// File: dynamic_resolution.cpp
+//
+// The dynamic resolution controller, see dynamic_resolution.h.
+//--------------------------------------------------------------------------------------
+
+#include "dynamic_resolution.h"
+
+#include <math.h>
+
+
+void DynamicResolution::Reset()
+{
+	scale = wanted = maxScale;
+	error1 = error2 = 0.0f;
+}
+
+float DynamicResolution::Update(float frameMs)
+{
+	float error = (targetMs - frameMs) / targetMs;
+	if (fabsf(error) < deadband)
+		error = 0.0f;
+
+	wanted += kp * (error - error1) + ki * error + kd * (error - 2.0f * error1 + error2);
+	wanted = fminf(fmaxf(wanted, minScale), maxScale);
+	error2 = error1;
+	error1 = error;
+
+	bool atLimit = (wanted == minScale || wanted == maxScale) && wanted != scale;
+	if (fabsf(wanted - scale) >= minStep || atLimit)
+		scale = wanted;
+
+	return scale;
+}
@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// File: dynamic_resolution.h
+//
+// The controller that picks the scale of the scene viewport from frame times.
+//
+// At 120Hz both eyes have to be done in 8.3ms, and a missed frame swaps the eyes on
+// the shutter glasses.  So when frames run long, the sample shrinks the viewport used
+// inside the fixed size offscreen array, and upscales during the copy to the back
+// buffer.
+//
+// The controller is a velocity form PID on the fractional frame time error, so there
+// is no integral to wind up.  To keep the viewport from twitching every frame, the
+// published scale only moves once the wanted scale is minStep away from it.
+// Nothing in here reads a clock, so feeding it the same frame times always gives
+// the same scales back, see dynamic_resolution_bench.cpp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+struct DynamicResolution
+{
+	float targetMs = 7.5f;		// leave some headroom below the 8.3ms frame
+	float kp = 0.20f;
+	float ki = 0.05f;
+	float kd = 0.05f;
+	float deadband = 0.05f;		// fractional error that is treated as on target
+	float minStep = 0.05f;		// hysteresis on the published scale
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+
+	float scale = 1.0f;			// what the renderer uses
+	float wanted = 1.0f;		// what the controller would like
+	float error1 = 0.0f;
+	float error2 = 0.0f;
+
+	void Reset();
+
+	// The scale for the next frame, given how long the last one took.
+	float Update(float frameMs);
+};
@@ -0,0 +1,275 @@
+//--------------------------------------------------------------------------------------
+// File: dynamic_resolution_bench.cpp
+//
+// Offline check of the dynamic resolution controller, see dynamic_resolution.h.
+//
+// Each trace is the time of every frame at full scale.  A frame drawn at scale s
+// costs that times fixed + (1 - fixed) * s^2, as the share that is per pixel
+// shrinks with the viewport, and the controller is fed what it cost, in a loop as
+// the sample runs it.  The traces are made here, a light and a heavy scene, a step
+// from one to the other and back, a ramp, and noise around the target, or come from
+// latency.csv, which the Profile build writes with the work of each frame and the
+// scale it was drawn at.
+//
+// For each it gives the frames that missed the 120Hz refresh at full scale and with
+// the controller, how often the scale changed, and the lowest and mean scale.  It
+// fails when a trace does not replay to the same scales twice, when the scale leaves
+// its range, when a light scene is not left at full scale, when noise on target
+// moves the scale more than a few times, or when the step is not caught within
+// 30 frames and given back within 120.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 dynamic_resolution_bench.cpp dynamic_resolution.cpp -o dynamic_resolution_bench
+//	./dynamic_resolution_bench [--fixed F] [latency.csv | trace.txt]
+//--------------------------------------------------------------------------------------
+
+#include "dynamic_resolution.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+static const float					s_RefreshMs = 1000.0f / 120.0f;
+
+struct Run
+{
+	std::vector<float> scales;		// each frame was drawn at
+	std::vector<float> frameMs;		// what each frame cost
+	uint32_t missed;
+	uint32_t changes;
+	float minScale;
+	float meanScale;
+};
+
+static inline uint32_t Hash(uint32_t x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x ^= x >> 4;
+	x *= 0x27d4eb2d;
+	return x ^ (x >> 15);
+}
+
+// -1 to 1, the same every run.
+static float Noise(uint32_t frame)
+{
+	return (float)(Hash(frame) & 0xffff) / 32767.5f - 1.0f;
+}
+
+static float Cost(float fullMs, float scale, float fixed)
+{
+	return fullMs * (fixed + (1.0f - fixed) * scale * scale);
+}
+
+// The frame drawn at the scale the controller gave after the frame before.
+static Run Simulate(const std::vector<float>& trace, float fixed)
+{
+	DynamicResolution controller;
+	controller.Reset();
+
+	Run run = {};
+	run.minScale = controller.scale;
+	double sum = 0.0;
+	float scale = controller.scale;
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		float ms = Cost(trace[i], scale, fixed);
+		run.scales.push_back(scale);
+		run.frameMs.push_back(ms);
+		run.missed += ms > s_RefreshMs ? 1 : 0;
+		run.minScale = std::min(run.minScale, scale);
+		sum += scale;
+
+		float next = controller.Update(ms);
+		run.changes += next != scale ? 1 : 0;
+		scale = next;
+	}
+	run.meanScale = trace.empty() ? 0.0f : (float)(sum / trace.size());
+	return run;
+}
+
+// Frames after start until a frame and all the frames up to end pass, or -1.
+static int Settle(const Run& run, size_t start, size_t end, bool (*pass)(const Run&, size_t))
+{
+	int settled = -1;
+	for (size_t i = start; i < end; i++)
+	{
+		if (!pass(run, i))
+			settled = -1;
+		else if (settled < 0)
+			settled = (int)(i - start);
+	}
+	return settled;
+}
+
+static bool InTime(const Run& run, size_t i)
+{
+	return run.frameMs[i] <= s_RefreshMs;
+}
+
+static bool AtFullScale(const Run& run, size_t i)
+{
+	return run.scales[i] == 1.0f;
+}
+
+// latency.csv from the Profile build, with the work of the frame before and the scale
+// of each, or one frame time in ms per line, at full scale.
+static bool LoadTrace(const char* fileName, float fixed, std::vector<float>& trace)
+{
+	FILE* file = fopen(fileName, "r");
+	if (!file)
+		return false;
+
+	char line[1024];
+	int workColumn = -1;
+	int scaleColumn = -1;
+	float lastScale = 1.0f;
+	bool first = true;
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == '#')
+			continue;
+		std::vector<std::string> columns;
+		for (char* field = strtok(line, ",\r\n"); field; field = strtok(nullptr, ",\r\n"))
+			columns.push_back(field);
+		if (columns.empty())
+			continue;
+
+		if (first)
+		{
+			first = false;
+			for (size_t c = 0; c < columns.size(); c++)
+			{
+				if (columns[c] == "workMs")
+					workColumn = (int)c;
+				else if (columns[c] == "renderScale")
+					scaleColumn = (int)c;
+			}
+			if (workColumn >= 0 && scaleColumn >= 0)
+				continue;
+		}
+
+		if (workColumn < 0)
+		{
+			trace.push_back((float)atof(columns[0].c_str()));
+			continue;
+		}
+		if ((int)columns.size() <= std::max(workColumn, scaleColumn))
+			continue;
+
+		// The work is of the frame before, drawn at the scale before.
+		float workMs = (float)atof(columns[workColumn].c_str());
+		if (workMs > 0.0f)
+			trace.push_back(workMs / (fixed + (1.0f - fixed) * lastScale * lastScale));
+		lastScale = (float)atof(columns[scaleColumn].c_str());
+	}
+	fclose(file);
+	return !trace.empty();
+}
+
+static void Print(const char* name, const std::vector<float>& trace, const Run& held, const Run& run, bool good)
+{
+	printf("  %-10s  %6u  %11u  %10u  %7u  %5.2f  %5.2f%s\n", name, (uint32_t)trace.size(), held.missed, run.missed, run.changes,
+		run.minScale, run.meanScale, good ? "" : ", FAILED");
+}
+
+int main(int argc, char** argv)
+{
+	float fixed = 0.2f;
+	const char* input = nullptr;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--fixed") == 0 && i + 1 < argc)
+			fixed = (float)atof(argv[++i]);
+		else if (argv[i][0] != '-' && !input)
+			input = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || fixed < 0.0f || fixed > 1.0f)
+	{
+		fprintf(stderr, "usage: %s [--fixed F] [latency.csv | trace.txt]\n", argv[0]);
+		return 2;
+	}
+
+	DynamicResolution limits;
+	printf("%.0f%% of a frame does not scale, target %.1fms, missed is over %.2fms:\n", 100.0f * fixed, limits.targetMs,
+		s_RefreshMs);
+	printf("  trace       frames  missed held  missed run  changes    min   mean\n");
+
+	std::vector<std::pair<std::string, std::vector<float>>> traces;
+	if (input)
+	{
+		std::vector<float> trace;
+		if (!LoadTrace(input, fixed, trace))
+		{
+			fprintf(stderr, "cannot read a trace from %s\n", input);
+			return 1;
+		}
+		traces.push_back(std::make_pair(std::string("file"), trace));
+	}
+	else
+	{
+		std::vector<float> light, heavy, step, ramp, target;
+		for (uint32_t f = 0; f < 600; f++)
+		{
+			light.push_back(5.0f + 0.3f * Noise(f));
+			heavy.push_back(14.0f + 0.5f * Noise(f));
+			step.push_back((f >= 120 && f < 360 ? 12.0f : 5.0f) + 0.3f * Noise(f));
+			ramp.push_back(4.0f + 10.0f * f / 600.0f + 0.3f * Noise(f));
+			target.push_back(limits.targetMs * (1.0f + 0.03f * Noise(f)));
+		}
+		traces.push_back(std::make_pair(std::string("light"), light));
+		traces.push_back(std::make_pair(std::string("heavy"), heavy));
+		traces.push_back(std::make_pair(std::string("step"), step));
+		traces.push_back(std::make_pair(std::string("ramp"), ramp));
+		traces.push_back(std::make_pair(std::string("on target"), target));
+	}
+
+	bool allGood = true;
+	int caught = -1, givenBack = -1;
+	for (const auto& named : traces)
+	{
+		const std::string& name = named.first;
+		const std::vector<float>& trace = named.second;
+
+		// Full scale throughout, as with dynamic resolution off.
+		std::vector<float> full(trace.size());
+		for (size_t i = 0; i < trace.size(); i++)
+			full[i] = Cost(trace[i], 1.0f, fixed);
+		Run held = {};
+		for (float ms : full)
+			held.missed += ms > s_RefreshMs ? 1 : 0;
+
+		Run run = Simulate(trace, fixed);
+		Run again = Simulate(trace, fixed);
+		bool good = run.scales == again.scales;
+		for (float scale : run.scales)
+			good = good && scale >= limits.minScale && scale <= limits.maxScale;
+
+		if (name == "light")
+			good = good && run.changes == 0;
+		else if (name == "on target")
+			good = good && run.changes <= 4;
+		else if (name == "step")
+		{
+			caught = Settle(run, 120, 360, InTime);
+			givenBack = Settle(run, 360, trace.size(), AtFullScale);
+			good = good && caught >= 0 && caught <= 30 && givenBack >= 0 && givenBack <= 120;
+		}
+
+		Print(name.c_str(), trace, held, run, good);
+		allGood = allGood && good;
+	}
+	if (caught >= 0 || givenBack >= 0)
+		printf("  the step is caught in %d frames and given back in %d\n", caught, givenBack);
+
+	return allGood ? 0 : 1;
+}
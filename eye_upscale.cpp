@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: eye_upscale.cpp
+//
+// Upscaling an eye drawn below full size, see eye_upscale.h.
+//--------------------------------------------------------------------------------------
+
+#include "eye_upscale.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+
+// lerp in HLSL.
+static inline float Lerp(float a, float b, float s)
+{
+	return a + s * (b - a);
+}
+
+void UpscaleEye(const uint8_t* eye, size_t eyePitch, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t width,
+	uint32_t height, uint8_t* out, size_t outPitch)
+{
+	if (eyeWidth == 0 || eyeHeight == 0)
+		return;
+
+	// ResolveParams.xy and ResolveClamp.xy.
+	const float scaleX = (float)eyeWidth / (float)width;
+	const float scaleY = (float)eyeHeight / (float)height;
+	const int32_t lastX = (int32_t)eyeWidth - 1;
+	const int32_t lastY = (int32_t)eyeHeight - 1;
+
+	// Columns are the same for every row.
+	std::vector<int32_t> x0(width), x1(width);
+	std::vector<float> fx(width);
+	for (uint32_t x = 0; x < width; x++)
+	{
+		float s = ((float)x + 0.5f) * scaleX - 0.5f;
+		int32_t i = (int32_t)floorf(s);
+		fx[x] = s - (float)i;
+		x0[x] = std::min(std::max(i, 0), lastX) * 4;
+		x1[x] = std::min(std::max(i + 1, 0), lastX) * 4;
+	}
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		float s = ((float)y + 0.5f) * scaleY - 0.5f;
+		int32_t i = (int32_t)floorf(s);
+		float fy = s - (float)i;
+		const uint8_t* top = eye + (size_t)std::min(std::max(i, 0), lastY) * eyePitch;
+		const uint8_t* bottom = eye + (size_t)std::min(std::max(i + 1, 0), lastY) * eyePitch;
+		uint8_t* row = out + (size_t)y * outPitch;
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				float t = Lerp(top[x0[x] + c] / 255.0f, top[x1[x] + c] / 255.0f, fx[x]);
+				float b = Lerp(bottom[x0[x] + c] / 255.0f, bottom[x1[x] + c] / 255.0f, fx[x]);
+				float v = std::min(std::max(Lerp(t, b, fy), 0.0f), 1.0f);
+				row[x * 4 + c] = (uint8_t)(v * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+UpscaleError CompareEyes(const uint8_t* reference, size_t referencePitch, const uint8_t* test, size_t testPitch,
+	uint32_t width, uint32_t height)
+{
+	UpscaleError error = {};
+	uint64_t squares = 0;
+	uint64_t sum = 0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* a = reference + (size_t)y * referencePitch;
+		const uint8_t* b = test + (size_t)y * testPitch;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			bool different = false;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				uint32_t d = (uint32_t)abs((int32_t)a[x * 4 + c] - (int32_t)b[x * 4 + c]);
+				squares += d * d;
+				sum += d;
+				error.maxAbs = std::max(error.maxAbs, d);
+				different = different || d != 0;
+			}
+			error.differentTexels += different ? 1 : 0;
+		}
+	}
+
+	double channels = 3.0 * width * height;
+	double mse = channels > 0.0 ? squares / channels : 0.0;
+	error.psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : HUGE_VAL;
+	error.meanAbs = channels > 0.0 ? sum / channels : 0.0;
+	return error;
+}
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// File: eye_upscale.h
+//
+// The plain C++ reference of UpscalePS in Tutorial07.fx, and the error of an eye
+// drawn small and filtered up against the same eye drawn at full size.
+//
+// An eye slice drawn below full size fills only the top left of its slice, eye
+// width x eye height texels.  Output texel (x, y) of width x height reads it at
+//	s = (x + 0.5) * eyeWidth / width - 0.5
+// and likewise for y, bilinear between the four texels around s, each clamped to
+// the last texel drawn.  The offscreen array has no filtering view, so the shader
+// does the same by hand, in float, and writes a UNORM target.  The two agree to
+// within one step of a channel, where the GPU rounds the lerps differently.
+//
+// The error is over red, green and blue, alpha is left out.  See eye_upscale_bench.cpp
+// for what the binocular suppression mode gives up at each scale.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Filter the eyeWidth x eyeHeight R8G8B8A8 texels at eye, rows eyePitch bytes
+// apart, up to width x height at out.  Alpha is filtered as the rest.
+void UpscaleEye(const uint8_t* eye, size_t eyePitch, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t width,
+	uint32_t height, uint8_t* out, size_t outPitch);
+
+struct UpscaleError
+{
+	double psnr;			// dB, over 255, infinite when the two are the same
+	double meanAbs;			// mean absolute difference of a channel
+	uint32_t maxAbs;		// largest difference of a channel
+	uint64_t differentTexels;
+};
+
+// How far test is from reference, both width x height R8G8B8A8.
+UpscaleError CompareEyes(const uint8_t* reference, size_t referencePitch, const uint8_t* test, size_t testPitch,
+	uint32_t width, uint32_t height);
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------
+// File: eye_upscale_bench.cpp
+//
+// Offline benchmark of drawing one eye below full size, see eye_upscale.h.
+//
+// It ray casts textured panels in front of a textured wall for the right eye at
+// full size, for the truth, and again into a viewport of each scale of the full
+// one, as the binocular suppression mode draws the eye it suppresses.  The small
+// eye is filtered back up as UpscalePS does, and compared with the truth.  With it
+// go the texels each scale saves, of the eye and of the frame, and the time of the
+// upscale on the CPU.  The times are the best of the runs.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 eye_upscale_bench.cpp eye_upscale.cpp -o eye_upscale_bench
+//	./eye_upscale_bench [--size WxH] [--runs N]
+//--------------------------------------------------------------------------------------
+
+#include "eye_upscale.h"
+#include "bench_scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The eye into a viewport of width x height.  The projection is that of the full
+// size, as the sample keeps it when the viewport shrinks.  GetStereoPos moves a
+// point at w by sep * (w - conv) in clip space, so the texels are rays from
+// (sep * conv / P11, 0, 0).
+static void Render(const Panel* panels, uint32_t panelCount, float projectionX, uint32_t width, uint32_t height,
+	float separation, float convergence, std::vector<uint8_t>& eye)
+{
+	const float origin[3] = { separation * convergence / projectionX, 0.0f, 0.0f };
+	eye.resize((size_t)width * height * 4);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float ex = (x + 0.5f) / (width * 0.5f) - 1.0f;
+			float ey = 1.0f - (y + 0.5f) / (height * 0.5f);
+			const float direction[3] = { (ex - separation) / projectionX, ey / s_ProjectionY, 1.0f };
+
+			float t;
+			uint32_t color = CastRay(panels, panelCount, origin, direction, t);
+			memcpy(&eye[((size_t)y * width + x) * 4], &color, 4);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t runs = 5;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			usage = sscanf(argv[++i], "%ux%u", &width, &height) != 2;
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || width < 4 || height < 4 || runs == 0)
+	{
+		fprintf(stderr, "usage: %s [--size WxH] [--runs N]\n", argv[0]);
+		return 2;
+	}
+
+	Panel panels[6];
+	for (uint32_t i = 0; i < 6; i++)
+		panels[i] = PlacePanel(i, 2.5f + 6.0f * i);
+
+	// The right eye as the sample sets it, the driver's separation and convergence.
+	const float separation = 0.05f;
+	const float convergence = 4.0f;
+	const float projectionX = s_ProjectionY * height / width;
+	const size_t pitch = (size_t)width * 4;
+
+	std::vector<uint8_t> truth, small, upscaled(pitch * height);
+	Render(panels, 6, projectionX, width, height, separation, convergence, truth);
+
+	// Scale 1 has to give the eye back as it is.
+	const float scales[] = { 1.0f, 0.85f, 0.75f, 0.6f, 0.5f };
+	printf("%ux%u, the right eye, best of %u:\n", width, height, runs);
+	printf("  scale  viewport    eye saved  frame saved  PSNR dB  mean  max  upscale ms\n");
+	bool exact = true;
+	for (float scale : scales)
+	{
+		// floorf, as UpdateSuppression sizes the viewport.
+		uint32_t eyeWidth = std::max((uint32_t)floorf(width * scale), 1u);
+		uint32_t eyeHeight = std::max((uint32_t)floorf(height * scale), 1u);
+		Render(panels, 6, projectionX, eyeWidth, eyeHeight, separation, convergence, small);
+
+		double upscaleMs = 1e30;
+		for (uint32_t r = 0; r < runs; r++)
+		{
+			double startMs = NowMs();
+			UpscaleEye(small.data(), (size_t)eyeWidth * 4, eyeWidth, eyeHeight, width, height, upscaled.data(), pitch);
+			upscaleMs = std::min(upscaleMs, NowMs() - startMs);
+		}
+		UpscaleError error = CompareEyes(truth.data(), pitch, upscaled.data(), pitch, width, height);
+		if (scale == 1.0f)
+			exact = error.differentTexels == 0;
+
+		// The frame is both eyes and the mono slice.
+		double eyeSaved = 1.0 - (double)eyeWidth * eyeHeight / ((double)width * height);
+		printf("  %5.2f  %4ux%-4u  %8.1f%%  %10.1f%%  %7.2f  %4.2f  %3u  %10.2f\n", scale, eyeWidth, eyeHeight,
+			100.0 * eyeSaved, 100.0 * eyeSaved / 3.0, error.psnr, error.meanAbs, error.maxAbs, upscaleMs);
+	}
+	if (!exact)
+		printf("  scale 1 does not give the eye back\n");
+
+	return exact ? 0 : 1;
+}
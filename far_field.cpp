@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// File: far_field.cpp
+//
+// Near and far classification for the mono far layer, see far_field.h.
+//--------------------------------------------------------------------------------------
+
+#include "far_field.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+float FarFieldShiftPx(const FarFieldSplit& split, float separation, float convergence, float widthPx)
+{
+	return separation * (1.0f - convergence * split.invReferenceW) * widthPx * 0.5f;
+}
+
+FarFieldSplit ClassifyFarField(const FarFieldView& view, const FarFieldObject* objects, size_t count, uint8_t* isFar,
+	std::vector<uint32_t>& order)
+{
+	FarFieldSplit split = {};
+
+	// k is the error in pixels per unit of 1/w away from the reference.
+	// Without separation every depth lands in the same place, so everything is far.
+	// With it, and no error allowed, nothing is.
+	float k = fabsf(view.separation * view.convergence) * view.widthPx * 0.5f;
+	if (k > 0.0f && view.thresholdPx > 0.0f)
+	{
+		split.splitW = k / (2.0f * view.thresholdPx);
+		split.invReferenceW = 0.5f / split.splitW;
+	}
+	else if (k > 0.0f)
+	{
+		split.splitW = HUGE_VALF;
+	}
+
+	// Nearest first.  Once an object is far, everything after it starts further
+	// away still, and no near object reaches past it, so the far set is the tail.
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+	std::sort(order.begin(), order.end(), [objects](uint32_t a, uint32_t b) { return objects[a].nearW < objects[b].nearW; });
+
+	float nearReach = split.splitW;
+	size_t first = count;
+	for (size_t i = 0; i < count; i++)
+	{
+		const FarFieldObject& object = objects[order[i]];
+		if (object.nearW >= nearReach && object.nearW > 0.0f)
+		{
+			first = i;
+			break;
+		}
+		nearReach = std::max(nearReach, object.farW);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const FarFieldObject& object = objects[order[i]];
+		bool inFarLayer = (i >= first);
+		isFar[order[i]] = inFarLayer ? 1 : 0;
+		if (inFarLayer)
+		{
+			split.farObjects++;
+			split.farTriangles += object.triangles;
+		}
+		else
+		{
+			split.nearObjects++;
+			split.nearTriangles += object.triangles;
+		}
+	}
+
+	split.shiftPx = FarFieldShiftPx(split, view.separation, view.convergence, view.widthPx);
+	return split;
+}
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// File: far_field.h
+//
+// Which objects are far enough away to be drawn once, into a mono layer, and shifted
+// into both eyes, rather than drawn into each eye.
+//
+// The GS moves a vertex in clip space by sep * (w - conv), so on screen an eye sees
+// a point at depth w moved by
+//	d(w) = sep * (1 - conv / w) * width / 2 pixels
+// which tends to sep * width / 2 far away.  Drawn once and shifted by d(ref), a
+// point at w is off by sep * conv * width / 2 * |1/w - 1/ref|.  Every point with
+// 1/w in [0, 1/splitW] is within the threshold of d(ref) when 1/ref is halfway
+// along that range, which puts splitW at sep * conv * width / (4 * threshold).
+//
+// The far layer is composited under everything else, so an object is only far when
+// it starts beyond splitW and no near object reaches past its nearest point.  Depth
+// here is w, which for the sample's projection is view space z.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct FarFieldView
+{
+	float separation;		// of one eye, in clip space x per unit of w - conv
+	float convergence;		// in w
+	float widthPx;			// of the eye's viewport
+	float thresholdPx;		// the most an object in the far layer may be off by, 0 or less for no far layer
+};
+
+struct FarFieldObject
+{
+	float nearW;			// depth range of the object's bounds
+	float farW;
+	uint32_t triangles;
+};
+
+struct FarFieldSplit
+{
+	float splitW;			// far objects start at or beyond this
+	float invReferenceW;	// the far layer is shifted as if it were all at 1 / this
+	float shiftPx;			// d(ref) for the eye, signed as its separation
+	uint32_t nearObjects;
+	uint32_t farObjects;
+	uint64_t nearTriangles;
+	uint64_t farTriangles;
+
+	// Of the triangles the GS would have drawn into slices, how many the far layer
+	// saves, as the far ones are drawn once instead.
+	double SavedFraction(uint32_t slices) const
+	{
+		uint64_t total = (nearTriangles + farTriangles) * slices;
+		return total ? (double)(farTriangles * (slices - 1)) / total : 0.0;
+	}
+};
+
+// The pixel shift of the far layer for an eye with this separation, the same split
+// as for the view.
+float FarFieldShiftPx(const FarFieldSplit& split, float separation, float convergence, float widthPx);
+
+// Sets isFar for every object, and returns the split.  order is scratch.
+FarFieldSplit ClassifyFarField(const FarFieldView& view, const FarFieldObject* objects, size_t count, uint8_t* isFar,
+	std::vector<uint32_t>& order);
@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------
+// File: far_field_bench.cpp
+//
+// Offline check/benchmark of the near and far classification, see far_field.h.
+//
+// A small scene, given out of depth order, is split by hand: the split depth, the
+// shift, which objects are far and the share of triangles saved have to come out
+// as worked out here.  An object beyond the split that a nearer object reaches past
+// has to stay near.  A threshold of 0 or less has to leave every object near, and
+// no separation or no convergence has to put every object in the far layer.  It
+// fails on any of these, then times the split of many objects.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 far_field_bench.cpp far_field.cpp -o far_field_bench
+//	./far_field_bench [--objects N] [--repeat N]
+//--------------------------------------------------------------------------------------
+
+#include "far_field.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+
+static bool							s_Good = true;
+
+static void Check(const char* what, bool passed)
+{
+	printf("  %s%s\n", what, passed ? "" : ", FAILED");
+	s_Good = s_Good && passed;
+}
+
+static bool Near(double a, double b)
+{
+	return fabs(a - b) <= 1e-5 * (fabs(b) > 1.0 ? fabs(b) : 1.0);
+}
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline uint32_t Hash(uint32_t x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x ^= x >> 4;
+	x *= 0x27d4eb2d;
+	return x ^ (x >> 15);
+}
+
+// k = 0.05 * 5 * 1920 / 2 = 240 pixels per unit of 1/w, so with 2 pixels allowed
+// splitW = 240 / 4 = 60, the reference is at 120, and the shift is
+// 0.05 * (1 - 5 / 120) * 960 = 46 pixels.
+static const FarFieldView			s_View = { 0.05f, 5.0f, 1920.0f, 2.0f };
+
+// Out of depth order.  B reaches to 70, past where C starts, so C stays near even
+// though it starts beyond the split, and the far layer is D and E.
+static const FarFieldObject			s_Scene[] =
+{
+	{ 80.0f, 82.0f, 24 },		// E, far
+	{ 65.0f, 67.0f, 12 },		// C, near as B reaches past it
+	{ 2.0f, 4.0f, 12 },			// A, near
+	{ 72.0f, 74.0f, 12 },		// D, far
+	{ 10.0f, 70.0f, 12 },		// B, near, and reaches past the split
+};
+static const uint8_t				s_SceneFar[] = { 1, 0, 0, 1, 0 };
+static const size_t					s_SceneCount = sizeof(s_Scene) / sizeof(s_Scene[0]);
+
+static void CheckScene()
+{
+	std::vector<uint32_t> order;
+	uint8_t isFar[s_SceneCount];
+	FarFieldSplit split = ClassifyFarField(s_View, s_Scene, s_SceneCount, isFar, order);
+
+	Check("the split is at 60, the reference at 120 and the shift 46px", Near(split.splitW, 60.0) &&
+		Near(split.invReferenceW, 1.0 / 120.0) && Near(split.shiftPx, 46.0));
+	Check("the far layer is D and E", !memcmp(isFar, s_SceneFar, sizeof(isFar)) && split.nearObjects == 3 &&
+		split.farObjects == 2 && split.nearTriangles == 36 && split.farTriangles == 36);
+
+	// 36 far triangles drawn once rather than into each slice, of 72 into each.
+	Check("the far layer saves 1/3 of the triangles with the mono slice, 1/4 without",
+		Near(split.SavedFraction(3), 72.0 / 216.0) && Near(split.SavedFraction(2), 36.0 / 144.0));
+
+	// Without B reaching past it, C is far.
+	FarFieldObject shorter[s_SceneCount];
+	memcpy(shorter, s_Scene, sizeof(shorter));
+	shorter[4].farW = 50.0f;
+	split = ClassifyFarField(s_View, shorter, s_SceneCount, isFar, order);
+	Check("C is far once B no longer reaches past it", isFar[1] == 1 && split.farObjects == 3);
+}
+
+static void CheckLimits()
+{
+	std::vector<uint32_t> order;
+	uint8_t isFar[s_SceneCount];
+	FarFieldObject far[s_SceneCount];
+	memcpy(far, s_Scene, sizeof(far));
+	far[0].nearW = far[0].farW = 1e6f;
+
+	bool none = true;
+	const float thresholds[] = { 0.0f, -1.0f };
+	for (float threshold : thresholds)
+	{
+		FarFieldView view = s_View;
+		view.thresholdPx = threshold;
+		FarFieldSplit split = ClassifyFarField(view, far, s_SceneCount, isFar, order);
+		none = none && split.farObjects == 0 && split.farTriangles == 0 && split.SavedFraction(3) == 0.0;
+		for (size_t i = 0; i < s_SceneCount; i++)
+			none = none && isFar[i] == 0;
+	}
+	Check("a threshold of 0 or less leaves every object near, however far", none);
+
+	bool all = true;
+	for (int which = 0; which < 2; which++)
+	{
+		FarFieldView view = s_View;
+		(which ? view.convergence : view.separation) = 0.0f;
+		FarFieldSplit split = ClassifyFarField(view, s_Scene, s_SceneCount, isFar, order);
+		all = all && split.nearObjects == 0 && split.farObjects == s_SceneCount;
+		for (size_t i = 0; i < s_SceneCount; i++)
+			all = all && isFar[i] == 1;
+	}
+	Check("no separation or no convergence puts every object in the far layer", all);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t objects = 10000;
+	uint32_t repeat = 100;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+			objects = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || objects == 0 || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s [--objects N] [--repeat N]\n", argv[0]);
+		return 2;
+	}
+
+	printf("separation %.2f, convergence %.0f, %.0fpx wide, %.0fpx allowed:\n", s_View.separation, s_View.convergence,
+		s_View.widthPx, s_View.thresholdPx);
+	CheckScene();
+	CheckLimits();
+
+	// Cubes spread from 1 to 98, each a quarter of the mean gap deep, so there are
+	// gaps for the far layer to start in.
+	std::vector<FarFieldObject> many(objects);
+	for (uint32_t i = 0; i < objects; i++)
+	{
+		many[i].nearW = 1.0f + 97.0f * (Hash(i) & 0xffff) / 65535.0f;
+		many[i].farW = many[i].nearW + 0.25f * 97.0f / objects;
+		many[i].triangles = 12;
+	}
+	std::vector<uint8_t> isFar(many.size(), 0);
+	std::vector<uint32_t> order;
+	FarFieldSplit split = {};
+	double start = NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+		split = ClassifyFarField(s_View, many.data(), many.size(), isFar.data(), order);
+	printf("  %u objects split in %.3fms, %u far, %.1f%% of triangles saved\n", objects, (NowMs() - start) / repeat,
+		split.farObjects, 100.0 * split.SavedFraction(3));
+
+	return s_Good ? 0 : 1;
+}
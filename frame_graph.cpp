@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------------------------
+// File: frame_graph.cpp
+//
+// Frame graph compile, see frame_graph.h.
+//--------------------------------------------------------------------------------------
+
+#include "frame_graph.h"
+
+
+//--------------------------------------------------------------------------------------
+// Pick the copy path for the eye slices.
+//
+// ResolveSubresource on a single sample source is legal, but it still goes down the
+// resolve path in the driver.  CopySubresourceRegion is a straight memcpy on the GPU.
+//--------------------------------------------------------------------------------------
+EyeCopyPath SelectEyeCopyPath(uint32_t sampleCount, float renderScale)
+{
+	if (renderScale < 1.0f)
+		return EyeCopy_Upscale;
+
+	return (sampleCount > 1) ? EyeCopy_Resolve : EyeCopy_Copy;
+}
+
+int FrameGraph::AddResource(const char* name, uint32_t width, uint32_t height, uint32_t arraySize,
+	uint32_t samples, uint32_t bytesPerTexel, bool imported)
+{
+	FgResource res = {};
+	res.name = name;
+	res.width = width;
+	res.height = height;
+	res.arraySize = arraySize;
+	res.samples = samples;
+	res.bytesPerTexel = bytesPerTexel;
+	res.renderScale = 1.0f;
+	res.imported = imported;
+	resources.push_back(res);
+	return (int)resources.size() - 1;
+}
+
+int FrameGraph::AddPass(const char* name, FgExecute execute)
+{
+	FgPass pass = {};
+	pass.name = name;
+	pass.execute = execute;
+	pass.enabled = true;
+	pass.eye = -1;
+	pass.sliceScale = 1.0f;
+	passes.push_back(pass);
+	return (int)passes.size() - 1;
+}
+
+int FrameGraph::AddEyeOutput(const char* name, FgExecute execute, int source, uint32_t slice, int eye, int target)
+{
+	int pass = AddPass(name, execute);
+	passes[pass].eyeOutput = true;
+	passes[pass].slice = slice;
+	passes[pass].eye = eye;
+	Read(pass, source);
+	Write(pass, target);
+	return pass;
+}
+
+void FrameGraph::Compile()
+{
+	// Cull, walking backwards from the imported resources.
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t r = 0; r < resources.size(); r++)
+		needed[r] = resources[r].imported;
+
+	for (int p = (int)passes.size() - 1; p >= 0; p--)
+	{
+		FgPass& pass = passes[p];
+		pass.culled = true;
+		if (!pass.enabled)
+			continue;
+
+		for (int w : pass.writes)
+			if (needed[w])
+				pass.culled = false;
+
+		if (!pass.culled)
+			for (int r : pass.reads)
+				needed[r] = true;
+	}
+
+	order.clear();
+	for (size_t p = 0; p < passes.size(); p++)
+		if (!passes[p].culled)
+			order.push_back((int)p);
+
+	// Copy path for the eye outputs, and lifetimes.
+	for (FgResource& res : resources)
+		res.firstUse = res.lastUse = res.pool = -1;
+
+	for (int i = 0; i < (int)order.size(); i++)
+	{
+		FgPass& pass = passes[order[i]];
+		if (pass.eyeOutput)
+		{
+			const FgResource& src = resources[pass.reads[0]];
+			pass.copyPath = SelectEyeCopyPath(src.samples, src.renderScale * pass.sliceScale);
+		}
+
+		for (int pr = 0; pr < 2; pr++)
+		{
+			for (int r : (pr == 0) ? pass.reads : pass.writes)
+			{
+				FgResource& res = resources[r];
+				if (res.firstUse < 0)
+					res.firstUse = i;
+				res.lastUse = i;
+			}
+		}
+	}
+
+	// Pack transients into pools, in order of first use.  A pool is free once
+	// the last target placed in it is done, and grows to its largest tenant.
+	pools.clear();
+	transientBytes = 0;
+	pooledBytes = 0;
+	for (int i = 0; i < (int)order.size(); i++)
+	{
+		for (FgResource& res : resources)
+		{
+			if (res.imported || res.firstUse != i)
+				continue;
+
+			int best = -1;
+			for (int p = 0; p < (int)pools.size(); p++)
+			{
+				if (pools[p].lastUse >= i)
+					continue;
+				if (best < 0 || pools[p].bytes > pools[best].bytes)
+					best = p;
+			}
+			if (best < 0)
+			{
+				FgPool pool = { 0, -1 };
+				pools.push_back(pool);
+				best = (int)pools.size() - 1;
+			}
+
+			uint64_t bytes = res.Bytes();
+			if (pools[best].bytes < bytes)
+				pools[best].bytes = bytes;
+			pools[best].lastUse = res.lastUse;
+			res.pool = best;
+			transientBytes += bytes;
+		}
+	}
+	for (const FgPool& pool : pools)
+		pooledBytes += pool.bytes;
+}
+
+void FrameGraph::Execute(FgExecute before, FgExecute after) const
+{
+	for (int p : order)
+	{
+		if (before)
+			before(passes[p]);
+		passes[p].execute(passes[p]);
+		if (after)
+			after(passes[p]);
+	}
+}
@@ -0,0 +1,115 @@
+//--------------------------------------------------------------------------------------
+// File: frame_graph.h
+//
+// The passes of a frame are declared once, with the resources they read and write.
+// Every frame the graph is compiled:
+//	- disabled passes, and passes whose output never reaches an imported resource
+//	  (the back buffer), are culled.
+//	- each declared eye output gets the cheapest copy pass for its source, the same
+//	  choice SelectEyeCopyPath makes.
+//	- the first and last use of every transient target is found, and targets that
+//	  are never alive at the same time are packed into shared memory pools.
+//
+// There is nothing D3D specific in here; passes carry a callback that does the work.
+// D3D11 has no placed resources, so the pools are a plan and a report of what an
+// aliasing backend would save.  Targets keep their own allocations for now.  In
+// Direct Mode the sample's targets are all alive together and nothing is saved;
+// composed, the eye pair can take the depth's place.  frame_graph_bench.cpp checks
+// the packing, and times the compile.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// How each eye slice gets from the offscreen array into the back buffer.
+//
+// In Direct Mode the driver owns the per-eye back buffers, and SetActiveEye selects
+// which one the next copy lands in, so we cannot simply render into a 2x wide
+// back buffer with a viewport per eye.  What we can pick is the cheapest copy.
+//--------------------------------------------------------------------------------------
+enum EyeCopyPath
+{
+	EyeCopy_Resolve,	// MSAA slices, fixed function box filter resolve.
+	EyeCopy_Copy,		// Single sample slices, a plain copy is enough.
+	EyeCopy_Upscale,	// Rendered below full size, filter up with a quad pass.
+};
+
+EyeCopyPath SelectEyeCopyPath(uint32_t sampleCount, float renderScale = 1.0f);
+
+struct FgPass;
+typedef void (*FgExecute)(const FgPass& pass);
+
+struct FgResource
+{
+	const char* name;
+	uint32_t width;
+	uint32_t height;
+	uint32_t arraySize;
+	uint32_t samples;
+	uint32_t bytesPerTexel;
+	float renderScale;		// part of each slice actually rendered
+	bool imported;			// owned outside the graph, like the back buffer
+
+	// Filled in by Compile
+	int firstUse;			// position in the compiled order, -1 when unused
+	int lastUse;
+	int pool;				// shared memory pool, -1 for imported or unused
+
+	uint64_t Bytes() const
+	{
+		return (uint64_t)width * height * arraySize * samples * bytesPerTexel;
+	}
+};
+
+struct FgPass
+{
+	const char* name;
+	FgExecute execute;
+	bool enabled;
+	std::vector<int> reads;
+	std::vector<int> writes;
+
+	// Eye outputs only, the copy path is picked by Compile
+	bool eyeOutput;
+	uint32_t slice;
+	int eye;
+	float sliceScale;		// of the source's renderScale, below 1 for an eye drawn smaller
+	EyeCopyPath copyPath;
+
+	bool culled;
+};
+
+struct FgPool
+{
+	uint64_t bytes;
+	int lastUse;
+};
+
+struct FrameGraph
+{
+	std::vector<FgResource> resources;
+	std::vector<FgPass> passes;
+	std::vector<int> order;			// compiled execution order
+	std::vector<FgPool> pools;
+
+	uint64_t transientBytes = 0;	// every transient with its own allocation
+	uint64_t pooledBytes = 0;		// the same transients packed into pools
+
+	int AddResource(const char* name, uint32_t width, uint32_t height, uint32_t arraySize,
+		uint32_t samples, uint32_t bytesPerTexel, bool imported = false);
+	int AddPass(const char* name, FgExecute execute);
+
+	// One slice of source is shown to one eye of the imported target.
+	int AddEyeOutput(const char* name, FgExecute execute, int source, uint32_t slice, int eye, int target);
+
+	void Read(int pass, int resource) { passes[pass].reads.push_back(resource); }
+	void Write(int pass, int resource) { passes[pass].writes.push_back(resource); }
+
+	void Compile();
+
+	// before and after run around every pass, for timers.
+	void Execute(FgExecute before = nullptr, FgExecute after = nullptr) const;
+};
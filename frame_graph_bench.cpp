@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------------------------
+// File: frame_graph_bench.cpp
+//
+// Offline check and benchmark of the frame graph compile, see frame_graph.h.
+//
+// The graphs are the sample's in Direct Mode and composed, both with the far layer
+// drawn, the same with it off, and a post chain whose targets each live for two
+// passes.  For each it gives the passes kept, the transient bytes, the bytes in
+// pools, what aliasing saves, and the time of one compile.  It fails when two targets
+// alive at the same time share a pool, a pool is smaller than a target in it, the
+// pools hold less than is ever alive at once, or a graph that has targets with apart
+// lifetimes saves nothing.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 frame_graph_bench.cpp frame_graph.cpp -o frame_graph_bench
+//	./frame_graph_bench [--repeat N]
+//--------------------------------------------------------------------------------------
+
+#include "frame_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+
+static const uint32_t				s_Width = 1920;
+static const uint32_t				s_Height = 1080;
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Nothing(const FgPass&)
+{
+}
+
+// As BuildFrameGraph lays it out, with a mono slice and the far layer.
+static FrameGraph SampleGraph(bool composed, bool farLayer)
+{
+	FrameGraph g;
+	int offscreen = g.AddResource("Offscreen", s_Width, s_Height, 3, 1, 4);
+	int depth = g.AddResource("DepthStencil", s_Width, s_Height, 3, 1, 4);
+	int backBuffer = g.AddResource("BackBuffer", s_Width, s_Height, 1, 1, 4, true);
+
+	int clear = g.AddPass("Clear", Nothing);
+	g.Write(clear, offscreen);
+	g.Write(clear, depth);
+
+	int far = g.AddResource("FarLayer", s_Width, s_Height, 2, 1, 4);
+	int farDepth = g.AddResource("FarDepth", s_Width, s_Height, 1, 1, 4);
+	int farField = g.AddPass("FarField", Nothing);
+	g.Write(farField, far);
+	g.Write(farField, farDepth);
+	int farComposite = g.AddPass("FarComposite", Nothing);
+	g.Read(farComposite, far);
+	g.Read(farComposite, offscreen);
+	g.Write(farComposite, offscreen);
+	g.passes[farField].enabled = g.passes[farComposite].enabled = farLayer;
+
+	int scene = g.AddPass("Scene", Nothing);
+	g.Read(scene, offscreen);
+	g.Read(scene, depth);
+	g.Write(scene, offscreen);
+	g.Write(scene, depth);
+
+	if (composed)
+	{
+		int eyePair = g.AddResource("EyePair", s_Width, s_Height, 2, 1, 4);
+		int output = g.AddResource("StereoOutput", s_Width * 2, s_Height, 1, 1, 4, true);
+		g.AddEyeOutput("LeftEye", Nothing, offscreen, 0, 0, eyePair);
+		g.AddEyeOutput("RightEye", Nothing, offscreen, 1, 1, eyePair);
+		int compose = g.AddPass("Compose", Nothing);
+		g.Read(compose, eyePair);
+		g.Write(compose, backBuffer);
+		g.Write(compose, output);
+	}
+	else
+	{
+		g.AddEyeOutput("LeftEye", Nothing, offscreen, 0, 0, backBuffer);
+		g.AddEyeOutput("RightEye", Nothing, offscreen, 1, 1, backBuffer);
+	}
+
+	int depthView = g.AddPass("DepthView", Nothing);
+	g.Read(depthView, offscreen);
+	g.Write(depthView, backBuffer);
+	g.passes[depthView].enabled = false;
+	return g;
+}
+
+// Each target is written by one pass and read by the next, at halving sizes down
+// and back up.
+static FrameGraph PostChain()
+{
+	static const char* names[] = { "Scene", "Down1", "Down2", "Down3", "Up2", "Up1", "Tonemap" };
+	static const uint32_t shifts[] = { 0, 1, 2, 3, 2, 1, 0 };
+	const int steps = sizeof(shifts) / sizeof(shifts[0]);
+
+	FrameGraph g;
+	int backBuffer = g.AddResource("BackBuffer", s_Width, s_Height, 1, 1, 4, true);
+	int last = -1;
+	for (int i = 0; i < steps; i++)
+	{
+		int target = g.AddResource(names[i], s_Width >> shifts[i], s_Height >> shifts[i], 2, 1, 8);
+		int pass = g.AddPass(names[i], Nothing);
+		if (last >= 0)
+			g.Read(pass, last);
+		g.Write(pass, target);
+		last = target;
+	}
+	int present = g.AddPass("Present", Nothing);
+	g.Read(present, last);
+	g.Write(present, backBuffer);
+	return g;
+}
+
+// The pools are a valid plan, and hold at least what is alive at the busiest pass.
+static bool Valid(const FrameGraph& g)
+{
+	const std::vector<FgResource>& res = g.resources;
+	for (size_t a = 0; a < res.size(); a++)
+	{
+		if (res[a].pool < 0)
+			continue;
+		if (g.pools[res[a].pool].bytes < res[a].Bytes())
+			return false;
+		for (size_t b = a + 1; b < res.size(); b++)
+			if (res[b].pool == res[a].pool && res[a].firstUse <= res[b].lastUse && res[b].firstUse <= res[a].lastUse)
+				return false;
+	}
+
+	uint64_t peak = 0;
+	for (int i = 0; i < (int)g.order.size(); i++)
+	{
+		uint64_t alive = 0;
+		for (const FgResource& r : res)
+			if (!r.imported && r.firstUse >= 0 && r.firstUse <= i && r.lastUse >= i)
+				alive += r.Bytes();
+		peak = std::max(peak, alive);
+	}
+	return g.pooledBytes >= peak && g.pooledBytes <= g.transientBytes;
+}
+
+// Some two targets are never alive at the same time.
+static bool ApartLifetimes(const FrameGraph& g)
+{
+	const std::vector<FgResource>& res = g.resources;
+	for (size_t a = 0; a < res.size(); a++)
+		for (size_t b = a + 1; b < res.size(); b++)
+			if (!res[a].imported && !res[b].imported && res[a].firstUse >= 0 && res[b].firstUse >= 0 &&
+				(res[a].lastUse < res[b].firstUse || res[b].lastUse < res[a].firstUse))
+				return true;
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t repeat = 100000;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s [--repeat N]\n", argv[0]);
+		return 2;
+	}
+
+	struct Named
+	{
+		const char* name;
+		FrameGraph graph;
+	};
+	Named graphs[] =
+	{
+		{ "direct mode", SampleGraph(false, true) },
+		{ "composed", SampleGraph(true, true) },
+		{ "composed, no far", SampleGraph(true, false) },
+		{ "post chain", PostChain() },
+	};
+
+	printf("%ux%u, MB, and us per compile over %u:\n", s_Width, s_Height, repeat);
+	printf("  graph              passes  transient  pooled  saved  pools     us\n");
+	bool good = true;
+	for (Named& named : graphs)
+	{
+		FrameGraph& g = named.graph;
+		double start = NowMs();
+		for (uint32_t i = 0; i < repeat; i++)
+			g.Compile();
+		double us = (NowMs() - start) * 1000.0 / repeat;
+
+		bool ok = Valid(g) && (!ApartLifetimes(g) || g.pooledBytes < g.transientBytes);
+		printf("  %-17s  %2u of %u  %9.1f  %6.1f  %5.1f  %5u  %5.2f%s\n", named.name, (uint32_t)g.order.size(),
+			(uint32_t)g.passes.size(), g.transientBytes / 1048576.0, g.pooledBytes / 1048576.0,
+			(g.transientBytes - g.pooledBytes) / 1048576.0, (uint32_t)g.pools.size(), us, ok ? "" : ", FAILED");
+		good = good && ok;
+	}
+
+	return good ? 0 : 1;
+}
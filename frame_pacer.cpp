@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------------------
+// File: frame_pacer.cpp
+//
+// Missed refresh and eye swap counting, see frame_pacer.h.
+//--------------------------------------------------------------------------------------
+
+#include "frame_pacer.h"
+
+#include <math.h>
+
+
+void FramePacer::Reset()
+{
+	started = statistics = eyesSwapped = false;
+	frames = missedFrames = missedRefreshes = eyeSwaps = 0;
+}
+
+uint32_t FramePacer::OnPresent(uint64_t presentCount, uint64_t refreshCount, double refreshTimeMs)
+{
+	// The app's counts do not carry on into DXGI's.
+	if (!statistics)
+	{
+		started = false;
+		statistics = true;
+	}
+	return Count(presentCount, refreshCount, refreshTimeMs);
+}
+
+uint32_t FramePacer::OnPresentTime(uint64_t presentCount, double presentTimeMs)
+{
+	if (statistics)
+		return 0;
+
+	uint64_t refreshCount = lastRefreshCount;
+	if (started)
+		refreshCount += (uint64_t)floor((presentTimeMs - lastRefreshMs) / refreshMs + 0.5);
+	return Count(presentCount, refreshCount, presentTimeMs);
+}
+
+void FramePacer::OnDisjoint()
+{
+	started = false;
+}
+
+uint32_t FramePacer::Count(uint64_t presentCount, uint64_t refreshCount, double refreshTimeMs)
+{
+	uint32_t missed = 0;
+	if (started && presentCount > lastPresentCount)
+	{
+		uint64_t expected = (presentCount - lastPresentCount) * refreshesPerFrame;
+		uint64_t actual = refreshCount - lastRefreshCount;
+		if (actual > expected)
+		{
+			missed = (uint32_t)(actual - expected);
+			missedFrames++;
+			missedRefreshes += missed;
+			if (missed & 1)
+			{
+				eyeSwaps++;
+				eyesSwapped = !eyesSwapped;
+			}
+		}
+		frames += presentCount - lastPresentCount;
+	}
+
+	started = true;
+	lastPresentCount = presentCount;
+	lastRefreshCount = refreshCount;
+	lastRefreshMs = refreshTimeMs;
+	return missed;
+}
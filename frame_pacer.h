@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// File: frame_pacer.h
+//
+// Which refresh each present landed on, and the misses that swap the eyes.
+//
+// 3D Vision alternates eyes on every refresh, so a present that misses its vsync
+// does not just stutter, an odd number of missed refreshes swaps which eye the
+// glasses show each image to until the next miss.
+//
+// The pacer only sees present and refresh counts, plus times in ms, so it can be
+// driven by DXGI frame statistics, by QPC, or by a simulated vsync clock, see
+// frame_pacer_bench.cpp.  The counts come from one place: DXGI's, once the frame
+// statistics have been there, which cover the presents without them as the counts
+// run on, and before that the app's own, with the refresh worked out from the time
+// of the present.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+
+struct FramePacer
+{
+	double refreshMs = 1000.0 / 120.0;
+	uint32_t refreshesPerFrame = 1;		// sync interval we present with
+
+	bool started = false;
+	bool statistics = false;			// the counts are from frame statistics
+	uint64_t lastPresentCount = 0;
+	uint64_t lastRefreshCount = 0;
+	double lastRefreshMs = 0.0;
+
+	uint64_t frames = 0;
+	uint64_t missedFrames = 0;			// presents that took more refreshes than asked
+	uint64_t missedRefreshes = 0;
+	uint64_t eyeSwaps = 0;				// misses by an odd number of refreshes
+	bool eyesSwapped = false;
+
+	void Reset();
+
+	// From frame statistics, present presentCount was shown on refresh refreshCount,
+	// at refreshTimeMs.  Returns the number of refreshes it was late.
+	uint32_t OnPresent(uint64_t presentCount, uint64_t refreshCount, double refreshTimeMs);
+
+	// A present without frame statistics, presentCount by the app's count.  Ignored
+	// once there have been statistics.
+	uint32_t OnPresentTime(uint64_t presentCount, double presentTimeMs);
+
+	// The statistics say their counts jumped, so start again from the next ones.
+	void OnDisjoint();
+
+private:
+	uint32_t Count(uint64_t presentCount, uint64_t refreshCount, double refreshTimeMs);
+};
@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+// File: frame_pacer_bench.cpp
+//
+// Offline check of the frame pacer against a simulated vsync clock, see frame_pacer.h.
+//
+// Frames of given costs are presented to a display that refreshes every 1/120s.  A
+// present blocks until the refresh it lands on, the first one after the frame is
+// done and at least the sync interval after the one before, and the next frame
+// starts when it returns.  The simulation knows which refresh every frame landed
+// on, so it knows the refreshes missed and whether the eyes ended up swapped.
+//
+// The pacer is fed as PresentFrame feeds it: with frame statistics, whose present and
+// refresh counts start where DXGI's happen to, without any, from the time the present
+// returned, a little after the refresh, with every fifth present missing its
+// statistics, with statistics only from the 50th present on, and with the statistics
+// disjoint once, their refresh count starting over.  It fails when the pacer does not
+// count the same missed refreshes as the simulation, over what it could see, or ends
+// with the eyes the other way round.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 frame_pacer_bench.cpp frame_pacer.cpp -o frame_pacer_bench
+//	./frame_pacer_bench [--frames N]
+//--------------------------------------------------------------------------------------
+
+#include "frame_pacer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+
+static const double					s_RefreshMs = 1000.0 / 120.0;
+static const uint64_t				s_DxgiPresentStart = 1000;	// DXGI counts from wherever it is at
+static const uint64_t				s_DxgiRefreshStart = 52000;
+static const uint32_t				s_LateStatistics = 50;
+static const uint32_t				s_Disjoint = 300;
+
+enum Source
+{
+	Source_Statistics,
+	Source_Time,
+	Source_SomeMissing,
+	Source_LateStatistics,
+	Source_Disjoint,
+	Source_Count
+};
+
+static const char* s_SourceNames[Source_Count] = { "statistics", "time", "some missing", "late", "disjoint" };
+
+struct Landed
+{
+	uint64_t refresh;		// of the display, from 0
+	double returnMs;		// when Present returned
+};
+
+static inline uint32_t Hash(uint32_t x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x ^= x >> 4;
+	x *= 0x27d4eb2d;
+	return x ^ (x >> 15);
+}
+
+// 0 to 1, the same every run.
+static double Random(uint32_t i)
+{
+	return (Hash(i) & 0xffff) / 65535.0;
+}
+
+static std::vector<Landed> Display(const std::vector<double>& costMs, uint32_t syncInterval)
+{
+	std::vector<Landed> landed(costMs.size());
+	double startMs = 0.0;
+	uint64_t last = 0;
+	for (size_t i = 0; i < costMs.size(); i++)
+	{
+		uint64_t refresh = (uint64_t)ceil((startMs + costMs[i]) / s_RefreshMs);
+		if (i > 0 && refresh < last + syncInterval)
+			refresh = last + syncInterval;
+
+		landed[i].refresh = refresh;
+		landed[i].returnMs = refresh * s_RefreshMs + 0.8 * Random((uint32_t)i + 77777);
+		startMs = landed[i].returnMs;
+		last = refresh;
+	}
+	return landed;
+}
+
+// What the pacer could see: every frame but the ones just after a gap it cannot
+// count across, and the last ones without statistics, which wait for the next that
+// has them.
+static uint64_t MissedRefreshes(const std::vector<Landed>& landed, uint32_t syncInterval, Source source)
+{
+	size_t end = landed.size();
+	while (source == Source_SomeMissing && end > 0 && (end - 1) % 5 == 4)
+		end--;
+
+	uint64_t missed = 0;
+	for (size_t i = 1; i < end; i++)
+	{
+		if (source == Source_LateStatistics && i == s_LateStatistics)
+			continue;
+		if (source == Source_Disjoint && (i == s_Disjoint || i == s_Disjoint + 1))
+			continue;
+		uint64_t took = landed[i].refresh - landed[i - 1].refresh;
+		missed += took > syncInterval ? took - syncInterval : 0;
+	}
+	return missed;
+}
+
+static void Feed(FramePacer& pacer, const std::vector<Landed>& landed, Source source)
+{
+	uint64_t refreshStart = s_DxgiRefreshStart;
+	for (uint32_t i = 0; i < landed.size(); i++)
+	{
+		const Landed& l = landed[i];
+		bool statistics = source != Source_Time;
+		if (source == Source_SomeMissing)
+			statistics = i % 5 != 4;
+		else if (source == Source_LateStatistics)
+			statistics = i >= s_LateStatistics;
+
+		if (source == Source_Disjoint && i == s_Disjoint)
+		{
+			pacer.OnDisjoint();
+			refreshStart = 7;
+		}
+		else if (statistics)
+		{
+			pacer.OnPresent(s_DxgiPresentStart + i + 1, refreshStart + l.refresh, l.refresh * s_RefreshMs);
+		}
+		else
+		{
+			pacer.OnPresentTime(i + 1, l.returnMs);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t frames = 600;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || frames <= s_Disjoint + 1)
+	{
+		fprintf(stderr, "usage: %s [--frames N], N over %u\n", argv[0], s_Disjoint + 1);
+		return 2;
+	}
+
+	struct Scene
+	{
+		const char* name;
+		uint32_t syncInterval;
+		double baseMs;
+		double spreadMs;
+		uint32_t spikeEvery;		// 0 for none
+		double spikeMs;
+	};
+	const Scene scenes[] =
+	{
+		{ "on time",     1,  5.0, 2.0,  0,  0.0 },
+		{ "one over",    1,  5.0, 1.0, 97, 12.0 },
+		{ "two over",    1,  5.0, 1.0, 97, 20.0 },
+		{ "heavy",       1,  4.0, 10.0, 0,  0.0 },
+		{ "interval 2",  2, 10.0, 4.0, 61, 22.0 },
+	};
+
+	printf("%u frames at 120Hz, missed refreshes and eyes swapped, simulated and counted:\n", frames);
+	printf("  scene       interval  source        missed  counted  swapped  counted\n");
+	bool good = true;
+	for (const Scene& scene : scenes)
+	{
+		std::vector<double> costMs(frames);
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			costMs[i] = scene.baseMs + scene.spreadMs * Random(i);
+			if (scene.spikeEvery && i % scene.spikeEvery == scene.spikeEvery - 1)
+				costMs[i] = scene.spikeMs;
+		}
+		std::vector<Landed> landed = Display(costMs, scene.syncInterval);
+
+		for (int source = 0; source < Source_Count; source++)
+		{
+			FramePacer pacer;
+			pacer.refreshesPerFrame = scene.syncInterval;
+			Feed(pacer, landed, (Source)source);
+
+			uint64_t missed = MissedRefreshes(landed, scene.syncInterval, (Source)source);
+			bool swapped = (missed & 1) != 0;
+			bool same = pacer.missedRefreshes == missed && pacer.eyesSwapped == swapped;
+			printf("  %-10s  %8u  %-12s  %6u  %7u  %7s  %7s%s\n", scene.name, scene.syncInterval, s_SourceNames[source],
+				(uint32_t)missed, (uint32_t)pacer.missedRefreshes, swapped ? "yes" : "no", pacer.eyesSwapped ? "yes" : "no",
+				same ? "" : ", DIFFERENT");
+			good = good && same;
+		}
+	}
+
+	return good ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// File: frame_timing.cpp
+//
+// Frame timing ring and percentiles, see frame_timing.h.
+//--------------------------------------------------------------------------------------
+
+#include "frame_timing.h"
+#include "chrome_trace.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+
+static size_t RoundUpPow2(size_t n)
+{
+	size_t p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+TimingRing::TimingRing(size_t capacity)
+	: m_slots(RoundUpPow2(capacity < 2 ? 2 : capacity)), m_head(0), m_tail(0), m_dropped(0)
+{
+	m_mask = m_slots.size() - 1;
+}
+
+bool TimingRing::Push(const TimingSample& sample)
+{
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) >= m_slots.size())
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	m_slots[head & m_mask] = sample;
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool TimingRing::Pop(TimingSample& sample)
+{
+	uint64_t tail = m_tail.load(std::memory_order_relaxed);
+	if (tail == m_head.load(std::memory_order_acquire))
+		return false;
+	sample = m_slots[tail & m_mask];
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+
+FrameTiming::FrameTiming(size_t ringCapacity, uint32_t window)
+	: m_ring(ringCapacity), m_window(window < 1 ? 1 : window), m_firstFrame(0), m_lastFrame(UINT64_MAX)
+{
+}
+
+int FrameTiming::AddScope(const char* name)
+{
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		if (m_scopes[i].name == name)
+			return (int)i;
+	}
+
+	Scope scope;
+	scope.name = name;
+	for (Window& window : scope.windows)
+	{
+		window.ms.resize(m_window);
+		window.next = window.count = 0;
+		window.totalMs = 0.0;
+	}
+	m_scopes.push_back(scope);
+	return (int)m_scopes.size() - 1;
+}
+
+double FrameTiming::NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t FrameTiming::Collect(ChromeTrace* trace)
+{
+	std::lock_guard<std::mutex> lock(m_statsLock);
+
+	size_t collected = 0;
+	TimingSample sample;
+	while (m_ring.Pop(sample))
+	{
+		collected++;
+		if (sample.scope >= m_scopes.size() || sample.clock >= Timing_ClockCount)
+			continue;
+		if (sample.frame < m_firstFrame || sample.frame > m_lastFrame)
+			continue;
+
+		Scope& scope = m_scopes[sample.scope];
+		Window& window = scope.windows[sample.clock];
+		float ms = (float)(sample.endMs - sample.startMs);
+		if (window.count == m_window)
+			window.totalMs -= window.ms[window.next];
+		else
+			window.count++;
+		window.ms[window.next] = ms;
+		window.totalMs += ms;
+		window.next = (window.next + 1) % m_window;
+
+		if (trace)
+			trace->Add(scope.name.c_str(), sample.clock == Timing_Cpu ? "cpu" : "gpu", sample.clock, sample.startMs, sample.endMs);
+	}
+
+	if (trace)
+	{
+		trace->NameThread(Timing_Cpu, "CPU");
+		trace->NameThread(Timing_Gpu, "GPU");
+	}
+	return collected;
+}
+
+void FrameTiming::Reset(uint32_t window, uint64_t firstFrame, uint64_t lastFrame)
+{
+	std::lock_guard<std::mutex> lock(m_statsLock);
+
+	TimingSample sample;
+	while (m_ring.Pop(sample))
+	{
+	}
+
+	m_window = window < 1 ? 1 : window;
+	m_firstFrame = firstFrame;
+	m_lastFrame = lastFrame;
+	for (Scope& scope : m_scopes)
+	{
+		for (Window& w : scope.windows)
+		{
+			w.ms.assign(m_window, 0.0f);
+			w.next = w.count = 0;
+			w.totalMs = 0.0;
+		}
+	}
+}
+
+// Nearest rank, on a copy of the window.
+static double Percentile(std::vector<float>& sorted, double p)
+{
+	size_t rank = (size_t)(p * (sorted.size() - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+TimingStats FrameTiming::Stats(int scope, TimingClock clock) const
+{
+	TimingStats stats = {};
+
+	std::vector<float> ms;
+	{
+		std::lock_guard<std::mutex> lock(m_statsLock);
+		const Window& window = m_scopes[scope].windows[clock];
+		if (window.count == 0)
+			return stats;
+		ms.assign(window.ms.begin(), window.ms.begin() + window.count);
+		stats.count = window.count;
+		stats.meanMs = window.totalMs / window.count;
+	}
+
+	stats.p50Ms = Percentile(ms, 0.50);
+	stats.p95Ms = Percentile(ms, 0.95);
+	stats.p99Ms = Percentile(ms, 0.99);
+	stats.maxMs = *std::max_element(ms.begin(), ms.end());
+	return stats;
+}
+
+std::string FrameTiming::Report() const
+{
+	static const char* clockNames[Timing_ClockCount] = { "cpu", "gpu" };
+
+	std::string out;
+	char line[256];
+	for (int scope = 0; scope < (int)m_scopes.size(); scope++)
+	{
+		for (int clock = 0; clock < Timing_ClockCount; clock++)
+		{
+			TimingStats stats = Stats(scope, (TimingClock)clock);
+			if (stats.count == 0)
+				continue;
+			snprintf(line, sizeof(line), "Timing %-10s %s: p50 %.3fms, p95 %.3fms, p99 %.3fms, max %.3fms over %u frames\n",
+				m_scopes[scope].name.c_str(), clockNames[clock], stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs, stats.count);
+			out += line;
+		}
+	}
+	if (Dropped())
+	{
+		snprintf(line, sizeof(line), "Timing: %llu samples dropped, the ring was full\n", (unsigned long long)Dropped());
+		out += line;
+	}
+	return out;
+}
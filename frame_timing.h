@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------------
+// File: frame_timing.h
+//
+// Per scope CPU and GPU times for each frame, and their percentiles.
+//
+// The render thread records samples into a lock-free ring, one producer and one
+// consumer, so recording never takes a lock or allocates.  When the consumer falls
+// behind, new samples are dropped and counted rather than blocking the frame.
+// Collect drains the ring into a window of the last durations of each scope, for
+// p50/p95/p99, and optionally into a ChromeTrace, CPU samples on lane 0 and GPU on
+// lane 1.  Collect may run on the render thread between frames, or on another one.
+//
+// GPU samples come from the backend, which turns timestamp queries into ms.  Their
+// times are put on the CPU clock by the backend, so the trace lines them up with the
+// CPU side only roughly.  The durations are exact.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ChromeTrace;
+
+enum TimingClock : uint8_t
+{
+	Timing_Cpu,
+	Timing_Gpu,
+	Timing_ClockCount
+};
+
+struct TimingSample
+{
+	uint64_t frame;
+	uint16_t scope;
+	TimingClock clock;
+	double startMs;
+	double endMs;
+};
+
+//--------------------------------------------------------------------------------------
+// Single producer, single consumer.  The capacity is rounded up to a power of two.
+//--------------------------------------------------------------------------------------
+class TimingRing
+{
+public:
+	explicit TimingRing(size_t capacity);
+
+	bool Push(const TimingSample& sample);
+	bool Pop(TimingSample& sample);
+
+	uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	std::vector<TimingSample> m_slots;
+	size_t m_mask;
+	std::atomic<uint64_t> m_head;		// next to write, producer only
+	std::atomic<uint64_t> m_tail;		// next to read, consumer only
+	std::atomic<uint64_t> m_dropped;
+};
+
+struct TimingStats
+{
+	uint32_t count;			// in the window
+	double meanMs;
+	double p50Ms;
+	double p95Ms;
+	double p99Ms;
+	double maxMs;
+};
+
+class FrameTiming
+{
+public:
+	explicit FrameTiming(size_t ringCapacity = 4096, uint32_t window = 600);
+
+	// Returns the scope with that name, adding it the first time.  Not thread safe,
+	// add the scopes at setup.
+	int AddScope(const char* name);
+	const char* ScopeName(int scope) const { return m_scopes[scope].name.c_str(); }
+	int ScopeCount() const { return (int)m_scopes.size(); }
+
+	static double NowMs();
+
+	// Producer side.
+	void Record(int scope, TimingClock clock, uint64_t frame, double startMs, double endMs)
+	{
+		TimingSample sample = { frame, (uint16_t)scope, clock, startMs, endMs };
+		m_ring.Push(sample);
+	}
+
+	// Consumer side.  Returns the samples taken from the ring.
+	size_t Collect(ChromeTrace* trace = nullptr);
+
+	// Consumer side.  Drops what the ring holds and empties every window, sized
+	// again to hold window samples, as at the start of a measurement.  From then on
+	// Collect keeps only the samples of frames firstFrame to lastFrame, as GPU
+	// samples arrive frames late.
+	void Reset(uint32_t window, uint64_t firstFrame = 0, uint64_t lastFrame = UINT64_MAX);
+
+	TimingStats Stats(int scope, TimingClock clock) const;
+	std::string Report() const;
+	uint64_t Dropped() const { return m_ring.Dropped(); }
+
+private:
+	struct Window
+	{
+		std::vector<float> ms;
+		uint32_t next;
+		uint32_t count;
+		double totalMs;
+	};
+
+	struct Scope
+	{
+		std::string name;
+		Window windows[Timing_ClockCount];
+	};
+
+	TimingRing m_ring;
+	uint32_t m_window;
+	uint64_t m_firstFrame;
+	uint64_t m_lastFrame;
+	std::vector<Scope> m_scopes;
+	mutable std::mutex m_statsLock;	// Collect against Stats, both off the hot path
+};
+
+//--------------------------------------------------------------------------------------
+// Times the rest of the enclosing block on the CPU.
+//--------------------------------------------------------------------------------------
+class ScopedCpuTimer
+{
+public:
+	ScopedCpuTimer(FrameTiming* timing, int scope, uint64_t frame)
+		: m_timing(timing), m_scope(scope), m_frame(frame), m_startMs(timing ? FrameTiming::NowMs() : 0.0)
+	{
+	}
+
+	~ScopedCpuTimer()
+	{
+		if (m_timing)
+			m_timing->Record(m_scope, Timing_Cpu, m_frame, m_startMs, FrameTiming::NowMs());
+	}
+
+private:
+	ScopedCpuTimer(const ScopedCpuTimer&);
+	ScopedCpuTimer& operator=(const ScopedCpuTimer&);
+
+	FrameTiming* m_timing;
+	int m_scope;
+	uint64_t m_frame;
+	double m_startMs;
+};
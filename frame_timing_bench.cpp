@@ -0,0 +1,188 @@
+//--------------------------------------------------------------------------------------
+// File: frame_timing_bench.cpp
+//
+// Offline check and benchmark of the frame timing ring and percentiles, see
+// frame_timing.h.
+//
+// Checks the percentiles of a window of known durations, that the window keeps only
+// the last ones, that a full ring drops and counts what does not fit, that Reset
+// keeps only the frames asked for, and that a producer and a consumer on two threads
+// lose and repeat nothing.  Then times a Record with its share of Collect, a
+// ScopedCpuTimer with its two clock reads, and Stats over a full window.  It fails
+// on the first check that does not pass, not on the times.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread frame_timing_bench.cpp frame_timing.cpp chrome_trace.cpp -o frame_timing_bench
+//	./frame_timing_bench [--repeat N]
+//--------------------------------------------------------------------------------------
+
+#include "frame_timing.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+
+static const uint32_t				s_Window = 600;
+static const uint32_t				s_Batch = 1000;		// samples between two Collects
+
+static bool s_Good = true;
+static volatile double s_Sink;		// keeps the timed Stats calls
+
+static void Check(const char* what, bool passed)
+{
+	printf("  %s%s\n", what, passed ? "" : ", FAILED");
+	s_Good = s_Good && passed;
+}
+
+static inline uint32_t Hash(uint32_t x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x ^= x >> 4;
+	x *= 0x27d4eb2d;
+	return x ^ (x >> 15);
+}
+
+static void CheckPercentiles()
+{
+	// 1 to 600ms, shuffled.
+	std::vector<uint32_t> order(s_Window);
+	for (uint32_t i = 0; i < s_Window; i++)
+		order[i] = i + 1;
+	for (uint32_t i = s_Window - 1; i > 0; i--)
+		std::swap(order[i], order[Hash(i) % (i + 1)]);
+
+	FrameTiming timing(4096, s_Window);
+	int scope = timing.AddScope("Scene");
+	for (uint32_t i = 0; i < s_Window; i++)
+		timing.Record(scope, Timing_Cpu, i, 10.0, 10.0 + order[i]);
+	timing.Collect();
+
+	TimingStats stats = timing.Stats(scope, Timing_Cpu);
+	Check("p50, p95, p99 and max of 1 to 600ms are 301, 570, 594 and 600",
+		stats.count == s_Window && stats.p50Ms == 301.0 && stats.p95Ms == 570.0 && stats.p99Ms == 594.0 &&
+		stats.maxMs == 600.0 && fabs(stats.meanMs - 300.5) < 1e-6);
+	Check("the GPU side of the scope is empty", timing.Stats(scope, Timing_Gpu).count == 0);
+
+	for (uint32_t i = 0; i < s_Window; i++)
+		timing.Record(scope, Timing_Cpu, s_Window + i, 0.0, 1000.0);
+	timing.Collect();
+	stats = timing.Stats(scope, Timing_Cpu);
+	Check("the window keeps only the last 600", stats.count == s_Window && stats.p50Ms == 1000.0 &&
+		fabs(stats.meanMs - 1000.0) < 1e-3);
+
+	timing.Reset(s_Window, 100, 199);
+	for (uint32_t i = 0; i < 300; i++)
+		timing.Record(scope, Timing_Gpu, i, 0.0, 1.0);
+	timing.Collect();
+	Check("after Reset only frames 100 to 199 count", timing.Stats(scope, Timing_Gpu).count == 100 &&
+		timing.Stats(scope, Timing_Cpu).count == 0);
+}
+
+static void CheckDropped()
+{
+	FrameTiming timing(64, s_Window);
+	int scope = timing.AddScope("Present");
+	for (uint32_t i = 0; i < 100; i++)
+		timing.Record(scope, Timing_Cpu, i, 0.0, 1.0);
+	size_t collected = timing.Collect();
+	Check("a ring of 64 takes 64 of 100 and counts 36 dropped", collected == 64 && timing.Dropped() == 36);
+}
+
+// The producer tries again while the ring is full, so everything gets through.
+static void CheckThreads()
+{
+	const uint64_t samples = 1000000;
+	TimingRing ring(1024);
+
+	std::thread producer([&]()
+	{
+		for (uint64_t i = 0; i < samples; i++)
+		{
+			TimingSample sample = { i, 0, Timing_Cpu, 0.0, 1.0 };
+			while (!ring.Push(sample))
+				std::this_thread::yield();
+		}
+	});
+
+	uint64_t popped = 0;
+	bool inOrder = true;
+	while (popped < samples)
+	{
+		TimingSample sample;
+		if (!ring.Pop(sample))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		inOrder = inOrder && sample.frame == popped;
+		popped++;
+	}
+	producer.join();
+
+	TimingSample extra;
+	char what[128];
+	snprintf(what, sizeof(what), "two threads, %llu samples through a ring of 1024, in order, none repeated",
+		(unsigned long long)samples);
+	Check(what, inOrder && !ring.Pop(extra));
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t repeat = 2000;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s [--repeat N]\n", argv[0]);
+		return 2;
+	}
+
+	printf("Checks:\n");
+	CheckPercentiles();
+	CheckDropped();
+	CheckThreads();
+
+	printf("Times, over %u batches of %u:\n", repeat, s_Batch);
+	FrameTiming timing(4096, s_Window);
+	int scope = timing.AddScope("Scene");
+
+	double start = FrameTiming::NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+	{
+		for (uint32_t i = 0; i < s_Batch; i++)
+			timing.Record(scope, Timing_Cpu, i, 0.0, 1.0 + i);
+		timing.Collect();
+	}
+	double recordNs = (FrameTiming::NowMs() - start) * 1e6 / ((double)repeat * s_Batch);
+	printf("  Record plus Collect  %7.1fns per sample\n", recordNs);
+
+	start = FrameTiming::NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+	{
+		for (uint32_t i = 0; i < s_Batch; i++)
+			ScopedCpuTimer timer(&timing, scope, i);
+		timing.Collect();
+	}
+	double timerNs = (FrameTiming::NowMs() - start) * 1e6 / ((double)repeat * s_Batch);
+	printf("  ScopedCpuTimer       %7.1fns per timer\n", timerNs);
+
+	start = FrameTiming::NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+		s_Sink = timing.Stats(scope, Timing_Cpu).p99Ms;
+	double statsUs = (FrameTiming::NowMs() - start) * 1e3 / repeat;
+	printf("  Stats over %u        %7.2fus\n", s_Window, statsUs);
+	printf("  %llu dropped\n", (unsigned long long)timing.Dropped());
+
+	return s_Good ? 0 : 1;
+}
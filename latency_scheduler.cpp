@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// File: latency_scheduler.cpp
+//
+// The low latency frame start, see latency_scheduler.h.
+//--------------------------------------------------------------------------------------
+
+#include "latency_scheduler.h"
+
+#include <math.h>
+
+
+void LatencyScheduler::OnFrameCost(double frameCostMs)
+{
+	recentMs[recentFrames++ % Window] = frameCostMs;
+	unsigned count = (recentFrames < Window) ? recentFrames : Window;
+	costMs = frameCostMs;
+	for (unsigned i = 0; i < count; i++)
+		costMs = (recentMs[i] > costMs) ? recentMs[i] : costMs;
+}
+
+double LatencyScheduler::FrameStartMs(double nowMs, double lastRefreshMs, double periodMs) const
+{
+	// The first refresh after the last one that is not before now.  Worked out rather
+	// than stepped to, as the first frame has no last refresh, and now is the time
+	// since boot.
+	double refreshes = ceil((nowMs - lastRefreshMs) / periodMs);
+	double deadlineMs = lastRefreshMs + periodMs * (refreshes > 1.0 ? refreshes : 1.0);
+
+	// Nothing to go by before the first frame, so it starts at once.
+	double startMs = recentFrames ? deadlineMs - costMs - safetyMs : nowMs;
+	return (startMs > nowMs) ? startMs : nowMs;
+}
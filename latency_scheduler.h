@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+// File: latency_scheduler.h
+//
+// When to start a frame in the low latency mode, and the times kept of each frame.
+//
+// Rendering as soon as the swap chain lets us means input and time are sampled a
+// whole frame before the image is shown.  In low latency mode the frame start is
+// pushed back to just before the next refresh, less what a frame has recently cost
+// and a bit of safety margin, and input, time and stereo settings are only read
+// after that.
+//
+// Like the frame pacer, this is only arithmetic on ms values, see
+// latency_scheduler_bench.cpp for it against a simulated display.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+struct LatencyScheduler
+{
+	static const unsigned Window = 120;		// frames, a second at 120Hz
+
+	double costMs = 0.0;		// the most a frame cost, start to present, over the window
+	double safetyMs = 1.0;
+	double recentMs[Window] = {};
+	unsigned recentFrames = 0;
+
+	// The most over the window, so a slow frame every so often, a spike every half
+	// second say, is planned for every time rather than forgotten in between.
+	void OnFrameCost(double frameCostMs);
+
+	// When to start the frame that should make the first refresh after nowMs.
+	double FrameStartMs(double nowMs, double lastRefreshMs, double periodMs) const;
+};
+
+// Timestamps of one frame, in ms
+struct LatencyMarkers
+{
+	double frameStartMs;
+	double inputSampleMs;
+	double latchMs;			// view and stereo constants read
+	double submitMs;		// right before Present
+	double presentMs;		// Present returned
+};
@@ -0,0 +1,180 @@
+//--------------------------------------------------------------------------------------
+// File: latency_scheduler_bench.cpp
+//
+// Simulator of the low latency frame start, see latency_scheduler.h.
+//
+// A display refreshes every 1/120s, and the swap chain holds one frame, so the wait
+// on it returns at the refresh that takes the frame before.  A frame samples input
+// when it starts, and is shown on the first refresh after it is done.  As soon as
+// possible, a frame starts when the wait returns.  In the low latency mode it starts
+// at FrameStartMs, as WaitForNextFrame does, and its cost goes to OnFrameCost.
+//
+// For each scene of frame costs it gives the mean and 99th percentile of input to
+// refresh, and the refreshes missed, both ways.  It fails when the low latency mode
+// is further from the refresh on average, or misses any refresh that starting as
+// soon as possible makes, other than for a frame that cost more than the safety
+// margin over every frame in the window before it, as nothing could have seen it
+// coming.  It also checks the first frame long after boot starts on time.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 latency_scheduler_bench.cpp latency_scheduler.cpp -o latency_scheduler_bench
+//	./latency_scheduler_bench [--frames N]
+//--------------------------------------------------------------------------------------
+
+#include "latency_scheduler.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+static const double					s_RefreshMs = 1000.0 / 120.0;
+
+struct Result
+{
+	double meanMs;			// input to refresh
+	double p99Ms;
+	uint32_t missed;		// refreshes without a new frame
+};
+
+static inline uint32_t Hash(uint32_t x)
+{
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x ^= x >> 4;
+	x *= 0x27d4eb2d;
+	return x ^ (x >> 15);
+}
+
+// 0 to 1, the same every run.
+static double Random(uint32_t i)
+{
+	return (Hash(i) & 0xffff) / 65535.0;
+}
+
+// Frames that cost more than the safety margin over every frame in the window
+// before them, which no schedule going by past frames could have started in time.
+// The first frame has nothing before it, and starts at once.
+static uint32_t Unforeseen(const std::vector<double>& costMs)
+{
+	LatencyScheduler scheduler;
+	uint32_t unforeseen = 0;
+	for (size_t i = 1; i < costMs.size(); i++)
+	{
+		double mostMs = 0.0;
+		for (size_t j = (i > LatencyScheduler::Window ? i - LatencyScheduler::Window : 0); j < i; j++)
+			mostMs = std::max(mostMs, costMs[j]);
+		unforeseen += costMs[i] > mostMs + scheduler.safetyMs ? 1 : 0;
+	}
+	return unforeseen;
+}
+
+static Result Simulate(const std::vector<double>& costMs, bool lowLatency)
+{
+	LatencyScheduler scheduler;
+	std::vector<double> latencies;
+	Result result = {};
+
+	// The wait returns at the refresh that took the frame before.
+	double lastRefreshMs = 0.0;
+	for (size_t i = 0; i < costMs.size(); i++)
+	{
+		double nowMs = lastRefreshMs;
+		double startMs = lowLatency ? scheduler.FrameStartMs(nowMs, lastRefreshMs, s_RefreshMs) : nowMs;
+		double doneMs = startMs + costMs[i];
+
+		uint64_t refresh = (uint64_t)ceil(doneMs / s_RefreshMs - 1e-9);
+		uint64_t last = (uint64_t)floor(lastRefreshMs / s_RefreshMs + 0.5);
+		refresh = std::max(refresh, last + 1);
+		double refreshMs = refresh * s_RefreshMs;
+
+		if (i > 0)
+			result.missed += (uint32_t)(refresh - last - 1);
+		latencies.push_back(refreshMs - startMs);
+		scheduler.OnFrameCost(costMs[i]);
+		lastRefreshMs = refreshMs;
+	}
+
+	double sum = 0.0;
+	for (double ms : latencies)
+		sum += ms;
+	result.meanMs = sum / latencies.size();
+	std::sort(latencies.begin(), latencies.end());
+	result.p99Ms = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t frames = 1200;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || frames < 2)
+	{
+		fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+		return 2;
+	}
+
+	struct Scene
+	{
+		const char* name;
+		double baseMs;
+		double spreadMs;
+		uint32_t spikeEvery;		// 0 for none
+		double spikeMs;
+		double stepMs;				// added from half way on
+	};
+	const Scene scenes[] =
+	{
+		{ "light",  2.0, 0.5,  0, 0.0, 0.0 },
+		{ "medium", 4.0, 1.0,  0, 0.0, 0.0 },
+		{ "heavy",  7.0, 0.5,  0, 0.0, 0.0 },
+		{ "noisy",  2.0, 4.0,  0, 0.0, 0.0 },
+		{ "spikes", 3.0, 0.5, 50, 7.5, 0.0 },
+		{ "step",   2.0, 0.5,  0, 0.0, 3.0 },
+	};
+
+	// The first frame has no last refresh, and the clock is the time since boot, so
+	// a day on the deadline is the one just after now, worked out in one step.
+	LatencyScheduler first;
+	first.OnFrameCost(4.0);
+	double dayMs = 86400000.0 + 0.5;
+	double deadlineMs = ceil(dayMs / s_RefreshMs) * s_RefreshMs;
+	bool firstGood = fabs(first.FrameStartMs(dayMs, 0.0, s_RefreshMs) - (deadlineMs - first.costMs - first.safetyMs)) < 1e-6;
+	printf("the first frame, a day after boot, starts %s\n", firstGood ? "before the next refresh" : "at the wrong time, FAILED");
+
+	printf("%u frames at 120Hz, input to refresh in ms and refreshes missed:\n", frames);
+	printf("  scene     soonest mean   p99  missed    low latency mean   p99  missed  unforeseen\n");
+	bool good = firstGood;
+	for (const Scene& scene : scenes)
+	{
+		std::vector<double> costMs(frames);
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			costMs[i] = scene.baseMs + scene.spreadMs * Random(i) + (i >= frames / 2 ? scene.stepMs : 0.0);
+			if (scene.spikeEvery && i % scene.spikeEvery == scene.spikeEvery - 1)
+				costMs[i] = scene.spikeMs;
+		}
+
+		Result soonest = Simulate(costMs, false);
+		Result low = Simulate(costMs, true);
+		uint32_t unforeseen = Unforeseen(costMs);
+		bool better = low.meanMs <= soonest.meanMs + 1e-9 && low.missed <= soonest.missed + unforeseen;
+		printf("  %-8s  %12.2f  %5.2f  %6u  %16.2f  %5.2f  %6u  %10u%s\n", scene.name, soonest.meanMs, soonest.p99Ms,
+			soonest.missed, low.meanMs, low.p99Ms, low.missed, unforeseen, better ? "" : ", WORSE");
+		good = good && better;
+	}
+
+	return good ? 0 : 1;
+}
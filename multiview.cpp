@@ -0,0 +1,142 @@
+//--------------------------------------------------------------------------------------
+// File: multiview.cpp
+//
+// Views for autostereoscopic panels, see multiview.h.
+//--------------------------------------------------------------------------------------
+
+#include "multiview.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MULTIVIEW_SSE2 1
+#endif
+
+
+void MultiviewStereoParams(float separation, float convergence, float shiftPx, uint32_t views, float (*out)[4])
+{
+	for (uint32_t i = 0; i < views; i++)
+	{
+		float side = (float)(2 * (int32_t)i - ((int32_t)views - 1));
+		out[i][0] = side * separation;
+		out[i][1] = convergence;
+		out[i][2] = side * shiftPx;
+		out[i][3] = 1.0f;
+	}
+
+	// The mono slice.
+	for (uint32_t c = 0; c < 3; c++)
+		out[views][c] = 0.0f;
+	out[views][3] = 1.0f;
+}
+
+// subpixels, in 1/65536ths of a view, modulo the period.
+static uint32_t Phase(double subpixels, const LenticularLayout& layout, uint32_t period)
+{
+	int64_t phase = (int64_t)floor(subpixels / layout.pitch * layout.views * 65536.0 + 0.5) % (int64_t)period;
+	return (uint32_t)(phase < 0 ? phase + period : phase);
+}
+
+void LenticularSteps(const LenticularLayout& layout, InterleaveSteps* steps)
+{
+	steps->period = layout.views << 16;
+	steps->subpixel = Phase(1.0, layout, steps->period);
+	steps->pixel = (3 * steps->subpixel) % steps->period;
+	steps->row = Phase(-layout.slant, layout, steps->period);
+	steps->origin = Phase(layout.offset, layout, steps->period);
+}
+
+
+//--------------------------------------------------------------------------------------
+// One row.  The texels are 4 bytes, x and width count texels.
+//--------------------------------------------------------------------------------------
+template <uint32_t Views>
+static void InterleaveRow(const InterleaveSteps& s, uint32_t rowPhase, const uint32_t* const* views, uint32_t* out,
+	uint32_t width, bool simd)
+{
+	uint32_t x = 0;
+#ifdef MULTIVIEW_SSE2
+	if (simd && width >= 4)
+	{
+		// The phases of four texels, a lane per channel.  Alpha takes a view as well,
+		// and is overwritten.
+		__m128i phase[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			uint32_t base = (rowPhase + (j * s.pixel) % s.period) % s.period;
+			phase[j] = _mm_setr_epi32((int32_t)base, (int32_t)((base + s.subpixel) % s.period),
+				(int32_t)((base + 2 * s.subpixel) % s.period), (int32_t)((base + 3 * s.subpixel) % s.period));
+		}
+		const __m128i step = _mm_set1_epi32((int32_t)((4 * s.pixel) % s.period));
+		const __m128i period = _mm_set1_epi32((int32_t)s.period);
+		const __m128i last = _mm_set1_epi32((int32_t)s.period - 1);
+		const __m128i alpha = _mm_set1_epi32((int32_t)0xff000000);
+
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i low = _mm_packs_epi32(_mm_srli_epi32(phase[0], 16), _mm_srli_epi32(phase[1], 16));
+			__m128i high = _mm_packs_epi32(_mm_srli_epi32(phase[2], 16), _mm_srli_epi32(phase[3], 16));
+			__m128i view = _mm_packus_epi16(low, high);
+
+			__m128i texels = alpha;
+			for (uint32_t v = 0; v < Views; v++)
+			{
+				__m128i mask = _mm_cmpeq_epi8(view, _mm_set1_epi8((char)v));
+				__m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(views[v] + x));
+				texels = _mm_or_si128(texels, _mm_and_si128(mask, source));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), texels);
+
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				phase[j] = _mm_add_epi32(phase[j], step);
+				phase[j] = _mm_sub_epi32(phase[j], _mm_and_si128(_mm_cmpgt_epi32(phase[j], last), period));
+			}
+		}
+	}
+#endif
+	for (; x < width; x++)
+	{
+		uint32_t base = (rowPhase + (x * s.pixel) % s.period) % s.period;
+		uint32_t texel = 0xff000000u;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			uint32_t view = ((base + c * s.subpixel) % s.period) >> 16;
+			texel |= views[view][x] & (0xffu << (8 * c));
+		}
+		out[x] = texel;
+	}
+}
+
+typedef void (*InterleaveRowFn)(const InterleaveSteps&, uint32_t, const uint32_t* const*, uint32_t*, uint32_t, bool);
+
+static const InterleaveRowFn s_InterleaveRows[MultiviewMaxViews + 1] =
+{
+	nullptr, nullptr, InterleaveRow<2>, InterleaveRow<3>, InterleaveRow<4>, InterleaveRow<5>, InterleaveRow<6>,
+	InterleaveRow<7>, InterleaveRow<8>, InterleaveRow<9>,
+};
+
+
+//--------------------------------------------------------------------------------------
+// The whole panel.
+//--------------------------------------------------------------------------------------
+void InterleaveViews(const LenticularLayout& layout, const uint8_t* const* views, size_t viewPitch, uint32_t width,
+	uint32_t height, uint8_t* out, size_t outPitch, bool simd)
+{
+	if (layout.views < 2 || layout.views > MultiviewMaxViews)
+		return;
+
+	InterleaveSteps steps;
+	LenticularSteps(layout, &steps);
+	InterleaveRowFn row = s_InterleaveRows[layout.views];
+
+	const uint32_t* rows[MultiviewMaxViews];
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t v = 0; v < layout.views; v++)
+			rows[v] = reinterpret_cast<const uint32_t*>(views[v] + y * viewPitch);
+		uint32_t rowPhase = (steps.origin + y * steps.row) % steps.period;
+		row(steps, rowPhase, rows, reinterpret_cast<uint32_t*>(out + y * outPitch), width, simd);
+	}
+}
@@ -0,0 +1,63 @@
+//--------------------------------------------------------------------------------------
+// File: multiview.h
+//
+// More than two views, for autostereoscopic panels, and interleaving them into the
+// subpixels of a slanted lenticular panel.
+//
+// The GS draws every view in one pass, a slice of the offscreen array each, with
+// the mono slice after them.  The views are spaced as the two eyes are in Direct
+// Mode: view i of N is at (2i - (N - 1)) times the driver's separation, so two
+// views are the eyes of Direct Mode, and any two neighbours are a stereo pair.
+//
+// Each subpixel of the panel shows one view, by where it falls under its lens.  A
+// lens covers pitch subpixels along a row, and the lenses are slanted, moving
+// slant subpixels to the left every row down.  The phase of a subpixel, its place
+// under the lens, is kept in 1/65536ths of a view, modulo views << 16, so the
+// pattern is integer and InterleavePS in Tutorial07.fx gives the same bytes:
+//	phase = ((origin + y * row) % period + (x * pixel) % period + c * subpixel) % period
+// for channel c of texel (x, y), and the view is phase >> 16.  Alpha is 255.  The
+// products stay in 32 bits for up to 7281 texels each way.
+//
+// The kernels are templates on the view count, so the view loop unrolls.  The SSE2
+// one does four texels at a time, blending every view in under a byte mask, so
+// its cost grows with the view count.  See multiview_bench.cpp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MAX_VIEWS in Tutorial07.fx, StereoParamsArray holds them and the mono slice.
+const uint32_t MultiviewMaxViews = 9;
+
+// StereoParamsArray for views views, then the mono slice: separation, convergence
+// and the far layer shift of each, and a viewport scale of 1.  separation and
+// shiftPx are those of the right eye in Direct Mode.  out holds views + 1 entries.
+void MultiviewStereoParams(float separation, float convergence, float shiftPx, uint32_t views, float (*out)[4]);
+
+struct LenticularLayout
+{
+	uint32_t views;
+	float pitch;		// subpixels under a lens, along a row
+	float slant;		// subpixels the lenses move left a row down
+	float offset;		// subpixels from the left edge to where view 0 starts, in the top row
+};
+
+// The layout as integer phase steps, in 1/65536ths of a view.  Also InterleaveSteps
+// in cbResolve.
+struct InterleaveSteps
+{
+	uint32_t subpixel;	// next channel
+	uint32_t pixel;		// next texel along a row
+	uint32_t row;		// next row
+	uint32_t origin;	// channel 0 of texel (0, 0)
+	uint32_t period;	// views << 16
+};
+
+void LenticularSteps(const LenticularLayout& layout, InterleaveSteps* steps);
+
+// Interleave layout.views R8G8B8A8 views, each width x height with rows viewPitch
+// bytes apart, into out.  views has to be from 2 to MultiviewMaxViews, nothing is
+// written otherwise.  simd false is the plain C++ one, for comparison.
+void InterleaveViews(const LenticularLayout& layout, const uint8_t* const* views, size_t viewPitch, uint32_t width,
+	uint32_t height, uint8_t* out, size_t outPitch, bool simd = true);
@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// File: multiview_bench.cpp
+//
+// Offline benchmark of drawing and interleaving N views, see multiview.h.
+//
+// For each view count it draws textured panels in front of a textured wall into
+// every view, each shifted as GetStereoPos shifts it for that view, the way the GS
+// instances draw the slices.  Then it interleaves the views for a slanted
+// lenticular panel with the plain and SSE2 kernels, and checks they give the same
+// bytes.  All the times are the best of the runs.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 multiview_bench.cpp multiview.cpp -o multiview_bench
+//	./multiview_bench [--size WxH] [--runs N]
+//--------------------------------------------------------------------------------------
+
+#include "multiview.h"
+#include "bench_scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One view, far to near, as the depth test would leave it.  The texture is fixed
+// to the panel, so a shifted panel carries its texels along.
+static void DrawView(const Panel* panels, uint32_t panelCount, const float* stereo, uint32_t width, uint32_t height,
+	uint32_t* view)
+{
+	const float projectionX = s_ProjectionY * height / width;
+	for (const Panel* p = panels + panelCount; p-- != panels;)
+	{
+		// GetStereoPos moves x by separation * (w - convergence) in clip space.
+		float shift = stereo[0] * (1.0f - stereo[1] / p->depth) * width * 0.5f;
+		float left = (p->x * projectionX / p->depth + 1.0f) * width * 0.5f + shift;
+		float right = ((p->x + p->width) * projectionX / p->depth + 1.0f) * width * 0.5f + shift;
+		float top = (1.0f - (p->y + p->height) * s_ProjectionY / p->depth) * height * 0.5f;
+		float bottom = (1.0f - p->y * s_ProjectionY / p->depth) * height * 0.5f;
+
+		int32_t x0 = std::max((int32_t)ceilf(left - 0.5f), 0);
+		int32_t x1 = std::min((int32_t)ceilf(right - 0.5f), (int32_t)width);
+		int32_t y0 = std::max((int32_t)ceilf(top - 0.5f), 0);
+		int32_t y1 = std::min((int32_t)ceilf(bottom - 0.5f), (int32_t)height);
+		int32_t u0 = (int32_t)floorf(left);
+		for (int32_t y = y0; y < y1; y++)
+		{
+			uint32_t* row = view + (size_t)y * width;
+			for (int32_t x = x0; x < x1; x++)
+				row[x] = Texel(x - u0, y - y0, p->seed);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t runs = 5;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			usage = sscanf(argv[++i], "%ux%u", &width, &height) != 2;
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || width == 0 || height == 0 || width > 7281 || height > 7281 || runs == 0)
+	{
+		fprintf(stderr, "usage: %s [--size WxH] [--runs N], up to 7281x7281\n", argv[0]);
+		return 2;
+	}
+
+	// The wall is the first panel, big enough to fill the view whatever the shift.
+	std::vector<Panel> panels;
+	Panel wall = { -s_WallDepth, -s_WallDepth, 2.0f * s_WallDepth, 2.0f * s_WallDepth, s_WallDepth, 3 };
+	panels.push_back(wall);
+	for (uint32_t i = 0; i < 12; i++)
+		panels.push_back(PlacePanel(i, 40.0f - 3.2f * i));
+	std::reverse(panels.begin(), panels.end());
+
+	const uint32_t counts[] = { 2, 4, 5, 8, 9 };
+	const float separation = 0.05f;
+	const float convergence = 4.0f;
+	const size_t pitch = (size_t)width * 4;
+
+	printf("%ux%u, %u panels, best of %u:\n", width, height, (uint32_t)panels.size(), runs);
+	printf("  views   draw ms  a view   plain ms  SSE2 ms   x     interleaved\n");
+	bool allSame = true;
+	for (uint32_t views : counts)
+	{
+		// A lens over views / 2 subpixels, two views a subpixel, at a slant of 1/6.
+		LenticularLayout layout = { views, views * 0.5f, 0.5f, 0.0f };
+		float stereo[MultiviewMaxViews + 1][4];
+		MultiviewStereoParams(separation, convergence, 0.0f, views, stereo);
+
+		std::vector<std::vector<uint32_t>> texels(views, std::vector<uint32_t>((size_t)width * height));
+		std::vector<const uint8_t*> slices(views);
+		for (uint32_t v = 0; v < views; v++)
+			slices[v] = reinterpret_cast<const uint8_t*>(texels[v].data());
+		std::vector<uint32_t> plain((size_t)width * height), simd(plain.size());
+
+		double drawMs = 1e30, plainMs = 1e30, simdMs = 1e30;
+		bool same = true;
+		for (uint32_t r = 0; r < runs; r++)
+		{
+			double startMs = NowMs();
+			for (uint32_t v = 0; v < views; v++)
+				DrawView(panels.data(), (uint32_t)panels.size(), stereo[v], width, height, texels[v].data());
+			drawMs = std::min(drawMs, NowMs() - startMs);
+
+			startMs = NowMs();
+			InterleaveViews(layout, slices.data(), pitch, width, height, reinterpret_cast<uint8_t*>(plain.data()), pitch, false);
+			plainMs = std::min(plainMs, NowMs() - startMs);
+
+			startMs = NowMs();
+			InterleaveViews(layout, slices.data(), pitch, width, height, reinterpret_cast<uint8_t*>(simd.data()), pitch, true);
+			simdMs = std::min(simdMs, NowMs() - startMs);
+			same = same && plain == simd;
+		}
+		allSame = allSame && same;
+		printf("  %5u  %8.2f  %6.2f  %9.2f  %7.2f  %4.2f  %s\n", views, drawMs, drawMs / views, plainMs, simdMs,
+			plainMs / simdMs, same ? "the same" : "DIFFERENT");
+	}
+
+	return allSame ? 0 : 1;
+}
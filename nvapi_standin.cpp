@@ -0,0 +1,650 @@
+//--------------------------------------------------------------------------------------
+// File: nvapi_standin.cpp
+//
+// In-process stand-in for NvAPI stereo, see nvapi_standin.h.
+//
+// Only built in when NVAPI_STANDIN is defined, otherwise the real nvapi.lib
+// provides these entry points.
+//--------------------------------------------------------------------------------------
+
+#ifdef NVAPI_STANDIN
+
+#include "nvapi_standin.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------
+// Stereo state.  Changed rarely, read every frame, so a plain mutex is fine here;
+// only the trace has to stay out of the way of the calls it measures.
+//--------------------------------------------------------------------------------------
+struct StandInKey
+{
+	uint64_t frame;
+	float value;
+};
+
+struct StandInParam
+{
+	float value;
+	std::vector<StandInKey> keys;	// sorted by frame, empty once the app sets it
+
+	float At(uint64_t frame) const
+	{
+		if (keys.empty())
+			return value;
+		if (frame <= keys.front().frame)
+			return keys.front().value;
+		if (frame >= keys.back().frame)
+			return keys.back().value;
+
+		size_t i = 1;
+		while (keys[i].frame < frame)
+			i++;
+		const StandInKey& a = keys[i - 1];
+		const StandInKey& b = keys[i];
+		float t = (float)(frame - a.frame) / (float)(b.frame - a.frame);
+		return a.value + (b.value - a.value) * t;
+	}
+};
+
+// The driver defaults, as a fresh 3D Vision install reports them.
+static std::mutex					s_StateLock;
+static StandInParam					s_Convergence = { 4.0f, {} };
+static StandInParam					s_Separation = { 15.0f, {} };
+static StandInParam					s_EyeSeparation = { 0.065f, {} };
+static bool							s_StereoEnabled = true;
+static std::atomic<bool>			s_Initialized(false);
+static bool							s_Activated = false;
+static NV_STEREO_DRIVER_MODE		s_DriverMode = NVAPI_STEREO_DRIVER_MODE_AUTOMATIC;
+static std::atomic<uint64_t>		s_Frame(0);
+static std::atomic<int>				s_ActiveEye(NVAPI_STEREO_EYE_MONO);
+
+// The one stereo handle, its address is the handle value.
+static int							s_HandleObject;
+static std::atomic<StereoHandle>	s_Handle(nullptr);
+
+static std::atomic<uint32_t>		s_LatencyUs[NvStandIn_CallCount];
+
+static const std::chrono::steady_clock::time_point s_Epoch = std::chrono::steady_clock::now();
+
+
+//--------------------------------------------------------------------------------------
+// Call statistics, all atomics.
+//--------------------------------------------------------------------------------------
+struct StandInStats
+{
+	std::atomic<uint64_t> calls;
+	std::atomic<uint64_t> totalNs;
+	std::atomic<uint64_t> maxNs;
+};
+
+static StandInStats					s_Stats[NvStandIn_CallCount];
+
+
+//--------------------------------------------------------------------------------------
+// Lock-free trace.
+//
+// A ring of slots that any thread can write without waiting.  A writer claims the
+// next sequence number with one fetch_add, and the slot it lands on is guarded by
+// a per slot sequence, the same idea as a seqlock:
+//	- the sequence is zeroed while the record is written, then set to seq + 1
+//	- a reader copies the record and only keeps it if the sequence was the one it
+//	  expected, and did not change while it was copying
+// When the ring wraps, the oldest records are overwritten.  The record itself is
+// stored in atomic words so the reader racing a writer is still well defined.
+//--------------------------------------------------------------------------------------
+static const uint32_t				s_TraceCapacity = 1 << 14;
+
+struct StandInTraceSlot
+{
+	std::atomic<uint64_t> sequence;		// 0 while being written, else record sequence + 1
+	std::atomic<uint64_t> header;		// call | thread << 16 | value bits << 32
+	std::atomic<int32_t> status;		// all of it, NvAPI errors go past -128
+	std::atomic<int64_t> startNs;
+	std::atomic<int64_t> durationNs;
+};
+
+static StandInTraceSlot				s_Trace[s_TraceCapacity];
+static std::atomic<uint64_t>		s_TraceHead(0);
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_Epoch).count();
+}
+
+static uint32_t ThreadTag()
+{
+	return (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffff);
+}
+
+static void TraceWrite(NvStandInCall call, NvAPI_Status status, float value, int64_t startNs, int64_t durationNs)
+{
+	uint64_t sequence = s_TraceHead.fetch_add(1, std::memory_order_relaxed);
+	StandInTraceSlot& slot = s_Trace[sequence & (s_TraceCapacity - 1)];
+
+	uint32_t valueBits;
+	memcpy(&valueBits, &value, sizeof(valueBits));
+	uint64_t header = (uint64_t)call | ((uint64_t)ThreadTag() << 16) | ((uint64_t)valueBits << 32);
+
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.header.store(header, std::memory_order_relaxed);
+	slot.status.store((int32_t)status, std::memory_order_relaxed);
+	slot.startNs.store(startNs, std::memory_order_relaxed);
+	slot.durationNs.store(durationNs, std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+static bool TraceRead(uint64_t sequence, NvStandInTraceRecord& record)
+{
+	const StandInTraceSlot& slot = s_Trace[sequence & (s_TraceCapacity - 1)];
+
+	uint64_t before = slot.sequence.load(std::memory_order_acquire);
+	if (before != sequence + 1)
+		return false;
+
+	uint64_t header = slot.header.load(std::memory_order_relaxed);
+	record.status = slot.status.load(std::memory_order_relaxed);
+	record.startNs = slot.startNs.load(std::memory_order_relaxed);
+	record.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (slot.sequence.load(std::memory_order_relaxed) != before)
+		return false;
+
+	uint32_t valueBits = (uint32_t)(header >> 32);
+	record.sequence = sequence;
+	record.call = (NvStandInCall)(header & 0xff);
+	record.thread = (uint32_t)((header >> 16) & 0xffff);
+	memcpy(&record.value, &valueBits, sizeof(record.value));
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Every entry point runs its body through here: injected latency, statistics and
+// the trace.
+//--------------------------------------------------------------------------------------
+struct StandInScope
+{
+	NvStandInCall call;
+	int64_t startNs;
+	float value;
+
+	explicit StandInScope(NvStandInCall c) : call(c), startNs(NowNs()), value(0.0f)
+	{
+		uint32_t latencyUs = s_LatencyUs[call].load(std::memory_order_relaxed);
+		if (latencyUs)
+		{
+			// Spin, a sleep is far too coarse for microseconds.
+			int64_t until = startNs + (int64_t)latencyUs * 1000;
+			while (NowNs() < until)
+				std::this_thread::yield();
+		}
+	}
+
+	NvAPI_Status Return(NvAPI_Status status)
+	{
+		int64_t durationNs = NowNs() - startNs;
+
+		StandInStats& stats = s_Stats[call];
+		stats.calls.fetch_add(1, std::memory_order_relaxed);
+		stats.totalNs.fetch_add((uint64_t)durationNs, std::memory_order_relaxed);
+		uint64_t max = stats.maxNs.load(std::memory_order_relaxed);
+		while ((uint64_t)durationNs > max &&
+			!stats.maxNs.compare_exchange_weak(max, (uint64_t)durationNs, std::memory_order_relaxed))
+		{
+		}
+
+		TraceWrite(call, status, value, startNs, durationNs);
+		return status;
+	}
+};
+
+static NvAPI_Status CheckHandle(StereoHandle handle)
+{
+	if (!s_Initialized)
+		return NVAPI_API_NOT_INITIALIZED;
+	if (!handle || handle != s_Handle.load())
+		return NVAPI_STEREO_INVALID_DEVICE_INTERFACE;
+	return NVAPI_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// NvAPI entry points
+//--------------------------------------------------------------------------------------
+extern "C" {
+
+NvAPI_Status __cdecl NvAPI_Initialize()
+{
+	StandInScope scope(NvStandIn_Initialize);
+
+	// A script can be given without touching the app.
+	static std::once_flag s_scriptOnce;
+	std::call_once(s_scriptOnce, []()
+	{
+		const char* script = getenv("NVAPI_STANDIN_SCRIPT");
+		if (script)
+			NvStandIn_LoadScript(script);
+	});
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	s_Initialized = true;
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_IsEnabled(NvU8* pIsStereoEnabled)
+{
+	StandInScope scope(NvStandIn_IsEnabled);
+	if (!pIsStereoEnabled)
+		return scope.Return(NVAPI_INVALID_POINTER);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	if (!s_Initialized)
+		return scope.Return(NVAPI_API_NOT_INITIALIZED);
+
+	*pIsStereoEnabled = s_StereoEnabled ? 1 : 0;
+	scope.value = (float)*pIsStereoEnabled;
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_SetDriverMode(NV_STEREO_DRIVER_MODE mode)
+{
+	StandInScope scope(NvStandIn_SetDriverMode);
+	scope.value = (float)mode;
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	if (!s_Initialized)
+		return scope.Return(NVAPI_API_NOT_INITIALIZED);
+
+	// The driver only takes the mode before the first handle is made.
+	if (s_Handle.load())
+		return scope.Return(NVAPI_ERROR);
+
+	s_DriverMode = mode;
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_CreateHandleFromIUnknown(IUnknown* pDevice, StereoHandle* pStereoHandle)
+{
+	StandInScope scope(NvStandIn_CreateHandle);
+	if (!pDevice || !pStereoHandle)
+		return scope.Return(NVAPI_INVALID_ARGUMENT);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	if (!s_Initialized)
+		return scope.Return(NVAPI_API_NOT_INITIALIZED);
+	if (!s_StereoEnabled)
+		return scope.Return(NVAPI_STEREO_NOT_ENABLED);
+
+	*pStereoHandle = &s_HandleObject;
+	s_Handle.store(*pStereoHandle);
+	// Direct Mode is active as soon as there is a handle.
+	s_Activated = (s_DriverMode == NVAPI_STEREO_DRIVER_MODE_DIRECT);
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_DestroyHandle(StereoHandle stereoHandle)
+{
+	StandInScope scope(NvStandIn_DestroyHandle);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status == NVAPI_OK)
+	{
+		s_Handle.store(nullptr);
+		s_Activated = false;
+	}
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_Activate(StereoHandle stereoHandle)
+{
+	StandInScope scope(NvStandIn_Activate);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status == NVAPI_OK)
+		s_Activated = true;
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_IsActivated(StereoHandle stereoHandle, NvU8* pIsStereoOn)
+{
+	StandInScope scope(NvStandIn_IsActivated);
+	if (!pIsStereoOn)
+		return scope.Return(NVAPI_INVALID_POINTER);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status == NVAPI_OK)
+	{
+		*pIsStereoOn = s_Activated ? 1 : 0;
+		scope.value = (float)*pIsStereoOn;
+	}
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_GetSeparation(StereoHandle stereoHandle, float* pSeparationPercentage)
+{
+	StandInScope scope(NvStandIn_GetSeparation);
+	if (!pSeparationPercentage)
+		return scope.Return(NVAPI_INVALID_POINTER);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status == NVAPI_OK)
+		scope.value = *pSeparationPercentage = s_Separation.At(s_Frame.load());
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_SetSeparation(StereoHandle stereoHandle, float newSeparationPercentage)
+{
+	StandInScope scope(NvStandIn_SetSeparation);
+	scope.value = newSeparationPercentage;
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status != NVAPI_OK)
+		return scope.Return(status);
+	if (newSeparationPercentage < 0.0f || newSeparationPercentage > 100.0f)
+		return scope.Return(NVAPI_STEREO_PARAMETER_OUT_OF_RANGE);
+
+	s_Separation.value = newSeparationPercentage;
+	s_Separation.keys.clear();
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_GetConvergence(StereoHandle stereoHandle, float* pConvergence)
+{
+	StandInScope scope(NvStandIn_GetConvergence);
+	if (!pConvergence)
+		return scope.Return(NVAPI_INVALID_POINTER);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status == NVAPI_OK)
+		scope.value = *pConvergence = s_Convergence.At(s_Frame.load());
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_SetConvergence(StereoHandle stereoHandle, float newConvergence)
+{
+	StandInScope scope(NvStandIn_SetConvergence);
+	scope.value = newConvergence;
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(stereoHandle);
+	if (status != NVAPI_OK)
+		return scope.Return(status);
+
+	s_Convergence.value = newConvergence;
+	s_Convergence.keys.clear();
+	return scope.Return(NVAPI_OK);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_GetEyeSeparation(StereoHandle hStereoHandle, float* pSeparation)
+{
+	StandInScope scope(NvStandIn_GetEyeSeparation);
+	if (!pSeparation)
+		return scope.Return(NVAPI_INVALID_POINTER);
+
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	NvAPI_Status status = CheckHandle(hStereoHandle);
+	if (status == NVAPI_OK)
+		scope.value = *pSeparation = s_EyeSeparation.At(s_Frame.load());
+	return scope.Return(status);
+}
+
+NvAPI_Status __cdecl NvAPI_Stereo_SetActiveEye(StereoHandle hStereoHandle, NV_STEREO_ACTIVE_EYE StereoEye)
+{
+	StandInScope scope(NvStandIn_SetActiveEye);
+	scope.value = (float)StereoEye;
+
+	// No lock, this one is called several times a frame.
+	if (!s_Initialized)
+		return scope.Return(NVAPI_API_NOT_INITIALIZED);
+	if (!hStereoHandle || hStereoHandle != s_Handle.load())
+		return scope.Return(NVAPI_STEREO_INVALID_DEVICE_INTERFACE);
+	if (StereoEye < NVAPI_STEREO_EYE_RIGHT || StereoEye > NVAPI_STEREO_EYE_MONO)
+		return scope.Return(NVAPI_INVALID_ARGUMENT);
+
+	// Direct Mode frames start with the left eye.
+	if (StereoEye == NVAPI_STEREO_EYE_LEFT)
+		s_Frame.fetch_add(1, std::memory_order_relaxed);
+	s_ActiveEye.store(StereoEye, std::memory_order_relaxed);
+	return scope.Return(NVAPI_OK);
+}
+
+}	// extern "C"
+
+
+//--------------------------------------------------------------------------------------
+// Scripts
+//--------------------------------------------------------------------------------------
+static void AddKey(StandInParam& param, uint64_t frame, float value)
+{
+	StandInKey key = { frame, value };
+	auto at = std::lower_bound(param.keys.begin(), param.keys.end(), key,
+		[](const StandInKey& a, const StandInKey& b) { return a.frame < b.frame; });
+	if (at != param.keys.end() && at->frame == frame)
+		at->value = value;
+	else
+		param.keys.insert(at, key);
+}
+
+static int CallFromName(const char* name)
+{
+	for (int call = 0; call < NvStandIn_CallCount; call++)
+	{
+		if (!strcmp(name, NvStandIn_CallName((NvStandInCall)call)))
+			return call;
+	}
+	return -1;
+}
+
+bool NvStandIn_ParseScript(const char* text)
+{
+	std::lock_guard<std::mutex> lock(s_StateLock);
+
+	bool ok = true;
+	int lineNumber = 0;
+	const char* line = text;
+	while (line && *line)
+	{
+		lineNumber++;
+		const char* end = strchr(line, '\n');
+		size_t length = end ? (size_t)(end - line) : strlen(line);
+
+		char buffer[256];
+		length = std::min(length, sizeof(buffer) - 1);
+		memcpy(buffer, line, length);
+		buffer[length] = 0;
+		char* comment = strchr(buffer, '#');
+		if (comment)
+			*comment = 0;
+
+		char word0[64], word1[64], word2[64];
+		int words = sscanf(buffer, "%63s %63s %63s", word0, word1, word2);
+
+		if (words <= 0)
+		{
+			// Blank line
+		}
+		else if (words == 3 && !strcmp(word0, "latency"))
+		{
+			uint32_t us = (uint32_t)strtoul(word2, nullptr, 10);
+			if (!strcmp(word1, "*"))
+			{
+				for (int call = 0; call < NvStandIn_CallCount; call++)
+					s_LatencyUs[call].store(us);
+			}
+			else if (CallFromName(word1) >= 0)
+				s_LatencyUs[CallFromName(word1)].store(us);
+			else
+				ok = false;
+		}
+		else if (words == 2 && !strcmp(word0, "enabled"))
+		{
+			s_StereoEnabled = (atoi(word1) != 0);
+		}
+		else if (words == 3 && isdigit((unsigned char)word0[0]))
+		{
+			uint64_t frame = strtoull(word0, nullptr, 10);
+			float value = (float)atof(word2);
+			if (!strcmp(word1, "convergence"))
+				AddKey(s_Convergence, frame, value);
+			else if (!strcmp(word1, "separation"))
+				AddKey(s_Separation, frame, value);
+			else if (!strcmp(word1, "eyeseparation"))
+				AddKey(s_EyeSeparation, frame, value);
+			else
+				ok = false;
+		}
+		else
+		{
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			fprintf(stderr, "nvapi stand-in: bad script line %d: %s\n", lineNumber, buffer);
+			return false;
+		}
+
+		line = end ? end + 1 : nullptr;
+	}
+	return true;
+}
+
+bool NvStandIn_LoadScript(const char* fileName)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+
+	std::vector<char> text;
+	char chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		text.insert(text.end(), chunk, chunk + read);
+	fclose(file);
+	text.push_back(0);
+
+	return NvStandIn_ParseScript(text.data());
+}
+
+
+//--------------------------------------------------------------------------------------
+// Direct control
+//--------------------------------------------------------------------------------------
+void NvStandIn_SetLatency(NvStandInCall call, uint32_t microseconds)
+{
+	if (call < NvStandIn_CallCount)
+		s_LatencyUs[call].store(microseconds);
+}
+
+void NvStandIn_SetStereoEnabled(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(s_StateLock);
+	s_StereoEnabled = enabled;
+}
+
+void NvStandIn_SetFrame(uint64_t frame)
+{
+	s_Frame.store(frame);
+}
+
+uint64_t NvStandIn_GetFrame()
+{
+	return s_Frame.load();
+}
+
+NV_STEREO_ACTIVE_EYE NvStandIn_GetActiveEye()
+{
+	return (NV_STEREO_ACTIVE_EYE)s_ActiveEye.load();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Measurement
+//--------------------------------------------------------------------------------------
+const char* NvStandIn_CallName(NvStandInCall call)
+{
+	static const char* names[NvStandIn_CallCount] =
+	{
+		"Initialize", "IsEnabled", "SetDriverMode", "CreateHandle", "DestroyHandle",
+		"Activate", "IsActivated", "GetSeparation", "SetSeparation", "GetConvergence",
+		"SetConvergence", "GetEyeSeparation", "SetActiveEye",
+	};
+	return (call < NvStandIn_CallCount) ? names[call] : "Unknown";
+}
+
+void NvStandIn_GetStats(NvStandInCall call, NvStandInCallStats* stats)
+{
+	if (call >= NvStandIn_CallCount || !stats)
+		return;
+	stats->calls = s_Stats[call].calls.load();
+	stats->totalNs = s_Stats[call].totalNs.load();
+	stats->maxNs = s_Stats[call].maxNs.load();
+}
+
+void NvStandIn_ResetStats()
+{
+	for (int call = 0; call < NvStandIn_CallCount; call++)
+	{
+		s_Stats[call].calls.store(0);
+		s_Stats[call].totalNs.store(0);
+		s_Stats[call].maxNs.store(0);
+	}
+}
+
+// Copies out up to maxRecords of the newest calls, oldest first.  Records being
+// written or overwritten during the copy are skipped.
+uint32_t NvStandIn_ReadTrace(NvStandInTraceRecord* records, uint32_t maxRecords)
+{
+	uint64_t head = s_TraceHead.load(std::memory_order_acquire);
+	uint64_t count = std::min<uint64_t>(std::min<uint64_t>(head, s_TraceCapacity), maxRecords);
+
+	uint32_t written = 0;
+	for (uint64_t sequence = head - count; sequence < head; sequence++)
+	{
+		if (TraceRead(sequence, records[written]))
+			written++;
+	}
+	return written;
+}
+
+bool NvStandIn_WriteTrace(const char* fileName)
+{
+	std::vector<NvStandInTraceRecord> records(s_TraceCapacity);
+	uint32_t count = NvStandIn_ReadTrace(records.data(), s_TraceCapacity);
+
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "sequence,call,status,thread,value,start_ns,duration_ns\n");
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const NvStandInTraceRecord& r = records[i];
+		fprintf(file, "%llu,%s,%d,%u,%g,%lld,%lld\n", (unsigned long long)r.sequence, NvStandIn_CallName(r.call),
+			r.status, r.thread, r.value, (long long)r.startNs, (long long)r.durationNs);
+	}
+	fclose(file);
+	return true;
+}
+
+#endif // NVAPI_STANDIN
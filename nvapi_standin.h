@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// File: nvapi_standin.h
+//
+// In-process stand-in for the part of NvAPI stereo that Tutorial07 uses.
+//
+// Build nvapi_standin.cpp with NVAPI_STANDIN defined, and it provides the NvAPI
+// entry points itself, so nvapi.lib and the 3D Vision driver are not needed.  It
+// builds on Linux as well, for testing stereo logic without Windows.
+//
+// On top of the NvAPI calls it has:
+//	- scripts, that drive convergence, separation and eye separation per frame
+//	- injected latency, a busy wait added to any call, to see what a slow driver
+//	  costs a frame
+//	- a lock-free trace of every call, and per call statistics
+//
+// The script frame advances every time the left eye is made active, which is how
+// a Direct Mode frame starts.
+//
+// Script format, one item per line, # starts a comment:
+//	<frame> convergence <value>
+//	<frame> separation <percent>
+//	<frame> eyeseparation <value>
+//	latency <call name | *> <microseconds>
+//	enabled <0 | 1>
+// Values are interpolated linearly between frames, and held past the last one.
+// A Set call from the app takes that value over from the script.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#ifdef _WIN32
+#include <d3d11.h>
+#else
+// Enough of the Windows and D3D11 headers for nvapi_lite_stereo.h to declare the
+// device functions.
+#define __cdecl
+#define __d3d11_h__
+struct IUnknown;
+#endif
+
+#include <stdint.h>
+#include "nvapi_lite_common.h"
+#include "nvapi_lite_stereo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// From nvapi.h, which needs the Windows headers.
+NvAPI_Status __cdecl NvAPI_Initialize();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+enum NvStandInCall
+{
+	NvStandIn_Initialize,
+	NvStandIn_IsEnabled,
+	NvStandIn_SetDriverMode,
+	NvStandIn_CreateHandle,
+	NvStandIn_DestroyHandle,
+	NvStandIn_Activate,
+	NvStandIn_IsActivated,
+	NvStandIn_GetSeparation,
+	NvStandIn_SetSeparation,
+	NvStandIn_GetConvergence,
+	NvStandIn_SetConvergence,
+	NvStandIn_GetEyeSeparation,
+	NvStandIn_SetActiveEye,
+	NvStandIn_CallCount
+};
+
+struct NvStandInTraceRecord
+{
+	uint64_t sequence;		// order the calls were made in, across threads
+	NvStandInCall call;
+	int32_t status;
+	uint32_t thread;		// hashed thread id
+	float value;			// the value set or returned, or the eye
+	int64_t startNs;		// from NvAPI_Initialize
+	int64_t durationNs;		// includes any injected latency
+};
+
+struct NvStandInCallStats
+{
+	uint64_t calls;
+	uint64_t totalNs;
+	uint64_t maxNs;
+};
+
+// Scripts
+bool NvStandIn_LoadScript(const char* fileName);
+bool NvStandIn_ParseScript(const char* text);
+
+// Direct control, for tests
+void NvStandIn_SetLatency(NvStandInCall call, uint32_t microseconds);
+void NvStandIn_SetStereoEnabled(bool enabled);
+void NvStandIn_SetFrame(uint64_t frame);
+uint64_t NvStandIn_GetFrame();
+NV_STEREO_ACTIVE_EYE NvStandIn_GetActiveEye();
+
+// Measurement
+const char* NvStandIn_CallName(NvStandInCall call);
+void NvStandIn_GetStats(NvStandInCall call, NvStandInCallStats* stats);
+void NvStandIn_ResetStats();
+uint32_t NvStandIn_ReadTrace(NvStandInTraceRecord* records, uint32_t maxRecords);
+bool NvStandIn_WriteTrace(const char* fileName);
@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// File: nvapi_standin_bench.cpp
+//
+// Offline check of the NvAPI stand-in's trace, see nvapi_standin.h.
+//
+// It makes calls that fail with NvAPI stereo errors, which are all below -128, and
+// calls that succeed, then reads the trace back and checks each record has the
+// call, status and value that was returned.  Then it times a traced call on one
+// thread and on several at once, and checks no record was torn.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread -DNVAPI_STANDIN nvapi_standin_bench.cpp nvapi_standin.cpp -o nvapi_standin_bench
+//	./nvapi_standin_bench [--threads N] [--calls N]
+//--------------------------------------------------------------------------------------
+
+#include "nvapi_standin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+struct Expected
+{
+	NvStandInCall call;
+	NvAPI_Status status;
+	float value;
+};
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t threads = 4;
+	uint32_t calls = 100000;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc)
+			calls = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || threads == 0 || calls == 0)
+	{
+		fprintf(stderr, "usage: %s [--threads N] [--calls N]\n", argv[0]);
+		return 2;
+	}
+
+	// Any pointer will do for the device, the stand-in only checks it is there.
+	IUnknown* device = (IUnknown*)&threads;
+	StereoHandle handle = nullptr;
+	float convergence = 0.0f;
+	std::vector<Expected> expected;
+
+	expected.push_back({ NvStandIn_Initialize, NvAPI_Initialize(), 0.0f });
+	NvStandIn_SetStereoEnabled(false);
+	expected.push_back({ NvStandIn_CreateHandle, NvAPI_Stereo_CreateHandleFromIUnknown(device, &handle), 0.0f });
+	NvStandIn_SetStereoEnabled(true);
+	expected.push_back({ NvStandIn_CreateHandle, NvAPI_Stereo_CreateHandleFromIUnknown(device, &handle), 0.0f });
+	expected.push_back({ NvStandIn_GetConvergence, NvAPI_Stereo_GetConvergence((StereoHandle)device, &convergence), 0.0f });
+	expected.push_back({ NvStandIn_SetSeparation, NvAPI_Stereo_SetSeparation(handle, 150.0f), 150.0f });
+	expected.push_back({ NvStandIn_SetConvergence, NvAPI_Stereo_SetConvergence(handle, 2.5f), 2.5f });
+	expected.push_back({ NvStandIn_GetConvergence, NvAPI_Stereo_GetConvergence(handle, &convergence), 2.5f });
+
+	// The errors the calls above have to give, or the check checks nothing.
+	const NvAPI_Status statuses[] = { NVAPI_OK, NVAPI_STEREO_NOT_ENABLED, NVAPI_OK, NVAPI_STEREO_INVALID_DEVICE_INTERFACE,
+		NVAPI_STEREO_PARAMETER_OUT_OF_RANGE, NVAPI_OK, NVAPI_OK };
+	bool good = true;
+	for (size_t i = 0; i < expected.size(); i++)
+		good = good && expected[i].status == statuses[i];
+	if (!good)
+		printf("the stand-in did not return the errors expected\n");
+
+	std::vector<NvStandInTraceRecord> records(expected.size());
+	uint32_t count = NvStandIn_ReadTrace(records.data(), (uint32_t)records.size());
+	printf("  call              returned  traced  value\n");
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Expected& e = expected[i];
+		const NvStandInTraceRecord& r = records[i];
+		bool same = r.call == e.call && r.status == (int32_t)e.status && r.value == e.value;
+		printf("  %-16s  %8d  %6d  %5.2f%s\n", NvStandIn_CallName(r.call), (int32_t)e.status, r.status, r.value,
+			same ? "" : ", DIFFERENT");
+		good = good && same;
+	}
+	if (count != expected.size())
+	{
+		printf("  %u records traced of %u\n", count, (uint32_t)expected.size());
+		good = false;
+	}
+
+	// A traced call, alone and with every thread calling at once.
+	printf("\n  threads  ns per call\n");
+	std::vector<uint32_t> threadCounts = { 1 };
+	if (threads > 1)
+		threadCounts.push_back(threads);
+	for (uint32_t n : threadCounts)
+	{
+		NvStandIn_ResetStats();
+		std::vector<std::thread> workers;
+		double startMs = NowMs();
+		for (uint32_t t = 0; t < n; t++)
+		{
+			workers.push_back(std::thread([&]()
+			{
+				float value;
+				for (uint32_t c = 0; c < calls; c++)
+					NvAPI_Stereo_GetConvergence(handle, &value);
+			}));
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+		double ms = NowMs() - startMs;
+		printf("  %7u  %11.1f\n", n, ms * 1e6 / ((double)calls * n));
+	}
+
+	// Nothing else is calling now, so the whole ring has to read back, all of it
+	// GetConvergence from a good handle.
+	records.resize(1 << 14);
+	count = NvStandIn_ReadTrace(records.data(), (uint32_t)records.size());
+	uint32_t torn = 0;
+	for (uint32_t i = 0; i < count; i++)
+		torn += (records[i].call != NvStandIn_GetConvergence || records[i].status != NVAPI_OK || records[i].value != 2.5f) ? 1 : 0;
+	torn += (uint32_t)records.size() - count;
+	if (torn)
+	{
+		printf("  %u records of the ring are wrong or missing\n", torn);
+		good = false;
+	}
+
+	return good ? 0 : 1;
+}
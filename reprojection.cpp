@@ -0,0 +1,308 @@
+//--------------------------------------------------------------------------------------
+// File: reprojection.cpp
+//
+// Warping eyes to a newer pose, see reprojection.h.
+//--------------------------------------------------------------------------------------
+
+#include "reprojection.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REPROJECTION_SSE2 1
+#endif
+
+
+void UnpackMonoDepth(const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding,
+	float maxDepth, float* out)
+{
+	const float unorm = maxDepth / 16777215.0f;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint32_t* row = reinterpret_cast<const uint32_t*>(texels + y * rowPitch);
+		float* depth = out + (size_t)y * width;
+		for (uint32_t x = 0; x < width; x++)
+		{
+			float w;
+			if (encoding == DepthEncoding_Float)
+				memcpy(&w, &row[x], sizeof(w));
+			else
+				w = (float)(row[x] & 0xffffff) * unorm;
+			depth[x] = (w > 0.0f && w < maxDepth) ? w : maxDepth;
+		}
+	}
+}
+
+
+// How far apart, in pixels of shift, two depths can be and still be the same surface.
+static const float					s_ConsistentPx = 1.0f;
+
+
+//--------------------------------------------------------------------------------------
+// One texel at a time.
+//--------------------------------------------------------------------------------------
+struct Warp
+{
+	const ReprojectionParams& p;
+	const float* depth;
+	float lastX;
+	float lastY;
+	float halfWidth;
+	float halfHeight;
+
+	explicit Warp(const ReprojectionParams& params, const float* monoDepth)
+		: p(params), depth(monoDepth), lastX(params.width - 1.0f), lastY(params.height - 1.0f),
+		halfWidth(params.width * 0.5f), halfHeight(params.height * 0.5f)
+	{
+	}
+
+	// The nearest texel, clamped into the slice.
+	static inline int32_t Nearest(float v, float last)
+	{
+		v = v < 0.0f ? 0.0f : v;
+		v = v > last ? last : v;
+		return (int32_t)(v + 0.5f);
+	}
+
+	inline float Depth(float x, float y) const
+	{
+		return depth[Nearest(y, lastY) * p.width + Nearest(x, lastX)];
+	}
+
+	static inline float Shift(float w, float separation, float convergence, float halfWidth)
+	{
+		return separation * (1.0f - convergence / w) * halfWidth;
+	}
+
+	// Where the eye sees mono texel (x, y) at depth w now.
+	inline void Forward(float x, float y, float w, float* outX, float* outY) const
+	{
+		const float (*m)[4] = (w < p.maxDepth) ? p.object : p.background;
+		float vx = ((x + 0.5f) / halfWidth - 1.0f) * w / p.projectionX;
+		float vy = (1.0f - (y + 0.5f) / halfHeight) * w / p.projectionY;
+		float nx = vx * m[0][0] + vy * m[1][0] + w * m[2][0] + m[3][0];
+		float ny = vx * m[0][1] + vy * m[1][1] + w * m[2][1] + m[3][1];
+		float nw = vx * m[0][2] + vy * m[1][2] + w * m[2][2] + m[3][2];
+		nw = nw > 0.001f ? nw : 0.001f;
+		*outX = (p.projectionX * nx / nw + 1.0f) * halfWidth - 0.5f + Shift(nw, p.newSeparation, p.newConvergence, halfWidth);
+		*outY = (1.0f - p.projectionY * ny / nw) * halfHeight - 0.5f;
+	}
+
+	inline float OldShift(float w) const
+	{
+		return Shift(w, p.oldSeparation, p.oldConvergence, halfWidth);
+	}
+
+	// The depth the eye saw at eye texel (x, y), through the mono slice.  A depth is
+	// right when the mono texel it points at has it too.  Of two right ones the
+	// nearer is in front.  With neither, the eye sees something the mono view does
+	// not, behind what the mono view saw there, so the farther.
+	inline float EyeDepth(float x, float y) const
+	{
+		float w0 = Depth(x, y);
+		float s0 = OldShift(w0);
+		float w1 = Depth(x - s0, y);
+		float s1 = OldShift(w1);
+		float s2 = OldShift(Depth(x - s1, y));
+		bool right0 = fabsf(s1 - s0) < s_ConsistentPx;
+		bool right1 = fabsf(s2 - s1) < s_ConsistentPx;
+		if (right0 && right1)
+			return w0 < w1 ? w0 : w1;
+		if (right0 || right1)
+			return right0 ? w0 : w1;
+		return w0 > w1 ? w0 : w1;
+	}
+
+	// The eye texel to show at output texel (x, y).
+	inline uint32_t Source(float x, float y) const
+	{
+		float ex = x;
+		float ey = y;
+		for (uint32_t i = 0; i < p.iterations; i++)
+		{
+			float w = EyeDepth(ex, ey);
+			float fx, fy;
+			Forward(ex - OldShift(w), ey, w, &fx, &fy);
+			ex = ex + (x - fx);
+			ey = ey + (y - fy);
+		}
+		return (uint32_t)(Nearest(ey, lastY) * p.width + Nearest(ex, lastX));
+	}
+};
+
+
+#ifdef REPROJECTION_SSE2
+//--------------------------------------------------------------------------------------
+// Four texels of a row at a time, the depth gathered one by one.
+//--------------------------------------------------------------------------------------
+struct Warp4
+{
+	const Warp& w;
+	__m128 lastX, lastY, halfWidth, halfHeight, half, one, zero, nearPlane, maxDepth, signBit, consistentPx;
+	__m128 projectionX, projectionY;
+	__m128 object[4][3], background[4][3];
+
+	explicit Warp4(const Warp& warp)
+		: w(warp)
+	{
+		lastX = _mm_set1_ps(warp.lastX);
+		lastY = _mm_set1_ps(warp.lastY);
+		halfWidth = _mm_set1_ps(warp.halfWidth);
+		halfHeight = _mm_set1_ps(warp.halfHeight);
+		half = _mm_set1_ps(0.5f);
+		one = _mm_set1_ps(1.0f);
+		zero = _mm_setzero_ps();
+		nearPlane = _mm_set1_ps(0.001f);
+		maxDepth = _mm_set1_ps(warp.p.maxDepth);
+		signBit = _mm_set1_ps(-0.0f);
+		consistentPx = _mm_set1_ps(s_ConsistentPx);
+		projectionX = _mm_set1_ps(warp.p.projectionX);
+		projectionY = _mm_set1_ps(warp.p.projectionY);
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				object[r][c] = _mm_set1_ps(warp.p.object[r][c]);
+				background[r][c] = _mm_set1_ps(warp.p.background[r][c]);
+			}
+		}
+	}
+
+	static inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	inline __m128i Nearest(__m128 v, __m128 last) const
+	{
+		v = _mm_min_ps(_mm_max_ps(v, zero), last);
+		return _mm_cvttps_epi32(_mm_add_ps(v, half));
+	}
+
+	inline __m128i Index(__m128 x, __m128 y) const
+	{
+		int32_t xs[4], ys[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(xs), Nearest(x, lastX));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ys), Nearest(y, lastY));
+		const int32_t width = (int32_t)w.p.width;
+		return _mm_setr_epi32(ys[0] * width + xs[0], ys[1] * width + xs[1], ys[2] * width + xs[2], ys[3] * width + xs[3]);
+	}
+
+	inline __m128 Depth(__m128 x, __m128 y) const
+	{
+		int32_t index[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(index), Index(x, y));
+		return _mm_setr_ps(w.depth[index[0]], w.depth[index[1]], w.depth[index[2]], w.depth[index[3]]);
+	}
+
+	inline __m128 Shift(__m128 d, float separation, float convergence) const
+	{
+		return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(separation), _mm_sub_ps(one, _mm_div_ps(_mm_set1_ps(convergence), d))),
+			halfWidth);
+	}
+
+	// v * m for one column, as ((vx m0 + vy m1) + w m2) + m3.
+	static inline __m128 Column(__m128 vx, __m128 vy, __m128 d, const __m128 (*m)[3], int c)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m[0][c]), _mm_mul_ps(vy, m[1][c])), _mm_mul_ps(d, m[2][c])),
+			m[3][c]);
+	}
+
+	inline void Forward(__m128 x, __m128 y, __m128 d, __m128* outX, __m128* outY) const
+	{
+		__m128 isObject = _mm_cmplt_ps(d, maxDepth);
+		__m128 vx = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(_mm_div_ps(_mm_add_ps(x, half), halfWidth), one), d), projectionX);
+		__m128 vy = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(one, _mm_div_ps(_mm_add_ps(y, half), halfHeight)), d), projectionY);
+		__m128 nx = Select(isObject, Column(vx, vy, d, object, 0), Column(vx, vy, d, background, 0));
+		__m128 ny = Select(isObject, Column(vx, vy, d, object, 1), Column(vx, vy, d, background, 1));
+		__m128 nw = Select(isObject, Column(vx, vy, d, object, 2), Column(vx, vy, d, background, 2));
+		nw = Select(_mm_cmpgt_ps(nw, nearPlane), nw, nearPlane);
+		*outX = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_div_ps(_mm_mul_ps(projectionX, nx), nw), one), halfWidth), half),
+			Shift(nw, w.p.newSeparation, w.p.newConvergence));
+		*outY = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(one, _mm_div_ps(_mm_mul_ps(projectionY, ny), nw)), halfHeight), half);
+	}
+
+	inline __m128 OldShift(__m128 d) const
+	{
+		return Shift(d, w.p.oldSeparation, w.p.oldConvergence);
+	}
+
+	inline __m128 Consistent(__m128 a, __m128 b) const
+	{
+		return _mm_cmplt_ps(_mm_andnot_ps(signBit, _mm_sub_ps(a, b)), consistentPx);
+	}
+
+	inline __m128 EyeDepth(__m128 x, __m128 y) const
+	{
+		__m128 w0 = Depth(x, y);
+		__m128 s0 = OldShift(w0);
+		__m128 w1 = Depth(_mm_sub_ps(x, s0), y);
+		__m128 s1 = OldShift(w1);
+		__m128 s2 = OldShift(Depth(_mm_sub_ps(x, s1), y));
+		__m128 right0 = Consistent(s1, s0);
+		__m128 right1 = Consistent(s2, s1);
+		__m128 both = Select(_mm_cmplt_ps(w0, w1), w0, w1);
+		__m128 neither = Select(_mm_cmpgt_ps(w0, w1), w0, w1);
+		__m128 one = Select(right0, w0, w1);
+		return Select(_mm_and_ps(right0, right1), both, Select(_mm_or_ps(right0, right1), one, neither));
+	}
+
+	inline __m128i Source(__m128 x, __m128 y) const
+	{
+		__m128 ex = x;
+		__m128 ey = y;
+		for (uint32_t i = 0; i < w.p.iterations; i++)
+		{
+			__m128 d = EyeDepth(ex, ey);
+			__m128 fx, fy;
+			Forward(_mm_sub_ps(ex, OldShift(d)), ey, d, &fx, &fy);
+			ex = _mm_add_ps(ex, _mm_sub_ps(x, fx));
+			ey = _mm_add_ps(ey, _mm_sub_ps(y, fy));
+		}
+		return Index(ex, ey);
+	}
+};
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// The whole eye.
+//--------------------------------------------------------------------------------------
+void ReprojectEye(const ReprojectionParams& params, const float* depth, const uint8_t* eye, size_t eyePitch, uint8_t* out,
+	size_t outPitch, bool simd)
+{
+	Warp warp(params, depth);
+#ifdef REPROJECTION_SSE2
+	Warp4 warp4(warp);
+#endif
+
+	for (uint32_t y = 0; y < params.height; y++)
+	{
+		uint32_t* row = reinterpret_cast<uint32_t*>(out + y * outPitch);
+		uint32_t x = 0;
+#ifdef REPROJECTION_SSE2
+		if (simd)
+		{
+			const __m128 fy = _mm_set1_ps((float)y);
+			for (; x + 4 <= params.width; x += 4)
+			{
+				int32_t index[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(index),
+					warp4.Source(_mm_setr_ps((float)x, (float)(x + 1), (float)(x + 2), (float)(x + 3)), fy));
+				for (int i = 0; i < 4; i++)
+				{
+					uint32_t source = (uint32_t)index[i];
+					memcpy(&row[x + i], eye + (source / params.width) * eyePitch + (source % params.width) * 4, 4);
+				}
+			}
+		}
+#endif
+		for (; x < params.width; x++)
+		{
+			uint32_t source = warp.Source((float)x, (float)y);
+			memcpy(&row[x], eye + (source / params.width) * eyePitch + (source % params.width) * 4, 4);
+		}
+	}
+}
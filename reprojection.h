@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: reprojection.h
+//
+// Warping the last eyes drawn to a newer pose, for a frame that would miss its
+// refresh, and the plain C++ and SSE2 reference of ReprojectPS in Tutorial07.fx.
+//
+// The mono slice holds the depth w of every texel as seen from the middle, so a
+// mono texel m at depth w is a point in view space,
+//	v = (nx * w / P11, ny * w / P22, w),	nx, ny the texel center in NDC
+// and the delta matrix takes it to view space at the new pose, where it projects to
+// a new mono texel, and each eye sees it sep * (1 - conv / w) * width / 2 pixels to
+// the side, as GetStereoPos moves it.  Texels at the background depth, where
+// nothing was drawn, only move with the view.
+//
+// The warp goes backwards, so every output texel gets a value: starting from the
+// texel itself, the eye texel that lands on it is found by a few fixed point
+// iterations, e += p - Forward(e), and read.  Forward takes e to the mono texel
+// through the depth the eye saw there, and back into the eye from the new pose, so
+// with nothing moved e stays where it is, whatever the depth.  The eye's depth is
+// looked up through the mono slice: a depth is taken when the mono texel it points
+// at has it too, the nearer of two, and the farther when neither does, where the
+// eye sees past the edge of something the mono view does not.  Depth and eye are
+// read at the nearest texel, so the shader and these give the same texels but where
+// a float rounds the other way.  Disocclusions take whatever the iterations settle
+// on, the edge of the nearer or the farther side.
+//
+// The SSE2 kernel works on four texels of a row at a time, with the same operations
+// in the same order as the plain one, so the two agree to the bit.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "depth_histogram.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ReprojectionParams
+{
+	float object[4][4];			// old view space to new, row vectors as DirectXMath has them
+	float background[4][4];		// the same for the background, the view alone
+	float projectionX;			// Projection._11
+	float projectionY;			// Projection._22
+	uint32_t width;				// of the part of the slices rendered
+	uint32_t height;
+	float oldSeparation;		// the eye's StereoParamsArray.xy, drawn with
+	float oldConvergence;
+	float newSeparation;		// and now
+	float newConvergence;
+	float maxDepth;				// DEPTH_FAR, the background
+	uint32_t iterations;
+};
+
+// The packed depth of the mono slice as floats, the background and anything not
+// in front of the camera at maxDepth.  out is width * height.
+void UnpackMonoDepth(const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding,
+	float maxDepth, float* out);
+
+// One eye, R8G8B8A8, warped into out, both params.width x params.height.  depth is
+// from UnpackMonoDepth.  simd false is the plain C++ one, for comparison.
+void ReprojectEye(const ReprojectionParams& params, const float* depth, const uint8_t* eye, size_t eyePitch, uint8_t* out,
+	size_t outPitch, bool simd = true);
@@ -0,0 +1,234 @@
+//--------------------------------------------------------------------------------------
+// File: reprojection_bench.cpp
+//
+// Offline benchmark of the reprojection warp, see reprojection.h.
+//
+// It ray casts textured panels in front of a textured wall for one eye, with the
+// mono depth, then moves the camera as a frame or two of head motion would and casts
+// the eye again for the truth.  It gives the PSNR against the truth of the old eye
+// shown again, as a missed refresh shows it, and of the old eye warped to the new
+// pose, then times the plain and SSE2 warps and checks they give the same texels.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 reprojection_bench.cpp reprojection.cpp -o reprojection_bench
+//	./reprojection_bench [--size WxH] [--runs N]
+//--------------------------------------------------------------------------------------
+
+#include "reprojection.h"
+#include "bench_scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+static const float					s_DepthFar = 100.0f;		// DEPTH_FAR in Tutorial07.fx
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Where the camera is, turned about y by yaw.
+struct Pose
+{
+	float x, y, z, yaw;
+};
+
+// World to view, row vectors.
+static void ViewMatrix(const Pose& pose, float m[4][4])
+{
+	float c = cosf(pose.yaw), s = sinf(pose.yaw);
+	const float rotation[4][4] = { { c, 0, s, 0 }, { 0, 1, 0, 0 }, { -s, 0, c, 0 }, { 0, 0, 0, 1 } };
+	memcpy(m, rotation, sizeof(rotation));
+	m[3][0] = -(pose.x * c - pose.z * s);
+	m[3][1] = -pose.y;
+	m[3][2] = -(pose.x * s + pose.z * c);
+}
+
+// The inverse of a ViewMatrix, rotation and translation alone.
+static void InverseView(const float v[4][4], float m[4][4])
+{
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+			m[r][c] = v[c][r];
+		m[r][3] = 0.0f;
+	}
+	for (int c = 0; c < 3; c++)
+		m[3][c] = -(v[3][0] * m[0][c] + v[3][1] * m[1][c] + v[3][2] * m[2][c]);
+	m[3][3] = 1.0f;
+}
+
+static void Multiply(const float a[4][4], const float b[4][4], float m[4][4])
+{
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			m[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+}
+
+// One eye from the pose, and the mono depth.  GetStereoPos moves a point at w by
+// sep * (w - conv) in clip space, so the eye's texels are rays from
+// (sep * conv / P11, 0, 0) in view space.
+static void Render(const Pose& pose, const Panel* panels, uint32_t panelCount, uint32_t width, uint32_t height,
+	float separation, float convergence, std::vector<uint8_t>& eye, std::vector<float>& depth)
+{
+	const float projectionX = s_ProjectionY * height / width;
+	float view[4][4], world[4][4];
+	ViewMatrix(pose, view);
+	InverseView(view, world);
+
+	eye.resize((size_t)width * height * 4);
+	depth.resize((size_t)width * height);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const float sep = pass ? separation : 0.0f;
+		const float origin[3] = { sep * convergence / projectionX, 0.0f, 0.0f };
+		float o[3];
+		for (int c = 0; c < 3; c++)
+			o[c] = origin[0] * world[0][c] + world[3][c];
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				float ex = (x + 0.5f) / (width * 0.5f) - 1.0f;
+				float ey = 1.0f - (y + 0.5f) / (height * 0.5f);
+				const float direction[3] = { (ex - sep) / projectionX, ey / s_ProjectionY, 1.0f };
+				float d[3];
+				for (int c = 0; c < 3; c++)
+					d[c] = direction[0] * world[0][c] + direction[1] * world[1][c] + direction[2] * world[2][c];
+
+				// Every surface faces -z in the world, t is the view depth.
+				float t;
+				uint32_t color = CastRay(panels, panelCount, o, d, t);
+
+				if (pass)
+					memcpy(&eye[((size_t)y * width + x) * 4], &color, 4);
+				else
+					depth[(size_t)y * width + x] = (t > 0.0f && t < s_DepthFar) ? t : s_DepthFar;
+			}
+		}
+	}
+}
+
+static double Psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+	double error = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if ((i & 3) == 3)
+			continue;
+		double d = (double)a[i] - b[i];
+		error += d * d;
+		count++;
+	}
+	return error > 0.0 ? 10.0 * log10(255.0 * 255.0 * count / error) : 99.0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t runs = 5;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			usage = sscanf(argv[++i], "%ux%u", &width, &height) != 2;
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || width < 4 || height == 0 || runs == 0)
+	{
+		fprintf(stderr, "usage: %s [--size WxH] [--runs N]\n", argv[0]);
+		return 2;
+	}
+
+	Panel panels[6];
+	for (uint32_t i = 0; i < 6; i++)
+		panels[i] = PlacePanel(i, 2.5f + 6.0f * i);
+
+	// The left eye as the sample sets it, the driver's separation and convergence.
+	const float separation = -0.05f;
+	const float convergence = 4.0f;
+	ReprojectionParams params = {};
+	params.projectionX = s_ProjectionY * height / width;
+	params.projectionY = s_ProjectionY;
+	params.width = width;
+	params.height = height;
+	params.oldSeparation = params.newSeparation = separation;
+	params.oldConvergence = params.newConvergence = convergence;
+	params.maxDepth = s_DepthFar;
+	params.iterations = 2;
+
+	// Standing still, then about what a turning, walking head does over one and two
+	// refreshes at 60Hz, then moving without turning.
+	const Pose from = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const Pose moves[] = {
+		{ 0.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 0.0f, 0.01f },
+		{ 0.0f, 0.0f, 0.0f, 0.02f },
+		{ 0.02f, 0.0f, 0.0f, 0.0f },
+		{ 0.02f, 0.01f, 0.03f, 0.01f },
+		{ 0.04f, 0.02f, 0.06f, 0.02f },
+		{ 0.0f, 0.02f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 0.06f, 0.0f },
+		{ 0.04f, 0.0f, 0.0f, 0.0f },
+	};
+
+	std::vector<uint8_t> held, truth, warped((size_t)width * height * 4), plain(warped.size());
+	std::vector<float> depth, newDepth;
+	Render(from, panels, 6, width, height, separation, convergence, held, depth);
+	float fromView[4][4], fromInverse[4][4];
+	ViewMatrix(from, fromView);
+	InverseView(fromView, fromInverse);
+
+	printf("%ux%u, the left eye, %u iterations:\n", width, height, params.iterations);
+	bool same = true;
+	bool better = true;
+	for (const Pose& to : moves)
+	{
+		// The scene stands still, so the objects move with the view as the background does.
+		float toView[4][4];
+		ViewMatrix(to, toView);
+		Multiply(fromInverse, toView, params.object);
+		memcpy(params.background, params.object, sizeof(params.object));
+
+		Render(to, panels, 6, width, height, separation, convergence, truth, newDepth);
+		ReprojectEye(params, depth.data(), held.data(), (size_t)width * 4, warped.data(), (size_t)width * 4, true);
+		ReprojectEye(params, depth.data(), held.data(), (size_t)width * 4, plain.data(), (size_t)width * 4, false);
+		same = same && warped == plain;
+
+		// Warping has to do at least as well as showing the old eye again.
+		double heldDb = Psnr(held, truth);
+		double warpedDb = Psnr(warped, truth);
+		better = better && warpedDb >= heldDb;
+		printf("  move %5.2f %5.2f %5.2f, turn %.3f: held %5.2f dB, warped %5.2f dB%s\n", to.x, to.y, to.z, to.yaw,
+			heldDb, warpedDb, warpedDb >= heldDb ? "" : ", WORSE");
+	}
+
+	double plainMs = 1e30, simdMs = 1e30;
+	for (uint32_t r = 0; r < runs; r++)
+	{
+		double startMs = NowMs();
+		ReprojectEye(params, depth.data(), held.data(), (size_t)width * 4, plain.data(), (size_t)width * 4, false);
+		plainMs = std::min(plainMs, NowMs() - startMs);
+		startMs = NowMs();
+		ReprojectEye(params, depth.data(), held.data(), (size_t)width * 4, warped.data(), (size_t)width * 4, true);
+		simdMs = std::min(simdMs, NowMs() - startMs);
+		same = same && warped == plain;
+	}
+	printf("  plain %.2fms, SSE2 %.2fms an eye, %.2fx, %s\n", plainMs, simdMs, plainMs / simdMs,
+		same ? "the same texels" : "DIFFERENT");
+
+	return (same && better) ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+//--------------------------------------------------------------------------------------
+// File: rhi.h
+//
+// The command lists the passes encode, and the null backend.  Nothing in here is
+// D3D specific, so it builds anywhere, and captures of the lists can be read and
+// replayed on any platform.  The D3D11 backend is in Tutorial07.cpp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Render hardware interface
+//
+// The passes do not call the D3D11 context themselves.  They encode commands into
+// an RhiCommandList, naming objects by typed handles, and a backend runs the list:
+//	- RhiD3D11 looks every handle up in its tables of D3D11 objects and makes the
+//	  matching context call.
+//	- RhiNull only walks the list, so the CPU cost of building and submitting a
+//	  frame can be measured apart from the GPU.
+//
+// A handle is an index into a table, index 0 is always the null object.  Lists keep
+// their memory between frames, so encoding does not allocate once warmed up.
+//--------------------------------------------------------------------------------------
+template <class Tag>
+struct RhiHandle
+{
+	uint32_t index;
+};
+
+typedef RhiHandle<struct RhiTextureTag>			RhiTexture;
+typedef RhiHandle<struct RhiRenderTargetTag>	RhiRenderTarget;
+typedef RhiHandle<struct RhiDepthTargetTag>		RhiDepthTarget;
+typedef RhiHandle<struct RhiShaderViewTag>		RhiShaderView;
+typedef RhiHandle<struct RhiBufferTag>			RhiBuffer;
+typedef RhiHandle<struct RhiInputLayoutTag>		RhiInputLayout;
+typedef RhiHandle<struct RhiVertexShaderTag>	RhiVertexShader;
+typedef RhiHandle<struct RhiGeometryShaderTag>	RhiGeometryShader;
+typedef RhiHandle<struct RhiPixelShaderTag>		RhiPixelShader;
+
+enum RhiOp : uint8_t
+{
+	RhiOp_SetRenderTargets,		// a = render target, b = depth target, c = second render target
+	RhiOp_ClearRenderTarget,	// a = render target, data = float[4]
+	RhiOp_ClearDepth,			// a = depth target, data = float
+	RhiOp_SetViewport,			// data = RhiViewport, one for each viewport from 0
+	RhiOp_SetInputLayout,		// a = input layout
+	RhiOp_SetVertexBuffer,		// a = buffer, b = stride
+	RhiOp_SetIndexBuffer,		// a = buffer, b = RhiFormat
+	RhiOp_SetTopology,			// a = RhiTopology
+	RhiOp_UpdateBuffer,			// a = buffer, data = contents
+	RhiOp_UpdateBufferRange,	// a = buffer, b = byte offset, data = contents of the range
+	RhiOp_SetVertexShader,		// a = shader
+	RhiOp_SetGeometryShader,	// a = shader
+	RhiOp_SetPixelShader,		// a = shader
+	RhiOp_SetConstantBuffer,	// a = RhiStage bits, b = slot, c = buffer
+	RhiOp_SetShaderView,		// a = slot, b = view, pixel shader only
+	RhiOp_Draw,					// a = vertex count, b = start vertex
+	RhiOp_DrawIndexed,			// a = index count, b = start index, c = base vertex
+	RhiOp_CopySubresource,		// a = dest, b = dest subresource, c = source, d = source subresource
+	RhiOp_Resolve,				// a = dest, b = dest subresource, c = source, d = source subresource, e = RhiFormat
+	RhiOp_SetActiveEye,			// a = NV_STEREO_ACTIVE_EYE
+	RhiOp_BeginTimer,			// a = timing scope
+	RhiOp_EndTimer,				// a = timing scope
+	RhiOp_BeginStatistics,		// pipeline statistics of what is between
+	RhiOp_EndStatistics,
+	RhiOp_Count
+};
+
+enum RhiStage
+{
+	RhiStage_Vertex		= 1 << 0,
+	RhiStage_Geometry	= 1 << 1,
+	RhiStage_Pixel		= 1 << 2,
+};
+
+enum RhiTopology
+{
+	RhiTopology_TriangleList,
+	RhiTopology_TriangleStrip,
+};
+
+enum RhiFormat
+{
+	RhiFormat_Unknown,
+	RhiFormat_R8G8B8A8_UNORM,
+	RhiFormat_R16_UINT,
+};
+
+struct RhiViewport
+{
+	float x, y, width, height, minDepth, maxDepth;
+};
+
+struct RhiCommand
+{
+	RhiOp op;
+	uint32_t a, b, c, d, e;
+	uint32_t dataOffset;		// into the payload of the list
+	uint32_t dataSize;
+};
+
+struct RhiCommandList
+{
+	std::vector<RhiCommand> commands;
+	std::vector<uint8_t> payload;
+
+	void Reset()
+	{
+		commands.clear();
+		payload.clear();
+	}
+
+	RhiCommand& Push(RhiOp op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0, uint32_t e = 0)
+	{
+		RhiCommand cmd = { op, a, b, c, d, e, 0, 0 };
+		commands.push_back(cmd);
+		return commands.back();
+	}
+
+	// Data starts on a 16 byte offset into the payload, as constant buffer registers
+	// do.  The payload itself is only as aligned as operator new makes it, enough
+	// to read floats and structs of them in place, not for aligned SIMD loads, and
+	// the backends hand constant buffer contents to calls that copy them.
+	RhiCommand& PushData(RhiOp op, const void* data, uint32_t size, uint32_t a = 0)
+	{
+		uint32_t offset = (uint32_t)((payload.size() + 15) & ~(size_t)15);
+		payload.resize(offset + size);
+		memcpy(&payload[offset], data, size);
+
+		RhiCommand& cmd = Push(op, a);
+		cmd.dataOffset = offset;
+		cmd.dataSize = size;
+		return cmd;
+	}
+
+	const void* Data(const RhiCommand& cmd) const
+	{
+		return &payload[cmd.dataOffset];
+	}
+
+	void SetRenderTargets(RhiRenderTarget rtv, RhiDepthTarget dsv, RhiRenderTarget rtv1 = RhiRenderTarget())	{ Push(RhiOp_SetRenderTargets, rtv.index, dsv.index, rtv1.index); }
+	void ClearRenderTarget(RhiRenderTarget rtv, const float color[4])	{ PushData(RhiOp_ClearRenderTarget, color, 4 * sizeof(float), rtv.index); }
+	void ClearDepth(RhiDepthTarget dsv, float depth)					{ PushData(RhiOp_ClearDepth, &depth, sizeof(float), dsv.index); }
+	void SetViewport(const RhiViewport& vp)								{ PushData(RhiOp_SetViewport, &vp, sizeof(vp)); }
+	void SetViewports(const RhiViewport* vps, uint32_t count)			{ PushData(RhiOp_SetViewport, vps, count * sizeof(RhiViewport)); }
+	void SetInputLayout(RhiInputLayout layout)							{ Push(RhiOp_SetInputLayout, layout.index); }
+	void SetVertexBuffer(RhiBuffer buffer, uint32_t stride)				{ Push(RhiOp_SetVertexBuffer, buffer.index, stride); }
+	void SetIndexBuffer(RhiBuffer buffer, RhiFormat format)				{ Push(RhiOp_SetIndexBuffer, buffer.index, format); }
+	void SetTopology(RhiTopology topology)								{ Push(RhiOp_SetTopology, topology); }
+	void UpdateBuffer(RhiBuffer buffer, const void* data, uint32_t size) { PushData(RhiOp_UpdateBuffer, data, size, buffer.index); }
+
+	// Only part of a constant buffer, offset and size whole 16 byte registers.
+	void UpdateBufferRange(RhiBuffer buffer, uint32_t offset, const void* data, uint32_t size)
+	{
+		PushData(RhiOp_UpdateBufferRange, data, size, buffer.index).b = offset;
+	}
+
+	void SetVertexShader(RhiVertexShader shader)						{ Push(RhiOp_SetVertexShader, shader.index); }
+	void SetGeometryShader(RhiGeometryShader shader)					{ Push(RhiOp_SetGeometryShader, shader.index); }
+	void SetPixelShader(RhiPixelShader shader)							{ Push(RhiOp_SetPixelShader, shader.index); }
+	void SetConstantBuffer(uint32_t stages, uint32_t slot, RhiBuffer buffer) { Push(RhiOp_SetConstantBuffer, stages, slot, buffer.index); }
+	void SetShaderView(uint32_t slot, RhiShaderView view)				{ Push(RhiOp_SetShaderView, slot, view.index); }
+	void Draw(uint32_t count, uint32_t start)							{ Push(RhiOp_Draw, count, start); }
+	void DrawIndexed(uint32_t count, uint32_t start, uint32_t base)		{ Push(RhiOp_DrawIndexed, count, start, base); }
+	void SetActiveEye(uint32_t eye)										{ Push(RhiOp_SetActiveEye, eye); }
+	void BeginTimer(uint32_t scope)										{ Push(RhiOp_BeginTimer, scope); }
+	void EndTimer(uint32_t scope)										{ Push(RhiOp_EndTimer, scope); }
+	void BeginStatistics()												{ Push(RhiOp_BeginStatistics); }
+	void EndStatistics()												{ Push(RhiOp_EndStatistics); }
+
+	void CopySubresource(RhiTexture dst, uint32_t dstSub, RhiTexture src, uint32_t srcSub)
+	{
+		Push(RhiOp_CopySubresource, dst.index, dstSub, src.index, srcSub);
+	}
+
+	void Resolve(RhiTexture dst, uint32_t dstSub, RhiTexture src, uint32_t srcSub, RhiFormat format)
+	{
+		Push(RhiOp_Resolve, dst.index, dstSub, src.index, srcSub, format);
+	}
+};
+
+
+//--------------------------------------------------------------------------------------
+// Null backend, counts what it is given and nothing else.
+//--------------------------------------------------------------------------------------
+struct RhiNull
+{
+	uint64_t commands = 0;
+	uint64_t draws = 0;
+	uint64_t payloadBytes = 0;
+
+	void Execute(const RhiCommandList& list)
+	{
+		for (const RhiCommand& cmd : list.commands)
+		{
+			commands++;
+			if (cmd.op == RhiOp_Draw || cmd.op == RhiOp_DrawIndexed)
+				draws++;
+		}
+		payloadBytes += list.payload.size();
+	}
+};
@@ -0,0 +1,285 @@
+//--------------------------------------------------------------------------------------
+// File: rhi_capture.cpp
+//
+// RHI command capture and replay, see rhi_capture.h.
+//--------------------------------------------------------------------------------------
+
+#include "rhi_capture.h"
+
+#include <chrono>
+
+
+static const uint8_t		s_Magic[4] = { 'R', 'H', 'I', 'C' };
+static const uint32_t		s_Version = 1;
+static const size_t			s_HeaderSize = 12;
+static const uint8_t		s_HasData = 1 << 5;
+
+static void PutU32(std::vector<uint8_t>& out, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint32_t GetU32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void PutVarint(std::vector<uint8_t>& out, uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		out.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static bool GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v)
+{
+	v = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		if (p == end)
+			return false;
+		uint8_t byte = *p++;
+		v |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+
+RhiCaptureWriter::RhiCaptureWriter() : m_file(nullptr), m_frames(0), m_bytes(0), m_commands(0)
+{
+}
+
+RhiCaptureWriter::~RhiCaptureWriter()
+{
+	Close();
+}
+
+bool RhiCaptureWriter::Open(const char* fileName)
+{
+	Close();
+	m_file = fopen(fileName, "wb");
+	if (!m_file)
+		return false;
+
+	std::vector<uint8_t> header(s_Magic, s_Magic + 4);
+	PutU32(header, s_Version);
+	PutU32(header, RhiOp_Count);
+	m_frames = 0;
+	m_commands = 0;
+	m_bytes = header.size();
+	if (fwrite(header.data(), 1, header.size(), m_file) != header.size())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool RhiCaptureWriter::WriteFrame(const RhiCommandList& list)
+{
+	if (!m_file)
+		return false;
+
+	std::vector<uint8_t>& out = m_frame;
+	out.clear();
+	PutU32(out, 0);		// the size, once known
+	PutVarint(out, (uint32_t)list.commands.size());
+
+	for (const RhiCommand& cmd : list.commands)
+	{
+		const uint32_t args[5] = { cmd.a, cmd.b, cmd.c, cmd.d, cmd.e };
+		uint8_t mask = cmd.dataSize ? s_HasData : 0;
+		for (int i = 0; i < 5; i++)
+			mask |= args[i] ? (1 << i) : 0;
+
+		out.push_back(cmd.op);
+		out.push_back(mask);
+		for (int i = 0; i < 5; i++)
+		{
+			if (args[i])
+				PutVarint(out, args[i]);
+		}
+		if (cmd.dataSize)
+		{
+			const uint8_t* data = static_cast<const uint8_t*>(list.Data(cmd));
+			PutVarint(out, cmd.dataSize);
+			out.insert(out.end(), data, data + cmd.dataSize);
+		}
+	}
+
+	uint32_t size = (uint32_t)out.size() - 4;
+	for (int i = 0; i < 4; i++)
+		out[i] = (uint8_t)(size >> (8 * i));
+
+	if (fwrite(out.data(), 1, out.size(), m_file) != out.size())
+		return false;
+
+	m_frames++;
+	m_commands += list.commands.size();
+	m_bytes += out.size();
+	return true;
+}
+
+void RhiCaptureWriter::Close()
+{
+	if (m_file)
+		fclose(m_file);
+	m_file = nullptr;
+}
+
+
+RhiCaptureReader::RhiCaptureReader() : m_first(0), m_next(0), m_frames(0)
+{
+}
+
+bool RhiCaptureReader::Fail(const char* error)
+{
+	m_error = error;
+	m_data.clear();
+	m_first = m_next = 0;
+	m_frames = 0;
+	return false;
+}
+
+bool RhiCaptureReader::Load(const char* fileName)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return Fail("cannot open the capture");
+
+	std::vector<uint8_t> data;
+	uint8_t chunk[65536];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	fclose(file);
+
+	return Load(data.data(), data.size());
+}
+
+bool RhiCaptureReader::Load(const uint8_t* data, size_t size)
+{
+	m_error.clear();
+	if (size < s_HeaderSize || memcmp(data, s_Magic, 4) != 0)
+		return Fail("not an RHI capture");
+	if (GetU32(data + 4) != s_Version)
+		return Fail("unknown capture version");
+	if (GetU32(data + 8) != RhiOp_Count)
+		return Fail("captured by a build with other RHI ops");
+
+	m_data.assign(data, data + size);
+	m_first = m_next = s_HeaderSize;
+
+	// Count the frames, and make sure the last is whole.
+	m_frames = 0;
+	for (size_t pos = s_HeaderSize; pos < size; m_frames++)
+	{
+		if (size - pos < 4 || size - pos - 4 < GetU32(&m_data[pos]))
+			return Fail("the capture is cut short");
+		pos += 4 + GetU32(&m_data[pos]);
+	}
+	return true;
+}
+
+bool RhiCaptureReader::ReadFrame(RhiCommandList& list)
+{
+	list.Reset();
+	if (m_next >= m_data.size())
+		return false;
+
+	const uint8_t* p = &m_data[m_next] + 4;
+	const uint8_t* end = p + GetU32(&m_data[m_next]);
+	m_next = end - m_data.data();
+
+	uint32_t count;
+	if (!GetVarint(p, end, count))
+		return false;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (end - p < 2 || p[0] >= RhiOp_Count)
+			return false;
+		RhiOp op = (RhiOp)p[0];
+		uint8_t mask = p[1];
+		p += 2;
+
+		uint32_t args[5] = {};
+		for (int a = 0; a < 5; a++)
+		{
+			if ((mask & (1 << a)) && !GetVarint(p, end, args[a]))
+				return false;
+		}
+
+		RhiCommand* cmd;
+		if (mask & s_HasData)
+		{
+			uint32_t size;
+			if (!GetVarint(p, end, size) || (uint32_t)(end - p) < size)
+				return false;
+			cmd = &list.PushData(op, p, size, args[0]);
+			p += size;
+		}
+		else
+		{
+			cmd = &list.Push(op, args[0]);
+		}
+		cmd->b = args[1];
+		cmd->c = args[2];
+		cmd->d = args[3];
+		cmd->e = args[4];
+	}
+	return true;
+}
+
+void RhiCaptureReader::Rewind()
+{
+	m_next = m_first;
+}
+
+
+RhiReplayStats ReplayNull(RhiCaptureReader& reader, uint32_t repeat)
+{
+	RhiReplayStats stats = {};
+	RhiNull rhi;
+	RhiCommandList list;
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t r = 0; r < repeat; r++)
+	{
+		reader.Rewind();
+		while (reader.ReadFrame(list))
+		{
+			rhi.Execute(list);
+			stats.frames++;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	reader.Rewind();
+
+	stats.commands = rhi.commands;
+	stats.draws = rhi.draws;
+	stats.payloadBytes = rhi.payloadBytes;
+	stats.ms = std::chrono::duration<double, std::milli>(end - start).count();
+	return stats;
+}
+
+const char* RhiOpName(uint32_t op)
+{
+	static const char* names[] =
+	{
+		"SetRenderTargets", "ClearRenderTarget", "ClearDepth", "SetViewport", "SetInputLayout",
+		"SetVertexBuffer", "SetIndexBuffer", "SetTopology", "UpdateBuffer", "UpdateBufferRange",
+		"SetVertexShader", "SetGeometryShader", "SetPixelShader", "SetConstantBuffer", "SetShaderView",
+		"Draw", "DrawIndexed", "CopySubresource", "Resolve", "SetActiveEye",
+		"BeginTimer", "EndTimer", "BeginStatistics", "EndStatistics",
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == RhiOp_Count, "RhiOpName is missing ops");
+
+	return op < RhiOp_Count ? names[op] : "?";
+}
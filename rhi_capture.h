@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------------------
+// File: rhi_capture.h
+//
+// Capture of the RhiCommandLists a frame submits, to a compact binary log, and
+// replay of it.
+//
+// The log is little endian whatever the host, so a capture from the sample reads
+// on Linux too:
+//	header	"RHIC", u32 version, u32 RhiOp_Count of the capturing build
+//	frame	u32 size of the rest of the frame, varint command count, commands
+//	command	u8 op, u8 mask of what follows, bits 0-4 for a to e, bit 5 for data.
+//			The non-zero arguments follow as LEB128 varints, then the data as a
+//			varint size and the bytes.
+//
+// The data is everything a command carries, constant buffer contents with the
+// stereo parameters, clear colors, viewports.  Handles are written as they are.
+// They do not change while the sample runs, as a rebuild points the same handles
+// at the new objects, so a capture replays on the device of the process that made
+// it.  Anywhere else it replays on RhiNull.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "rhi.h"
+
+class RhiCaptureWriter
+{
+public:
+	RhiCaptureWriter();
+	~RhiCaptureWriter();
+
+	bool Open(const char* fileName);
+	bool WriteFrame(const RhiCommandList& list);
+	void Close();
+
+	bool IsOpen() const { return m_file != nullptr; }
+	uint32_t Frames() const { return m_frames; }
+	uint64_t Bytes() const { return m_bytes; }
+	uint64_t Commands() const { return m_commands; }
+
+private:
+	RhiCaptureWriter(const RhiCaptureWriter&);
+	RhiCaptureWriter& operator=(const RhiCaptureWriter&);
+
+	FILE* m_file;
+	std::vector<uint8_t> m_frame;	// kept between frames
+	uint32_t m_frames;
+	uint64_t m_bytes;
+	uint64_t m_commands;
+};
+
+class RhiCaptureReader
+{
+public:
+	RhiCaptureReader();
+
+	// The whole log is read into memory, and checked frame by frame, so replay
+	// does no IO.
+	bool Load(const char* fileName);
+	bool Load(const uint8_t* data, size_t size);
+
+	// Decodes the next frame into list, replacing what it held.  Returns false at
+	// the end of the log.
+	bool ReadFrame(RhiCommandList& list);
+	void Rewind();
+
+	uint32_t Frames() const { return m_frames; }
+	uint64_t Bytes() const { return m_data.size(); }
+	const char* Error() const { return m_error.c_str(); }
+
+private:
+	bool Fail(const char* error);
+
+	std::vector<uint8_t> m_data;
+	size_t m_first;			// the first frame
+	size_t m_next;
+	uint32_t m_frames;
+	std::string m_error;
+};
+
+struct RhiReplayStats
+{
+	uint32_t frames;		// replayed, repeats included
+	uint64_t commands;
+	uint64_t draws;
+	uint64_t payloadBytes;
+	double ms;
+};
+
+// Decode and run the whole log repeat times on the null backend, as fast as it goes.
+RhiReplayStats ReplayNull(RhiCaptureReader& reader, uint32_t repeat);
+
+const char* RhiOpName(uint32_t op);
@@ -0,0 +1,93 @@
+//--------------------------------------------------------------------------------------
+// File: rhi_replay.cpp
+//
+// Offline reader of the RHI captures the sample writes, see rhi_capture.h.
+//
+// It checks the capture, prints its size per frame, and replays it on the null
+// backend as fast as it goes, which is the CPU cost of decoding and walking the
+// command stream without a driver.  With --dump it lists every command.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 rhi_replay.cpp rhi_capture.cpp -o rhi_replay
+//	./rhi_replay frame_capture.rhic [--repeat N] [--dump]
+//--------------------------------------------------------------------------------------
+
+#include "rhi_capture.h"
+
+#include <stdlib.h>
+
+
+static void Dump(RhiCaptureReader& reader)
+{
+	RhiCommandList list;
+	for (uint32_t frame = 0; reader.ReadFrame(list); frame++)
+	{
+		printf("frame %u: %u commands, %u payload bytes\n", frame, (uint32_t)list.commands.size(), (uint32_t)list.payload.size());
+		for (const RhiCommand& cmd : list.commands)
+		{
+			printf("  %-18s %u %u %u %u %u", RhiOpName(cmd.op), cmd.a, cmd.b, cmd.c, cmd.d, cmd.e);
+			if (cmd.dataSize)
+			{
+				// Most data is floats, constant buffers, colors and viewports.
+				const float* data = static_cast<const float*>(list.Data(cmd));
+				printf("  data %u:", cmd.dataSize);
+				for (uint32_t i = 0; i < cmd.dataSize / 4 && i < 8; i++)
+					printf(" %g", data[i]);
+				if (cmd.dataSize / 4 > 8)
+					printf(" ...");
+			}
+			printf("\n");
+		}
+	}
+	reader.Rewind();
+}
+
+int main(int argc, char** argv)
+{
+	const char* fileName = nullptr;
+	uint32_t repeat = 100;
+	bool dump = false;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dump") == 0)
+			dump = true;
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else if (!fileName)
+			fileName = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || !fileName || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s <capture.rhic> [--repeat N] [--dump]\n", argv[0]);
+		return 2;
+	}
+
+	RhiCaptureReader reader;
+	if (!reader.Load(fileName))
+	{
+		fprintf(stderr, "%s: %s\n", fileName, reader.Error());
+		return 1;
+	}
+	if (reader.Frames() == 0)
+	{
+		fprintf(stderr, "%s: no frames\n", fileName);
+		return 1;
+	}
+
+	if (dump)
+		Dump(reader);
+
+	RhiReplayStats stats = ReplayNull(reader, repeat);
+	uint32_t frames = reader.Frames();
+	printf("%s: %u frames, %llu bytes, %.0f bytes/frame, %.1f commands/frame, %.1f draws/frame, %.0f payload bytes/frame\n",
+		fileName, frames, (unsigned long long)reader.Bytes(), (double)reader.Bytes() / frames,
+		(double)stats.commands / stats.frames, (double)stats.draws / stats.frames, (double)stats.payloadBytes / stats.frames);
+	printf("replay on null: %u frames in %.2fms, %.2fus/frame, %.1fM commands/s\n",
+		stats.frames, stats.ms, stats.ms * 1000.0 / stats.frames, stats.commands / (stats.ms * 1000.0));
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// File: shader_cache.cpp
+//
+// On-disk cache of compiled shader bytecode, see shader_cache.h.
+//--------------------------------------------------------------------------------------
+
+#include "shader_cache.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+
+// Bump when the file layout or the hash inputs change.
+static const uint32_t s_CacheVersion = 1;
+static const char s_CacheMagic[4] = { 'S', 'H', 'C', 'B' };
+
+struct ShaderCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint64_t size;
+	uint64_t checksum;
+};
+
+
+//--------------------------------------------------------------------------------------
+// FNV-1a, 64 bit.  Not cryptographic, but the cache only needs to tell builds of
+// its own shaders apart.
+//--------------------------------------------------------------------------------------
+uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Strings go in with their terminator, so "ab" + "c" and "a" + "bc" differ.
+static uint64_t HashString(const char* s, uint64_t hash)
+{
+	if (!s)
+		s = "";
+	return Fnv1a64(s, strlen(s) + 1, hash);
+}
+
+static uint64_t HashU32(uint32_t v, uint64_t hash)
+{
+	uint8_t bytes[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	return Fnv1a64(bytes, sizeof(bytes), hash);
+}
+
+uint64_t ShaderCacheHash(const ShaderCacheKey& key)
+{
+	uint64_t hash = HashU32(s_CacheVersion, 0xcbf29ce484222325ull);
+	hash = HashU32((uint32_t)key.sourceSize, hash);
+	hash = Fnv1a64(key.source, key.sourceSize, hash);
+	hash = HashU32((uint32_t)key.defineCount, hash);
+	for (size_t i = 0; i < key.defineCount; i++)
+	{
+		hash = HashString(key.defines[i].name, hash);
+		hash = HashString(key.defines[i].value, hash);
+	}
+	hash = HashString(key.entry, hash);
+	hash = HashString(key.profile, hash);
+	hash = HashU32(key.flags, hash);
+	hash = HashU32(key.compilerVersion, hash);
+	return hash;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The store
+//--------------------------------------------------------------------------------------
+ShaderCache::ShaderCache(const char* directory) : m_directory(directory)
+{
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+}
+
+std::string ShaderCache::PathFor(uint64_t hash) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash);
+	return m_directory + name;
+}
+
+bool ShaderCache::Load(uint64_t hash, std::vector<uint8_t>& bytecode) const
+{
+	FILE* file = fopen(PathFor(hash).c_str(), "rb");
+	if (!file)
+		return false;
+
+	ShaderCacheHeader header;
+	bool ok = (fread(&header, sizeof(header), 1, file) == 1) &&
+		!memcmp(header.magic, s_CacheMagic, sizeof(s_CacheMagic)) &&
+		header.version == s_CacheVersion && header.hash == hash &&
+		header.size > 0 && header.size < (64u << 20);
+	if (ok)
+	{
+		bytecode.resize((size_t)header.size);
+		ok = (fread(bytecode.data(), 1, bytecode.size(), file) == bytecode.size()) &&
+			Fnv1a64(bytecode.data(), bytecode.size()) == header.checksum;
+	}
+	fclose(file);
+
+	if (!ok)
+		bytecode.clear();
+	return ok;
+}
+
+// Written to a temporary name and renamed into place, so a reader never sees
+// half a file, and two writers of the same entry leave one good copy.
+bool ShaderCache::Store(uint64_t hash, const void* bytecode, size_t size) const
+{
+	std::string path = PathFor(hash);
+	// Unique per thread and call, the stack address tells threads apart.
+	static std::atomic<uint32_t> s_tempCount(0);
+	char suffix[48];
+	snprintf(suffix, sizeof(suffix), ".%p.%u.tmp", (void*)&suffix, s_tempCount.fetch_add(1));
+	std::string temp = path + suffix;
+
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, s_CacheMagic, sizeof(s_CacheMagic));
+	header.version = s_CacheVersion;
+	header.hash = hash;
+	header.size = size;
+	header.checksum = Fnv1a64(bytecode, size);
+
+	bool ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+		(fwrite(bytecode, 1, size, file) == size);
+	ok = (fclose(file) == 0) && ok;
+
+	// rename will not replace an existing file on Windows, and removing it first
+	// leaves a gap with no entry.  MoveFileEx replaces it in one step, or fails and
+	// keeps the old copy while a reader has it open.
+#ifdef _WIN32
+	if (ok)
+		ok = MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	if (ok)
+		ok = (rename(temp.c_str(), path.c_str()) == 0);
+#endif
+	if (!ok)
+		remove(temp.c_str());
+	return ok;
+}
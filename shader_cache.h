@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// File: shader_cache.h
+//
+// On-disk cache of compiled shader bytecode.
+//
+// Entries are keyed on a 64 bit FNV-1a hash of everything that changes the output
+// of the compiler: the source text, the defines, the entry point, the profile, the
+// compile flags and the compiler version.  Anything changing gives a new key, so
+// there is never a stale entry to invalidate, old ones are just not found.
+//
+// Nothing in here depends on D3D or Windows, the compiler lives with the caller.
+// Each entry is a file named by its key, with a small header and a checksum of the
+// bytecode, so a torn or corrupt file is treated as a miss.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct ShaderDefine
+{
+	const char* name;
+	const char* value;
+};
+
+struct ShaderCacheKey
+{
+	const void* source;
+	size_t sourceSize;
+	const ShaderDefine* defines;
+	size_t defineCount;
+	const char* entry;
+	const char* profile;
+	uint32_t flags;
+	uint32_t compilerVersion;
+};
+
+uint64_t ShaderCacheHash(const ShaderCacheKey& key);
+uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+class ShaderCache
+{
+public:
+	// The directory is made if it is not there yet.
+	explicit ShaderCache(const char* directory);
+
+	bool Load(uint64_t hash, std::vector<uint8_t>& bytecode) const;
+	bool Store(uint64_t hash, const void* bytecode, size_t size) const;
+
+	std::string PathFor(uint64_t hash) const;
+
+private:
+	std::string m_directory;
+};
@@ -0,0 +1,251 @@
+//--------------------------------------------------------------------------------------
+// File: shader_cache_bench.cpp
+//
+// Offline check/benchmark of the shader cache, see shader_cache.h.
+//
+// In a directory of its own it checks that every input of the key changes the
+// hash, that an entry stored is loaded back, that storing it again replaces it,
+// and that a truncated or corrupt file is a miss.  Then threads store the same
+// entry over and over, each with bytecode of its own, while others load it, and
+// every load has to be a miss or one writer's bytecode whole, with no temporary
+// files left over.  It fails on any of these, and gives the time of a hash, a
+// store and a load.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread shader_cache_bench.cpp shader_cache.cpp -o shader_cache_bench
+//	./shader_cache_bench [--dir D] [--repeat N]
+//--------------------------------------------------------------------------------------
+
+#include "shader_cache.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static const uint32_t				s_Writers = 4;
+static const uint32_t				s_Readers = 4;
+static const uint32_t				s_Stores = 200;			// by each writer
+
+static bool							s_Good = true;
+
+static void Check(const char* what, bool passed)
+{
+	printf("  %s%s\n", what, passed ? "" : ", FAILED");
+	s_Good = s_Good && passed;
+}
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bytecode of a given size that tells the writer and size apart.
+static std::vector<uint8_t> MakeBytecode(uint32_t writer, size_t size)
+{
+	std::vector<uint8_t> bytecode(size);
+	for (size_t i = 0; i < size; i++)
+		bytecode[i] = (uint8_t)(writer * 31 + i * 7 + (i >> 8));
+	return bytecode;
+}
+
+static std::vector<std::string> ListFiles(const std::string& directory)
+{
+	std::vector<std::string> names;
+	if (DIR* dir = opendir(directory.c_str()))
+	{
+		while (dirent* entry = readdir(dir))
+		{
+			if (entry->d_name[0] != '.')
+				names.push_back(entry->d_name);
+		}
+		closedir(dir);
+	}
+	return names;
+}
+
+static void RemoveAll(const std::string& directory)
+{
+	for (const std::string& name : ListFiles(directory))
+		remove((directory + "/" + name).c_str());
+	rmdir(directory.c_str());
+}
+
+static void CheckHash()
+{
+	const char source[] = "float4 PS(float4 p : SV_Position) : SV_Target { return p; }";
+	ShaderDefine defines[] = { { "MAX_VIEWS", "2" }, { "DEPTH_PACK_FLOAT", "1" } };
+	ShaderDefine split[] = { { "MAX_VIEWS2", "" }, { "DEPTH_PACK_FLOAT", "1" } };
+	ShaderDefine renamed[] = { { "MAX_VIEWS", "4" }, { "DEPTH_PACK_FLOAT", "1" } };
+	ShaderCacheKey base = { source, sizeof(source) - 1, defines, 2, "PS", "ps_5_0", 0x800, 47 };
+	uint64_t hash = ShaderCacheHash(base);
+
+	ShaderCacheKey key = base;
+	Check("the same key gives the same hash", ShaderCacheHash(key) == hash);
+
+	bool differ = true;
+	key = base; key.sourceSize--;				differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.defineCount = 1;			differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.defines = renamed;			differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.defines = split;			differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.entry = "VS";				differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.profile = "ps_4_0";			differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.flags = 0x801;				differ = differ && ShaderCacheHash(key) != hash;
+	key = base; key.compilerVersion = 43;		differ = differ && ShaderCacheHash(key) != hash;
+	Check("the source, defines, entry, profile, flags and compiler each change the hash", differ);
+}
+
+static void CheckStore(const ShaderCache& cache)
+{
+	const uint64_t hash = 0x0123456789abcdefull;
+	std::vector<uint8_t> loaded;
+	Check("an entry not stored is a miss", !cache.Load(hash, loaded));
+
+	std::vector<uint8_t> first = MakeBytecode(1, 3000);
+	Check("an entry is stored and loaded back", cache.Store(hash, first.data(), first.size()) &&
+		cache.Load(hash, loaded) && loaded == first);
+
+	std::vector<uint8_t> second = MakeBytecode(2, 5000);
+	Check("storing it again replaces it", cache.Store(hash, second.data(), second.size()) &&
+		cache.Load(hash, loaded) && loaded == second);
+
+	// Cut the file short, then flip a byte of the bytecode.
+	std::string path = cache.PathFor(hash);
+	Check("a truncated file is a miss", truncate(path.c_str(), 1000) == 0 && !cache.Load(hash, loaded) && loaded.empty());
+
+	cache.Store(hash, second.data(), second.size());
+	bool flipped = false;
+	if (FILE* file = fopen(path.c_str(), "r+b"))
+	{
+		flipped = fseek(file, -100, SEEK_END) == 0 && fputc(0x5a ^ second[second.size() - 100], file) != EOF;
+		flipped = (fclose(file) == 0) && flipped;
+	}
+	Check("a corrupt file is a miss", flipped && !cache.Load(hash, loaded) && loaded.empty());
+}
+
+static void CheckRace(const ShaderCache& cache, const std::string& directory)
+{
+	const uint64_t hash = 0xfedcba9876543210ull;
+	std::vector<std::vector<uint8_t>> versions;
+	for (uint32_t w = 0; w < s_Writers; w++)
+		versions.push_back(MakeBytecode(w + 10, 2000 + 1000 * w));
+
+	std::atomic<uint32_t> writing(s_Writers);
+	std::atomic<uint32_t> failedStores(0), hits(0), torn(0);
+	std::vector<std::thread> threads;
+	for (uint32_t w = 0; w < s_Writers; w++)
+	{
+		threads.emplace_back([&, w]()
+		{
+			for (uint32_t s = 0; s < s_Stores; s++)
+				failedStores += cache.Store(hash, versions[w].data(), versions[w].size()) ? 0 : 1;
+			writing--;
+		});
+	}
+	for (uint32_t r = 0; r < s_Readers; r++)
+	{
+		threads.emplace_back([&]()
+		{
+			std::vector<uint8_t> loaded;
+			while (writing.load() > 0)
+			{
+				if (!cache.Load(hash, loaded))
+					continue;
+				bool whole = false;
+				for (const std::vector<uint8_t>& version : versions)
+					whole = whole || loaded == version;
+				hits++;
+				torn += whole ? 0 : 1;
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	char what[160];
+	snprintf(what, sizeof(what), "%u writers store one entry %u times each while %u readers load it, %u hits",
+		s_Writers, s_Stores, s_Readers, hits.load());
+	Check(what, failedStores == 0 && torn == 0);
+
+	std::vector<std::string> files = ListFiles(directory);
+	bool temporary = false;
+	for (const std::string& name : files)
+		temporary = temporary || name.find(".tmp") != std::string::npos;
+	Check("no temporary files are left", !temporary);
+}
+
+static void Time(const ShaderCache& cache, uint32_t repeat)
+{
+	std::vector<char> source(64 << 10);
+	for (size_t i = 0; i < source.size(); i++)
+		source[i] = (char)('a' + i % 26);
+	ShaderDefine defines[] = { { "MAX_VIEWS", "2" } };
+	ShaderCacheKey key = { source.data(), source.size(), defines, 1, "PS", "ps_5_0", 0, 47 };
+
+	double start = NowMs();
+	uint64_t hash = 0;
+	for (uint32_t r = 0; r < repeat; r++)
+	{
+		key.flags = r;
+		hash ^= ShaderCacheHash(key);
+	}
+	double hashMs = (NowMs() - start) / repeat;
+
+	std::vector<uint8_t> bytecode = MakeBytecode(3, 8 << 10), loaded;
+	start = NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+		cache.Store(hash + r % 16, bytecode.data(), bytecode.size());
+	double storeMs = (NowMs() - start) / repeat;
+
+	start = NowMs();
+	bool hit = true;
+	for (uint32_t r = 0; r < repeat; r++)
+		hit = cache.Load(hash + r % 16, loaded) && hit;
+	double loadMs = (NowMs() - start) / repeat;
+
+	printf("  hash of %uKB of source %.3fms, store of %uKB %.3fms, load %.3fms\n", (uint32_t)(source.size() >> 10), hashMs,
+		(uint32_t)(bytecode.size() >> 10), storeMs, loadMs);
+	Check("the timed entries load back", hit && loaded == bytecode);
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "shader_cache_bench.dir";
+	uint32_t repeat = 200;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+			directory = argv[++i];
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s [--dir D] [--repeat N]\n", argv[0]);
+		return 2;
+	}
+
+	// Start from nothing, and leave nothing behind.
+	RemoveAll(directory);
+	ShaderCache cache(directory.c_str());
+	printf("cache in %s:\n", directory.c_str());
+
+	CheckHash();
+	CheckStore(cache);
+	CheckRace(cache, directory);
+	Time(cache, repeat);
+
+	RemoveAll(directory);
+	return s_Good ? 0 : 1;
+}
@@ -0,0 +1,464 @@
+//--------------------------------------------------------------------------------------
+// File: shader_watch.cpp
+//
+// File watching and per entry point source hashes, see shader_watch.h.
+//--------------------------------------------------------------------------------------
+
+#include "shader_watch.h"
+#include "shader_cache.h"
+
+#include <chrono>
+#include <ctype.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <set>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+double WatchClockMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//--------------------------------------------------------------------------------------
+// The watcher
+//--------------------------------------------------------------------------------------
+FileWatcher::FileWatcher() : m_debounceMs(50), m_stamp(0), m_stop(false)
+{
+#ifdef _WIN32
+	m_stopEvent = nullptr;
+#else
+	m_stopFd = -1;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+}
+
+// Size and modify time, folded together.  Zero when the file is not there, which
+// happens for a moment during a save by rename.
+static uint64_t FileStamp(const std::string& path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return 0;
+	return Fnv1a64(&st.st_mtime, sizeof(st.st_mtime), (uint64_t)st.st_size * 0x9e3779b97f4a7c15ull + 1);
+}
+
+bool FileWatcher::Changed()
+{
+	uint64_t stamp = FileStamp(m_directory + "/" + m_name);
+	if (stamp == 0 || stamp == m_stamp)
+		return false;
+	m_stamp = stamp;
+	return true;
+}
+
+bool FileWatcher::Start(const char* path, std::function<void(double)> onChange, uint32_t debounceMs)
+{
+	Stop();
+
+	std::string full = path;
+	size_t slash = full.find_last_of("/\\");
+	m_directory = (slash == std::string::npos) ? "." : full.substr(0, slash);
+	m_name = (slash == std::string::npos) ? full : full.substr(slash + 1);
+	m_onChange = onChange;
+	m_debounceMs = debounceMs;
+	m_stamp = FileStamp(m_directory + "/" + m_name);
+	m_stop = false;
+
+#ifdef _WIN32
+	m_stopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	if (!m_stopEvent)
+		return false;
+#else
+	m_stopFd = eventfd(0, EFD_CLOEXEC);
+	if (m_stopFd < 0)
+		return false;
+#endif
+
+	m_thread = std::thread(&FileWatcher::Run, this);
+	return true;
+}
+
+void FileWatcher::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_stop = true;
+#ifdef _WIN32
+	SetEvent(m_stopEvent);
+	m_thread.join();
+	CloseHandle(m_stopEvent);
+	m_stopEvent = nullptr;
+#else
+	uint64_t one = 1;
+	ssize_t written = write(m_stopFd, &one, sizeof(one));
+	(void)written;
+	m_thread.join();
+	close(m_stopFd);
+	m_stopFd = -1;
+#endif
+}
+
+#ifdef _WIN32
+void FileWatcher::Run()
+{
+	HANDLE change = FindFirstChangeNotificationA(m_directory.c_str(), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+	if (change == INVALID_HANDLE_VALUE)
+		return;
+
+	HANDLE handles[2] = { (HANDLE)m_stopEvent, change };
+	double firstMs = 0.0;
+	while (!m_stop)
+	{
+		// Once something changed, wait for it to go quiet before reporting it.
+		DWORD timeout = (firstMs != 0.0) ? m_debounceMs : INFINITE;
+		DWORD wait = WaitForMultipleObjects(2, handles, FALSE, timeout);
+		if (wait == WAIT_OBJECT_0)
+			break;
+		if (wait == WAIT_OBJECT_0 + 1)
+		{
+			if (firstMs == 0.0)
+				firstMs = WatchClockMs();
+			FindNextChangeNotification(change);
+			continue;
+		}
+		if (wait == WAIT_TIMEOUT && firstMs != 0.0)
+		{
+			if (Changed())
+				m_onChange(firstMs);
+			firstMs = 0.0;
+		}
+	}
+	FindCloseChangeNotification(change);
+}
+#else
+void FileWatcher::Run()
+{
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (inotify_add_watch(fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY) < 0)
+	{
+		close(fd);
+		return;
+	}
+
+	pollfd fds[2] = { { m_stopFd, POLLIN, 0 }, { fd, POLLIN, 0 } };
+	double firstMs = 0.0;
+	alignas(inotify_event) char buffer[4096];
+	while (!m_stop)
+	{
+		int timeout = (firstMs != 0.0) ? (int)m_debounceMs : -1;
+		int ready = poll(fds, 2, timeout);
+		if (ready < 0 || (fds[0].revents & POLLIN))
+			break;
+		if (ready > 0 && (fds[1].revents & POLLIN))
+		{
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			for (ssize_t at = 0; at < length;)
+			{
+				const inotify_event* event = (const inotify_event*)(buffer + at);
+				if (event->len > 0 && m_name == event->name && firstMs == 0.0)
+					firstMs = WatchClockMs();
+				at += sizeof(inotify_event) + event->len;
+			}
+			continue;
+		}
+		if (ready == 0 && firstMs != 0.0)
+		{
+			if (Changed())
+				m_onChange(firstMs);
+			firstMs = 0.0;
+		}
+	}
+	close(fd);
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Per entry point hashes
+//--------------------------------------------------------------------------------------
+struct HlslDecl
+{
+	std::string text;
+	std::set<std::string> defines;		// names this declaration makes
+	std::set<std::string> uses;			// every identifier in it
+	bool global;						// in every hash
+};
+
+static bool IsIdentStart(char c)
+{
+	return isalpha((unsigned char)c) || c == '_';
+}
+
+static void Identifiers(const std::string& text, std::vector<std::string>& out)
+{
+	for (size_t i = 0; i < text.size();)
+	{
+		if (IsIdentStart(text[i]))
+		{
+			size_t start = i;
+			while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '_'))
+				i++;
+			out.push_back(text.substr(start, i - start));
+		}
+		else if (isdigit((unsigned char)text[i]))
+		{
+			while (i < text.size() && (isalnum((unsigned char)text[i]) || text[i] == '.'))
+				i++;
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+// Comments out, so editing one does not count as a change.  Newlines are kept, to
+// keep preprocessor lines apart.
+static std::string StripComments(const char* source, size_t size)
+{
+	std::string out;
+	out.reserve(size);
+	for (size_t i = 0; i < size;)
+	{
+		if (source[i] == '/' && i + 1 < size && source[i + 1] == '/')
+		{
+			while (i < size && source[i] != '\n')
+				i++;
+		}
+		else if (source[i] == '/' && i + 1 < size && source[i + 1] == '*')
+		{
+			for (i += 2; i < size && !(source[i] == '*' && i + 1 < size && source[i + 1] == '/'); i++)
+			{
+				if (source[i] == '\n')
+					out += '\n';
+			}
+			i += 2;
+		}
+		else
+		{
+			out += source[i++];
+		}
+	}
+	return out;
+}
+
+// What a top level declaration names.  A function is the identifier before its
+// first parenthesis, past any [attributes]; a struct or cbuffer is the identifier
+// after the keyword, and a cbuffer also makes each of its fields; anything else,
+// a resource or a static, is the identifier before its : or = or ; or [.
+static void DeclDefines(HlslDecl& decl)
+{
+	const std::string& t = decl.text;
+	std::vector<std::string> idents;
+	Identifiers(t, idents);
+	if (idents.empty())
+		return;
+
+	if (idents[0] == "struct" || idents[0] == "cbuffer")
+	{
+		if (idents.size() > 1)
+			decl.defines.insert(idents[1]);
+		if (idents[0] == "struct")
+			return;
+
+		// The fields: the identifier before each ; [ or : inside the braces.
+		size_t open = t.find('{');
+		for (size_t i = open; open != std::string::npos && i < t.size(); i++)
+		{
+			if (t[i] != ';' && t[i] != '[' && t[i] != ':')
+				continue;
+			size_t end = i;
+			while (end > 0 && isspace((unsigned char)t[end - 1]))
+				end--;
+			size_t start = end;
+			while (start > 0 && (isalnum((unsigned char)t[start - 1]) || t[start - 1] == '_'))
+				start--;
+			if (start < end && IsIdentStart(t[start]))
+				decl.defines.insert(t.substr(start, end - start));
+		}
+		return;
+	}
+
+	int square = 0;
+	int angle = 0;
+	for (size_t i = 0; i < t.size(); i++)
+	{
+		char c = t[i];
+		if (square == 0 && angle == 0 && (c == '(' || c == ':' || c == '=' || c == ';' || c == '[' || c == '{'))
+		{
+			size_t end = i;
+			while (end > 0 && isspace((unsigned char)t[end - 1]))
+				end--;
+			size_t start = end;
+			while (start > 0 && (isalnum((unsigned char)t[start - 1]) || t[start - 1] == '_'))
+				start--;
+
+			// A [ with no identifier before it opens an attribute, not an array.
+			if (start < end && IsIdentStart(t[start]))
+			{
+				decl.defines.insert(t.substr(start, end - start));
+				return;
+			}
+			if (c != '[')
+				return;
+		}
+		if (c == '[') square++;
+		else if (c == ']') square--;
+		else if (c == '<') angle++;
+		else if (c == '>') angle--;
+	}
+}
+
+// Split at depth 0: each preprocessor line is one declaration, and anything else
+// runs to a ; or to the } that closes its body, with a ; after that kept with it.
+static void SplitDecls(const std::string& text, std::vector<HlslDecl>& decls)
+{
+	size_t start = 0;
+	int depth = 0;
+	bool lineStart = true;
+
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		char c = text[i];
+		if (c == '\n')
+		{
+			lineStart = true;
+			continue;
+		}
+		if (lineStart && c == '#' && depth == 0)
+		{
+			size_t end = i;
+			while (end < text.size() && text[end] != '\n')
+			{
+				// A \ at the end of the line carries the directive on.
+				if (text[end] == '\\' && end + 1 < text.size() && text[end + 1] == '\n')
+					end++;
+				end++;
+			}
+
+			HlslDecl decl;
+			decl.text = text.substr(i, end - i);
+			std::vector<std::string> idents;
+			Identifiers(decl.text, idents);
+			decl.global = !(idents.size() >= 2 && idents[0] == "define");
+			if (!decl.global)
+				decl.defines.insert(idents[1]);
+			decl.uses.insert(idents.begin(), idents.end());
+			decls.push_back(decl);
+
+			i = end - 1;
+			start = end;
+			continue;
+		}
+		if (!isspace((unsigned char)c))
+			lineStart = false;
+
+		bool endDecl = false;
+		if (c == '{')
+			depth++;
+		else if (c == '}' && --depth == 0)
+		{
+			// Keep a following ; with the struct or cbuffer.
+			size_t next = i + 1;
+			while (next < text.size() && isspace((unsigned char)text[next]))
+				next++;
+			if (next < text.size() && text[next] == ';')
+				i = next;
+			endDecl = true;
+		}
+		else if (c == ';' && depth == 0)
+			endDecl = true;
+
+		if (endDecl)
+		{
+			HlslDecl decl;
+			decl.text = text.substr(start, i + 1 - start);
+			decl.global = false;
+			DeclDefines(decl);
+			std::vector<std::string> idents;
+			Identifiers(decl.text, idents);
+			decl.uses.insert(idents.begin(), idents.end());
+			decls.push_back(decl);
+			start = i + 1;
+		}
+	}
+}
+
+// Whitespace runs count as one space, so reindenting is not a change either.
+static uint64_t HashText(const std::string& text, uint64_t hash)
+{
+	bool space = false;
+	for (char c : text)
+	{
+		if (isspace((unsigned char)c))
+		{
+			space = true;
+			continue;
+		}
+		if (space)
+		{
+			uint8_t s = ' ';
+			hash = Fnv1a64(&s, 1, hash);
+			space = false;
+		}
+		hash = Fnv1a64(&c, 1, hash);
+	}
+	return hash;
+}
+
+void ShaderEntryHashes(const char* source, size_t size, const char* const* entries, size_t count, uint64_t* hashes)
+{
+	std::vector<HlslDecl> decls;
+	SplitDecls(StripComments(source, size), decls);
+
+	for (size_t e = 0; e < count; e++)
+	{
+		// Everything reachable from the entry point, by name.
+		std::vector<bool> used(decls.size(), false);
+		std::vector<std::string> pending(1, entries[e]);
+		std::set<std::string> seen(pending.begin(), pending.end());
+		while (!pending.empty())
+		{
+			std::string name = pending.back();
+			pending.pop_back();
+			for (size_t d = 0; d < decls.size(); d++)
+			{
+				if (used[d] || !decls[d].defines.count(name))
+					continue;
+				used[d] = true;
+				for (const std::string& use : decls[d].uses)
+				{
+					if (seen.insert(use).second)
+						pending.push_back(use);
+				}
+			}
+		}
+
+		// In source order, so moving a function is a change, as it can be in HLSL.
+		uint64_t hash = Fnv1a64(entries[e], strlen(entries[e]) + 1);
+		for (size_t d = 0; d < decls.size(); d++)
+		{
+			if (used[d] || decls[d].global)
+				hash = HashText(decls[d].text, hash);
+		}
+		hashes[e] = hash;
+	}
+}
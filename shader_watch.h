@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: shader_watch.h
+//
+// The portable half of shader hot reload: a watcher that notices a source file
+// being saved, and a hash per entry point of just the source it depends on.
+//
+// FileWatcher runs its own thread, on directory change notifications on Windows
+// and inotify on Linux.  It watches the directory rather than the file, since most
+// editors save by writing a new file and renaming it over the old one.  A save can
+// be several writes, so the callback only runs once the file has been quiet for
+// debounceMs.  The callback runs on the watcher thread, so a slow callback, a
+// recompile say, holds back the next notification rather than piling them up.
+//
+// ShaderEntryHashes splits HLSL into its top level declarations, and follows what
+// each entry point names, the functions it calls, the structs, cbuffer fields,
+// resources and macros they use, and so on.  The hash of an entry point covers
+// those declarations only, so an edit to QuadPS leaves the hash of GS alone.
+// Preprocessor lines other than #define are in every hash, as the watcher cannot
+// tell what they enable.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	// onChange gets the time the change was first seen, in ms on the same clock
+	// as WatchClockMs.
+	bool Start(const char* path, std::function<void(double)> onChange, uint32_t debounceMs = 50);
+	void Stop();
+
+private:
+	void Run();
+	bool Changed();
+
+	std::string m_directory;
+	std::string m_name;
+	std::function<void(double)> m_onChange;
+	uint32_t m_debounceMs;
+	uint64_t m_stamp;			// size and modify time when last reported
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+#ifdef _WIN32
+	void* m_stopEvent;
+#else
+	int m_stopFd;
+#endif
+};
+
+double WatchClockMs();
+
+void ShaderEntryHashes(const char* source, size_t size, const char* const* entries, size_t count, uint64_t* hashes);
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// File: shader_watch_bench.cpp
+//
+// Offline check of the per entry point source hashes, see shader_watch.h.
+//
+// It hashes the sample's entry points in Tutorial07.fx, then makes one edit at a
+// time, to a static table, a macro, a struct, a cbuffer field and a helper
+// function, and hashes them again.  Exactly the entry points that use what was
+// edited have to get a new hash, so hot reload compiles them and nothing else, and
+// an edit to a comment has to change none.  It fails when an edit does not apply,
+// or the entry points rehashed are not the ones listed.  Then it times the hashes.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread shader_watch_bench.cpp shader_watch.cpp shader_cache.cpp -o shader_watch_bench
+//	./shader_watch_bench [--repeat N] [Tutorial07.fx]
+//--------------------------------------------------------------------------------------
+
+#include "shader_watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <set>
+#include <vector>
+
+
+// g_ShaderJobs in Tutorial07.cpp.
+static const char* const			s_Entries[] =
+{
+	"VS", "GS", "PS", "QuadVS", "QuadPS", "UpscalePS", "FarPS", "FarCompositeGS", "FarCompositePS", "DepthCopyPS",
+	"ComposePS", "ReprojectPS", "InterleavePS",
+};
+static const size_t					s_EntryCount = sizeof(s_Entries) / sizeof(s_Entries[0]);
+
+struct Edit
+{
+	const char* name;
+	const char* from;			// has to be in the source once
+	const char* to;
+	const char* rehashed;		// the entry points that use it, space separated
+};
+
+static const Edit					s_Edits[] =
+{
+	{ "static table", "int3(387, 752, -18)", "int3(387, 752, -17)", "ComposePS" },
+	{ "macro", "#define REPROJECT_ITERATIONS 2", "#define REPROJECT_ITERATIONS 3", "ReprojectPS" },
+	{ "struct", "nointerpolation float scale : TEXCOORD1;", "float scale : TEXCOORD1;", "FarCompositeGS FarCompositePS" },
+	{ "cbuffer field", "row_major matrix Projection;", "column_major matrix Projection;", "VS GS FarCompositeGS" },
+	{ "helper function", "return LoadEyeTexel(xy) / 255.0f;", "return LoadEyeTexel(xy) * (1.0f / 255.0f);",
+		"UpscalePS ReprojectPS" },
+	{ "comment", "// Exact through the UNORM target.", "// Exact through the UNORM render target.", "" },
+};
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool LoadFile(const char* fileName, std::string& text)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+		return false;
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, read);
+	fclose(file);
+	return !text.empty();
+}
+
+static std::vector<uint64_t> Hashes(const std::string& source)
+{
+	std::vector<uint64_t> hashes(s_EntryCount);
+	ShaderEntryHashes(source.data(), source.size(), s_Entries, s_EntryCount, hashes.data());
+	return hashes;
+}
+
+int main(int argc, char** argv)
+{
+	const char* input = "Tutorial07.fx";
+	uint32_t repeat = 100;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else if (argv[i][0] != '-')
+			input = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || repeat == 0)
+	{
+		fprintf(stderr, "usage: %s [--repeat N] [Tutorial07.fx]\n", argv[0]);
+		return 2;
+	}
+
+	std::string source;
+	if (!LoadFile(input, source))
+	{
+		fprintf(stderr, "cannot read %s\n", input);
+		return 1;
+	}
+
+	std::vector<uint64_t> base = Hashes(source);
+	bool good = true;
+	printf("%u entry points in %s, rehashed by each edit:\n", (uint32_t)s_EntryCount, input);
+	for (const Edit& edit : s_Edits)
+	{
+		std::set<std::string> expected;
+		for (const char* at = edit.rehashed; *at;)
+		{
+			size_t length = strcspn(at, " ");
+			expected.insert(std::string(at, length));
+			at += length + strspn(at + length, " ");
+		}
+
+		size_t found = source.find(edit.from);
+		bool once = found != std::string::npos && source.find(edit.from, found + 1) == std::string::npos;
+		std::string edited = source;
+		if (once)
+			edited.replace(found, strlen(edit.from), edit.to);
+
+		std::vector<uint64_t> hashes = Hashes(edited);
+		std::set<std::string> rehashed;
+		std::string names;
+		for (size_t e = 0; e < s_EntryCount; e++)
+		{
+			if (hashes[e] == base[e])
+				continue;
+			rehashed.insert(s_Entries[e]);
+			names += names.empty() ? "" : " ";
+			names += s_Entries[e];
+		}
+
+		bool same = once && rehashed == expected;
+		printf("  %-16s %s%s\n", edit.name, names.empty() ? "none" : names.c_str(),
+			!once ? ", NOT FOUND" : same ? "" : ", DIFFERENT");
+		if (once && !same)
+			printf("  %-16s %s expected\n", "", expected.empty() ? "none" : edit.rehashed);
+		good = good && same;
+	}
+
+	double start = NowMs();
+	for (uint32_t r = 0; r < repeat; r++)
+		Hashes(source);
+	printf("  all %u hashes of %uKB of source in %.3fms\n", (uint32_t)s_EntryCount, (uint32_t)(source.size() >> 10),
+		(NowMs() - start) / repeat);
+
+	return good ? 0 : 1;
+}
@@ -0,0 +1,1104 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_capture.cpp
+//
+// Stereo capture codec, see stereo_capture.h.
+//--------------------------------------------------------------------------------------
+
+#include "stereo_capture.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEREO_CAPTURE_SSE2 1
+#endif
+
+static const uint32_t				s_Version = 1;
+static const uint32_t				s_FrameHeaderBytes = 32;
+static const uint32_t				s_FlagDisparity = 1;		// the right eye is predicted from the left
+static const uint32_t				s_RiceLimit = 24;			// unary bits before the escape to 32 raw bits
+static const int16_t				s_Hole = INT16_MIN;
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bits, least significant first.  A writer without a buffer only counts.
+//--------------------------------------------------------------------------------------
+class BitWriter
+{
+public:
+	explicit BitWriter(std::vector<uint8_t>* out) : m_out(out), m_acc(0), m_count(0), m_bits(0) {}
+
+	void Put(uint32_t value, uint32_t bits)
+	{
+		m_bits += bits;
+		if (!m_out)
+			return;
+		m_acc |= ((uint64_t)value & ((1ull << bits) - 1)) << m_count;
+		m_count += bits;
+		while (m_count >= 8)
+		{
+			m_out->push_back((uint8_t)m_acc);
+			m_acc >>= 8;
+			m_count -= 8;
+		}
+	}
+
+	void Flush()
+	{
+		if (m_out && m_count)
+			m_out->push_back((uint8_t)m_acc);
+		m_acc = 0;
+		m_count = 0;
+	}
+
+	uint64_t Bits() const { return m_bits; }
+
+private:
+	std::vector<uint8_t>* m_out;
+	uint64_t m_acc;
+	uint32_t m_count;
+	uint64_t m_bits;
+};
+
+// Reads zeros past the end, the decoder checks the sizes it gets.
+class BitReader
+{
+public:
+	BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_pos(0), m_acc(0), m_count(0) {}
+
+	uint32_t Get(uint32_t bits)
+	{
+		Fill();
+		uint32_t value = (uint32_t)(m_acc & ((1ull << bits) - 1));
+		m_acc >>= bits;
+		m_count -= bits;
+		return value;
+	}
+
+	// Ones before the first zero, up to limit, which are taken along with the zero.
+	uint32_t Unary(uint32_t limit)
+	{
+		Fill();
+		uint32_t ones = 0;
+		while (ones < limit && ((m_acc >> ones) & 1))
+			ones++;
+		uint32_t taken = ones < limit ? ones + 1 : ones;
+		m_acc >>= taken;
+		m_count -= taken;
+		return ones;
+	}
+
+private:
+	void Fill()
+	{
+		while (m_count <= 56)
+		{
+			uint64_t byte = m_pos < m_size ? m_data[m_pos] : 0;
+			m_pos++;
+			m_acc |= byte << m_count;
+			m_count += 8;
+		}
+	}
+
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_pos;
+	uint64_t m_acc;
+	uint32_t m_count;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Adaptive Rice codes, k from the running mean of what the context has coded, as in
+// LOCO-I.
+//--------------------------------------------------------------------------------------
+struct RiceContext
+{
+	uint32_t sum = 4;
+	uint32_t count = 1;
+
+	uint32_t K() const
+	{
+		uint32_t k = 0;
+		while ((count << k) < sum && k < 24)
+			k++;
+		return k;
+	}
+
+	void Update(uint32_t value)
+	{
+		sum += value;
+		if (++count == 64)
+		{
+			sum >>= 1;
+			count >>= 1;
+		}
+	}
+};
+
+static void PutRice(BitWriter& bw, RiceContext& ctx, uint32_t value)
+{
+	uint32_t k = ctx.K();
+	uint32_t q = value >> k;
+	if (q < s_RiceLimit)
+	{
+		bw.Put((1u << q) - 1, q + 1);
+		bw.Put(value, k);
+	}
+	else
+	{
+		bw.Put((1u << s_RiceLimit) - 1, s_RiceLimit);
+		bw.Put(value, 32);
+	}
+	ctx.Update(value);
+}
+
+static uint32_t GetRice(BitReader& br, RiceContext& ctx)
+{
+	uint32_t k = ctx.K();
+	uint32_t q = br.Unary(s_RiceLimit);
+	uint32_t value = (q < s_RiceLimit) ? (q << k) | br.Get(k) : br.Get(32);
+	ctx.Update(value);
+	return value;
+}
+
+// Zero texels go in runs, each run followed by a texel that is not zero unless
+// the row ended.
+struct EyeContexts
+{
+	RiceContext run;
+	RiceContext channel[2][4];	// by prediction, 0 from the neighbours, 1 from the left eye
+};
+
+struct DisparityContexts
+{
+	RiceContext run;
+	RiceContext value;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Prediction and residuals, per channel.  Residuals are mod 256, folded so small
+// ones either way are small numbers.
+//--------------------------------------------------------------------------------------
+static inline uint8_t Fold(uint8_t value, uint8_t prediction)
+{
+	uint8_t d = (uint8_t)(value - prediction);
+	return (d & 0x80) ? (uint8_t)(((uint8_t)~d << 1) | 1) : (uint8_t)(d << 1);
+}
+
+static inline uint8_t Unfold(uint32_t folded, uint8_t prediction)
+{
+	uint8_t d = (folded & 1) ? (uint8_t)~(folded >> 1) : (uint8_t)(folded >> 1);
+	return (uint8_t)(prediction + d);
+}
+
+static inline uint32_t FoldSigned(int32_t d)
+{
+	return d < 0 ? ((uint32_t)(-(d + 1)) << 1) | 1 : (uint32_t)d << 1;
+}
+
+static inline int32_t UnfoldSigned(uint32_t folded)
+{
+	return (folded & 1) ? -(int32_t)(folded >> 1) - 1 : (int32_t)(folded >> 1);
+}
+
+// LOCO-I's median edge detector.  Only the left texel on a strip's first row, and
+// only the one above at the start of a row.
+static inline uint8_t IntraPrediction(const uint8_t* row, const uint8_t* up, uint32_t x, uint32_t c)
+{
+	if (!up)
+		return x ? row[(x - 1) * 4 + c] : 0;
+	if (!x)
+		return up[c];
+
+	uint8_t a = row[(x - 1) * 4 + c];
+	uint8_t b = up[x * 4 + c];
+	uint8_t cc = up[(x - 1) * 4 + c];
+	if (cc >= std::max(a, b))
+		return std::min(a, b);
+	if (cc <= std::min(a, b))
+		return std::max(a, b);
+	return (uint8_t)(a + b - cc);
+}
+
+#ifdef STEREO_CAPTURE_SSE2
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Fold of 16 channels at once, (d + d) ^ sign is ((~d << 1) | 1) where d is negative.
+static inline __m128i Fold16(__m128i value, __m128i prediction)
+{
+	__m128i d = _mm_sub_epi8(value, prediction);
+	return _mm_xor_si128(_mm_add_epi8(d, d), _mm_cmplt_epi8(d, _mm_setzero_si128()));
+}
+#endif
+
+// Folded residuals of a whole row from its neighbours, the edges out of the loop.
+static void FoldRow(const uint8_t* row, const uint8_t* up, uint32_t width, uint8_t* folded)
+{
+	const uint32_t end = width * 4;
+	for (uint32_t c = 0; c < 4; c++)
+		folded[c] = Fold(row[c], up ? up[c] : 0);
+	uint32_t i = 4;
+#ifdef STEREO_CAPTURE_SSE2
+	for (; i + 16 <= end; i += 16)
+	{
+		__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - 4));
+		__m128i prediction = a;
+		if (up)
+		{
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i));
+			__m128i cc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i - 4));
+			__m128i low = _mm_min_epu8(a, b);
+			__m128i high = _mm_max_epu8(a, b);
+			__m128i aboveHigh = _mm_cmpeq_epi8(_mm_max_epu8(cc, high), cc);
+			__m128i belowLow = _mm_cmpeq_epi8(_mm_min_epu8(cc, low), cc);
+			__m128i gradient = _mm_sub_epi8(_mm_add_epi8(a, b), cc);
+			prediction = Select(aboveHigh, low, Select(belowLow, high, gradient));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(folded + i), Fold16(value, prediction));
+	}
+#endif
+	if (!up)
+	{
+		for (; i < end; i++)
+			folded[i] = Fold(row[i], row[i - 4]);
+		return;
+	}
+	for (; i < end; i++)
+	{
+		uint8_t a = row[i - 4];
+		uint8_t b = up[i];
+		uint8_t cc = up[i - 4];
+		uint8_t low = std::min(a, b);
+		uint8_t high = std::max(a, b);
+		uint8_t prediction = (cc >= high) ? low : (cc <= low) ? high : (uint8_t)(a + b - cc);
+		folded[i] = Fold(row[i], prediction);
+	}
+}
+
+static inline uint32_t PredictedX(uint32_t x, int16_t disparity, uint32_t width)
+{
+	int32_t source = (int32_t)x - disparity;
+	return (uint32_t)std::min(std::max(source, 0), (int32_t)width - 1);
+}
+
+static inline bool ZeroTexel(const uint8_t* folded, uint32_t channels)
+{
+	uint32_t any = folded[0] | folded[1] | folded[2];
+	if (channels == 4)
+		any |= folded[3];
+	return any == 0;
+}
+
+// A row of folded residuals, with the prediction of each texel or null for all from
+// the neighbours.
+static void PutRow(BitWriter& bw, EyeContexts& ctx, const uint8_t* folded, const uint8_t* modes, uint32_t width,
+	uint32_t channels)
+{
+	uint32_t x = 0;
+	while (x < width)
+	{
+		uint32_t run = 0;
+		while (x + run < width && ZeroTexel(folded + (x + run) * 4, channels))
+			run++;
+		PutRice(bw, ctx.run, run);
+		x += run;
+		if (x == width)
+			break;
+
+		RiceContext* channel = ctx.channel[modes ? modes[x] : 0];
+		for (uint32_t c = 0; c < channels; c++)
+			PutRice(bw, channel[c], folded[x * 4 + c]);
+		x++;
+	}
+}
+
+// The left eye's texel through the disparity, plus what the neighbours of the right
+// eye missed by from theirs, with difference the right eye less the left one.
+static inline uint8_t Prediction(const uint8_t* row, const uint8_t* up, const uint8_t* difference,
+	const uint8_t* differenceUp, uint8_t source, uint8_t mode, uint32_t x, uint32_t c)
+{
+	return mode ? (uint8_t)(source + IntraPrediction(difference, differenceUp, x, c)) : IntraPrediction(row, up, x, c);
+}
+
+static inline void DecodeTexel(uint8_t* row, const uint8_t* up, uint8_t* difference, const uint8_t* differenceUp,
+	const uint8_t* source, uint8_t mode, uint32_t x, uint32_t channels, RiceContext* channel, BitReader* br)
+{
+	for (uint32_t c = 0; c < channels; c++)
+	{
+		uint8_t prediction = Prediction(row, up, difference, differenceUp, source ? source[c] : 0, mode, x, c);
+		row[x * 4 + c] = br ? Unfold(GetRice(*br, channel[c]), prediction) : prediction;
+	}
+	if (channels == 3)
+		row[x * 4 + 3] = 255;
+	if (difference)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			difference[x * 4 + c] = (uint8_t)(row[x * 4 + c] - source[c]);
+	}
+}
+
+// A row of either eye, the right one with the left eye's row, the disparity, the
+// modes and the difference rows, all null for the left eye.
+static bool GetRow(BitReader& br, EyeContexts& ctx, uint8_t* row, const uint8_t* up, const uint8_t* left,
+	const int16_t* disparity, const uint8_t* modes, uint8_t* difference, const uint8_t* differenceUp, uint32_t width,
+	uint32_t channels)
+{
+	uint32_t x = 0;
+	while (x < width)
+	{
+		uint32_t run = GetRice(br, ctx.run);
+		if (run > width - x)
+			return false;
+		for (uint32_t end = x + run; x < end; x++)
+		{
+			const uint8_t* source = left ? left + PredictedX(x, disparity[x], width) * 4 : nullptr;
+			DecodeTexel(row, up, difference, differenceUp, source, modes ? modes[x] : 0, x, channels, nullptr, nullptr);
+		}
+		if (x == width)
+			break;
+
+		uint8_t mode = modes ? modes[x] : 0;
+		const uint8_t* source = left ? left + PredictedX(x, disparity[x], width) * 4 : nullptr;
+		DecodeTexel(row, up, difference, differenceUp, source, mode, x, channels, ctx.channel[mode], &br);
+		x++;
+	}
+	return true;
+}
+
+// Disparity rows, each texel against the one before it, the first against the
+// first of the row above.
+static void PutDisparityRow(BitWriter& bw, DisparityContexts& ctx, const int16_t* row, const int16_t* up, uint32_t width)
+{
+	uint32_t x = 0;
+	while (x < width)
+	{
+		uint32_t run = 0;
+		for (; x + run < width; run++)
+		{
+			int32_t before = (x + run) ? row[x + run - 1] : (up ? up[0] : 0);
+			if (row[x + run] != before)
+				break;
+		}
+		PutRice(bw, ctx.run, run);
+		x += run;
+		if (x == width)
+			break;
+
+		int32_t before = x ? row[x - 1] : (up ? up[0] : 0);
+		PutRice(bw, ctx.value, FoldSigned(row[x] - before) - 1);
+		x++;
+	}
+}
+
+static bool GetDisparityRow(BitReader& br, DisparityContexts& ctx, int16_t* row, const int16_t* up, uint32_t width)
+{
+	uint32_t x = 0;
+	while (x < width)
+	{
+		uint32_t run = GetRice(br, ctx.run);
+		if (run > width - x)
+			return false;
+		for (uint32_t end = x + run; x < end; x++)
+			row[x] = (int16_t)(x ? row[x - 1] : (up ? up[0] : 0));
+		if (x == width)
+			break;
+
+		int32_t before = x ? row[x - 1] : (up ? up[0] : 0);
+		row[x] = (int16_t)(before + UnfoldSigned(GetRice(br, ctx.value) + 1));
+		x++;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The disparity of every texel of the right eye, in whole texels, from a row of the
+// mono slice.  Each center texel lands where the right eye sees it, the nearest
+// winning, and the holes take the farther of their two sides, the background the
+// right eye sees past an edge.
+//--------------------------------------------------------------------------------------
+static inline float UnpackDepth(uint32_t texel, DepthEncoding encoding, float maxDepth)
+{
+	float w;
+	if (encoding == DepthEncoding_Float)
+		memcpy(&w, &texel, sizeof(w));
+	else
+		w = (float)(texel & 0xffffff) * (maxDepth / 16777215.0f);
+	return (w > 0.0f && w < maxDepth) ? w : maxDepth;
+}
+
+static void RightDisparityRow(const uint8_t* depthRow, uint32_t width, DepthEncoding encoding, float maxDepth,
+	const StereoCaptureView& view, int16_t* out, float* nearest)
+{
+	const float halfWidth = width * 0.5f;
+	for (uint32_t x = 0; x < width; x++)
+	{
+		out[x] = s_Hole;
+		nearest[x] = FLT_MAX;
+	}
+
+	const uint32_t* texels = reinterpret_cast<const uint32_t*>(depthRow);
+	for (uint32_t x = 0; x < width; x++)
+	{
+		// As GetStereoPos moves each eye, in pixels.
+		float w = UnpackDepth(texels[x], encoding, maxDepth);
+		float shiftLeft = view.leftSeparation * (1.0f - view.leftConvergence / w) * halfWidth;
+		float shiftRight = view.rightSeparation * (1.0f - view.rightConvergence / w) * halfWidth;
+
+		int32_t xr = (int32_t)floorf(x + 0.5f + shiftRight);
+		if (xr < 0 || xr >= (int32_t)width || !(w < nearest[xr]))
+			continue;
+		float disparity = floorf(shiftRight - shiftLeft + 0.5f);
+		nearest[xr] = w;
+		out[xr] = (int16_t)std::min(std::max(disparity, -32767.0f), 32767.0f);
+	}
+
+	for (uint32_t x = 0; x < width;)
+	{
+		if (out[x] != s_Hole)
+		{
+			x++;
+			continue;
+		}
+		uint32_t end = x;
+		while (end < width && out[end] == s_Hole)
+			end++;
+
+		int16_t fill = 0;
+		if (x > 0 && (end == width || nearest[x - 1] >= nearest[end]))
+			fill = out[x - 1];
+		else if (end < width)
+			fill = out[end];
+		for (; x < end; x++)
+			out[x] = fill;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// One strip of rows, coded on its own.
+//--------------------------------------------------------------------------------------
+struct StripStats
+{
+	uint64_t leftBits;
+	uint64_t rightBits;
+	uint64_t disparityBits;
+	uint64_t independentBits;
+	uint32_t blocks;
+	uint32_t predictedBlocks;
+};
+
+struct StripScratch
+{
+	std::vector<uint8_t> intra;			// folded residuals of the strip, 4 per texel
+	std::vector<uint8_t> inter;
+	std::vector<uint8_t> difference;
+	std::vector<int16_t> disparity;
+	std::vector<float> nearest;
+	std::vector<uint8_t> blockModes;
+	std::vector<uint8_t> modes;			// of a row, by texel
+	std::vector<uint8_t> row;			// the right eye's residuals of a row, as the modes pick them
+};
+
+static void EncodeStrip(const uint8_t* left, const uint8_t* right, size_t eyePitch, const uint8_t* depth, size_t depthPitch,
+	DepthEncoding encoding, float maxDepth, const StereoCaptureView& view, uint32_t width, uint32_t y0, uint32_t y1,
+	uint32_t blockSize, bool countIndependent, std::vector<uint8_t>& out, StripStats& stats, StripScratch& scratch)
+{
+	const uint32_t rows = y1 - y0;
+	const size_t rowTexels = (size_t)width * 4;
+	BitWriter bw(&out);
+	memset(&stats, 0, sizeof(stats));
+
+	// Alpha is left out when both eyes are opaque.
+	bool opaque = true;
+	for (uint32_t y = y0; y < y1 && opaque; y++)
+	{
+		for (uint32_t x = 0; x < width && opaque; x++)
+			opaque = left[y * eyePitch + x * 4 + 3] == 255 && right[y * eyePitch + x * 4 + 3] == 255;
+	}
+	const uint32_t channels = opaque ? 3 : 4;
+	bw.Put(opaque ? 1 : 0, 1);
+
+	scratch.intra.resize(rows * rowTexels);
+	scratch.inter.resize(rows * rowTexels);
+
+	// The left eye from its neighbours.
+	EyeContexts leftContexts;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		const uint8_t* row = left + y * eyePitch;
+		const uint8_t* up = (y > y0) ? row - eyePitch : nullptr;
+		uint8_t* folded = &scratch.intra[(y - y0) * rowTexels];
+		FoldRow(row, up, width, folded);
+		PutRow(bw, leftContexts, folded, nullptr, width, channels);
+	}
+	stats.leftBits = bw.Bits();
+
+	// The right eye from its neighbours, and from the left eye through the disparity.
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		const uint8_t* row = right + y * eyePitch;
+		const uint8_t* up = (y > y0) ? row - eyePitch : nullptr;
+		FoldRow(row, up, width, &scratch.intra[(y - y0) * rowTexels]);
+	}
+
+	const uint32_t blocksX = (width + blockSize - 1) / blockSize;
+	const uint32_t blocksY = (rows + blockSize - 1) / blockSize;
+	scratch.blockModes.assign(blocksX * blocksY, 0);
+	scratch.modes.assign(width, 0);
+	scratch.row.resize(rowTexels);
+	stats.blocks = blocksX * blocksY;
+
+	if (depth)
+	{
+		scratch.disparity.resize(rows * width);
+		scratch.difference.resize(rows * rowTexels);
+		scratch.nearest.resize(width);
+		DisparityContexts disparityContexts;
+		for (uint32_t y = y0; y < y1; y++)
+		{
+			int16_t* disparity = &scratch.disparity[(y - y0) * width];
+			RightDisparityRow(depth + y * depthPitch, width, encoding, maxDepth, view, disparity, scratch.nearest.data());
+			PutDisparityRow(bw, disparityContexts, disparity, (y > y0) ? disparity - width : nullptr, width);
+
+			const uint8_t* row = right + y * eyePitch;
+			const uint8_t* source = left + y * eyePitch;
+			uint8_t* folded = &scratch.inter[(y - y0) * rowTexels];
+			uint8_t* difference = &scratch.difference[(y - y0) * rowTexels];
+			const uint8_t* differenceUp = (y > y0) ? difference - rowTexels : nullptr;
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint32_t sx = PredictedX(x, disparity[x], width);
+				for (uint32_t c = 0; c < 4; c++)
+					difference[x * 4 + c] = (uint8_t)(row[x * 4 + c] - source[sx * 4 + c]);
+			}
+			// Residuals of the difference from its neighbours, the same as of the
+			// texel from Prediction.
+			FoldRow(difference, differenceUp, width, folded);
+		}
+
+		// Each block takes whichever prediction leaves less, going by the sum of
+		// its folded residuals.
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				uint32_t intraSum = 0, interSum = 0;
+				uint32_t yEnd = std::min((by + 1) * blockSize, rows);
+				uint32_t xEnd = std::min((bx + 1) * blockSize, width);
+				for (uint32_t y = by * blockSize; y < yEnd; y++)
+				{
+					for (uint32_t i = bx * blockSize * 4; i < xEnd * 4; i++)
+					{
+						intraSum += scratch.intra[y * rowTexels + i];
+						interSum += scratch.inter[y * rowTexels + i];
+					}
+				}
+				uint8_t mode = interSum < intraSum ? 1 : 0;
+				scratch.blockModes[by * blocksX + bx] = mode;
+				stats.predictedBlocks += mode;
+				bw.Put(mode, 1);
+			}
+		}
+		stats.disparityBits = bw.Bits() - stats.leftBits;
+	}
+
+	EyeContexts rightContexts;
+	for (uint32_t y = 0; y < rows; y++)
+	{
+		const uint8_t* blockRow = &scratch.blockModes[(y / blockSize) * blocksX];
+		const uint8_t* folded = &scratch.intra[y * rowTexels];
+		if (stats.predictedBlocks)
+		{
+			uint8_t* mixed = scratch.row.data();
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint8_t mode = blockRow[x / blockSize];
+				scratch.modes[x] = mode;
+				memcpy(mixed + x * 4, mode ? &scratch.inter[y * rowTexels + x * 4] : folded + x * 4, 4);
+			}
+			folded = mixed;
+		}
+		PutRow(bw, rightContexts, folded, scratch.modes.data(), width, channels);
+	}
+	stats.rightBits = bw.Bits() - stats.leftBits - stats.disparityBits;
+	bw.Flush();
+
+	// What the right eye would cost on its own, counted, not written.
+	if (!countIndependent)
+		return;
+	if (!stats.predictedBlocks)
+	{
+		stats.independentBits = stats.rightBits;
+		return;
+	}
+	BitWriter counter(nullptr);
+	EyeContexts independentContexts;
+	for (uint32_t y = 0; y < rows; y++)
+		PutRow(counter, independentContexts, &scratch.intra[y * rowTexels], nullptr, width, channels);
+	stats.independentBits = counter.Bits();
+}
+
+static bool DecodeStrip(const uint8_t* data, size_t size, uint32_t flags, uint32_t width, uint32_t y0, uint32_t y1,
+	uint32_t blockSize, uint8_t* left, uint8_t* right)
+{
+	const uint32_t rows = y1 - y0;
+	const size_t pitch = (size_t)width * 4;
+	BitReader br(data, size);
+	const uint32_t channels = br.Get(1) ? 3 : 4;
+
+	EyeContexts leftContexts;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		uint8_t* row = left + y * pitch;
+		if (!GetRow(br, leftContexts, row, (y > y0) ? row - pitch : nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, width,
+			channels))
+			return false;
+	}
+
+	const uint32_t blocksX = (width + blockSize - 1) / blockSize;
+	const uint32_t blocksY = (rows + blockSize - 1) / blockSize;
+	std::vector<int16_t> disparity;
+	std::vector<uint8_t> blockModes(blocksX * blocksY, 0);
+	std::vector<uint8_t> modes(width, 0);
+	if (flags & s_FlagDisparity)
+	{
+		disparity.resize(rows * width);
+		DisparityContexts disparityContexts;
+		for (uint32_t y = 0; y < rows; y++)
+		{
+			int16_t* row = &disparity[y * width];
+			if (!GetDisparityRow(br, disparityContexts, row, y ? row - width : nullptr, width))
+				return false;
+		}
+		for (uint32_t i = 0; i < blocksX * blocksY; i++)
+			blockModes[i] = (uint8_t)br.Get(1);
+	}
+
+	// Without the disparity the right eye comes from its own neighbours only.
+	const bool predicted = (flags & s_FlagDisparity) != 0;
+	std::vector<uint8_t> difference(predicted ? rows * pitch : 0);
+	EyeContexts rightContexts;
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		const uint8_t* blockRow = &blockModes[((y - y0) / blockSize) * blocksX];
+		for (uint32_t x = 0; x < width; x++)
+			modes[x] = blockRow[x / blockSize];
+
+		uint8_t* row = right + y * pitch;
+		const uint8_t* up = (y > y0) ? row - pitch : nullptr;
+		bool ok;
+		if (predicted)
+		{
+			uint8_t* rowDifference = &difference[(y - y0) * pitch];
+			ok = GetRow(br, rightContexts, row, up, left + y * pitch, &disparity[(y - y0) * width], modes.data(),
+				rowDifference, (y > y0) ? rowDifference - pitch : nullptr, width, channels);
+		}
+		else
+		{
+			ok = GetRow(br, rightContexts, row, up, nullptr, nullptr, nullptr, nullptr, nullptr, width, channels);
+		}
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Little endian fields, whatever the host.
+//--------------------------------------------------------------------------------------
+static void PutU32(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t GetU32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void PutF32(uint8_t* p, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	PutU32(p, bits);
+}
+
+static float GetF32(const uint8_t* p)
+{
+	uint32_t bits = GetU32(p);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The writer.
+//--------------------------------------------------------------------------------------
+struct StereoCaptureWriter::Job
+{
+	uint32_t index;
+	uint32_t flags;
+	bool countIndependent;
+	StereoCaptureView view;
+	DepthEncoding encoding;
+	float maxDepth;
+	std::vector<uint8_t> left;			// width * 4 bytes per row
+	std::vector<uint8_t> right;
+	std::vector<uint8_t> depth;
+	std::vector<std::vector<uint8_t>> strips;
+	uint32_t nextStrip;
+	uint32_t doneStrips;
+};
+
+StereoCaptureWriter::StereoCaptureWriter(uint32_t threads, uint32_t maxFrames, uint32_t independentEvery)
+	: m_file(nullptr), m_width(0), m_height(0), m_strips(0), m_threadCount(std::max(threads, 1u)),
+	m_maxFrames(std::max(maxFrames, 1u)), m_independentEvery(independentEvery), m_nextIndex(0), m_kept(0),
+	m_writeFailed(false), m_stats(), m_quit(false)
+{
+}
+
+StereoCaptureWriter::~StereoCaptureWriter()
+{
+	Close();
+	for (Job* job : m_free)
+		delete job;
+}
+
+bool StereoCaptureWriter::Open(const char* fileName, uint32_t width, uint32_t height)
+{
+	Close();
+	m_file = fopen(fileName, "wb");
+	if (!m_file)
+		return false;
+
+	uint8_t header[24];
+	memcpy(header, "SCAP", 4);
+	PutU32(header + 4, s_Version);
+	PutU32(header + 8, width);
+	PutU32(header + 12, height);
+	PutU32(header + 16, StripRows);
+	PutU32(header + 20, BlockSize);
+	m_writeFailed = fwrite(header, sizeof(header), 1, m_file) != 1;
+
+	m_width = width;
+	m_height = height;
+	m_strips = (height + StripRows - 1) / StripRows;
+	m_nextIndex = 0;
+	m_kept = 0;
+	m_stats = StereoCaptureStats();
+	m_stats.bytes = sizeof(header);
+	m_quit = false;
+	for (uint32_t i = 0; i < m_threadCount; i++)
+		m_threads.push_back(std::thread(&StereoCaptureWriter::Worker, this));
+	m_writer = std::thread(&StereoCaptureWriter::Writer, this);
+	return !m_writeFailed;
+}
+
+bool StereoCaptureWriter::Submit(const StereoCaptureFrame& frame)
+{
+	Job* job;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		uint32_t index = m_nextIndex++;
+		if (!m_file || m_jobs.size() >= m_maxFrames)
+		{
+			m_stats.dropped++;
+			return false;
+		}
+		if (m_free.empty())
+		{
+			job = new Job();
+		}
+		else
+		{
+			job = m_free.back();
+			m_free.pop_back();
+		}
+		job->index = index;
+		job->countIndependent = m_independentEvery && m_kept++ % m_independentEvery == 0;
+	}
+
+	// Not queued yet, so the copy can be outside the lock.
+	const size_t pitch = (size_t)m_width * 4;
+	job->left.resize(pitch * m_height);
+	job->right.resize(pitch * m_height);
+	job->depth.resize(frame.depth ? pitch * m_height : 0);
+	for (uint32_t y = 0; y < m_height; y++)
+	{
+		memcpy(&job->left[y * pitch], frame.left + y * frame.eyePitch, pitch);
+		memcpy(&job->right[y * pitch], frame.right + y * frame.eyePitch, pitch);
+		if (frame.depth)
+			memcpy(&job->depth[y * pitch], frame.depth + y * frame.depthPitch, pitch);
+	}
+	job->flags = frame.depth ? s_FlagDisparity : 0;
+	job->view = frame.view;
+	job->encoding = frame.encoding;
+	job->maxDepth = frame.maxDepth;
+	job->strips.resize(m_strips);
+	job->nextStrip = 0;
+	job->doneStrips = 0;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_jobs.push_back(job);
+	m_work.notify_all();
+	return true;
+}
+
+void StereoCaptureWriter::Worker()
+{
+	StripScratch scratch;
+	std::unique_lock<std::mutex> lock(m_lock);
+	for (;;)
+	{
+		Job* job = nullptr;
+		uint32_t strip = 0;
+		for (Job* queued : m_jobs)
+		{
+			if (queued->nextStrip < m_strips)
+			{
+				job = queued;
+				strip = job->nextStrip++;
+				break;
+			}
+		}
+		if (!job)
+		{
+			if (m_quit)
+				return;
+			m_work.wait(lock);
+			continue;
+		}
+		lock.unlock();
+
+		double startMs = NowMs();
+		uint32_t y0 = strip * StripRows;
+		uint32_t y1 = std::min(y0 + StripRows, m_height);
+		const size_t pitch = (size_t)m_width * 4;
+		StripStats stats;
+		std::vector<uint8_t>& out = job->strips[strip];
+		out.clear();
+		EncodeStrip(job->left.data(), job->right.data(), pitch, job->depth.empty() ? nullptr : job->depth.data(), pitch,
+			job->encoding, job->maxDepth, job->view, m_width, y0, y1, BlockSize, job->countIndependent, out, stats, scratch);
+		double ms = NowMs() - startMs;
+
+		lock.lock();
+		m_stats.leftBits += stats.leftBits;
+		m_stats.rightBits += stats.rightBits;
+		m_stats.disparityBits += stats.disparityBits;
+		m_stats.blocks += stats.blocks;
+		m_stats.predictedBlocks += stats.predictedBlocks;
+		m_stats.encodeMs += ms;
+		if (job->countIndependent)
+		{
+			m_stats.sampledLeftBits += stats.leftBits;
+			m_stats.sampledBits += stats.leftBits + stats.rightBits + stats.disparityBits;
+			m_stats.independentBits += stats.independentBits;
+		}
+		if (++job->doneStrips == m_strips)
+			m_done.notify_all();
+	}
+}
+
+void StereoCaptureWriter::Writer()
+{
+	std::vector<uint8_t> header;
+	std::unique_lock<std::mutex> lock(m_lock);
+	for (;;)
+	{
+		if (m_jobs.empty() || m_jobs.front()->doneStrips < m_strips)
+		{
+			if (m_quit && m_jobs.empty())
+				return;
+			m_done.wait(lock);
+			continue;
+		}
+		Job* job = m_jobs.front();
+		m_jobs.pop_front();
+		lock.unlock();
+
+		header.resize(s_FrameHeaderBytes + 4 * m_strips);
+		memcpy(&header[0], "SFRM", 4);
+		PutU32(&header[4], job->index);
+		PutU32(&header[8], job->flags);
+		PutF32(&header[12], job->view.leftSeparation);
+		PutF32(&header[16], job->view.leftConvergence);
+		PutF32(&header[20], job->view.rightSeparation);
+		PutF32(&header[24], job->view.rightConvergence);
+		PutU32(&header[28], m_strips);
+		uint64_t bytes = header.size();
+		for (uint32_t s = 0; s < m_strips; s++)
+		{
+			PutU32(&header[s_FrameHeaderBytes + 4 * s], (uint32_t)job->strips[s].size());
+			bytes += job->strips[s].size();
+		}
+
+		bool failed = fwrite(header.data(), header.size(), 1, m_file) != 1;
+		for (uint32_t s = 0; s < m_strips && !failed; s++)
+			failed = !job->strips[s].empty() && fwrite(job->strips[s].data(), job->strips[s].size(), 1, m_file) != 1;
+
+		lock.lock();
+		m_writeFailed = m_writeFailed || failed;
+		m_stats.frames++;
+		m_stats.sampledFrames += job->countIndependent ? 1 : 0;
+		m_stats.bytes += bytes;
+		m_free.push_back(job);
+	}
+}
+
+void StereoCaptureWriter::Close()
+{
+	if (!m_file)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+		m_work.notify_all();
+		m_done.notify_all();
+	}
+	for (std::thread& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+	m_writer.join();
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+StereoCaptureStats StereoCaptureWriter::Stats() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_stats;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The reader.
+//--------------------------------------------------------------------------------------
+StereoCaptureReader::StereoCaptureReader()
+	: m_file(nullptr), m_width(0), m_height(0), m_stripRows(0), m_blockSize(0), m_frameBytes(0)
+{
+}
+
+StereoCaptureReader::~StereoCaptureReader()
+{
+	Close();
+}
+
+bool StereoCaptureReader::Open(const char* fileName)
+{
+	Close();
+	m_file = fopen(fileName, "rb");
+	if (!m_file)
+		return false;
+
+	uint8_t header[24];
+	if (fread(header, sizeof(header), 1, m_file) != 1 || memcmp(header, "SCAP", 4) != 0 || GetU32(header + 4) != s_Version)
+	{
+		Close();
+		return false;
+	}
+	m_width = GetU32(header + 8);
+	m_height = GetU32(header + 12);
+	m_stripRows = GetU32(header + 16);
+	m_blockSize = GetU32(header + 20);
+	if (!m_width || !m_height || !m_stripRows || !m_blockSize)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void StereoCaptureReader::Close()
+{
+	if (m_file)
+		fclose(m_file);
+	m_file = nullptr;
+}
+
+bool StereoCaptureReader::ReadFrame(std::vector<uint8_t>& left, std::vector<uint8_t>& right, uint32_t* index,
+	StereoCaptureView* view, uint32_t threads)
+{
+	uint8_t header[s_FrameHeaderBytes];
+	if (!m_file || fread(header, sizeof(header), 1, m_file) != 1 || memcmp(header, "SFRM", 4) != 0)
+		return false;
+
+	const uint32_t strips = GetU32(header + 28);
+	if (strips != (m_height + m_stripRows - 1) / m_stripRows)
+		return false;
+	if (index)
+		*index = GetU32(header + 4);
+	uint32_t flags = GetU32(header + 8);
+	if (view)
+	{
+		view->leftSeparation = GetF32(header + 12);
+		view->leftConvergence = GetF32(header + 16);
+		view->rightSeparation = GetF32(header + 20);
+		view->rightConvergence = GetF32(header + 24);
+	}
+
+	std::vector<uint32_t> sizes(strips);
+	std::vector<size_t> offsets(strips);
+	std::vector<uint8_t> table(4 * strips);
+	if (fread(table.data(), table.size(), 1, m_file) != 1)
+		return false;
+	size_t total = 0;
+	for (uint32_t s = 0; s < strips; s++)
+	{
+		sizes[s] = GetU32(&table[4 * s]);
+		offsets[s] = total;
+		total += sizes[s];
+	}
+	m_data.resize(total);
+	if (total && fread(m_data.data(), total, 1, m_file) != 1)
+		return false;
+	m_frameBytes = sizeof(header) + table.size() + total;
+
+	const size_t bytes = (size_t)m_width * m_height * 4;
+	left.resize(bytes);
+	right.resize(bytes);
+
+	// The strips are independent, so any thread takes the next one.
+	std::atomic<uint32_t> next(0);
+	std::atomic<bool> ok(true);
+	auto decode = [&]()
+	{
+		for (uint32_t s = next++; s < strips; s = next++)
+		{
+			uint32_t y0 = s * m_stripRows;
+			uint32_t y1 = std::min(y0 + m_stripRows, m_height);
+			if (!DecodeStrip(m_data.data() + offsets[s], sizes[s], flags, m_width, y0, y1, m_blockSize, left.data(), right.data()))
+				ok = false;
+		}
+	};
+	std::vector<std::thread> helpers;
+	for (uint32_t t = 1; t < std::min(threads, strips); t++)
+		helpers.push_back(std::thread(decode));
+	decode();
+	for (std::thread& helper : helpers)
+		helper.join();
+	return ok;
+}
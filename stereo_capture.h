@@ -0,0 +1,179 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_capture.h
+//
+// Lossless capture of the two eyes to disk, with the right eye predicted from the
+// left one through the disparity, so the second eye costs much less than the first.
+//
+// The right eye is mostly the left eye shifted by the disparity, which the mono
+// slice's depth and the stereo parameters give for every texel, as in
+// stereo_comfort.h.  Each row of the mono slice is warped into the right eye's view,
+// the nearest depth winning, and the holes, where the right eye sees past an edge,
+// are filled from the farther side.  That gives a whole texel disparity D for
+// every right eye texel, and the prediction of right(x) is left(x - D), plus the
+// difference between the eyes as its neighbours predict it, which takes the
+// lighting and the sub texel shifts the whole texel D leaves.  Blocks where that
+// predicts worse than the right eye's own neighbours, at occlusions or without
+// depth, are coded on their own.
+//
+// Everything is coded with LOCO-I's median predictor, on the eyes or on their
+// difference, zero texels in runs and the rest as adaptive Rice codes of the residual per
+// channel.  The frame is cut into strips of rows that code independently, so
+// workers can encode them in parallel and the reader decode them in parallel.
+// Submit copies the frame and returns, a writer thread puts the frames on disk in
+// order as they are done, and a frame is dropped rather than the caller kept
+// waiting when too many are in flight.
+//
+// The file is little endian:
+//	header	"SCAP", u32 version, u32 width, u32 height, u32 rows per strip, u32 block size
+//	frame	"SFRM", u32 frame index, u32 flags, f32 separation and convergence for the
+//			left and right eye, u32 strip count, u32 bytes of each strip, the strips
+//	strip	a bit stream, the left eye's rows, with depth the disparity rows and a
+//			bit per block for the right eye's prediction, then the right eye's rows
+//
+// Frames that were dropped leave a gap in the frame index.  For the savings, the
+// encoder can also count what the right eye would have cost coded on its own, which
+// is a second pass over it, so only on some of the frames.
+//
+// It is not real time: at 1920x1080 a frame is several hundred ms of coding on one
+// core, so at the refresh rate most frames are dropped, and the recording has the
+// frames the workers kept up with.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "depth_histogram.h"
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// StereoParamsArray[0].xy and [1].xy, as the frame drew with them.
+struct StereoCaptureView
+{
+	float leftSeparation;
+	float leftConvergence;
+	float rightSeparation;
+	float rightConvergence;
+};
+
+// One frame to Submit, R8G8B8A8 eyes the same size as the capture.  The depth is
+// the packed mono slice, or null to code the right eye on its own.
+struct StereoCaptureFrame
+{
+	const uint8_t* left;
+	const uint8_t* right;
+	size_t eyePitch;
+	const uint8_t* depth;
+	size_t depthPitch;
+	DepthEncoding encoding;
+	float maxDepth;
+	StereoCaptureView view;
+};
+
+struct StereoCaptureStats
+{
+	uint64_t frames;			// written
+	uint64_t dropped;			// the encoder was behind
+	uint64_t bytes;				// of the file
+	uint64_t leftBits;
+	uint64_t rightBits;
+	uint64_t disparityBits;		// the disparity rows and the block modes
+	uint64_t blocks;
+	uint64_t predictedBlocks;	// right eye blocks from the left eye
+	double encodeMs;			// on the workers, summed
+
+	// The frames the right eye was also counted for on its own.
+	uint64_t sampledFrames;
+	uint64_t sampledLeftBits;
+	uint64_t sampledBits;		// left, right and disparity
+	uint64_t independentBits;	// the right eye coded on its own, as it would have cost
+
+	// Of both eyes, coded together against each on its own, over the frames sampled.
+	double Savings() const
+	{
+		uint64_t apart = sampledLeftBits + independentBits;
+		return apart ? 1.0 - (double)sampledBits / apart : 0.0;
+	}
+};
+
+class StereoCaptureWriter
+{
+public:
+	static const uint32_t StripRows = 64;
+	static const uint32_t BlockSize = 16;
+
+	// At most maxFrames submitted and not yet written.  Every independentEvery
+	// frames kept, the right eye is also counted on its own, 0 for never.
+	StereoCaptureWriter(uint32_t threads, uint32_t maxFrames, uint32_t independentEvery = 0);
+	~StereoCaptureWriter();
+
+	bool Open(const char* fileName, uint32_t width, uint32_t height);
+	bool Submit(const StereoCaptureFrame& frame);	// false when the frame was dropped
+	void Close();									// after every frame submitted is written
+
+	bool IsOpen() const { return m_file != nullptr; }
+	StereoCaptureStats Stats() const;
+
+private:
+	struct Job;
+
+	StereoCaptureWriter(const StereoCaptureWriter&);
+	StereoCaptureWriter& operator=(const StereoCaptureWriter&);
+
+	void Worker();
+	void Writer();
+
+	FILE* m_file;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_strips;
+	uint32_t m_threadCount;
+	uint32_t m_maxFrames;
+	uint32_t m_independentEvery;
+	uint32_t m_nextIndex;
+	uint32_t m_kept;			// frames submitted and not dropped
+	bool m_writeFailed;
+	StereoCaptureStats m_stats;
+
+	std::deque<Job*> m_jobs;		// in submit order, the writer takes the front
+	std::vector<Job*> m_free;
+	std::vector<std::thread> m_threads;
+	std::thread m_writer;
+	mutable std::mutex m_lock;
+	std::condition_variable m_work;		// for the workers, a strip to encode
+	std::condition_variable m_done;		// for the writer, a frame finished
+	bool m_quit;
+};
+
+class StereoCaptureReader
+{
+public:
+	StereoCaptureReader();
+	~StereoCaptureReader();
+
+	bool Open(const char* fileName);
+	void Close();
+
+	// The next frame into width x height texels of each eye, rows width * 4 bytes
+	// apart, decoding the strips on that many threads.
+	bool ReadFrame(std::vector<uint8_t>& left, std::vector<uint8_t>& right, uint32_t* index, StereoCaptureView* view,
+		uint32_t threads = 1);
+
+	uint32_t Width() const { return m_width; }
+	uint32_t Height() const { return m_height; }
+	uint64_t FrameBytes() const { return m_frameBytes; }	// of the last frame read
+
+private:
+	StereoCaptureReader(const StereoCaptureReader&);
+	StereoCaptureReader& operator=(const StereoCaptureReader&);
+
+	FILE* m_file;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_stripRows;
+	uint32_t m_blockSize;
+	uint64_t m_frameBytes;
+	std::vector<uint8_t> m_data;
+};
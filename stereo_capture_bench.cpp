@@ -0,0 +1,252 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_capture_bench.cpp
+//
+// Offline benchmark and reader of the stereo captures, see stereo_capture.h.
+//
+// Without a file it makes a sequence of stereo frames, textured panels moving in
+// front of a textured wall, with the mono depth and the eyes shifted as
+// GetStereoPos shifts them.  It encodes them to a capture on the worker threads,
+// reads it back, and checks every texel.  It gives the bits per texel of each part,
+// the savings against coding each eye on its own, and the encode and decode speed.
+// The savings need the right eye coded a second time, on its own, which --sample
+// does only every N frames, as the sample does, to time what the sample pays.
+//
+// With a file, a capture from the sample, it decodes every frame and gives its size,
+// and --dump writes each eye out as a PPM file.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread stereo_capture_bench.cpp stereo_capture.cpp -o stereo_capture_bench
+//	./stereo_capture_bench [--frames N] [--threads N] [--size WxH] [--sample N] [--out file]
+//	./stereo_capture_bench eye_capture.scap [--threads N] [--dump prefix]
+//--------------------------------------------------------------------------------------
+
+#include "stereo_capture.h"
+#include "bench_scene.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+
+static const float					s_DepthFar = 100.0f;		// DEPTH_FAR in Tutorial07.fx
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Textures are in view space units, and the frame is drawn in texels, 48 to one.
+static const float					s_TexelsPerUnit = 48.0f;
+
+// The eyes and the mono depth of one frame.  Panels are nearest first, the eye
+// shifts as GetStereoPos does.
+static void MakeFrame(uint32_t frame, uint32_t width, uint32_t height, const StereoCaptureView& view,
+	std::vector<uint8_t>& left, std::vector<uint8_t>& right, std::vector<uint8_t>& depth)
+{
+	Panel panels[6];
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		float t = frame * (0.02f + 0.005f * i);
+		panels[i].width = width * (0.12f + 0.03f * i);
+		panels[i].height = height * (0.15f + 0.04f * i);
+		panels[i].x = width * (0.5f + 0.35f * sinf(t + i)) - panels[i].width / 2;
+		panels[i].y = height * (0.5f + 0.3f * cosf(t * 0.7f + 2 * i)) - panels[i].height / 2;
+		panels[i].depth = 2.5f + 6.0f * i;
+		panels[i].seed = 17 + i;
+	}
+
+	left.resize((size_t)width * height * 4);
+	right.resize(left.size());
+	depth.resize(left.size());
+	const float halfWidth = width * 0.5f;
+	const float separation[3] = { view.leftSeparation, view.rightSeparation, 0.0f };
+	const float convergence[3] = { view.leftConvergence, view.rightConvergence, 0.0f };
+	uint32_t* out[3] = { (uint32_t*)left.data(), (uint32_t*)right.data(), (uint32_t*)depth.data() };
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			for (int eye = 0; eye < 3; eye++)
+			{
+				float w = s_WallDepth;
+				uint32_t color = 0;
+				bool hit = false;
+				for (uint32_t i = 0; i < 6 && !hit; i++)
+				{
+					const Panel& p = panels[i];
+					float u = x + 0.5f - separation[eye] * (1.0f - convergence[eye] / p.depth) * halfWidth - p.x;
+					float v = y + 0.5f - p.y;
+					if (u >= 0.0f && u < p.width && v >= 0.0f && v < p.height)
+					{
+						hit = true;
+						w = p.depth;
+						color = Texture(u / s_TexelsPerUnit, v / s_TexelsPerUnit, p.seed);
+					}
+				}
+				if (!hit)
+				{
+					float u = x + 0.5f - separation[eye] * (1.0f - convergence[eye] / w) * halfWidth;
+					color = Texture(u / s_TexelsPerUnit, (y + 0.5f) / s_TexelsPerUnit, 3);
+				}
+
+				uint32_t packed;
+				memcpy(&packed, &w, sizeof(packed));
+				out[eye][y * width + x] = (eye == 2) ? packed : color;
+			}
+		}
+	}
+}
+
+static bool WritePpm(const char* fileName, const std::vector<uint8_t>& texels, uint32_t width, uint32_t height)
+{
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+		return false;
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	std::vector<uint8_t> rgb((size_t)width * height * 3);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+		memcpy(&rgb[i * 3], &texels[i * 4], 3);
+	bool ok = fwrite(rgb.data(), rgb.size(), 1, file) == 1;
+	fclose(file);
+	return ok;
+}
+
+static int Decode(const char* fileName, uint32_t threads, const char* dump)
+{
+	StereoCaptureReader reader;
+	if (!reader.Open(fileName))
+	{
+		fprintf(stderr, "%s is not a stereo capture\n", fileName);
+		return 1;
+	}
+
+	std::vector<uint8_t> left, right;
+	uint32_t index;
+	StereoCaptureView view;
+	uint32_t frames = 0;
+	uint64_t bytes = 0;
+	double startMs = NowMs();
+	while (reader.ReadFrame(left, right, &index, &view, threads))
+	{
+		printf("frame %u: %llu bytes, %.3f bits/texel, separation %.3f %.3f, convergence %.3f %.3f\n", index,
+			(unsigned long long)reader.FrameBytes(), reader.FrameBytes() * 8.0 / (2.0 * reader.Width() * reader.Height()),
+			view.leftSeparation, view.rightSeparation, view.leftConvergence, view.rightConvergence);
+		if (dump)
+		{
+			char name[512];
+			snprintf(name, sizeof(name), "%s_%05u_left.ppm", dump, index);
+			WritePpm(name, left, reader.Width(), reader.Height());
+			snprintf(name, sizeof(name), "%s_%05u_right.ppm", dump, index);
+			WritePpm(name, right, reader.Width(), reader.Height());
+		}
+		frames++;
+		bytes += reader.FrameBytes();
+	}
+	double ms = NowMs() - startMs;
+	printf("%u frames of %ux%u, %.1f KB/frame, decoded at %.1f frames/s\n", frames, reader.Width(), reader.Height(),
+		frames ? bytes / 1024.0 / frames : 0.0, frames ? frames * 1000.0 / ms : 0.0);
+	return frames ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t frames = 30;
+	uint32_t threads = 4;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	uint32_t sample = 1;
+	const char* out = "stereo_capture_bench.scap";
+	const char* input = nullptr;
+	const char* dump = nullptr;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			usage = sscanf(argv[++i], "%ux%u", &width, &height) != 2;
+		else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+			sample = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out = argv[++i];
+		else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+			dump = argv[++i];
+		else if (argv[i][0] != '-' && !input)
+			input = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || frames == 0 || threads == 0 || width == 0 || height == 0)
+	{
+		fprintf(stderr, "usage: %s [--frames N] [--threads N] [--size WxH] [--sample N] [--out file]\n"
+			"       %s capture [--threads N] [--dump prefix]\n", argv[0], argv[0]);
+		return 2;
+	}
+	if (input)
+		return Decode(input, threads, dump);
+
+	// As the sample sets them, the driver's separation either way of the middle.
+	StereoCaptureView view = { -0.05f, 4.0f, 0.05f, 4.0f };
+	std::vector<std::vector<uint8_t>> lefts(frames), rights(frames), depths(frames);
+	for (uint32_t f = 0; f < frames; f++)
+		MakeFrame(f, width, height, view, lefts[f], rights[f], depths[f]);
+
+	// Every frame is waited for, so none are dropped.
+	StereoCaptureWriter writer(threads, frames, sample);
+	if (!writer.Open(out, width, height))
+	{
+		fprintf(stderr, "cannot write %s\n", out);
+		return 1;
+	}
+	double startMs = NowMs();
+	for (uint32_t f = 0; f < frames; f++)
+	{
+		StereoCaptureFrame frame = { lefts[f].data(), rights[f].data(), (size_t)width * 4, depths[f].data(), (size_t)width * 4,
+			DepthEncoding_Float, s_DepthFar, view };
+		writer.Submit(frame);
+	}
+	writer.Close();
+	double encodeMs = NowMs() - startMs;
+
+	StereoCaptureStats stats = writer.Stats();
+	double texels = (double)width * height * stats.frames;
+	double rawMB = 2.0 * texels * 4 / 1e6;
+	printf("%u frames of %ux%u, %u threads, to %s:\n", (uint32_t)stats.frames, width, height, threads, out);
+	printf("  left eye         %6.3f bits/texel\n", stats.leftBits / texels);
+	printf("  right eye        %6.3f bits/texel, %.1f%% of blocks from the left eye\n", stats.rightBits / texels,
+		100.0 * stats.predictedBlocks / std::max<uint64_t>(stats.blocks, 1));
+	printf("  disparity        %6.3f bits/texel\n", stats.disparityBits / texels);
+	printf("  right on its own %6.3f bits/texel, of %u frames\n", stats.independentBits /
+		((double)width * height * std::max<uint64_t>(stats.sampledFrames, 1)), (uint32_t)stats.sampledFrames);
+	printf("  %.1f MB from %.1f MB raw, %.1f%% smaller than each eye on its own\n", stats.bytes / 1e6, rawMB,
+		100.0 * stats.Savings());
+	printf("  encoded at %.1f frames/s, %.0f MB/s of eyes, %.1fms of work per frame\n", stats.frames * 1000.0 / encodeMs,
+		rawMB / encodeMs * 1000.0, stats.encodeMs / std::max<uint64_t>(stats.frames, 1));
+
+	StereoCaptureReader reader;
+	if (!reader.Open(out))
+	{
+		fprintf(stderr, "cannot read %s back\n", out);
+		return 1;
+	}
+	std::vector<uint8_t> left, right;
+	uint32_t index;
+	uint32_t decoded = 0;
+	bool same = true;
+	startMs = NowMs();
+	while (reader.ReadFrame(left, right, &index, nullptr, threads))
+	{
+		same = same && index < frames && left == lefts[index] && right == rights[index];
+		decoded++;
+	}
+	double decodeMs = NowMs() - startMs;
+	printf("  decoded at %.1f frames/s, %s\n", decoded * 1000.0 / decodeMs,
+		same && decoded == frames ? "every texel the same" : "DIFFERENT");
+
+	return same && decoded == frames ? 0 : 1;
+}
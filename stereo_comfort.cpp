@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_comfort.cpp
+//
+// Disparity map and comfort flags, see stereo_comfort.h.
+//--------------------------------------------------------------------------------------
+
+#include "stereo_comfort.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEREO_COMFORT_SSE2 1
+#endif
+
+
+static double ClockMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ComfortAnalyzer::Kernel ComfortAnalyzer::MakeKernel(uint32_t width, DepthEncoding encoding, float maxDepth,
+	const ComfortView& view, const ComfortLimits& limits)
+{
+	Kernel kernel;
+	float half = view.displayWidthPx * 0.5f;
+	kernel.a = (view.rightSeparation - view.leftSeparation) * half;
+	kernel.b = (view.leftSeparation * view.leftConvergence - view.rightSeparation * view.rightConvergence) * half;
+	kernel.maxDepth = maxDepth;
+	kernel.uncrossedPx = limits.maxUncrossed * view.displayWidthPx;
+	kernel.crossedPx = limits.maxCrossed * view.displayWidthPx;
+	kernel.edgeTexels = limits.edgeBand * width;
+	kernel.width = width;
+	kernel.encoding = encoding;
+	return kernel;
+}
+
+// The SSE2 path does the same steps in the same order, so both count alike.
+void ComfortAnalyzer::AnalyzeRect(const Kernel& kernel, const uint8_t* texels, size_t rowPitch, uint32_t x0, uint32_t y0,
+	uint32_t x1, uint32_t y1, float* map, ComfortTileStats& stats, bool simd)
+{
+	const float unormScale = kernel.maxDepth / 16777215.0f;
+	const float rightEdge = (float)kernel.width - kernel.edgeTexels;
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	stats.texels = stats.divergent = stats.crossed = stats.window = 0;
+	stats.minDisparity = std::numeric_limits<float>::infinity();
+	stats.maxDisparity = -std::numeric_limits<float>::infinity();
+	stats.sumDisparity = 0.0;
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		const uint32_t* row = reinterpret_cast<const uint32_t*>(texels + y * rowPitch);
+		float* mapRow = map ? map + (size_t)y * kernel.width : nullptr;
+		float rowSum = 0.0f;
+		uint32_t x = x0;
+
+#ifdef STEREO_COMFORT_SSE2
+		if (simd)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 a = _mm_set1_ps(kernel.a);
+			const __m128 b = _mm_set1_ps(kernel.b);
+			const __m128 maxDepth = _mm_set1_ps(kernel.maxDepth);
+			const __m128 vUnormScale = _mm_set1_ps(unormScale);
+			const __m128i unormMask = _mm_set1_epi32(0xffffff);
+			const __m128 uncrossed = _mm_set1_ps(kernel.uncrossedPx);
+			const __m128 crossed = _mm_set1_ps(-kernel.crossedPx);
+			const __m128 leftEdge = _mm_set1_ps(kernel.edgeTexels);
+			const __m128 vRightEdge = _mm_set1_ps(rightEdge);
+			const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+			const __m128 vNan = _mm_set1_ps(nan);
+			__m128 minD = _mm_set1_ps(stats.minDisparity);
+			__m128 maxD = _mm_set1_ps(stats.maxDisparity);
+			__m128 sum = zero;
+			__m128i texelCount = _mm_setzero_si128();
+			__m128i divergentCount = _mm_setzero_si128();
+			__m128i crossedCount = _mm_setzero_si128();
+			__m128i windowCount = _mm_setzero_si128();
+
+			for (; x + 4 <= x1; x += 4)
+			{
+				__m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+				__m128 w = (kernel.encoding == DepthEncoding_Float) ? _mm_castsi128_ps(packed) :
+					_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(packed, unormMask)), vUnormScale);
+
+				__m128 valid = _mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_cmplt_ps(w, maxDepth));
+				__m128 safeW = _mm_or_ps(_mm_and_ps(valid, w), _mm_andnot_ps(valid, one));
+				__m128 d = _mm_add_ps(a, _mm_mul_ps(b, _mm_div_ps(one, safeW)));
+
+				__m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+				__m128 edge = _mm_or_ps(_mm_cmplt_ps(xs, leftEdge), _mm_cmpge_ps(xs, vRightEdge));
+
+				texelCount = _mm_sub_epi32(texelCount, _mm_castps_si128(valid));
+				divergentCount = _mm_sub_epi32(divergentCount, _mm_castps_si128(_mm_and_ps(valid, _mm_cmpgt_ps(d, uncrossed))));
+				crossedCount = _mm_sub_epi32(crossedCount, _mm_castps_si128(_mm_and_ps(valid, _mm_cmplt_ps(d, crossed))));
+				windowCount = _mm_sub_epi32(windowCount,
+					_mm_castps_si128(_mm_and_ps(valid, _mm_and_ps(edge, _mm_cmplt_ps(d, zero)))));
+
+				__m128 validD = _mm_and_ps(valid, d);
+				minD = _mm_min_ps(minD, _mm_or_ps(validD, _mm_andnot_ps(valid, minD)));
+				maxD = _mm_max_ps(maxD, _mm_or_ps(validD, _mm_andnot_ps(valid, maxD)));
+				sum = _mm_add_ps(sum, validD);
+				if (mapRow)
+					_mm_storeu_ps(mapRow + x, _mm_or_ps(validD, _mm_andnot_ps(valid, vNan)));
+			}
+
+			float lane[4];
+			uint32_t count[4];
+			_mm_storeu_ps(lane, minD);
+			stats.minDisparity = std::min(std::min(lane[0], lane[1]), std::min(lane[2], lane[3]));
+			_mm_storeu_ps(lane, maxD);
+			stats.maxDisparity = std::max(std::max(lane[0], lane[1]), std::max(lane[2], lane[3]));
+			_mm_storeu_ps(lane, sum);
+			rowSum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(count), texelCount);
+			stats.texels += count[0] + count[1] + count[2] + count[3];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(count), divergentCount);
+			stats.divergent += count[0] + count[1] + count[2] + count[3];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(count), crossedCount);
+			stats.crossed += count[0] + count[1] + count[2] + count[3];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(count), windowCount);
+			stats.window += count[0] + count[1] + count[2] + count[3];
+		}
+#endif
+
+		for (; x < x1; x++)
+		{
+			float w;
+			if (kernel.encoding == DepthEncoding_Float)
+				memcpy(&w, &row[x], sizeof(w));
+			else
+				w = (float)(int32_t)(row[x] & 0xffffff) * unormScale;
+
+			if (!(w > 0.0f && w < kernel.maxDepth))
+			{
+				if (mapRow)
+					mapRow[x] = nan;
+				continue;
+			}
+
+			float d = kernel.a + kernel.b * (1.0f / w);
+			float fx = (float)x;
+			stats.texels++;
+			stats.divergent += (d > kernel.uncrossedPx) ? 1 : 0;
+			stats.crossed += (d < -kernel.crossedPx) ? 1 : 0;
+			stats.window += (d < 0.0f && (fx < kernel.edgeTexels || fx >= rightEdge)) ? 1 : 0;
+			stats.minDisparity = std::min(stats.minDisparity, d);
+			stats.maxDisparity = std::max(stats.maxDisparity, d);
+			rowSum += d;
+			if (mapRow)
+				mapRow[x] = d;
+		}
+		stats.sumDisparity += rowSum;
+	}
+}
+
+
+ComfortAnalyzer::ComfortAnalyzer(uint32_t threads, bool keepMap)
+	: m_keepMap(keepMap), m_report(), m_tilesX(0), m_tilesY(0), m_kernel(), m_texels(nullptr), m_rowPitch(0),
+	m_width(0), m_height(0), m_startMs(0.0), m_endMs(0.0), m_nextTile(0), m_generation(0), m_running(0), m_quit(false)
+{
+	threads = threads < 1 ? 1 : threads;
+	for (uint32_t i = 0; i < threads; i++)
+		m_threads.push_back(std::thread(&ComfortAnalyzer::Worker, this));
+}
+
+ComfortAnalyzer::~ComfortAnalyzer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+void ComfortAnalyzer::Start(const void* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding,
+	float maxDepth, const ComfortView& view, const ComfortLimits& limits)
+{
+	Wait();
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	uint32_t tilesX = (width + TileSize - 1) / TileSize;
+	uint32_t tilesY = (height + TileSize - 1) / TileSize;
+	if (tilesX != m_tilesX || tilesY != m_tilesY)
+	{
+		// A new size, nothing to compare the means with.
+		m_tilesX = tilesX;
+		m_tilesY = tilesY;
+		m_tileMeans.assign(tilesX * tilesY, std::numeric_limits<float>::quiet_NaN());
+	}
+	m_tiles.resize(tilesX * tilesY);
+	m_tileFlags.resize(tilesX * tilesY);
+	if (m_keepMap)
+		m_map.resize((size_t)width * height);
+
+	m_kernel = MakeKernel(width, encoding, maxDepth, view, limits);
+	m_limits = limits;
+	m_limits.maxJump *= view.displayWidthPx;
+	m_texels = static_cast<const uint8_t*>(texels);
+	m_rowPitch = rowPitch;
+	m_width = width;
+	m_height = height;
+	m_startMs = ClockMs();
+	m_nextTile.store(0);
+	m_running = (uint32_t)m_threads.size();
+	m_generation++;
+	m_wake.notify_all();
+}
+
+bool ComfortAnalyzer::Busy() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_running != 0;
+}
+
+void ComfortAnalyzer::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_done.wait(lock, [this] { return m_running == 0; });
+	if (!m_texels)
+		return;
+
+	ComfortReport& report = m_report;
+	report = ComfortReport();
+	report.minDisparityPx = std::numeric_limits<float>::infinity();
+	report.maxDisparityPx = -std::numeric_limits<float>::infinity();
+	report.tiles = (uint32_t)m_tiles.size();
+	double sum = 0.0;
+
+	for (size_t t = 0; t < m_tiles.size(); t++)
+	{
+		const ComfortTileStats& tile = m_tiles[t];
+		report.texels += tile.texels;
+		report.divergent += tile.divergent;
+		report.crossed += tile.crossed;
+		report.window += tile.window;
+		sum += tile.sumDisparity;
+		if (tile.texels)
+		{
+			report.minDisparityPx = std::min(report.minDisparityPx, tile.minDisparity);
+			report.maxDisparityPx = std::max(report.maxDisparityPx, tile.maxDisparity);
+		}
+
+		uint8_t flags = 0;
+		flags |= (tile.divergent >= m_limits.minTexels) ? Comfort_Divergence : 0;
+		flags |= (tile.crossed >= m_limits.minTexels) ? Comfort_Crossed : 0;
+		flags |= (tile.window >= m_limits.minTexels) ? Comfort_Window : 0;
+
+		float mean = (tile.texels >= m_limits.minTexels) ? (float)(tile.sumDisparity / tile.texels) :
+			std::numeric_limits<float>::quiet_NaN();
+		if (fabsf(mean - m_tileMeans[t]) > m_limits.maxJump)
+		{
+			flags |= Comfort_Jump;
+			report.jumpTiles++;
+		}
+		m_tileMeans[t] = mean;
+
+		m_tileFlags[t] = flags;
+		report.flaggedTiles += flags ? 1 : 0;
+		report.flags |= flags;
+	}
+
+	report.background = (uint64_t)m_width * m_height - report.texels;
+	report.meanDisparityPx = report.texels ? sum / report.texels : 0.0;
+	if (!report.texels)
+		report.minDisparityPx = report.maxDisparityPx = 0.0f;
+	report.ms = m_endMs - m_startMs;
+	m_texels = nullptr;
+}
+
+void ComfortAnalyzer::RunTiles()
+{
+	uint32_t tiles = m_tilesX * m_tilesY;
+	for (uint32_t t = m_nextTile.fetch_add(1); t < tiles; t = m_nextTile.fetch_add(1))
+	{
+		uint32_t x0 = (t % m_tilesX) * TileSize;
+		uint32_t y0 = (t / m_tilesX) * TileSize;
+		uint32_t x1 = std::min(x0 + TileSize, m_width);
+		uint32_t y1 = std::min(y0 + TileSize, m_height);
+		AnalyzeRect(m_kernel, m_texels, m_rowPitch, x0, y0, x1, y1, m_keepMap ? m_map.data() : nullptr, m_tiles[t], true);
+	}
+}
+
+void ComfortAnalyzer::Worker()
+{
+	uint64_t seen = 0;
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+		if (m_quit)
+			return;
+		seen = m_generation;
+		lock.unlock();
+
+		// The job does not change until every worker is done with it.
+		RunTiles();
+
+		lock.lock();
+		if (--m_running == 0)
+		{
+			m_endMs = ClockMs();
+			m_done.notify_all();
+		}
+	}
+}
@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_comfort.h
+//
+// Screen disparity of every texel of the mono slice, and where it breaks the limits
+// of comfortable viewing.
+//
+// The GS moves a vertex in clip space by sep * (w - conv) for each eye, as in
+// GetStereoPos, so on screen a point at depth w is moved by sep * (1 - conv / w)
+// * width / 2 pixels.  The disparity is the right eye's shift less the left eye's,
+//	d(w) = A + B / w,	A = (sepR - sepL) * width / 2,	B = (sepL * convL - sepR * convR) * width / 2
+// which is 0 at the convergence, positive (uncrossed) behind the screen and negative
+// (crossed) in front of it.  The texels are packed depth as for DepthHistogram, the
+// background is left out.
+//
+// What is flagged, each by tile:
+//	- divergence, uncrossed disparity past the interocular on screen, so the eyes
+//	  would have to turn outwards
+//	- crossed disparity beyond the comfortable amount in front of the screen
+//	- window violations, anything in front of the screen at the left or right edge,
+//	  where the frame cuts it off but should be behind it
+//	- depth jumps, a tile whose mean disparity moved further than the limit since
+//	  the previous analysis
+// A tile is only flagged for a kind with at least minTexels of it, so a few noisy
+// texels do not count.
+//
+// The kernel works four texels at a time with SSE2.  The frame is cut into tiles,
+// which persistent workers take in turn, and the tile results are added up in Wait.
+// Start returns at once, and the texels have to stay where they are until Wait.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "depth_histogram.h"
+
+#include <atomic>
+
+enum ComfortFlag
+{
+	Comfort_Divergence = 1 << 0,
+	Comfort_Crossed = 1 << 1,
+	Comfort_Window = 1 << 2,
+	Comfort_Jump = 1 << 3,
+};
+
+// StereoParamsArray[0].xy and [1].xy, as the frame drew with them.
+struct ComfortView
+{
+	float leftSeparation;
+	float leftConvergence;
+	float rightSeparation;
+	float rightConvergence;
+	float displayWidthPx;		// of an eye as shown, the disparity is in these pixels
+};
+
+// All of them as a fraction of the display width.
+struct ComfortLimits
+{
+	float maxUncrossed = 0.03f;		// the interocular on screen, past it the eyes diverge
+	float maxCrossed = 0.02f;
+	float edgeBand = 0.03f;			// at each side, for window violations
+	float maxJump = 0.01f;			// of a tile's mean disparity, between analyses
+	uint32_t minTexels = 32;		// of a kind in a tile, to flag it
+};
+
+struct ComfortReport
+{
+	uint64_t texels;			// with depth
+	uint64_t background;
+	float minDisparityPx;		// most crossed
+	float maxDisparityPx;		// most uncrossed
+	double meanDisparityPx;
+	uint64_t divergent;			// texels of each kind, flagged tiles or not
+	uint64_t crossed;
+	uint64_t window;
+	uint32_t tiles;
+	uint32_t flaggedTiles;
+	uint32_t jumpTiles;
+	uint32_t flags;				// ComfortFlag, of every flagged tile
+	double ms;					// from Start until the last tile was done
+};
+
+// One tile, or a row of four texels' worth of it.
+struct ComfortTileStats
+{
+	uint32_t texels;
+	uint32_t divergent;
+	uint32_t crossed;
+	uint32_t window;
+	float minDisparity;
+	float maxDisparity;
+	double sumDisparity;
+};
+
+class ComfortAnalyzer
+{
+public:
+	static const uint32_t TileSize = 64;
+
+	// keepMap fills Map with the disparity of every texel.
+	ComfortAnalyzer(uint32_t threads, bool keepMap);
+	~ComfortAnalyzer();
+
+	void Start(const void* texels, size_t rowPitch, uint32_t width, uint32_t height, DepthEncoding encoding, float maxDepth,
+		const ComfortView& view, const ComfortLimits& limits);
+	bool Busy() const;
+	void Wait();
+
+	// After Wait.
+	const ComfortReport& Report() const { return m_report; }
+	const std::vector<uint8_t>& TileFlags() const { return m_tileFlags; }	// ComfortFlag, row by row
+	uint32_t TilesX() const { return m_tilesX; }
+	uint32_t TilesY() const { return m_tilesY; }
+	const std::vector<float>& Map() const { return m_map; }	// width * height, NaN for the background
+
+	// The kernel on its own, over a rectangle.  The map may be null.  simd false is
+	// the plain C++ one, for comparison.
+	struct Kernel
+	{
+		float a, b;					// d = a + b / w
+		float maxDepth;
+		float uncrossedPx, crossedPx;
+		float edgeTexels;			// the band at each side, in texels
+		uint32_t width;				// of the whole frame, for the right edge
+		DepthEncoding encoding;
+	};
+	static Kernel MakeKernel(uint32_t width, DepthEncoding encoding, float maxDepth, const ComfortView& view,
+		const ComfortLimits& limits);
+	static void AnalyzeRect(const Kernel& kernel, const uint8_t* texels, size_t rowPitch, uint32_t x0, uint32_t y0,
+		uint32_t x1, uint32_t y1, float* map, ComfortTileStats& stats, bool simd);
+
+private:
+	ComfortAnalyzer(const ComfortAnalyzer&);
+	ComfortAnalyzer& operator=(const ComfortAnalyzer&);
+
+	void Worker();
+	void RunTiles();
+
+	bool m_keepMap;
+	ComfortReport m_report;
+	std::vector<uint8_t> m_tileFlags;
+	std::vector<ComfortTileStats> m_tiles;
+	std::vector<float> m_tileMeans;		// of the previous analysis, NaN where too empty
+	std::vector<float> m_map;
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+
+	// The job, set by Start.
+	Kernel m_kernel;
+	ComfortLimits m_limits;
+	const uint8_t* m_texels;
+	size_t m_rowPitch;
+	uint32_t m_width;
+	uint32_t m_height;
+	double m_startMs;
+	double m_endMs;
+	std::atomic<uint32_t> m_nextTile;
+
+	std::vector<std::thread> m_threads;
+	mutable std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint64_t m_generation;
+	uint32_t m_running;
+	bool m_quit;
+};
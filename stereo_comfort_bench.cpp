@@ -0,0 +1,220 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_comfort_bench.cpp
+//
+// Offline check/benchmark of the comfort analysis, see stereo_comfort.h.
+//
+// It makes a 1920x1080 mono slice of packed depth, as depth_histogram_bench.cpp does,
+// in both encodings, seen with eyes set so that every kind of flag turns up, and runs
+// every tile through the SSE2 kernel and the plain C++ one.  It fails when they do
+// not count the same texels of each kind, or their disparities differ.  Then it
+// times both kernels on one thread, and the analyzer on a whole frame on one thread
+// and on the workers, best of the runs.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread stereo_comfort_bench.cpp stereo_comfort.cpp -o stereo_comfort_bench
+//	./stereo_comfort_bench [--threads N] [--runs N]
+//--------------------------------------------------------------------------------------
+
+#include "stereo_comfort.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+
+static const uint32_t				s_Width = 1920;
+static const uint32_t				s_Height = 1080;
+static const float					s_DepthFar = 100.0f;		// DEPTH_FAR in Tutorial07.fx
+
+// The eyes at -sep and sep, converged at 4, so the disparity is crossed nearer than
+// 4, past the crossed limit nearer than about 2.5, and divergent beyond about 28.
+static const ComfortView			s_View = { -0.035f, 4.0f, 0.035f, 4.0f, (float)s_Width };
+
+static uint32_t PackDepth(float depth, DepthEncoding encoding)
+{
+	uint32_t packed;
+	if (encoding == DepthEncoding_Float)
+	{
+		memcpy(&packed, &depth, sizeof(packed));
+		return packed;
+	}
+	float unorm = depth / s_DepthFar;
+	unorm = unorm < 0.0f ? 0.0f : (unorm > 1.0f ? 1.0f : unorm);
+	return (uint32_t)(unorm * 16777215.0f + 0.5f) | 0xff000000u;
+}
+
+static void MakeFrame(std::vector<uint32_t>& texels, DepthEncoding encoding)
+{
+	uint32_t clear = PackDepth(encoding == DepthEncoding_Float ? FLT_MAX : s_DepthFar, encoding);
+	uint32_t seed = 12345;
+	texels.resize(s_Width * s_Height);
+	for (uint32_t y = 0; y < s_Height; y++)
+	{
+		for (uint32_t x = 0; x < s_Width; x++)
+		{
+			// Blocks of the same depth with noise over them, and a few near ones.
+			seed = seed * 1664525u + 1013904223u;
+			uint32_t block = ((x / 48) * 7919u + (y / 48) * 104729u) % 97u;
+			float depth = (block < 12 ? 0.5f + block * 0.25f : 1.0f + block * 0.35f) + (seed >> 8) * (1.0f / 16777216.0f);
+			texels[y * s_Width + x] = (block >= 12 && block < 32) ? clear : PackDepth(depth, encoding);
+		}
+	}
+}
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool Near(double a, double b, double tolerance)
+{
+	return fabs(a - b) <= tolerance * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+// Every tile both ways, with the maps.  Returns the tiles that differ.
+static uint32_t Compare(const ComfortAnalyzer::Kernel& kernel, const uint8_t* frame, size_t rowPitch, ComfortTileStats& total)
+{
+	const uint32_t tile = ComfortAnalyzer::TileSize;
+	std::vector<float> simdMap(s_Width * s_Height), plainMap(s_Width * s_Height);
+	uint32_t different = 0;
+	total = ComfortTileStats();
+	for (uint32_t y0 = 0; y0 < s_Height; y0 += tile)
+	{
+		for (uint32_t x0 = 0; x0 < s_Width; x0 += tile)
+		{
+			uint32_t x1 = std::min(x0 + tile, s_Width);
+			uint32_t y1 = std::min(y0 + tile, s_Height);
+			ComfortTileStats simd, plain;
+			ComfortAnalyzer::AnalyzeRect(kernel, frame, rowPitch, x0, y0, x1, y1, simdMap.data(), simd, true);
+			ComfortAnalyzer::AnalyzeRect(kernel, frame, rowPitch, x0, y0, x1, y1, plainMap.data(), plain, false);
+
+			bool same = simd.texels == plain.texels && simd.divergent == plain.divergent && simd.crossed == plain.crossed &&
+				simd.window == plain.window && (plain.texels == 0 || (Near(simd.minDisparity, plain.minDisparity, 1e-5) &&
+				Near(simd.maxDisparity, plain.maxDisparity, 1e-5) && Near(simd.sumDisparity, plain.sumDisparity, 1e-4)));
+			different += same ? 0 : 1;
+
+			total.texels += plain.texels;
+			total.divergent += plain.divergent;
+			total.crossed += plain.crossed;
+			total.window += plain.window;
+		}
+	}
+
+	uint32_t mapDifferent = 0;
+	for (size_t i = 0; i < simdMap.size(); i++)
+	{
+		bool bothNan = simdMap[i] != simdMap[i] && plainMap[i] != plainMap[i];
+		mapDifferent += (bothNan || Near(simdMap[i], plainMap[i], 1e-5)) ? 0 : 1;
+	}
+	if (mapDifferent)
+		printf("  %u texels of the map differ\n", mapDifferent);
+	return different + (mapDifferent ? 1 : 0);
+}
+
+// The kernel alone over every tile on this thread, best of the runs.
+static double TimeKernel(const ComfortAnalyzer::Kernel& kernel, const uint8_t* frame, size_t rowPitch, bool simd, uint32_t runs)
+{
+	const uint32_t tile = ComfortAnalyzer::TileSize;
+	double best = 0.0;
+	for (uint32_t r = 0; r < runs; r++)
+	{
+		double start = NowMs();
+		for (uint32_t y0 = 0; y0 < s_Height; y0 += tile)
+		{
+			for (uint32_t x0 = 0; x0 < s_Width; x0 += tile)
+			{
+				ComfortTileStats stats;
+				ComfortAnalyzer::AnalyzeRect(kernel, frame, rowPitch, x0, y0, std::min(x0 + tile, s_Width),
+					std::min(y0 + tile, s_Height), nullptr, stats, simd);
+			}
+		}
+		double ms = NowMs() - start;
+		best = (r == 0 || ms < best) ? ms : best;
+	}
+	return best;
+}
+
+// Best of the runs, as the workers may be held up by whatever else runs.
+static double TimeAnalyzer(uint32_t threads, uint32_t runs, const uint8_t* frame, size_t rowPitch, DepthEncoding encoding,
+	ComfortReport& report)
+{
+	ComfortAnalyzer analyzer(threads, false);
+	ComfortLimits limits;
+	double best = 0.0;
+	for (uint32_t r = 0; r < runs; r++)
+	{
+		double start = NowMs();
+		analyzer.Start(frame, rowPitch, s_Width, s_Height, encoding, s_DepthFar, s_View, limits);
+		analyzer.Wait();
+		double ms = NowMs() - start;
+		best = (r == 0 || ms < best) ? ms : best;
+	}
+	report = analyzer.Report();
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t threads = 2;
+	uint32_t runs = 50;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || threads == 0 || runs == 0)
+	{
+		fprintf(stderr, "usage: %s [--threads N] [--runs N]\n", argv[0]);
+		return 2;
+	}
+
+	const size_t rowPitch = s_Width * sizeof(uint32_t);
+	const ComfortLimits limits;
+	bool ok = true;
+	std::vector<uint32_t> texels;
+
+	for (int e = 0; e < 2; e++)
+	{
+		DepthEncoding encoding = e ? DepthEncoding_Unorm24 : DepthEncoding_Float;
+		MakeFrame(texels, encoding);
+		const uint8_t* frame = reinterpret_cast<const uint8_t*>(texels.data());
+		printf("%s, %ux%u:\n", e ? "unorm24" : "float", s_Width, s_Height);
+
+		// Every kind has to turn up, or the counts would agree on nothing.
+		ComfortTileStats total;
+		ComfortAnalyzer::Kernel kernel = ComfortAnalyzer::MakeKernel(s_Width, encoding, s_DepthFar, s_View, limits);
+		uint32_t different = Compare(kernel, frame, rowPitch, total);
+		bool good = different == 0 && total.divergent && total.crossed && total.window;
+		printf("  sse2 against plain C++: %u texels, %u divergent, %u crossed, %u window%s\n", total.texels, total.divergent,
+			total.crossed, total.window, good ? "" : different ? ", DIFFERENT" : ", FAILED");
+		ok = ok && good;
+
+		double plainMs = TimeKernel(kernel, frame, rowPitch, false, runs);
+		double simdMs = TimeKernel(kernel, frame, rowPitch, true, runs);
+		printf("  kernel on 1 thread: plain C++ %.3fms, sse2 %.3fms, %.1fx\n", plainMs, simdMs, plainMs / simdMs);
+
+		for (int w = 0; w < 2; w++)
+		{
+			uint32_t n = w ? threads : 1;
+			ComfortReport report;
+			double ms = TimeAnalyzer(n, runs, frame, rowPitch, encoding, report);
+			bool same = report.texels == total.texels && report.divergent == total.divergent &&
+				report.crossed == total.crossed && report.window == total.window;
+			printf("  %u thread%s %7.3fms, %u of %u tiles flagged%s\n", n, n == 1 ? ": " : "s:", ms, report.flaggedTiles,
+				report.tiles, same ? "" : ", DIFFERENT");
+			ok = ok && same;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_compose.cpp
+//
+// Stereo output formats, see stereo_compose.h.
+//--------------------------------------------------------------------------------------
+
+#include "stereo_compose.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEREO_COMPOSE_SSE2 1
+#endif
+
+
+// Dubois' red-cyan matrices, rounded to 1/1024ths.
+const int32_t g_DuboisLeft[3][3] =
+{
+	{ 467, 512, 180 },
+	{ -41, -39, -16 },
+	{ -15, -22, -5 },
+};
+
+const int32_t g_DuboisRight[3][3] =
+{
+	{ -44, -90, -2 },
+	{ 387, 752, -18 },
+	{ -74, -116, 1255 },
+};
+
+const char* StereoFormatName(StereoFormat format)
+{
+	static const char* names[StereoFormat_Count] =
+	{
+		"side by side", "half side by side", "top and bottom", "row interleaved", "checkerboard", "anaglyph"
+	};
+	return (unsigned)format < StereoFormat_Count ? names[format] : "unknown";
+}
+
+void StereoOutputSize(StereoFormat format, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t* width, uint32_t* height)
+{
+	*width = (format == StereoFormat_SideBySide) ? eyeWidth * 2 : eyeWidth;
+	*height = eyeHeight;
+}
+
+
+//--------------------------------------------------------------------------------------
+// One row of each format.  The texels are 4 bytes, x and width count texels.
+//--------------------------------------------------------------------------------------
+static inline uint32_t Average(uint32_t a, uint32_t b)
+{
+	// Per byte (a + b + 1) >> 1, as _mm_avg_epu8, without carries between bytes.
+	return (a | b) - (((a ^ b) >> 1) & 0x7f7f7f7fu);
+}
+
+// Half width, out[x] from eye texels 2x and 2x + 1, for count texels.
+static void SqueezeRow(const uint32_t* eye, uint32_t eyeWidth, uint32_t* out, uint32_t count, bool simd)
+{
+	uint32_t x = 0;
+#ifdef STEREO_COMPOSE_SSE2
+	if (simd)
+	{
+		// Four out of eight in, as long as all eight are inside the row.
+		for (; 2 * x + 8 <= eyeWidth && x + 4 <= count; x += 4)
+		{
+			__m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(eye + 2 * x)));
+			__m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(eye + 2 * x + 4)));
+			__m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_avg_epu8(even, odd));
+		}
+	}
+#endif
+	for (; x < count; x++)
+	{
+		uint32_t sx = 2 * x;
+		uint32_t next = sx + 1 < eyeWidth ? sx + 1 : eyeWidth - 1;
+		out[x] = Average(eye[sx], eye[next]);
+	}
+}
+
+// Half height, the average of two whole rows.
+static void AverageRows(const uint32_t* a, const uint32_t* b, uint32_t width, uint32_t* out, bool simd)
+{
+	uint32_t x = 0;
+#ifdef STEREO_COMPOSE_SSE2
+	if (simd)
+	{
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_avg_epu8(va, vb));
+		}
+	}
+#endif
+	for (; x < width; x++)
+		out[x] = Average(a[x], b[x]);
+}
+
+// The right eye where x + y is odd.
+static void CheckerRow(const uint32_t* left, const uint32_t* right, uint32_t width, uint32_t y, uint32_t* out, bool simd)
+{
+	uint32_t x = 0;
+#ifdef STEREO_COMPOSE_SSE2
+	if (simd)
+	{
+		const __m128i mask = (y & 1) ? _mm_set_epi32(0, -1, 0, -1) : _mm_set_epi32(-1, 0, -1, 0);
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + x));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(_mm_and_si128(mask, r), _mm_andnot_si128(mask, l)));
+		}
+	}
+#endif
+	for (; x < width; x++)
+		out[x] = ((x + y) & 1) ? right[x] : left[x];
+}
+
+static inline int32_t DuboisChannel(int32_t sum)
+{
+	int32_t v = sum + 512;
+	v = v < 0 ? 0 : v >> 10;
+	return v > 255 ? 255 : v;
+}
+
+#ifdef STEREO_COMPOSE_SSE2
+// Two 16 bit coefficients in a 32 bit lane, for _mm_madd_epi16 against a pair of
+// channels in the same lane.
+static inline __m128i CoefficientPair(int32_t low, int32_t high)
+{
+	return _mm_set1_epi32((int)(((uint32_t)(uint16_t)high << 16) | (uint16_t)low));
+}
+#endif
+
+static void AnaglyphRow(const uint32_t* left, const uint32_t* right, uint32_t width, uint32_t* out, bool simd)
+{
+	uint32_t x = 0;
+#ifdef STEREO_COMPOSE_SSE2
+	if (simd)
+	{
+		// Each texel's channels go in pairs into the 16 bit halves of its lane,
+		// (rL, gL), (bL, rR) and (gR, bR), so three madds give an output channel.
+		__m128i k[3][3];
+		for (int c = 0; c < 3; c++)
+		{
+			k[c][0] = CoefficientPair(g_DuboisLeft[c][0], g_DuboisLeft[c][1]);
+			k[c][1] = CoefficientPair(g_DuboisLeft[c][2], g_DuboisRight[c][0]);
+			k[c][2] = CoefficientPair(g_DuboisRight[c][1], g_DuboisRight[c][2]);
+		}
+		const __m128i byte0 = _mm_set1_epi32(0xff);
+		const __m128i byte2 = _mm_set1_epi32(0xff0000);
+		const __m128i round = _mm_set1_epi32(512);
+		const __m128i alpha = _mm_set1_epi16(255);
+
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + x));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + x));
+			__m128i pair[3];
+			pair[0] = _mm_or_si128(_mm_and_si128(l, byte0), _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(l, 8), byte0), 16));
+			pair[1] = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(l, 16), byte0), _mm_slli_epi32(_mm_and_si128(r, byte0), 16));
+			pair[2] = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(r, 8), byte0), _mm_and_si128(r, byte2));
+
+			__m128i channel[3];
+			for (int c = 0; c < 3; c++)
+			{
+				__m128i sum = _mm_add_epi32(_mm_madd_epi16(pair[0], k[c][0]),
+					_mm_add_epi32(_mm_madd_epi16(pair[1], k[c][1]), _mm_madd_epi16(pair[2], k[c][2])));
+				channel[c] = _mm_srai_epi32(_mm_add_epi32(sum, round), 10);
+			}
+
+			// rg = r0..r3 g0..g3, ba = b0..b3 255.., then texel by texel, and the
+			// unsigned pack clamps to 0..255.
+			__m128i rg = _mm_packs_epi32(channel[0], channel[1]);
+			__m128i ba = _mm_unpacklo_epi64(_mm_packs_epi32(channel[2], channel[2]), alpha);
+			__m128i rgrg = _mm_unpacklo_epi16(rg, _mm_srli_si128(rg, 8));
+			__m128i baba = _mm_unpacklo_epi16(ba, _mm_srli_si128(ba, 8));
+			__m128i texels = _mm_packus_epi16(_mm_unpacklo_epi32(rgrg, baba), _mm_unpackhi_epi32(rgrg, baba));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), texels);
+		}
+	}
+#endif
+	for (; x < width; x++)
+	{
+		int32_t l[3] = { (int32_t)(left[x] & 255), (int32_t)((left[x] >> 8) & 255), (int32_t)((left[x] >> 16) & 255) };
+		int32_t r[3] = { (int32_t)(right[x] & 255), (int32_t)((right[x] >> 8) & 255), (int32_t)((right[x] >> 16) & 255) };
+		uint32_t texel = 0xff000000u;
+		for (int c = 0; c < 3; c++)
+		{
+			int32_t sum = 0;
+			for (int i = 0; i < 3; i++)
+				sum += g_DuboisLeft[c][i] * l[i] + g_DuboisRight[c][i] * r[i];
+			texel |= (uint32_t)DuboisChannel(sum) << (8 * c);
+		}
+		out[x] = texel;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// The whole frame.
+//--------------------------------------------------------------------------------------
+void ComposeStereo(StereoFormat format, const uint8_t* left, const uint8_t* right, size_t eyePitch, uint32_t eyeWidth,
+	uint32_t eyeHeight, uint8_t* out, size_t outPitch, bool simd)
+{
+	const size_t rowBytes = eyeWidth * sizeof(uint32_t);
+	const uint32_t halfWidth = eyeWidth / 2;
+	const uint32_t halfHeight = eyeHeight / 2;
+
+	for (uint32_t y = 0; y < eyeHeight; y++)
+	{
+		const uint32_t* l = reinterpret_cast<const uint32_t*>(left + y * eyePitch);
+		const uint32_t* r = reinterpret_cast<const uint32_t*>(right + y * eyePitch);
+		uint32_t* o = reinterpret_cast<uint32_t*>(out + y * outPitch);
+
+		switch (format)
+		{
+		case StereoFormat_SideBySide:
+			memcpy(o, l, rowBytes);
+			memcpy(o + eyeWidth, r, rowBytes);
+			break;
+
+		case StereoFormat_HalfSideBySide:
+			// With an odd width the right eye gets the extra column.
+			SqueezeRow(l, eyeWidth, o, halfWidth, simd);
+			SqueezeRow(r, eyeWidth, o + halfWidth, eyeWidth - halfWidth, simd);
+			break;
+
+		case StereoFormat_TopBottom:
+		{
+			const uint8_t* eye = (y < halfHeight) ? left : right;
+			uint32_t sy = 2 * (y < halfHeight ? y : y - halfHeight);
+			uint32_t next = sy + 1 < eyeHeight ? sy + 1 : eyeHeight - 1;
+			AverageRows(reinterpret_cast<const uint32_t*>(eye + sy * eyePitch),
+				reinterpret_cast<const uint32_t*>(eye + next * eyePitch), eyeWidth, o, simd);
+			break;
+		}
+
+		case StereoFormat_RowInterleaved:
+			memcpy(o, (y & 1) ? r : l, rowBytes);
+			break;
+
+		case StereoFormat_Checkerboard:
+			CheckerRow(l, r, eyeWidth, y, o, simd);
+			break;
+
+		case StereoFormat_Anaglyph:
+			AnaglyphRow(l, r, eyeWidth, o, simd);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
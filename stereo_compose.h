@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_compose.h
+//
+// Packs the two eye images into one frame, for displays and captures that take
+// stereo in a single image rather than through Direct Mode.
+//
+// The eyes are R8G8B8A8 and the same size, W x H, rows eyePitch bytes apart.  The
+// formats, and the size of what each one puts out:
+//	- side by side, 2W x H, left eye on the left
+//	- half side by side, W x H, each eye squeezed to half width
+//	- top and bottom, W x H, left eye on top, each squeezed to half height
+//	- row interleaved, W x H, even rows from the left eye and odd rows from the
+//	  right, for passive line-polarized monitors
+//	- checkerboard, W x H, the right eye where x + y is odd, for DLP displays
+//	- anaglyph, W x H, red-cyan with Dubois' least squares matrices
+//
+// Everything is integer, so ComposePS in Tutorial07.fx gives the same bytes:
+//	- squeezing averages two neighbouring texels per channel, (a + b + 1) >> 1, the
+//	  second clamped to the last column or row
+//	- the Dubois matrices are in 1/1024ths, each channel is (sum + 512) >> 10,
+//	  clamped to 0..255, and alpha is 255
+//
+// The kernels work 16 bytes at a time with SSE2, with a plain C++ fallback that
+// gives the same bytes.  See stereo_compose_bench.cpp.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Also STEREO_FORMAT_* in Tutorial07.fx.
+enum StereoFormat
+{
+	StereoFormat_SideBySide,
+	StereoFormat_HalfSideBySide,
+	StereoFormat_TopBottom,
+	StereoFormat_RowInterleaved,
+	StereoFormat_Checkerboard,
+	StereoFormat_Anaglyph,
+	StereoFormat_Count
+};
+
+const char* StereoFormatName(StereoFormat format);
+
+// The size of the composed frame, for eyes of eyeWidth x eyeHeight.
+void StereoOutputSize(StereoFormat format, uint32_t eyeWidth, uint32_t eyeHeight, uint32_t* width, uint32_t* height);
+
+// Compose left and right into out, which has to be StereoOutputSize.  simd false is
+// the plain C++ one, for comparison.
+void ComposeStereo(StereoFormat format, const uint8_t* left, const uint8_t* right, size_t eyePitch, uint32_t eyeWidth,
+	uint32_t eyeHeight, uint8_t* out, size_t outPitch, bool simd = true);
+
+// The Dubois red-cyan matrices in 1/1024ths, row by output channel, column by input
+// channel.  Also in ComposePS.
+extern const int32_t g_DuboisLeft[3][3];
+extern const int32_t g_DuboisRight[3][3];
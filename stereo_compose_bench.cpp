@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// File: stereo_compose_bench.cpp
+//
+// Offline benchmark of the stereo output formats, see stereo_compose.h.
+//
+// It makes a pair of 1920x1080 eyes, gradients with noise over them, and times the
+// plain C++ and the SSE2 composer for every format.  The throughput counts both
+// eyes in and the frame out.  Both have to give the same bytes, there and on an
+// odd sized pair, which takes the edge cases.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 stereo_compose_bench.cpp stereo_compose.cpp -o stereo_compose_bench
+//	./stereo_compose_bench [--repeat N] [--size WxH]
+//--------------------------------------------------------------------------------------
+
+#include "stereo_compose.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+
+static void MakeEye(std::vector<uint32_t>& texels, uint32_t width, uint32_t height, uint32_t seed)
+{
+	texels.resize(width * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			uint32_t noise = seed >> 24;
+			uint32_t r = (x * 255 / width + noise / 8) & 255;
+			uint32_t g = (y * 255 / height + noise / 16) & 255;
+			uint32_t b = noise;
+			texels[y * width + x] = r | (g << 8) | (b << 16) | 0xff000000u;
+		}
+	}
+}
+
+static double NowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Compose with both kernels and compare.  Times them when repeat is not 0.
+static bool Run(StereoFormat format, uint32_t width, uint32_t height, uint32_t repeat)
+{
+	std::vector<uint32_t> left, right;
+	MakeEye(left, width, height, 12345);
+	MakeEye(right, width, height, 67890);
+
+	uint32_t outWidth, outHeight;
+	StereoOutputSize(format, width, height, &outWidth, &outHeight);
+	std::vector<uint32_t> frames[2];
+	double ms[2] = { 0.0, 0.0 };
+
+	for (int simd = 0; simd < 2; simd++)
+	{
+		frames[simd].assign(outWidth * outHeight, 0);
+		uint32_t runs = repeat ? repeat : 1;
+		double start = NowMs();
+		for (uint32_t r = 0; r < runs; r++)
+		{
+			ComposeStereo(format, reinterpret_cast<const uint8_t*>(left.data()), reinterpret_cast<const uint8_t*>(right.data()),
+				width * sizeof(uint32_t), width, height, reinterpret_cast<uint8_t*>(frames[simd].data()),
+				outWidth * sizeof(uint32_t), simd != 0);
+		}
+		ms[simd] = (NowMs() - start) / runs;
+	}
+
+	bool same = frames[0] == frames[1];
+	if (repeat)
+	{
+		double bytes = (2.0 * width * height + (double)outWidth * outHeight) * sizeof(uint32_t);
+		printf("  %-18s %4ux%-4u scalar %7.3fms %6.2f GB/s, sse2 %7.3fms %6.2f GB/s%s\n", StereoFormatName(format),
+			outWidth, outHeight, ms[0], bytes / ms[0] / 1e6, ms[1], bytes / ms[1] / 1e6, same ? "" : ", DIFFERENT");
+	}
+	else if (!same)
+	{
+		printf("  %-18s %ux%u: the kernels disagree\n", StereoFormatName(format), width, height);
+	}
+	return same;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t repeat = 50;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+			repeat = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			usage = sscanf(argv[++i], "%ux%u", &width, &height) != 2;
+		else
+			usage = true;
+	}
+	if (usage || repeat == 0 || width < 2 || height < 2)
+	{
+		fprintf(stderr, "usage: %s [--repeat N] [--size WxH]\n", argv[0]);
+		return 2;
+	}
+
+	bool ok = true;
+	printf("eyes %ux%u:\n", width, height);
+	for (int format = 0; format < StereoFormat_Count; format++)
+	{
+		ok = Run((StereoFormat)format, width, height, repeat) && ok;
+		ok = Run((StereoFormat)format, 37, 23, 0) && ok;
+	}
+
+	if (!ok)
+	{
+		fprintf(stderr, "the kernels disagree\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,195 @@
+//--------------------------------------------------------------------------------------
+// File: task_graph.cpp
+//
+// Startup task graph executor, see task_graph.h.
+//--------------------------------------------------------------------------------------
+
+#include "task_graph.h"
+#include "chrome_trace.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+static double TaskClockMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int TaskGraph::Add(const char* name, std::function<bool()> run, std::initializer_list<int> dependencies, bool mainThread)
+{
+	int index = (int)m_tasks.size();
+
+	Task task = {};
+	task.name = name;
+	task.run = std::move(run);
+	task.mainThread = mainThread;
+	task.state = Task_Waiting;
+	for (int dependency : dependencies)
+	{
+		assert(dependency >= 0 && dependency < index);
+		m_tasks[dependency].dependents.push_back(index);
+		task.dependencies++;
+	}
+	m_tasks.push_back(std::move(task));
+
+	return index;
+}
+
+//--------------------------------------------------------------------------------------
+// One lock covers the queues and the task states.  A task holds it only to pick up
+// work and to hand on to its dependents, never while it runs.
+//--------------------------------------------------------------------------------------
+struct TaskGraphRun
+{
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<int> mainReady;
+	std::deque<int> anyReady;
+	size_t finished = 0;
+};
+
+bool TaskGraph::Run(uint32_t workerCount, ChromeTrace* trace, const char* category)
+{
+	TaskGraphRun run;
+
+	for (size_t i = 0; i < m_tasks.size(); i++)
+	{
+		Task& task = m_tasks[i];
+		task.state = Task_Waiting;
+		task.waitingOn = task.dependencies;
+		task.thread = 0;
+		task.startMs = task.endMs = 0.0;
+		if (task.waitingOn == 0)
+			(task.mainThread ? run.mainReady : run.anyReady).push_back((int)i);
+	}
+
+	// Called with the lock held.  A failed or skipped task skips what waits on it,
+	// but only once the dependents' other inputs are finished too, so that the
+	// count of finished tasks still reaches the total.
+	std::function<void(int, bool)> finish = [&](int index, bool ok)
+	{
+		run.finished++;
+		for (int dependent : m_tasks[index].dependents)
+		{
+			Task& task = m_tasks[dependent];
+			if (!ok)
+				task.state = Task_Skipped;
+			if (--task.waitingOn != 0)
+				continue;
+			if (task.state == Task_Skipped)
+				finish(dependent, false);
+			else
+				(task.mainThread ? run.mainReady : run.anyReady).push_back(dependent);
+		}
+	};
+
+	auto work = [&](uint32_t thread)
+	{
+		std::unique_lock<std::mutex> lock(run.lock);
+		for (;;)
+		{
+			std::deque<int>* queue = nullptr;
+			if (thread == 0 && !run.mainReady.empty())
+				queue = &run.mainReady;
+			else if (!run.anyReady.empty())
+				queue = &run.anyReady;
+
+			if (!queue)
+			{
+				if (run.finished == m_tasks.size())
+					break;
+				run.wake.wait(lock);
+				continue;
+			}
+
+			int index = queue->front();
+			queue->pop_front();
+			Task& task = m_tasks[index];
+			task.state = Task_Running;
+			task.thread = thread;
+			lock.unlock();
+
+			task.startMs = TaskClockMs();
+			bool ok = task.run ? task.run() : true;
+			task.endMs = TaskClockMs();
+			if (trace)
+				trace->Add(task.name, category, thread, task.startMs, task.endMs);
+
+			lock.lock();
+			task.state = ok ? Task_Done : Task_Failed;
+			finish(index, ok);
+			run.wake.notify_all();
+		}
+	};
+
+	if (trace)
+	{
+		trace->NameThread(0, "Main");
+		for (uint32_t i = 1; i <= workerCount; i++)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "Worker %u", i);
+			trace->NameThread(i, name);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i <= workerCount; i++)
+		workers.emplace_back(work, i);
+	work(0);
+	for (auto& worker : workers)
+		worker.join();
+
+	return Failed() < 0;
+}
+
+int TaskGraph::Failed() const
+{
+	for (size_t i = 0; i < m_tasks.size(); i++)
+	{
+		if (m_tasks[i].state == Task_Failed)
+			return (int)i;
+	}
+	return -1;
+}
+
+double TaskGraph::CriticalPath(std::vector<int>* path) const
+{
+	// Tasks come after their dependencies, so one pass in order finds the
+	// longest chain ending at each task.
+	std::vector<double> length(m_tasks.size(), 0.0);
+	std::vector<int> previous(m_tasks.size(), -1);
+	int last = -1;
+
+	for (size_t i = 0; i < m_tasks.size(); i++)
+	{
+		const Task& task = m_tasks[i];
+		double ms = (task.state == Task_Done || task.state == Task_Failed) ? task.endMs - task.startMs : 0.0;
+		length[i] += ms;
+		if (last < 0 || length[i] > length[last])
+			last = (int)i;
+		for (int dependent : task.dependents)
+		{
+			if (length[i] > length[dependent])
+			{
+				length[dependent] = length[i];
+				previous[dependent] = (int)i;
+			}
+		}
+	}
+
+	if (path)
+	{
+		path->clear();
+		for (int i = last; i >= 0; i = previous[i])
+			path->insert(path->begin(), i);
+	}
+	return last < 0 ? 0.0 : length[last];
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// File: task_graph.h
+//
+// Runs a DAG of tasks on a pool of threads, for startup.
+//
+// A task runs once everything it depends on has finished, on whichever thread is
+// free, or only on the thread that called Run when it is marked mainThread.  Window
+// and DXGI full-screen calls have to stay on the thread that owns the window, and
+// that thread is blocked in Run, so it takes those tasks itself, and helps with the
+// rest while it waits.
+//
+// A task returns false to fail.  Everything downstream of it is skipped, the tasks
+// already running finish, and Run returns false.  Tasks depend only on tasks added
+// before them, so there can be no cycle.
+//
+// Each task is timed, and with a ChromeTrace given, goes into it on the lane of the
+// thread that ran it, lane 0 being the main thread.
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+class ChromeTrace;
+
+class TaskGraph
+{
+public:
+	enum State
+	{
+		Task_Waiting,
+		Task_Running,
+		Task_Done,
+		Task_Failed,
+		Task_Skipped,
+	};
+
+	struct Task
+	{
+		const char* name;
+		std::function<bool()> run;
+		std::vector<int> dependents;
+		uint32_t dependencies;
+		bool mainThread;
+
+		// Filled in by Run
+		State state;
+		uint32_t waitingOn;
+		uint32_t thread;
+		double startMs;
+		double endMs;
+	};
+
+	int Add(const char* name, std::function<bool()> run, std::initializer_list<int> dependencies = {}, bool mainThread = false);
+
+	// workerCount threads besides the caller.  Returns true when every task ran
+	// and none failed.
+	bool Run(uint32_t workerCount, ChromeTrace* trace = nullptr, const char* category = "task");
+
+	const Task& operator[](int task) const { return m_tasks[task]; }
+	size_t Size() const { return m_tasks.size(); }
+
+	// The first task that failed, or -1.
+	int Failed() const;
+
+	// The longest chain of tasks by time, which bounds the run however many
+	// threads there are.  Returns its length in ms.
+	double CriticalPath(std::vector<int>* path = nullptr) const;
+
+private:
+	std::vector<Task> m_tasks;
+};
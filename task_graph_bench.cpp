@@ -0,0 +1,166 @@
+//--------------------------------------------------------------------------------------
+// File: task_graph_bench.cpp
+//
+// Offline check of the startup task graph, see task_graph.h.
+//
+// A failing task in the middle of a graph, run many times on several threads: Run
+// has to return false and name it, everything downstream has to be skipped without
+// running, even a task that also waits on a slow one, and the rest has to finish.
+// Tasks marked mainThread, some after worker tasks, have to run on the thread that
+// called Run, with workers and without.  Tasks that sleep known times have to give
+// the chain they make as the critical path, and its length.  It fails on the first
+// that does not.
+//
+// Build and run:
+//	g++ -O2 -std=c++11 -pthread task_graph_bench.cpp task_graph.cpp chrome_trace.cpp -o task_graph_bench
+//	./task_graph_bench [--runs N]
+//--------------------------------------------------------------------------------------
+
+#include "task_graph.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+static bool s_Good = true;
+
+static void Check(const char* what, bool passed)
+{
+	printf("  %s%s\n", what, passed ? "" : ", FAILED");
+	s_Good = s_Good && passed;
+}
+
+static std::function<bool()> Sleep(int ms)
+{
+	return [ms]() { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); return true; };
+}
+
+// A, then B that fails, with C and D after it, E beside it, F on both B and a slow E,
+// and G after F.
+static bool FailureRun(uint32_t workers, std::atomic<int>& ranAfterFailure)
+{
+	TaskGraph graph;
+	int a = graph.Add("A", []() { return true; });
+	int b = graph.Add("B", []() { return false; }, { a });
+	int c = graph.Add("C", [&]() { ranAfterFailure++; return true; }, { b });
+	int d = graph.Add("D", [&]() { ranAfterFailure++; return true; }, { c });
+	int e = graph.Add("E", Sleep(2), { a });
+	int f = graph.Add("F", [&]() { ranAfterFailure++; return true; }, { b, e });
+	int g = graph.Add("G", [&]() { ranAfterFailure++; return true; }, { f }, true);
+
+	bool ran = graph.Run(workers);
+	return !ran && graph.Failed() == b &&
+		graph[a].state == TaskGraph::Task_Done && graph[e].state == TaskGraph::Task_Done &&
+		graph[b].state == TaskGraph::Task_Failed &&
+		graph[c].state == TaskGraph::Task_Skipped && graph[d].state == TaskGraph::Task_Skipped &&
+		graph[f].state == TaskGraph::Task_Skipped && graph[g].state == TaskGraph::Task_Skipped;
+}
+
+// Main thread tasks at the start, after worker tasks, and at the end.
+static bool MainThreadRun(uint32_t workers)
+{
+	std::thread::id caller = std::this_thread::get_id();
+	std::atomic<int> wrongThread(0);
+	auto onMain = [&]() { if (std::this_thread::get_id() != caller) wrongThread++; return true; };
+
+	TaskGraph graph;
+	int window = graph.Add("Window", onMain, {}, true);
+	int load = graph.Add("Load", Sleep(1));
+	int compile = graph.Add("Compile", Sleep(1));
+	int device = graph.Add("Device", Sleep(1), { load });
+	int fullScreen = graph.Add("FullScreen", onMain, { window, device }, true);
+	int buffers = graph.Add("Buffers", Sleep(1), { device });
+	graph.Add("Show", onMain, { fullScreen, buffers, compile }, true);
+
+	bool ran = graph.Run(workers);
+	bool onCaller = wrongThread == 0;
+	for (size_t i = 0; i < graph.Size(); i++)
+		if (graph[(int)i].mainThread)
+			onCaller = onCaller && graph[(int)i].thread == 0;
+	return ran && onCaller;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t runs = 200;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = (uint32_t)atoi(argv[++i]);
+		else
+			usage = true;
+	}
+	if (usage || runs == 0)
+	{
+		fprintf(stderr, "usage: %s [--runs N]\n", argv[0]);
+		return 2;
+	}
+
+	printf("Failure, %u runs each:\n", runs);
+	const uint32_t workerCounts[] = { 0, 1, 3, 7 };
+	for (uint32_t workers : workerCounts)
+	{
+		std::atomic<int> ranAfterFailure(0);
+		bool passed = true;
+		for (uint32_t i = 0; i < runs; i++)
+			passed = FailureRun(workers, ranAfterFailure) && passed;
+
+		char what[128];
+		snprintf(what, sizeof(what), "%u workers, the failure is named and only what is downstream skipped", workers);
+		Check(what, passed);
+		snprintf(what, sizeof(what), "%u workers, nothing downstream ran", workers);
+		Check(what, ranAfterFailure == 0);
+	}
+
+	printf("Main thread tasks, %u runs each:\n", runs);
+	for (uint32_t workers : workerCounts)
+	{
+		bool passed = true;
+		for (uint32_t i = 0; i < runs; i++)
+			passed = MainThreadRun(workers) && passed;
+
+		char what[128];
+		snprintf(what, sizeof(what), "%u workers, they ran on the caller", workers);
+		Check(what, passed);
+	}
+
+	// A 20ms, B 5ms and C 30ms after A, D 10ms after both, E 40ms on its own: the
+	// critical path is A C D, 60ms.
+	printf("Critical path:\n");
+	TaskGraph graph;
+	int a = graph.Add("A", Sleep(20));
+	int b = graph.Add("B", Sleep(5), { a });
+	int c = graph.Add("C", Sleep(30), { a });
+	int d = graph.Add("D", Sleep(10), { b, c });
+	graph.Add("E", Sleep(40));
+	bool ran = graph.Run(3);
+
+	std::vector<int> path;
+	double pathMs = graph.CriticalPath(&path);
+	printf("  ");
+	for (int task : path)
+		printf("%s %.1fms ", graph[task].name, graph[task].endMs - graph[task].startMs);
+	printf("\n");
+	Check("the path is A C D", ran && path.size() == 3 && path[0] == a && path[1] == c && path[2] == d);
+	Check("its length is the sum of its tasks, at least 60ms",
+		pathMs >= 60.0 && pathMs < 60.0 + 15.0 &&
+		fabs(pathMs - (graph[a].endMs - graph[a].startMs) - (graph[c].endMs - graph[c].startMs) - (graph[d].endMs - graph[d].startMs)) < 1e-6);
+
+	// A failed task counts, the skipped ones do not.
+	TaskGraph failing;
+	int slow = failing.Add("Slow", Sleep(20));
+	int fails = failing.Add("Fails", []() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); return false; }, { slow });
+	failing.Add("Skipped", Sleep(50), { fails });
+	failing.Run(1);
+	pathMs = failing.CriticalPath(&path);
+	Check("a failed task ends the path", path.size() == 2 && path[0] == slow && path[1] == fails && pathMs >= 30.0);
+
+	return s_Good ? 0 : 1;
+}